@@ -0,0 +1,351 @@
+// GARLI version 2.0 source code
+// Copyright 2005-2011 Derrick J. Zwickl
+// email: garli.support@gmail.com
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <math.h>
+#include <cassert>
+#include <limits>
+
+using namespace std;
+
+#include "defs.h"
+#include "bufferedoutput.h"
+#include "errorexception.h"
+#include "outputman.h"
+
+extern OutputManager outman;
+
+static const double fixedScales[16] = {1.0e0, 1.0e1, 1.0e2, 1.0e3, 1.0e4, 1.0e5, 1.0e6, 1.0e7, 1.0e8, 1.0e9,
+	1.0e10, 1.0e11, 1.0e12, 1.0e13, 1.0e14, 1.0e15};
+
+static const char siteLikeMagic[8] = {'G', 'A', 'R', 'L', 'I', 'S', 'L', 'B'};
+static const unsigned siteLikeVersion = 1;
+//magic, version, value size, then the tree and site counts
+static const long long siteLikeCountsOffset = sizeof(siteLikeMagic) + 2 * sizeof(unsigned);
+static const long long siteLikeHeaderSize = siteLikeCountsOffset + 2 * sizeof(unsigned long long);
+
+static int SeekFile(FILE *f, long long pos){
+#if defined(_MSC_VER)
+	return _fseeki64(f, pos, SEEK_SET);
+#elif defined(UNIX)
+	return fseeko(f, (off_t) pos, SEEK_SET);
+#else
+	return fseek(f, (long) pos, SEEK_SET);
+#endif
+	}
+
+static long long TellFile(FILE *f){
+#if defined(_MSC_VER)
+	return _ftelli64(f);
+#elif defined(UNIX)
+	return (long long) ftello(f);
+#else
+	return ftell(f);
+#endif
+	}
+
+static char *PutDigits(char *dest, unsigned long long val){
+	char rev[24];
+	int n = 0;
+	do{
+		rev[n++] = (char) ('0' + val % 10);
+		val /= 10;
+		}while(val > 0);
+	while(n > 0)
+		*dest++ = rev[--n];
+	return dest;
+	}
+
+int FormatInt(char *dest, long long val){
+	char *out = dest;
+	unsigned long long mag = (unsigned long long) val;
+	if(val < 0){
+		*out++ = '-';
+		mag = 0 - mag;
+		}
+	out = PutDigits(out, mag);
+	*out = '\0';
+	return (int) (out - dest);
+	}
+
+int FormatFixed(char *dest, double val, int precision){
+	//NaN, infinities and anything too big for the integer arithmetic below are left to printf
+	if(!FormatFixedIsFast(val, precision))
+		return sprintf(dest, "%.*f", precision, val);
+
+	char *out = dest;
+	unsigned long long bits;
+	memcpy(&bits, &val, sizeof(bits));
+	if(bits >> 63){
+		*out++ = '-';
+		val = -val;
+		}
+	//both the integer part and the fraction are exact in a double at this size
+	double intPart = floor(val);
+	double frac = val - intPart;
+	double scale = fixedScales[precision];
+	//the scaled fraction rounded to the nearest double, and the exact error of that rounding.  Together they
+	//decide the rounding of the last digit exactly as printf would (ties to even), so the output is identical.
+	double scaled = frac * scale;
+	double err = fma(frac, scale, -scaled);
+	double digits = floor(scaled);
+	double rem = scaled - digits;
+	unsigned long long fracDigits = (unsigned long long) digits;
+	unsigned long long whole = (unsigned long long) intPart;
+	unsigned long long lastDigit = (precision > 0 ? fracDigits : whole);
+	if(rem > 0.5 || (rem == 0.5 && (err > 0.0 || (err == 0.0 && (lastDigit & 1)))))
+		fracDigits++;
+	if(fracDigits >= (unsigned long long) scale){
+		fracDigits -= (unsigned long long) scale;
+		whole++;
+		}
+
+	out = PutDigits(out, whole);
+	if(precision > 0){
+		*out++ = '.';
+		for(int d = precision - 1;d >= 0;d--){
+			out[d] = (char) ('0' + fracDigits % 10);
+			fracDigits /= 10;
+			}
+		out += precision;
+		}
+	*out = '\0';
+	return (int) (out - dest);
+	}
+
+BufferedOutputFile::BufferedOutputFile(size_t bufferSize) : file(NULL), buffer(bufferSize), used(0){
+	assert(bufferSize > 0);
+	}
+
+BufferedOutputFile::~BufferedOutputFile(){
+	//can't throw out of a destructor, so any error on this last write is lost
+	try{
+		Close();
+		}
+	catch(ErrorException &){}
+	}
+
+void BufferedOutputFile::Open(const string &n, const char *mode){
+	Close();
+	file = fopen(n.c_str(), mode);
+	if(file == NULL)
+		throw ErrorException("Could not open file %s for writing!", n.c_str());
+	name = n;
+	}
+
+long long BufferedOutputFile::Tell() const{
+	assert(file);
+	return TellFile(file) + (long long) used;
+	}
+
+void BufferedOutputFile::Seek(long long pos){
+	Flush();
+	if(SeekFile(file, pos) != 0)
+		throw ErrorException("Problem seeking in file %s", name.c_str());
+	}
+
+void BufferedOutputFile::WriteThrough(const void *data, size_t len){
+	if(fwrite(data, 1, len, file) != len)
+		throw ErrorException("Problem writing to file %s.  Disk full?", name.c_str());
+	}
+
+void BufferedOutputFile::Flush(){
+	if(file == NULL)
+		return;
+	if(used > 0){
+		//reset first, so that a failure doesn't leave the same data to be written again
+		size_t len = used;
+		used = 0;
+		WriteThrough(&buffer[0], len);
+		}
+	fflush(file);
+	}
+
+void BufferedOutputFile::Close(){
+	if(file == NULL)
+		return;
+	FILE *f = file;
+	try{
+		Flush();
+		}
+	catch(ErrorException &){
+		fclose(f);
+		file = NULL;
+		throw;
+		}
+	fclose(f);
+	file = NULL;
+	}
+
+void BufferedOutputFile::PutInt(long long val){
+	char num[24];
+	Write(num, FormatInt(num, val));
+	}
+
+void BufferedOutputFile::PutFixed(double val, int precision){
+	if(FormatFixedIsFast(val, precision)){
+		char num[FORMAT_FIXED_CHARS];
+		int len = FormatFixed(num, val, precision);
+		assert(len < FORMAT_FIXED_CHARS);
+		Write(num, len);
+		}
+	else{
+		//up to 309 integer digits for the largest doubles, plus the decimals
+		vector<char> num(320 + (precision > 6 ? precision : 6));
+		Write(&num[0], sprintf(&num[0], "%.*f", precision, val));
+		}
+	}
+
+void BufferedOutputFile::PutGeneral(double val, int precision){
+	char num[64];
+	int len = sprintf(num, "%.*g", precision, val);
+	Write(num, len);
+	}
+
+SiteLikelihoodOutput::~SiteLikelihoodOutput(){
+	try{
+		Close();
+		}
+	catch(ErrorException &){}
+	}
+
+void SiteLikelihoodOutput::SetFormat(const string &format){
+	if(format == "text"){
+		textFormat = true;
+		binaryFormat = false;
+		}
+	else if(format == "binary"){
+		textFormat = false;
+		binaryFormat = true;
+		}
+	else if(format == "both")
+		textFormat = binaryFormat = true;
+	else
+		throw ErrorException("Unknown value \"%s\" for sitelikelihoodformat.  Options are text, binary or both.", format.c_str());
+	}
+
+void SiteLikelihoodOutput::Start(const string &ofprefix, bool underflowColumns){
+	Close();
+	prefix = ofprefix;
+	if(textFormat){
+		text.Open(ofprefix + ".sitelikes.log", "w");
+		text.Put("Tree\t-lnL\tSite\t-lnL");
+		if(underflowColumns)
+			text.Put("\tunder1\tunder2");
+		text.Put('\n');
+		}
+	if(binaryFormat){
+		binary.Open(ofprefix + ".sitelikes.bin", "wb");
+		numTrees = numSites = rowSites = 0;
+		WriteBinaryHeader();
+		}
+	}
+
+void SiteLikelihoodOutput::Resume(const string &ofprefix){
+	Close();
+	prefix = ofprefix;
+	if(textFormat)
+		text.Open(ofprefix + ".sitelikes.log", "a");
+	if(binaryFormat){
+		string bname = ofprefix + ".sitelikes.bin";
+		if(!ResumeBinary(bname)){
+			outman.UserMessage("WARNING: could not continue binary site likelihood file %s, starting a new one", bname.c_str());
+			binary.Open(bname, "wb");
+			numTrees = numSites = rowSites = 0;
+			WriteBinaryHeader();
+			}
+		}
+	}
+
+bool SiteLikelihoodOutput::ResumeBinary(const string &bname){
+	FILE *in = fopen(bname.c_str(), "rb");
+	if(in == NULL)
+		return false;
+	char magic[sizeof(siteLikeMagic)];
+	unsigned version = 0, valueSize = 0;
+	unsigned long long trees = 0, sites = 0;
+	bool ok = fread(magic, 1, sizeof(magic), in) == sizeof(magic)
+		&& memcmp(magic, siteLikeMagic, sizeof(magic)) == 0
+		&& fread(&version, sizeof(version), 1, in) == 1 && version == siteLikeVersion
+		&& fread(&valueSize, sizeof(valueSize), 1, in) == 1 && valueSize == sizeof(double)
+		&& fread(&trees, sizeof(trees), 1, in) == 1
+		&& fread(&sites, sizeof(sites), 1, in) == 1;
+	fclose(in);
+	if(!ok)
+		return false;
+	//anything past the last complete row is from a tree that was never finished, and is overwritten
+	binary.Open(bname, "r+b");
+	numTrees = trees;
+	numSites = sites;
+	rowSites = 0;
+	binary.Seek(siteLikeHeaderSize + (long long) (numTrees * numSites * sizeof(double)));
+	return true;
+	}
+
+void SiteLikelihoodOutput::WriteBinaryHeader(){
+	binary.Write(siteLikeMagic, sizeof(siteLikeMagic));
+	unsigned val = siteLikeVersion;
+	binary.Write(&val, sizeof(val));
+	val = sizeof(double);
+	binary.Write(&val, sizeof(val));
+	binary.Write(&numTrees, sizeof(numTrees));
+	binary.Write(&numSites, sizeof(numSites));
+	}
+
+void SiteLikelihoodOutput::AddMissingSite(){
+	AddSite(numeric_limits<double>::quiet_NaN());
+	}
+
+void SiteLikelihoodOutput::EndTree(int treeNum, double lnL, int precision, const char *newick /*=NULL*/){
+	if(text.IsOpen()){
+		text.PutInt(treeNum);
+		text.Put('\t');
+		text.PutGeneral(-lnL, precision);
+		if(newick != NULL){
+			text.Put('\t');
+			text.Put(newick);
+			}
+		text.Put('\n');
+		}
+	if(binary.IsOpen()){
+		if(numTrees == 0)
+			numSites = rowSites;
+		else if(rowSites != numSites)
+			throw ErrorException("Wrong number of site likelihoods for tree %d (%llu, expected %llu)", treeNum, rowSites, numSites);
+		numTrees++;
+		rowSites = 0;
+		}
+	}
+
+void SiteLikelihoodOutput::Flush(){
+	text.Flush();
+	if(binary.IsOpen()){
+		long long end = binary.Tell();
+		binary.Seek(siteLikeCountsOffset);
+		binary.Write(&numTrees, sizeof(numTrees));
+		binary.Write(&numSites, sizeof(numSites));
+		binary.Seek(end);
+		}
+	}
+
+void SiteLikelihoodOutput::Close(){
+	if(binary.IsOpen()){
+		Flush();
+		binary.Close();
+		}
+	text.Close();
+	}
@@ -0,0 +1,153 @@
+// GARLI version 2.0 source code
+// Copyright 2005-2011 Derrick J. Zwickl
+// email: garli.support@gmail.com
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef BUFFEREDOUTPUT_H
+#define BUFFEREDOUTPUT_H
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+//Formats val into dest, which must have room for at least 21 chars.  Returns the number of chars written,
+//not counting the terminator.
+int FormatInt(char *dest, long long val);
+
+//Formats val with a fixed number of decimal places, giving the same result as printf's "%.*f" but without
+//its overhead for the common case of moderately sized values.  When FormatFixedIsFast(val, precision) dest
+//needs room for FORMAT_FIXED_CHARS chars (sign, 16 digits, point, 15 decimals and terminator), otherwise 
+//for the full printf output.  Returns the number of chars written, not counting the terminator.
+#define FORMAT_FIXED_CHARS 40
+inline bool FormatFixedIsFast(double val, int precision){
+	return precision >= 0 && precision <= 15 && (val < 0.0 ? -val : val) < 1.0e15;
+	}
+int FormatFixed(char *dest, double val, int precision);
+
+//An output file with a large user-space buffer, for output that is produced a few bytes at a time
+//but in large volume.  Nothing reaches the disk until the buffer fills or Flush or Close is called.
+class BufferedOutputFile{
+	FILE *file;
+	string name;
+	vector<char> buffer;
+	size_t used;
+
+	void WriteThrough(const void *data, size_t len);
+
+public:
+	BufferedOutputFile(size_t bufferSize = 1024 * 1024);
+	~BufferedOutputFile();
+
+	//mode is as for fopen
+	void Open(const string &n, const char *mode);
+	bool IsOpen() const {return file != NULL;}
+	const string &Name() const {return name;}
+	//the position that the next write will go to, relative to the start of the file
+	long long Tell() const;
+	void Seek(long long pos);
+	void Flush();
+	void Close();
+
+	void Write(const void *data, size_t len){
+		if(used + len > buffer.size()){
+			Flush();
+			if(len > buffer.size()){
+				WriteThrough(data, len);
+				return;
+				}
+			}
+		memcpy(&buffer[used], data, len);
+		used += len;
+		}
+	void Put(char c){
+		if(used == buffer.size())
+			Flush();
+		buffer[used++] = c;
+		}
+	void Put(const char *str){
+		Write(str, strlen(str));
+		}
+	void Put(const string &str){
+		Write(str.data(), str.length());
+		}
+	void PutInt(long long val);
+	void PutFixed(double val, int precision);
+	//the equivalent of writing to an ostream with the given precision but no fixed or scientific flag
+	void PutGeneral(double val, int precision);
+	};
+
+//The site likelihood output of a run.  The files stay open across all of the trees scored so that
+//each tree or partition subset doesn't reopen and append to them.  There are two formats:
+//text - the usual .sitelikes.log table
+//binary - a .sitelikes.bin file, much faster to write and to read back in for large numbers of trees.  It
+//	holds a header and then a row of site log-likelihoods for each tree (native byte order):
+//		char[8]		"GARLISLB"
+//		uint32		format version (1)
+//		uint32		bytes per value (8)
+//		uint64		number of trees (rows)
+//		uint64		number of sites (columns)
+//		float64		the matrix, row by row.  Sites are in the same order as in sitelikes.log, and the values
+//					are log-likelihoods (not negated as in sitelikes.log).  Sites that were not resampled in
+//					a bootstrap replicate are NaN.
+//	The header is only updated when the output is flushed, and counts only complete rows.
+class SiteLikelihoodOutput{
+	BufferedOutputFile text;
+	BufferedOutputFile binary;
+	string prefix;
+	bool textFormat;
+	bool binaryFormat;
+	unsigned long long numTrees;
+	unsigned long long numSites;
+	unsigned long long rowSites;
+
+	void WriteBinaryHeader();
+	bool ResumeBinary(const string &bname);
+
+public:
+	SiteLikelihoodOutput() : textFormat(true), binaryFormat(false), numTrees(0), numSites(0), rowSites(0){}
+	~SiteLikelihoodOutput();
+
+	//format is "text", "binary" or "both"
+	void SetFormat(const string &format);
+	//creates new output files, replacing any existing ones
+	void Start(const string &ofprefix, bool underflowColumns);
+	//continues output files from an earlier run with the same ofprefix
+	void Resume(const string &ofprefix);
+	bool IsOpenFor(const string &ofprefix) const{
+		return (text.IsOpen() || binary.IsOpen()) && prefix == ofprefix;
+		}
+
+	bool WritingText() const {return text.IsOpen();}
+	BufferedOutputFile &Text() {return text;}
+
+	void AddSite(double lnL){
+		if(binary.IsOpen()){
+			binary.Write(&lnL, sizeof(double));
+			rowSites++;
+			}
+		}
+	void AddMissingSite();
+	//writes the total score line for a tree and completes its row in the binary output
+	void EndTree(int treeNum, double lnL, int precision, const char *newick = NULL);
+
+	void Flush();
+	void Close();
+	};
+
+#endif
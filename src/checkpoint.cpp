@@ -0,0 +1,364 @@
+// GARLI version 2.0 source code
+// Copyright 2005-2011 Derrick J. Zwickl
+// email: garli.support@gmail.com
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+
+#ifdef UNIX
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+#include "defs.h"
+#include "checkpoint.h"
+#include "bipartition.h"
+#include "reconnode.h"
+#include "errorexception.h"
+
+
+static const char checkMagic[8] = {'G', 'A', 'R', 'L', 'I', 'C', 'H', 'K'};
+static const unsigned checkVersion = 1;
+//magic, then version, layout, number of sections and a spare
+static const long fileHeaderSize = sizeof(checkMagic) + 4 * sizeof(unsigned);
+//id, crc and length
+static const long sectionHeaderSize = 2 * sizeof(unsigned) + sizeof(long long);
+
+//the sections are mostly raw dumps of objects, so can't be read by builds with different type sizes
+static unsigned CheckpointLayout(){
+	return (unsigned) (sizeof(FLOAT_TYPE) | (sizeof(int) << 8) | (sizeof(long) << 16) | (sizeof(void *) << 24));
+	}
+
+CheckCRC CRC32(const void *buf, size_t len, CheckCRC crc /*=0*/){
+	static CheckCRC table[256];
+	static bool tableDone = false;
+	if(!tableDone){
+		for(unsigned i = 0;i < 256;i++){
+			CheckCRC c = i;
+			for(int k = 0;k < 8;k++)
+				c = (c & 1) ? 0xEDB88320U ^ (c >> 1) : (c >> 1);
+			table[i] = c;
+			}
+		tableDone = true;
+		}
+	const unsigned char *p = (const unsigned char *) buf;
+	crc = ~crc;
+	for(size_t i = 0;i < len;i++)
+		crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+	}
+
+ostream &CheckpointWriter::BeginSection(CheckpointSection id){
+	assert(sectionStarts.size() == sectionEnds.size());
+	ids.push_back(id);
+	sectionStarts.push_back(out.tellp());
+	return out;
+	}
+
+void CheckpointWriter::EndSection(){
+	sectionEnds.push_back(out.tellp());
+	assert(sectionStarts.size() == sectionEnds.size());
+	}
+
+void CheckpointWriter::GetImage(string &image) const{
+	assert(sectionStarts.size() == sectionEnds.size());
+	const string sections = out.str();
+	unsigned header[4] = {checkVersion, CheckpointLayout(), (unsigned) ids.size(), 0};
+	image.reserve(fileHeaderSize + ids.size() * sectionHeaderSize + sections.size());
+	image.assign(checkMagic, sizeof(checkMagic));
+	image.append((const char *) header, sizeof(header));
+	for(unsigned s = 0;s < ids.size();s++){
+		long long len = (long long) (sectionEnds[s] - sectionStarts[s]);
+		unsigned idAndCRC[2] = {(unsigned) ids[s], CRC32(sections.data() + sectionStarts[s], (size_t) len)};
+		image.append((const char *) idAndCRC, sizeof(idAndCRC));
+		image.append((const char *) &len, sizeof(len));
+		image.append(sections, (size_t) sectionStarts[s], (size_t) len);
+		}
+	}
+
+//flushes and closes the file, making sure that the data is really on disk
+static bool CloseSynced(FILE *f, bool ok){
+	ok = ok && (fflush(f) == 0);
+#ifdef UNIX
+	ok = ok && (fsync(fileno(f)) == 0);
+#endif
+	if(fclose(f) != 0)
+		ok = false;
+	return ok;
+	}
+
+bool WriteCheckpointFile(const string &name, const string &image){
+	string tempName = name + ".tmp";
+	FILE *f = fopen(tempName.c_str(), "wb");
+	if(f == NULL)
+		return false;
+	bool ok = CloseSynced(f, fwrite(image.data(), 1, image.size(), f) == image.size());
+	if(ok){
+#ifndef UNIX
+		//rename won't replace an existing file on windows
+		remove(name.c_str());
+#endif
+		ok = (rename(tempName.c_str(), name.c_str()) == 0);
+		}
+	if(!ok)
+		remove(tempName.c_str());
+	return ok;
+	}
+
+bool WriteSwapLogBlock(const SwapLogBlock &block){
+	FILE *f = fopen(block.name.c_str(), (block.truncate ? "wb" : "r+b"));
+	if(f == NULL)
+		return false;
+	//anything past the end of the last block written is left from a failed checkpoint, and is overwritten
+	bool ok = (fseek(f, block.offset, SEEK_SET) == 0);
+	if(ok && !block.data.empty())
+		ok = (fwrite(&block.data[0], 1, block.data.size(), f) == block.data.size());
+	return CloseSynced(f, ok);
+	}
+
+void CheckpointJob::Write(){
+	if(writeSwaps){
+		swapsOK = WriteSwapLogBlock(swapBlock);
+		if(!swapsOK){
+			failedName = swapBlock.name;
+			return;
+			}
+		}
+	for(vector<pair<string, string> >::iterator it = files.begin();it != files.end();it++){
+		if(WriteCheckpointFile(it->first, it->second) == false){
+			filesOK = false;
+			failedName = it->first;
+			return;
+			}
+		}
+	}
+
+#ifdef UNIX
+void *BackgroundCheckpointWriter::Run(void *j){
+	((CheckpointJob *) j)->Write();
+	return NULL;
+	}
+#endif
+
+void BackgroundCheckpointWriter::Start(){
+	assert(!running);
+	running = true;
+#ifdef UNIX
+	threaded = (pthread_create(&thread, NULL, Run, &job) == 0);
+	if(!threaded)
+#endif
+		job.Write();
+	}
+
+bool BackgroundCheckpointWriter::Wait(){
+	if(!running)
+		return false;
+#ifdef UNIX
+	if(threaded)
+		pthread_join(thread, NULL);
+#endif
+	running = false;
+	return true;
+	}
+
+CheckpointReader::CheckpointReader(FILE *f, const char *n) : name(n), in(f), legacy(false), sectionEnd(-1){
+	if(in == NULL)
+		throw ErrorException("Could not open checkpoint file %s!", n);
+	char magic[sizeof(checkMagic)];
+	if(fread(magic, 1, sizeof(magic), in) != sizeof(magic) || memcmp(magic, checkMagic, sizeof(magic)) != 0){
+		legacy = true;
+		rewind(in);
+		return;
+		}
+	const char *problem = NULL;
+	unsigned header[4];
+	if(fread(header, sizeof(unsigned), 4, in) != 4)
+		problem = "truncated";
+	else if(header[0] != checkVersion)
+		problem = "written by an incompatible version of GARLI";
+	else if(header[1] != CheckpointLayout())
+		problem = "written by a build of GARLI with different integer or floating point sizes";
+
+	vector<char> buf(1 << 16);
+	for(unsigned s = 0;problem == NULL && s < header[2];s++){
+		unsigned idAndCRC[2];
+		long long len;
+		if(fread(idAndCRC, sizeof(unsigned), 2, in) != 2 || fread(&len, sizeof(len), 1, in) != 1 || len < 0){
+			problem = "truncated";
+			break;
+			}
+		ids.push_back((CheckpointSection) idAndCRC[0]);
+		offsets.push_back(ftell(in));
+		lengths.push_back((long) len);
+		CheckCRC crc = 0;
+		for(long long left = len;left > 0;left -= (long long) buf.size()){
+			size_t num = (size_t) min(left, (long long) buf.size());
+			if(fread(&buf[0], 1, num, in) != num){
+				problem = "truncated";
+				break;
+				}
+			crc = CRC32(&buf[0], num, crc);
+			}
+		if(problem == NULL && crc != idAndCRC[1])
+			problem = "corrupted (checksum mismatch)";
+		}
+	if(problem != NULL){
+		fclose(in);
+		in = NULL;
+		throw ErrorException("Checkpoint file %s is %s.\n\tUnfortunately you'll need to start the run again from scratch.", n, problem);
+		}
+	}
+
+CheckpointReader::~CheckpointReader(){
+	if(in != NULL)
+		fclose(in);
+	}
+
+bool CheckpointReader::HasSection(CheckpointSection id) const{
+	return find(ids.begin(), ids.end(), id) != ids.end();
+	}
+
+FILE *CheckpointReader::BeginSection(CheckpointSection id){
+	//old checkpoints are a single unlabeled section
+	if(legacy)
+		return in;
+	vector<CheckpointSection>::iterator it = find(ids.begin(), ids.end(), id);
+	if(it == ids.end())
+		throw ErrorException("Checkpoint file %s is missing expected data.\n\tUnfortunately you'll need to start the run again from scratch.", name.c_str());
+	int s = (int) (it - ids.begin());
+	fseek(in, offsets[s], SEEK_SET);
+	sectionEnd = offsets[s] + lengths[s];
+	return in;
+	}
+
+void CheckpointReader::EndSection(){
+	if(!legacy && (ferror(in) || ftell(in) != sectionEnd))
+		throw ErrorException("Checkpoint file %s was not read correctly.\n\tIt may have been written by a different version of GARLI.", name.c_str());
+	}
+
+static const char swapLogMagic[8] = {'G', 'A', 'R', 'L', 'I', 'S', 'W', 'P'};
+//magic, then version and record size
+static const long swapLogHeaderSize = sizeof(swapLogMagic) + 2 * sizeof(unsigned);
+
+//Each checkpoint appends a block of the swaps added since the last one (number of records, CRC, records).
+//The log position is updated assuming that the block will be written, see SwapLogWriteFailed.
+void AttemptedSwapList::PrepareSwapLogBlock(const char *base, SwapLogBlock &block){
+	//when a compacted log is written it goes to whichever file the last committed checkpoint didn't use
+	bool compact = !logging || logReset || logBytes > 4 * (swapLogHeaderSize + (long) (unique * Swap::RecordSize())) + (1 << 20);
+	block.data.clear();
+	if(compact){
+		activeLog = 1 - committedLog;
+		block.truncate = true;
+		block.offset = 0;
+		unsigned header[2] = {checkVersion, (unsigned) Swap::RecordSize()};
+		block.data.insert(block.data.end(), swapLogMagic, swapLogMagic + sizeof(swapLogMagic));
+		block.data.insert(block.data.end(), (const char *) header, (const char *) header + sizeof(header));
+		pendingLog.clear();
+		pendingRecords = 0;
+		for(list<Swap>::iterator it = swaps.begin();it != swaps.end();it++){
+			(*it).AppendRecord(pendingLog);
+			pendingRecords++;
+			}
+		logging = true;
+		logReset = false;
+		}
+	else{
+		block.truncate = false;
+		block.offset = logBytes;
+		}
+	block.name = SwapLogName(base, activeLog);
+
+	if(pendingRecords > 0){
+		unsigned blockHeader[2] = {pendingRecords, CRC32(&pendingLog[0], pendingLog.size())};
+		block.data.insert(block.data.end(), (const char *) blockHeader, (const char *) blockHeader + sizeof(blockHeader));
+		block.data.insert(block.data.end(), pendingLog.begin(), pendingLog.end());
+		}
+	logBytes = block.offset + (long) block.data.size();
+	pendingLog.clear();
+	pendingRecords = 0;
+	}
+
+void AttemptedSwapList::WriteSwapLogPosition(OUTPUT_CLASS &out) const{
+	int index = activeLog;
+	long long bytes = logBytes;
+	out.WRITE_TO_FILE(&index, sizeof(index), 1);
+	out.WRITE_TO_FILE(&bytes, sizeof(bytes), 1);
+	out.WRITE_TO_FILE(&unique, sizeof(unique), 1);
+	out.WRITE_TO_FILE(&total, sizeof(total), 1);
+	}
+
+//rebuilds the list by replaying the log up to the point recorded in the population checkpoint
+void AttemptedSwapList::ReadSwapLog(FILE *position, const char *base){
+	int index;
+	long long bytes;
+	unsigned expectedUnique, expectedTotal;
+	fread(&index, sizeof(index), 1, position);
+	fread(&bytes, sizeof(bytes), 1, position);
+	fread(&expectedUnique, sizeof(expectedUnique), 1, position);
+	fread(&expectedTotal, sizeof(expectedTotal), 1, position);
+
+	string name = SwapLogName(base, index);
+	FILE *in = fopen(name.c_str(), "rb");
+	if(in == NULL)
+		throw ErrorException("Could not find checkpoint file %s!\nEither the previous run was not writing checkpoints (checkpoint = 0),\nthe file was moved/deleted or the ofprefix setting\nin the config file was changed.", name.c_str());
+
+	ClearAttemptedSwaps();
+	const char *problem = NULL;
+	char magic[sizeof(swapLogMagic)];
+	unsigned header[2];
+	if(fread(magic, 1, sizeof(magic), in) != sizeof(magic) || memcmp(magic, swapLogMagic, sizeof(magic)) != 0 || fread(header, sizeof(unsigned), 2, in) != 2)
+		problem = "not a swap log";
+	else if(header[0] != checkVersion || header[1] != Swap::RecordSize())
+		problem = "written by an incompatible version of GARLI";
+
+	long pos = swapLogHeaderSize;
+	vector<char> buf;
+	Swap swap;
+	while(problem == NULL && pos < bytes){
+		unsigned blockHeader[2];
+		if(fread(blockHeader, sizeof(unsigned), 2, in) != 2){
+			problem = "truncated";
+			break;
+			}
+		buf.resize(blockHeader[0] * Swap::RecordSize());
+		if(buf.empty() || fread(&buf[0], 1, buf.size(), in) != buf.size())
+			problem = "truncated";
+		else if(CRC32(&buf[0], buf.size()) != blockHeader[1])
+			problem = "corrupted (checksum mismatch)";
+		else{
+			for(unsigned r = 0;r < blockHeader[0];r++){
+				swap.ReadRecord(&buf[r * Swap::RecordSize()]);
+				MergeSwap(swap);
+				}
+			pos += (long) (2 * sizeof(unsigned) + buf.size());
+			}
+		}
+	fclose(in);
+	if(problem == NULL && (pos != bytes || unique != expectedUnique || total != expectedTotal))
+		problem = "inconsistent with the population checkpoint";
+	if(problem != NULL)
+		throw ErrorException("Checkpoint file %s is %s.\n\tUnfortunately you'll need to start the run again from scratch.", name.c_str(), problem);
+	IndexSwaps();
+
+	logging = true;
+	logReset = false;
+	activeLog = committedLog = index;
+	logBytes = (long) bytes;
+	pendingLog.clear();
+	pendingRecords = 0;
+	}
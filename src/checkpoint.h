@@ -0,0 +1,161 @@
+// GARLI version 2.0 source code
+// Copyright 2005-2011 Derrick J. Zwickl
+// email: garli.support@gmail.com
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef _CHECKPOINT_
+#define _CHECKPOINT_
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <cassert>
+#include <stdio.h>
+
+#ifdef UNIX
+#include <pthread.h>
+#endif
+
+using namespace std;
+
+typedef unsigned int CheckCRC;
+
+//a block of the swap log, prepared by the search and written with the rest of a checkpoint
+class SwapLogBlock{
+public:
+	string name;
+	long offset;
+	//compacted logs replace the file
+	bool truncate;
+	vector<char> data;
+
+	SwapLogBlock() : offset(0), truncate(false){}
+	};
+
+//standard (zlib/png) CRC-32, which can be accumulated over several calls by passing in the previous value
+CheckCRC CRC32(const void *buf, size_t len, CheckCRC crc = 0);
+
+//four character tags identifying the sections of a checkpoint file
+enum CheckpointSection{
+	ADAPTATION_SECTION = 0x50414441,	//"ADAP"
+	POPULATION_SECTION = 0x53504f50,	//"POPS"
+	SWAP_LOG_SECTION = 0x474c5753		//"SWLG"
+	};
+
+//Checkpoints are written as a container of sections, each with its length and CRC, preceded by a header
+//giving the format version and the sizes of the basic types (since the sections themselves are largely
+//raw memory dumps).  The sections are serialized to memory, and the complete file is then written to a
+//temporary that is only renamed over the previous checkpoint once it is flushed to disk, so a run killed
+//mid-checkpoint still leaves a usable one.
+class CheckpointWriter{
+	string name;
+	ostringstream out;
+	vector<CheckpointSection> ids;
+	vector<streamoff> sectionStarts;
+	vector<streamoff> sectionEnds;
+
+public:
+	CheckpointWriter(const char *n) : name(n){}
+
+	//the returned stream is what the existing section writers expect
+	ostream &BeginSection(CheckpointSection id);
+	void EndSection();
+	const string &Name() const {return name;}
+	//the contents of the complete file
+	void GetImage(string &image) const;
+	};
+
+//these don't output anything, since they may be called from the background writer thread
+bool WriteCheckpointFile(const string &name, const string &image);
+bool WriteSwapLogBlock(const SwapLogBlock &block);
+
+//Everything to be written for one checkpoint.  The swap log block goes first, then the files in order,
+//stopping at the first failure.
+class CheckpointJob{
+public:
+	bool writeSwaps;
+	SwapLogBlock swapBlock;
+	vector<pair<string, string> > files;
+
+	bool swapsOK;
+	bool filesOK;
+	string failedName;
+
+	CheckpointJob() : writeSwaps(false), swapsOK(true), filesOK(true){}
+	void Clear(){
+		writeSwaps = false;
+		swapBlock.data.clear();
+		files.clear();
+		swapsOK = filesOK = true;
+		failedName.clear();
+		}
+	void AddFile(const CheckpointWriter &w){
+		files.push_back(make_pair(w.Name(), string()));
+		w.GetImage(files.back().second);
+		}
+	void Write();
+	};
+
+//Writes checkpoint jobs in a background thread, so that the search doesn't wait on the disk.  Only one job is
+//in flight at a time, and Wait must be called (and the results dealt with) before the job is reused.
+//Without pthreads the job is just written when started.
+class BackgroundCheckpointWriter{
+	CheckpointJob job;
+	bool running;
+#ifdef UNIX
+	bool threaded;
+	pthread_t thread;
+	static void *Run(void *j);
+#endif
+
+public:
+	BackgroundCheckpointWriter() : running(false){}
+	~BackgroundCheckpointWriter(){
+		Wait();
+		}
+	CheckpointJob &Job(){
+		assert(!running);
+		return job;
+		}
+	void Start();
+	//returns false if no job was being written
+	bool Wait();
+	};
+
+//Verifies the container and all section CRCs when opened, then hands out the file positioned at the start of
+//each section.  Files that don't start with the container header are assumed to be old style checkpoints
+//that consist of just the raw data of a single section.
+class CheckpointReader{
+	string name;
+	FILE *in;
+	bool legacy;
+	vector<CheckpointSection> ids;
+	vector<long> offsets;
+	vector<long> lengths;
+	long sectionEnd;
+
+public:
+	//takes ownership of the file, which should already be open for binary reading
+	CheckpointReader(FILE *f, const char *n);
+	~CheckpointReader();
+
+	bool IsLegacy() const {return legacy;}
+	bool HasSection(CheckpointSection id) const;
+	FILE *BeginSection(CheckpointSection id);
+	//verifies that exactly the whole section was read
+	void EndSection();
+	};
+
+#endif
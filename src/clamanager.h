@@ -49,6 +49,8 @@ class ClaManager{
 	int numClas;
 	int numHolders;
 	int maxUsed;
+	unsigned long long numRecycles;//calls to RecycleClas, i.e. times that no free cla was available
+	unsigned long long totalReclaimed;//total clas taken back from holders by RecycleClas
 	CondLikeArraySet **allClas; //these are the actual sets of arrays to be used in calculations, but will assigned to 
 							 //nodes via a CondLikeArrayHolder.  There may be a limited number						 
 
@@ -84,6 +86,7 @@ class ClaManager{
 */
 	ClaManager(int nnod, int nClas, int nHolders, const ModelPartition *mods, const DataPartition *data) : numNodes(nnod), numClas(nClas), numHolders(nHolders){
 		maxUsed=0;
+		numRecycles=totalReclaimed=0;
 		allClas=new CondLikeArraySet*[numClas];
 		claStack.reserve(numClas);
 		for(int i=numClas-1;i>=0;i--){
@@ -116,6 +119,16 @@ class ClaManager{
 	
 	int NumClas() {return numClas;}
 	int MaxUsedClas() {return maxUsed;}
+	unsigned long long NumRecycles() {return numRecycles;}
+	unsigned long long NumReclaimed() {return totalReclaimed;}
+	//all clas for a data subset are allocated for its full set of patterns, but only the first nsites are used
+	//when zero count bootstrap patterns have been compacted out of the data
+	void SetActiveSites(int dataIndex, int nsites){
+		for(int i = 0;i < numClas;i++)
+			for(int c = 0;c < (int) claSpecs.size();c++)
+				if(claSpecs[c].dataIndex == dataIndex)
+					allClas[i]->GetCLA(c)->SetActiveSites(nsites);
+		}
 	int NumFreeClas() {return (int) claStack.size();}
 	int NumFreeHolders() {return (int) holderStack.size();}
 
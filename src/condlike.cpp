@@ -89,6 +89,7 @@ CondLikeArraySet* ClaManager::AssignFreeCla(){
 
 void ClaManager::RecycleClas(){
 	int numReclaimed=0;
+	numRecycles++;
 	for(int i=0;i<numHolders;i++){
 		if(holders[i].theSet != NULL){
 			if(holders[i].GetReclaimLevel() == 2 && holders[i].tempReserved == false && holders[i].reserved == false){
@@ -96,6 +97,7 @@ void ClaManager::RecycleClas(){
 				holders[i].SetReclaimLevel(0);
 				holders[i].theSet=NULL;
 				numReclaimed++;
+				totalReclaimed++;
 				}
 			}
 		if(memLevel < 2) 
@@ -111,6 +113,7 @@ void ClaManager::RecycleClas(){
 				holders[i].SetReclaimLevel(0);
 				holders[i].theSet=NULL;
 				numReclaimed++;
+				totalReclaimed++;
 				}
 			}
 		if(numReclaimed == 20) 
@@ -131,7 +134,7 @@ void CondLikeArraySet::Allocate() {
 	unsigned size = 0, usize = 0;
 	for(vector<CondLikeArray *>::iterator cit = theSets.begin();cit != theSets.end();cit++){
 		size += (*cit)->RequiredSize();
-		usize += (*cit)->NChar();
+		usize += (*cit)->AllocatedNChar();
 		}
 	try{
 		rawAllocation = new FLOAT_TYPE[size];
@@ -149,6 +152,6 @@ void CondLikeArraySet::Allocate() {
 	for(vector<CondLikeArray *>::iterator cit = theSets.begin();cit != theSets.end();cit++){
 		(*cit)->Assign(&rawAllocation[offset], &rawUnder[uoffset]);
 		offset += (*cit)->RequiredSize();
-		uoffset += (*cit)->NChar();
+		uoffset += (*cit)->AllocatedNChar();
 		}
 	}
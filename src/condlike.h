@@ -47,6 +47,7 @@
 
 #include <vector>
 #include <stddef.h>
+#include <cassert>
 using namespace std;
 
 #include "defs.h"
@@ -59,21 +60,28 @@ class CondLikeArray{
 	friend class CondLikeArrayIterator;
 
 	unsigned nsites, nrates, nstates;
+	//nsites can be less than this when zero count bootstrap patterns have been compacted out of the data
+	unsigned allocatedSites;
 	public:
 		FLOAT_TYPE* arr;
 		int* underflow_mult;
 		unsigned rescaleRank;
 		CondLikeArray(int nsit, int nsta, int nrat)
-			: nsites(nsit), nrates(nrat), nstates(nsta), arr(NULL), underflow_mult(NULL), rescaleRank(1){}
+			: nsites(nsit), nrates(nrat), nstates(nsta), allocatedSites(nsit), arr(NULL), underflow_mult(NULL), rescaleRank(1){}
 		CondLikeArray()
-			: nsites(0), nrates(0), nstates(0), arr(0), underflow_mult(0), rescaleRank(1){}
+			: nsites(0), nrates(0), nstates(0), allocatedSites(0), arr(0), underflow_mult(0), rescaleRank(1){}
 		~CondLikeArray();
 		int NStates() const {
 			return nstates;
 			}
 		int NChar() const {return nsites;}
 		int NRateCats() const {return nrates;}
-		int RequiredSize() const {return nsites * nstates * nrates;}
+		int AllocatedNChar() const {return allocatedSites;}
+		int RequiredSize() const {return allocatedSites * nstates * nrates;}
+		void SetActiveSites(int nsit){
+			assert(nsit <= (int) allocatedSites);
+			nsites = nsit;
+			}
 		void Assign(FLOAT_TYPE *alloc, int * under) {arr = alloc; underflow_mult = under;}
 
 		void Allocate( int nk, int ns, int nr = 1 );
@@ -45,6 +45,7 @@ GeneralGamlConfig::GeneralGamlConfig(){
 	outputCurrentBestTopology = false;
 	collapseBranches = false;
 	outputSitelikelihoods = 0;
+	siteLikelihoodFormat = "text";
 	reportRunProgress = 0;
 
 	//starting the run
@@ -61,6 +62,7 @@ GeneralGamlConfig::GeneralGamlConfig(){
 	megsClaMemory = 512;
 	restart = false;
 	checkpoint = false;
+	backgroundCheckpoints = false;
 	significantTopoChange = (FLOAT_TYPE)0.01;
 	searchReps = 1;
 	//this isn't for general consumption, but lets me easily enable hacked in features
@@ -71,6 +73,14 @@ GeneralGamlConfig::GeneralGamlConfig(){
 
 	workPhaseDivision = false;
 
+#ifdef ENABLE_CUSTOM_PROFILER
+	profile = true;
+#else
+	profile = false;
+#endif
+	throughputReport = false;
+	telemetryInterval = 0;
+
 	alternateAlignmentMode = "none";
 
 	attachmentsPerTaxon = 50;
@@ -81,8 +91,14 @@ GeneralGamlConfig::GeneralGamlConfig(){
 	combineAdjacentIdenticalGapPatterns = false;
 
 	usePatternManager = true;
+	patternCache = false;
+	streamingReader = false;
 	rootAtBranchMidpoint = false;
 	useOptBoundedForBlen = false;
+	concurrentBranchOpt = false;
+	gradientBranchOpt = false;
+	jointModelOpt = false;
+	shareInitialOpt = false;
 	optimizeInputOnly = false;
 	//this should really not be necessary, but for some reason not explicitly initializing it was causing problems with icc
 	parameterValueString = "";
@@ -128,10 +144,17 @@ GeneralGamlConfig::GeneralGamlConfig(){
 	limSPRrange = 6;
 	uniqueSwapBias = (FLOAT_TYPE)0.1;
 	distanceSwapBias = 1.0;
+	useTopologyCache = false;
+	topologyCacheSize = 1000;
 	
 	//optional analyses
 	inferInternalStateProbs = false;
 	bootstrapReps = 0;
+	bootstrapWorkers = 1;
+	numIslands = 1;
+	subtreeWorkers = 1;
+	subtreeGens = 200;
+	compactBootstrapPatterns = false;
 	resampleProportion = 1.0;
 
 	sendInterval = 60.0;
@@ -177,6 +200,7 @@ int GeneralGamlConfig::Read(const char* fname, bool isMaster /*=false*/)	{
 	cr.GetPositiveNonZeroDoubleOption("significanttopochange", significantTopoChange, true);
 	cr.GetUnsignedNonZeroOption("attachmentspertaxon", attachmentsPerTaxon, true);
 	cr.GetUnsignedOption("outputsitelikelihoods", outputSitelikelihoods, true);
+	cr.GetStringOption("sitelikelihoodformat", siteLikelihoodFormat, true);
 	cr.GetBoolOption("reportrunprogress", reportRunProgress, true);
 	cr.GetBoolOption("optimizeinputonly", optimizeInputOnly, true);
 
@@ -191,6 +215,8 @@ int GeneralGamlConfig::Read(const char* fname, bool isMaster /*=false*/)	{
 	cr.GetUnsignedOption("windowlength", siteWindowLength, true);
 	cr.GetUnsignedOption("windowstride", siteWindowStride, true);
 	cr.GetBoolOption("usepatternmanager", usePatternManager, true);
+	cr.GetBoolOption("patterncache", patternCache, true);
+	cr.GetBoolOption("streamingreader", streamingReader, true);
 	cr.GetStringOption("parametervaluestring", parameterValueString, true);
 	cr.GetBoolOption("combineadjacentidenticalgappatterns", combineAdjacentIdenticalGapPatterns, true);
 
@@ -198,6 +224,10 @@ int GeneralGamlConfig::Read(const char* fname, bool isMaster /*=false*/)	{
 
 	cr.GetBoolOption("rootatbranchmidpoint", rootAtBranchMidpoint, true);
 	cr.GetBoolOption("useoptboundedforblen", useOptBoundedForBlen, true);
+	cr.GetBoolOption("concurrentbranchopt", concurrentBranchOpt, true);
+	cr.GetBoolOption("gradientbranchopt", gradientBranchOpt, true);
+	cr.GetBoolOption("jointmodelopt", jointModelOpt, true);
+	cr.GetBoolOption("shareinitialopt", shareInitialOpt, true);
 
 	//changed the wording of this from besttree to besttopology, to match outputeachbettertopology
 	//still allow besttree, since that is what I told Maddison, and I think has already been incorporated
@@ -208,6 +238,7 @@ int GeneralGamlConfig::Read(const char* fname, bool isMaster /*=false*/)	{
 
 	cr.GetBoolOption("restart", restart, true);
 	cr.GetBoolOption("writecheckpoints", checkpoint, true);
+	cr.GetBoolOption("backgroundcheckpoints", backgroundCheckpoints, true);
 
 	cr.GetUnsignedNonZeroOption("searchreps", searchReps, true);
 	cr.GetUnsignedOption("runmode", runmode, true);
@@ -216,10 +247,20 @@ int GeneralGamlConfig::Read(const char* fname, bool isMaster /*=false*/)	{
 	//These three used to be in the [master] section, for no apparent reason. Now allowed in [general] 
 	//as well.  If in both, will be overridden by master
 	cr.GetUnsignedOption("bootstrapreps", bootstrapReps, true);
+	cr.GetUnsignedNonZeroOption("bootstrapworkers", bootstrapWorkers, true);
+	cr.GetBoolOption("compactbootstrappatterns", compactBootstrapPatterns, true);
 	cr.GetPositiveNonZeroDoubleOption("resampleproportion", resampleProportion, true);
 	cr.GetBoolOption("inferinternalstateprobs", inferInternalStateProbs, true);
 
 	cr.GetBoolOption("workphasedivision", workPhaseDivision, true);
+	cr.GetBoolOption("profile", profile, true);
+	cr.GetBoolOption("throughputreport", throughputReport, true);
+	cr.GetUnsignedOption("telemetryinterval", telemetryInterval, true);
+
+	cr.GetUnsignedNonZeroOption("numislands", numIslands, true);
+	cr.GetPositiveNonZeroDoubleOption("sendinterval", sendInterval, true);
+	cr.GetUnsignedNonZeroOption("subtreeworkers", subtreeWorkers, true);
+	cr.GetUnsignedNonZeroOption("subtreegens", subtreeGens, true);
 
 	bool multipleModelsFound = ReadPossibleModelPartition(cr);
 
@@ -277,6 +318,8 @@ int GeneralGamlConfig::Read(const char* fname, bool isMaster /*=false*/)	{
 	
 	cr.GetPositiveNonZeroDoubleOption("uniqueswapbias", uniqueSwapBias, true);
 	cr.GetPositiveNonZeroDoubleOption("distanceswapbias", distanceSwapBias, true);
+	cr.GetBoolOption("usetopologycache", useTopologyCache, true);
+	cr.GetUnsignedOption("topologycachesize", topologyCacheSize, true);
 
 	cr.GetDoubleOption("treerejectionthreshold", treeRejectionThreshold, true);
 
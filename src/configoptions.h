@@ -68,8 +68,14 @@ class GeneralGamlConfig{
 	bool combineAdjacentIdenticalGapPatterns;
 
 	bool usePatternManager;
+	bool patternCache;
+	bool streamingReader;
 	bool rootAtBranchMidpoint;
 	bool useOptBoundedForBlen;
+	bool concurrentBranchOpt;
+	bool gradientBranchOpt;
+	bool jointModelOpt;
+	bool shareInitialOpt;
 	string parameterValueString;
 	bool optimizeInputOnly;
 
@@ -87,11 +93,13 @@ class GeneralGamlConfig{
 	FLOAT_TYPE availableMemory;
 	bool restart;
 	bool checkpoint;
+	bool backgroundCheckpoints;
 	FLOAT_TYPE significantTopoChange;
 	string outgroupString;
 	unsigned searchReps;
 	unsigned runmode;
 	unsigned outputSitelikelihoods;
+	string siteLikelihoodFormat;
 	bool reportRunProgress;
 	bool scoreOnly;
 
@@ -109,6 +117,13 @@ class GeneralGamlConfig{
 
 	bool workPhaseDivision;
 
+	//time and count events in the likelihood code, and write a report at the end of each search
+	bool profile;
+	//write generation and likelihood throughput, memory use and cla recycling for each search replicate
+	bool throughputReport;
+	//seconds between rewrites of the live run telemetry file, 0 for none
+	unsigned telemetryInterval;
+
 	string alternateAlignmentMode;
 
 	//this holds descriptions of models, possible > 1 in the case of partitioning
@@ -160,9 +175,16 @@ class GeneralGamlConfig{
 	unsigned limSPRrange;		
 	FLOAT_TYPE uniqueSwapBias;
 	FLOAT_TYPE distanceSwapBias;
+	bool useTopologyCache;
+	unsigned topologyCacheSize;
 	
 	//optional analyses
 	unsigned bootstrapReps;
+	unsigned bootstrapWorkers;
+	unsigned numIslands;
+	unsigned subtreeWorkers;
+	unsigned subtreeGens;
+	bool compactBootstrapPatterns;
 	FLOAT_TYPE resampleProportion;
 	bool inferInternalStateProbs;
 
@@ -186,7 +208,7 @@ class GeneralGamlConfig{
 	int sprPertRange;
 #endif
 
-	//the number of seconds between remote tree sends (parallel only)
+	//the number of seconds between remote tree sends (parallel), or between migrations (numislands > 1)
 	FLOAT_TYPE sendInterval;
 	
 	//by default these come from the defs.h file, but could be overriden
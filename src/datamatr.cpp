@@ -237,46 +237,93 @@ int SitePattern::MinScore(set<unsigned char> patt, int bound, unsigned char bits
 	return min_sc_this_lvl;
 	}
 
-//Collapse merges like patterns, transfering over the counts and site numbers represented by each sucessive identical column.
-//Patterns that are assigned zero counts here will be removed in Pack(), but will still contribute to the numNonMissingRealSitesInOrigMatrix, except
-//for those with zero states (= missing)
+static inline unsigned long long HashColumn(const unsigned char *col, int numTax){
+	//FNV-1a
+	unsigned long long h = 14695981039346656037ULL;
+	for(int t = 0;t < numTax;t++){
+		h ^= (unsigned long long) col[t];
+		h *= 1099511628211ULL;
+		}
+	return h;
+	}
+
+//Collapse merges identical input columns into the uniquePatterns list, summing their counts and gathering their
+//site numbers.  The columns are hashed in parallel, and then merged through an open addressing table that only
+//grows with the number of unique patterns.  Missing patterns are included here, and removed in NewPack
 void PatternManager::NewCollapse(){
-	list<SitePattern>::iterator first;
-	list<SitePattern>::iterator second  = patterns.begin();
-
-	while(second != patterns.end()){
-		first = second++;
-		while(second != patterns.end() && (*first == *second)){
-			(*first).count += (*second).count;
-			(*first).siteNumbers.insert((*first).siteNumbers.end(), (*second).siteNumbers.begin(), (*second).siteNumbers.end());
-			//if a wtset was used, this definitely doesn't need to be the case
-			//assert((*first).count == (*first).siteNumbers.size());
-			(*second).count = 0;
-			second++;
+	const int numSites = NumSites();
+	vector<unsigned long long> hashes(numSites);
+#ifdef OPEN_MP
+#pragma omp parallel for schedule(static)
+#endif
+	for(int s = 0;s < numSites;s++)
+		hashes[s] = HashColumn(Column(s), numTax);
+
+	//entries are indeces into uniqueFirstSite, or -1 if empty.  The table is kept at most half full.
+	vector<int> table(1024, -1);
+	size_t mask = table.size() - 1;
+	vector<int> uniqueFirstSite;
+	vector<int> siteToUnique(numSites);
+	for(int s = 0;s < numSites;s++){
+		size_t slot = hashes[s] & mask;
+		while(table[slot] != -1){
+			int first = uniqueFirstSite[table[slot]];
+			if(hashes[first] == hashes[s] && memcmp(Column(first), Column(s), numTax) == 0)
+				break;
+			slot = (slot + 1) & mask;
 			}
-		}
-	//this will zero the count of all missing pats, which will make them not get put into the uniquePatterns
-	//list in NewPack
-	for(list<SitePattern>::iterator pit = patterns.begin();pit != patterns.end();pit++){
-		if((*pit).numStates == 0){
-			(*pit).count = 0;
+		if(table[slot] != -1){
+			siteToUnique[s] = table[slot];
+			continue;
 			}
+		siteToUnique[s] = table[slot] = (int) uniqueFirstSite.size();
+		uniqueFirstSite.push_back(s);
+		if(uniqueFirstSite.size() * 2 > table.size()){
+			table.assign(table.size() * 2, -1);
+			mask = table.size() - 1;
+			for(int u = 0;u < (int) uniqueFirstSite.size();u++){
+				slot = hashes[uniqueFirstSite[u]] & mask;
+				while(table[slot] != -1)
+					slot = (slot + 1) & mask;
+				table[slot] = u;
+				}
+			}
+		}
+	vector<int>().swap(table);
+	vector<unsigned long long>().swap(hashes);
+
+	vector<SitePattern *> unique(uniqueFirstSite.size());
+	for(int u = 0;u < (int) uniqueFirstSite.size();u++){
+		uniquePatterns.push_back(SitePattern());
+		SitePattern &pat = uniquePatterns.back();
+		const unsigned char *col = Column(uniqueFirstSite[u]);
+		pat.stateVec.assign(col, col + numTax);
+		pat.count = 0;
+		unique[u] = &pat;
 		}
+	//sites are visited in order, so each siteNumbers vector ends up sorted
+	for(int s = 0;s < numSites;s++){
+		SitePattern *pat = unique[siteToUnique[s]];
+		pat->count += siteCounts[s];
+		pat->siteNumbers.push_back(s);
+		}
+	for(list<SitePattern>::iterator pit = uniquePatterns.begin();pit != uniquePatterns.end();pit++)
+		(*pit).origCount = (*pit).count;
 	}
 
 void PatternManager::NewSort(){
 	//this is the stl list sort function, using SitePattern::operator<
-	patterns.sort();
+	//only unique patterns are sorted, which will be in the same order that sorting all of the sites gave
+	uniquePatterns.sort();
 	}
 
-// This version of pack copies unique patterns from the patterns list into the uniquePatterns list
+//This removes the missing patterns (and any with zero counts) from the uniquePatterns list
 void PatternManager::NewPack(){
-	for(list<SitePattern>::iterator pit = patterns.begin();pit != patterns.end();pit++){
-		if(pit->numStates > 0){
-			if(pit->count > 0){ 
-				uniquePatterns.push_back(*pit);
-				}
-			}
+	for(list<SitePattern>::iterator pit = uniquePatterns.begin();pit != uniquePatterns.end();){
+		if(pit->numStates > 0 && pit->count > 0)
+			pit++;
+		else
+			pit = uniquePatterns.erase(pit);
 		}
 	pman_numPatterns = uniquePatterns.size();
 	compressed = true;
@@ -286,41 +333,58 @@ void PatternManager::NewPack(){
 //up to the point when the compressed matrix can be copied back into 
 //this will only be used for nuc/AA/codon data
 void PatternManager::ProcessPatterns(){
+	NewCollapse();
 	CalcPatternTypesAndNumStates();
 	NewSort();
-	NewCollapse();
 	NewPack();
 	NewDetermineConstantSites();
 	}
 
-//it would really make more sense to do this after packing, but the number of states
-//is needed in pattern comparison in sorting.  This also does what Summarize used to, 
-//filling the counts of various types of patterns
+//This does what Summarize used to, filling the counts of various types of patterns.  The number of states
+//is needed in pattern comparison in sorting.  It is calculated once per unique pattern, and the counts
+//of each pattern then apply to all of the sites that it represents.
 //THIS DOES NOT CURRENTLY SUPPORT CONDITIONING PATTERNS!
 void PatternManager::CalcPatternTypesAndNumStates(){
-	//this is just a scratch array to be used repeatedly in PatternType	
-	vector<unsigned int> s(maxNumStates);
+	vector<SitePattern *> pats;
+	pats.reserve(uniquePatterns.size());
+	for(list<SitePattern>::iterator pit = uniquePatterns.begin();pit != uniquePatterns.end();pit++)
+		pats.push_back(&(*pit));
+	vector<int> types(pats.size());
+
+#ifdef OPEN_MP
+#pragma omp parallel
+#endif
+		{
+		//this is just a scratch array to be used repeatedly in PatternType	
+		vector<unsigned int> s(maxNumStates);
+#ifdef OPEN_MP
+#pragma omp for schedule(dynamic, 256)
+#endif
+		for(int p = 0;p < (int) pats.size();p++)
+			types[p] = pats[p]->CalcPatternTypeAndNumStates(s);
+		}
 
 	pman_numMissingChars = pman_numConstantChars = pman_numInformativeChars = pman_numUninformVariableChars = pman_numNonMissingRealCountsInOrigMatrix = 0;
 
-	pman_numRealSitesInOrigMatrix = patterns.size();
-	for(list<SitePattern>::iterator pit = patterns.begin();pit != patterns.end();pit++){
-		int t = pit->CalcPatternTypeAndNumStates(s);
+	pman_numRealSitesInOrigMatrix = NumSites();
+	for(int p = 0;p < (int) pats.size();p++){
+		int t = types[p];
+		int c = pats[p]->count;
 		//Fixed 2 bugs - It is important to calculate numNonMissingRealCountsInOrigMatrix here from counts of the  
 		//the generally unpacked data, because it could effectively be partially packed due to the use of a wtset, 
 		//but also need to keep separate track of the number of columns in the orig matrix with numRealSitesInOrigMatrix
 		if( t != SitePattern::MISSING )
-			pman_numNonMissingRealCountsInOrigMatrix += pit->count;
+			pman_numNonMissingRealCountsInOrigMatrix += c;
 
 		if( t == SitePattern::MISSING )
-			pman_numMissingChars += pit->count;
+			pman_numMissingChars += c;
 		else if( t == SitePattern::CONSTANT )
-			pman_numConstantChars += pit->count;
+			pman_numConstantChars += c;
 		else if( t == SitePattern::INFORMATIVE )
-			pman_numInformativeChars += pit->count;
+			pman_numInformativeChars += c;
 		else{
 			assert(t == SitePattern::UNINFORM_VARIABLE);
-			pman_numUninformVariableChars += pit->count;
+			pman_numUninformVariableChars += c;
 			}
 		}
 	pman_numNonMissingChars = pman_numRealSitesInOrigMatrix - pman_numMissingChars;
@@ -375,9 +439,9 @@ void PatternManager::NewDetermineConstantSites(){
 //This takes the unique pattern types and uses their siteNumbers vector to map back to the original
 //ordering of sites, as used to tbe stored in the number array.
 void PatternManager::FillNumberVector(vector<int> &nums) const{
-	if(nums.size() != patterns.size()){
+	if(nums.size() != siteCounts.size()){
 		nums.clear();
-		nums.resize(patterns.size());
+		nums.resize(siteCounts.size());
 		}
 	
 	//this is necessary so that all missing patterns, which should already have been removed from
@@ -440,8 +504,8 @@ void PatternManager::FillIntegerValues(int &_nMissing, int &_nConstant, int &_nV
 	}
 
 vector<IdenticalColumnRange> PatternManager::FindIdenticalAlignmentColumns(const PatternManager &other) const{
-	vector<SitePattern> basePos1(patterns.size());
-	vector<SitePattern> basePos2(other.patterns.size());
+	vector<SitePattern> basePos1(NumSites());
+	vector<SitePattern> basePos2(other.NumSites());
 
 	//assuming nucleotide for now
 	unsigned char ambigState = 15;
@@ -457,14 +521,12 @@ vector<IdenticalColumnRange> PatternManager::FindIdenticalAlignmentColumns(const
 	int baseNum, colNum;
 	for(int tax = 0;tax < numTax;tax++){
 		baseNum = 1;
-		colNum = 0;
-		for(list<SitePattern>::const_iterator sit = patterns.begin();sit != patterns.end();sit++)
-			basePos1[colNum++].AddChar( (*sit).stateVec[tax] == ambigState ? -baseNum : baseNum++); 
+		for(colNum = 0;colNum < NumSites();colNum++)
+			basePos1[colNum].AddChar( Column(colNum)[tax] == ambigState ? -baseNum : baseNum++); 
 			
 		baseNum = 1;
-		colNum = 0;
-		for(list<SitePattern>::const_iterator sit = other.patterns.begin();sit != other.patterns.end();sit++)
-			basePos2[colNum++].AddChar( (*sit).stateVec[tax] == ambigState ? -baseNum : baseNum++); 
+		for(colNum = 0;colNum < other.NumSites();colNum++)
+			basePos2[colNum].AddChar( other.Column(colNum)[tax] == ambigState ? -baseNum : baseNum++); 
 		}
 
 	//Things get confusing below.  IdenticalColumnPair consists of one column index in one alignment and one in another. 
@@ -506,19 +568,11 @@ vector<IdenticalColumnRange> PatternManager::FindIdenticalAlignmentColumns(const
 	}
 
 void DataMatrix::CreateMatrixFromOtherMatrix(const DataMatrix &other, int startIndex, int endIndex){
-	NewMatrix(other.patman.numTax, other.patman.patterns.size());
-	patman.Initialize(other.patman.numTax, other.patman.maxNumStates);
+	NewMatrix(other.patman.numTax, other.patman.NumSites());
+	patman.Initialize(other.patman.numTax, other.patman.maxNumStates, endIndex - startIndex + 1);
 
-	list<SitePattern>::const_iterator fromStart = other.patman.patterns.begin();
-	list<SitePattern>::const_iterator fromEnd = fromStart;
-	advance(fromStart, startIndex);
-	advance(fromEnd, endIndex + 1);
-	for(list<SitePattern>::const_iterator copypat = fromStart;copypat != fromEnd;copypat++){
-		SitePattern thisPat(*copypat);
-		for(vector<int>::iterator sit = thisPat.siteNumbers.begin();sit != thisPat.siteNumbers.end();sit++)
-			(*sit) -= startIndex;
-		patman.AddPattern(thisPat);
-		}
+	for(int site = startIndex;site <= endIndex;site++)
+		patman.AddColumn(other.patman.Column(site), other.patman.siteCounts[site]);
 
 	for(int tax = 0;tax < other.nTax;tax++)
 		this->SetTaxonLabel(tax, other.TaxonLabel(tax));
@@ -560,9 +614,7 @@ void DataMatrix::ProcessPatterns() {
 		Collapse();
 		DetermineConstantSites();
 		}
-	CalcEmpiricalFreqs();
-	ReserveOriginalCounts();
-	OutputDataSummary();
+	FinishPatternProcessing();
 	int t = stoppy.SplitTime();
 	/*There isn't much point in outputting all of this clutter
 	if(t == 0)
@@ -575,6 +627,86 @@ void DataMatrix::ProcessPatterns() {
 	*/
 	}
 
+//the steps that follow packing, whether the packed patterns were just made or were read from a PatternCache
+void DataMatrix::FinishPatternProcessing(){
+	CalcEmpiricalFreqs();
+	ReserveOriginalCounts();
+	OutputDataSummary();
+	}
+
+static void ReadPackedValues(void *dest, size_t size, size_t num, FILE *in){
+	if(num > 0 && fread(dest, size, num, in) != num)
+		throw ErrorException("Pattern cache file appears to be truncated or corrupt.\n\tDelete it and it will be recreated.");
+	}
+
+//everything that CreateMatrixFromNCL and ProcessPatterns leave in a pattern manager matrix, other than the
+//empirical freqs and original counts that FinishPatternProcessing recalculates
+void DataMatrix::WritePackedPatterns(FILE *out) const{
+	assert(usePatternManager && newNumber.size() > 0 && IsCompacted() == false);
+	int origSites = (int) newNumber.size();
+	int vals[] = {nTax, numPatterns, origSites, numRealSitesInOrigMatrix, numNonMissingRealSitesInOrigMatrix, numNonMissingRealCountsInOrigMatrix,
+		numMissingChars, numConstantChars, numInformativeChars, numVariableUninformChars, lastConstant, dense, (int) wtsetName.length()};
+	fwrite(vals, sizeof(int), 13, out);
+	fwrite(wtsetName.c_str(), sizeof(char), wtsetName.length(), out);
+	for(int t = 0;t < nTax;t++){
+		int len = (int) strlen(taxonLabel[t]);
+		fwrite(&len, sizeof(int), 1, out);
+		fwrite(taxonLabel[t], sizeof(char), len, out);
+		}
+	fwrite(origDataNumber, sizeof(int), origSites, out);
+	fwrite(&newNumber[0], sizeof(int), origSites, out);
+	fwrite(&newCount[0], sizeof(int), numPatterns, out);
+	fwrite(&newNumStates[0], sizeof(int), numPatterns, out);
+	fwrite(&newConstStates[0], sizeof(int), numPatterns, out);
+	for(int t = 0;t < nTax;t++)
+		fwrite(matrix[t], sizeof(unsigned char), numPatterns, out);
+	}
+
+//used in place of CreateMatrixFromNCL and the packing part of ProcessPatterns.  The allocation mirrors
+//what those do, so that the matrix is indistinguishable from one that was freshly packed
+void DataMatrix::ReadPackedPatterns(FILE *in){
+	assert(usePatternManager);
+	int vals[13];
+	ReadPackedValues(vals, sizeof(int), 13, in);
+	int origSites = vals[2];
+	if(vals[0] < 1 || vals[1] < 1 || origSites < vals[1])
+		throw ErrorException("Pattern cache file appears to be corrupt.\n\tDelete it and it will be recreated.");
+
+	NewMatrix(vals[0], origSites);
+	ResizeCharacterNumberDependentVariables(vals[1]);
+	numRealSitesInOrigMatrix = vals[3];
+	numNonMissingRealSitesInOrigMatrix = vals[4];
+	numNonMissingRealCountsInOrigMatrix = vals[5];
+	numMissingChars = vals[6];
+	numConstantChars = vals[7];
+	numInformativeChars = vals[8];
+	numVariableUninformChars = vals[9];
+	lastConstant = vals[10];
+	dense = vals[11];
+
+	vector<char> buf(vals[12] + 1, '\0');
+	ReadPackedValues(&buf[0], sizeof(char), vals[12], in);
+	wtsetName = &buf[0];
+	for(int t = 0;t < nTax;t++){
+		int len;
+		ReadPackedValues(&len, sizeof(int), 1, in);
+		buf.assign(len + 1, '\0');
+		ReadPackedValues(&buf[0], sizeof(char), len, in);
+		SetTaxonLabel(t, &buf[0]);
+		}
+	ReadPackedValues(origDataNumber, sizeof(int), origSites, in);
+	newNumber.resize(origSites);
+	ReadPackedValues(&newNumber[0], sizeof(int), origSites, in);
+	newCount.resize(numPatterns);
+	ReadPackedValues(&newCount[0], sizeof(int), numPatterns, in);
+	newNumStates.resize(numPatterns);
+	ReadPackedValues(&newNumStates[0], sizeof(int), numPatterns, in);
+	newConstStates.resize(numPatterns);
+	ReadPackedValues(&newConstStates[0], sizeof(int), numPatterns, in);
+	for(int t = 0;t < nTax;t++)
+		ReadPackedValues(matrix[t], sizeof(unsigned char), numPatterns, in);
+	}
+
 //this pulls all of the processed data back out of the patman into the old fields of DataMatrix
 void DataMatrix::GetDataFromPatternManager(){
 	ResizeCharacterNumberDependentVariables(patman.NChar()) ;
@@ -623,6 +755,7 @@ void DataMatrix::ReplaceTaxonLabel( int i, const char* s )
 	if(newLength > MAX_TAXON_LABEL) throw ErrorException("Sorry, taxon name %s for taxon #%d is too long (max length=%d)", s, i+1, MAX_TAXON_LABEL);
 	MEM_NEW_ARRAY(taxonLabel[i],char,newLength);
 	strcpy(taxonLabel[i], s);
+	taxonNumbersNTax = -1;
 }
 
 //
@@ -844,8 +977,10 @@ void DataMatrix::Summarize(){
 //
 // NewMatrix deletes old matrix, taxonLabel, count, and number
 // arrays and creates new ones
+// allocateMatrix = false leaves the matrix itself unallocated, for when the
+// data go straight into the pattern manager
 //
-void DataMatrix::NewMatrix( int taxa, int sites )
+void DataMatrix::NewMatrix( int taxa, int sites, bool allocateMatrix /*=true*/ )
 {
 	//allocate an extra taxon unless there previously wasn't one
 	int extraTax = 1;
@@ -861,6 +996,8 @@ void DataMatrix::NewMatrix( int taxa, int sites )
 		MEM_DELETE_ARRAY(taxonLabel); // taxonLabel is of length nTax
 		}
 
+	taxonNumbersNTax = -1;
+
 	// create new array of taxon label pointers
 	if( taxa > 0 ) {
 		MEM_NEW_ARRAY(taxonLabel,char*,taxa + extraTax);
@@ -895,7 +1032,8 @@ void DataMatrix::NewMatrix( int taxa, int sites )
 	// all counts are initially 1, and characters are numbered
 	// sequentially from 0 to numPatterns-1
 	if( taxa > 0 && sites > 0 ) {
-		MEM_NEW_ARRAY(matrix,unsigned char*,taxa + extraTax);
+		if(allocateMatrix)
+			MEM_NEW_ARRAY(matrix,unsigned char*,taxa + extraTax);
 		MEM_NEW_ARRAY(number,int,sites);
 		MEM_NEW_ARRAY(origDataNumber,int,sites);
 		for( int j = 0; j < sites; j++ ) {
@@ -913,7 +1051,7 @@ void DataMatrix::NewMatrix( int taxa, int sites )
 				numStates[j] = 1;
 				}
 			}
-		for( int i = 0; i < taxa + extraTax; i++ ) {
+		for( int i = 0; allocateMatrix && i < taxa + extraTax; i++ ) {
 			matrix[i]=new unsigned char[sites];
 			//MEM_NEW_ARRAY(matrix[i],unsigned char,sites);
 			//memset( matrix[i], 0xff, taxa*sizeof(unsigned char) );
@@ -1165,12 +1303,23 @@ void DataMatrix::BeginNexusTreesBlock(ofstream &treeout) const{
 	}
 
 int DataMatrix::TaxonNameToNumber(const NxsString &name) const{\
-	string nameStr = NxsToken::Tokenize(name)[0].GetToken();
-	for(int i=0;i<nTax;i++){
-		if(nameStr == (NxsToken::Tokenize(TaxonLabel(i)))[0].GetToken())
-			return i+1;//indeces run 0->ntax-1, taxon numbers 1->ntax
+	//tokenizing every label for every lookup made reading trees with many taxa quadratic, so the
+	//tokenized labels are put in a table once.  It is rebuilt if the labels or number of taxa change.
+	if(taxonNumbersNTax != nTax){
+		taxonNumbers.clear();
+		for(int i=0;i<nTax;i++){
+			if(TaxonLabel(i) == NULL)
+				continue;
+			ProcessedNxsCommand tok = NxsToken::Tokenize(TaxonLabel(i));
+			//if labels are duplicated the first one wins, as it always has
+			if(!tok.empty())
+				taxonNumbers.insert(make_pair(tok[0].GetToken(), i+1));//indeces run 0->ntax-1, taxon numbers 1->ntax
 			}
-	return -1;
+		taxonNumbersNTax = nTax;
+		}
+	string nameStr = NxsToken::Tokenize(name)[0].GetToken();
+	map<string, int>::const_iterator it = taxonNumbers.find(nameStr);
+	return (it == taxonNumbers.end() ? -1 : it->second);
 	}
 
 //
@@ -1924,6 +2073,109 @@ int DataMatrix::BootstrapReweight(int seedToUse, FLOAT_TYPE resampleProportion){
 	return nextSeed;
 	}
 
+//gathers entry order[k] into position k, or when restoring scatters it back again
+template<class T> static void PermuteColumns(T *arr, const vector<int> &order, bool restore){
+	vector<T> temp(arr, arr + order.size());
+	for(unsigned k = 0;k < order.size();k++){
+		if(restore)
+			arr[order[k]] = temp[k];
+		else
+			arr[k] = temp[order[k]];
+		}
+	}
+
+void DataMatrix::PermutePatterns(bool restore){
+	assert(compactedOrder.size() == numPatterns);
+
+	for(int t = 0;t < nTax;t++)
+		PermuteColumns(matrix[t], compactedOrder, restore);
+	if(newCount.size() > 0)
+		PermuteColumns(&newCount[0], compactedOrder, restore);
+	if(count)
+		PermuteColumns(count, compactedOrder, restore);
+	if(newNumStates.size() == compactedOrder.size())
+		PermuteColumns(&newNumStates[0], compactedOrder, restore);
+	if(numStates)
+		PermuteColumns(numStates, compactedOrder, restore);
+
+	//the uncompressed columns need to point to the new locations of their patterns
+	int *numberAlias = (newNumber.size() > 0 ? &newNumber[0] : number);
+	int numCols = (newNumber.size() > 0 ? (int) newNumber.size() : numRealSitesInOrigMatrix + numConditioningPatterns);
+	if(numberAlias == NULL)
+		return;
+	vector<int> newIndex(compactedOrder.size());
+	for(unsigned k = 0;k < compactedOrder.size();k++)
+		newIndex[compactedOrder[k]] = k;
+	for(int j = 0;j < numCols;j++){
+		if(numberAlias[j] > -1)
+			numberAlias[j] = (restore ? compactedOrder[numberAlias[j]] : newIndex[numberAlias[j]]);
+		}
+	}
+
+bool DataMatrix::CompactZeroCountPatterns(){
+	assert(numUncompactedPatterns == 0);
+	const int *countsAlias = GetCounts();
+
+	//conditioning patterns must stay at the start.  Otherwise this is a stable partition, so the constant
+	//patterns remain a prefix of the ones that are kept
+	compactedOrder.clear();
+	vector<int> dropped;
+	for(int p = 0;p < numPatterns;p++){
+		if(p < (int) numConditioningPatterns || countsAlias[p] > 0)
+			compactedOrder.push_back(p);
+		else
+			dropped.push_back(p);
+		}
+	if(dropped.size() == 0){
+		compactedOrder.clear();
+		return false;
+		}
+	int numKept = (int) compactedOrder.size();
+	compactedOrder.insert(compactedOrder.end(), dropped.begin(), dropped.end());
+	PermutePatterns(false);
+
+	int *constAlias = (newConstStates.size() > 0 ? &newConstStates[0] : constStates);
+	uncompactedLastConstant = lastConstant;
+	uncompactedConstStates.clear();
+	for(int k = 0;k <= lastConstant;k++)
+		uncompactedConstStates.push_back(constAlias[k]);
+	lastConstant = -1;
+	for(int k = 0;k < numKept && compactedOrder[k] <= uncompactedLastConstant;k++){
+		constAlias[k] = uncompactedConstStates[compactedOrder[k]];
+		lastConstant = k;
+		}
+
+	numUncompactedPatterns = numPatterns;
+	numPatterns = numKept;
+	return true;
+	}
+
+bool DataMatrix::RestoreUncompactedPatterns(){
+	if(numUncompactedPatterns == 0)
+		return false;
+	numPatterns = numUncompactedPatterns;
+	numUncompactedPatterns = 0;
+	PermutePatterns(true);
+
+	int *constAlias = (newConstStates.size() > 0 ? &newConstStates[0] : constStates);
+	for(int k = 0;k <= uncompactedLastConstant;k++)
+		constAlias[k] = uncompactedConstStates[k];
+	lastConstant = uncompactedLastConstant;
+	compactedOrder.clear();
+	return true;
+	}
+
+void DataMatrix::KeepPatternSlice(int slice, int numSlices){
+	int first = numConditioningPatterns;
+	if(numPatterns - first < numSlices)
+		throw ErrorException("A data subset has only %d unique patterns, which is too few to divide among %d processes", numPatterns - first, numSlices);
+	for(int p = first;p < numPatterns;p++){
+		if((p - first) % numSlices != slice)
+			SetCount(p, 0);
+		}
+	CompactZeroCountPatterns();
+	}
+
 void DataMatrix::CheckForIdenticalTaxonNames(){
 	const char *name1, *name2;
 	vector< pair<int, int> > identicals;
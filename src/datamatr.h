@@ -22,6 +22,7 @@
 
 #include <string>
 #include <cstring>
+#include <map>
 #include <iostream>
 #include <cassert>
 #include <stdio.h>
@@ -112,8 +113,11 @@ public:
 //code, even if this is used the results are copied back into their usual locations in DataMatrix.
 //Also need to keep around DataMatrix packing for certain types of data.
 //THIS DOES NOT CURRENTLY SUPPORT CONDITIONING PATTERNS, NOR IS IS CURRENTLY USED FOR NON-SEQUENCE DATA
+//The input sites are held as a flat column-major byte matrix rather than as a SitePattern each, and identical
+//columns are merged by hashing, so that SitePatterns (and the sorting of them) are only needed for the unique patterns.
 class PatternManager{
 	friend class DataMatrix;
+	friend class KernelBenchmark;
 
 	int numTax;
 	int maxNumStates;
@@ -129,7 +133,8 @@ class PatternManager{
 	
 	int lastConstant;					
 	bool compressed;					//dense
-	list<SitePattern> patterns;
+	vector<unsigned char> columns;		//the input sites, numTax states per site
+	vector<int> siteCounts;				//the input weight of each site
 	list<SitePattern> uniquePatterns;
 	vector<int> constStates;
 
@@ -137,32 +142,55 @@ class PatternManager{
 	PatternManager(const PatternManager &other) {Reset();numTax = other.numTax;maxNumStates = other.maxNumStates;}
 
 	~PatternManager(){
-		patterns.clear();
 		uniquePatterns.clear();
 		constStates.clear();
 		}
+	const unsigned char *Column(int site) const {return &columns[(size_t) site * numTax];}
 	virtual void NewCollapse();
 	virtual void NewPack();
 	virtual void NewSort();
 	virtual void NewDetermineConstantSites();
 
 public:
-	void Initialize(int nt, int max){
+	//expectedSites just avoids repeated reallocation of the input matrix as sites are added
+	void Initialize(int nt, int max, int expectedSites = 0){
 		Reset();
 		numTax = nt;
 		maxNumStates = max;
 		SitePattern::maxNumStates = max;
 		SitePattern::numTax = nt;
+		if(expectedSites > 0){
+			columns.reserve((size_t) expectedSites * nt);
+			siteCounts.reserve(expectedSites);
+			}
 		}
 	void Reset(){
 		numTax = maxNumStates = pman_numRealSitesInOrigMatrix = pman_numNonMissingChars = pman_numPatterns = pman_numMissingChars = pman_numConstantChars = pman_numInformativeChars = lastConstant = pman_numUninformVariableChars = 0;
 		compressed = false;
-		patterns.clear();
+		//swapping actually frees the memory, which clear doesn't
+		vector<unsigned char>().swap(columns);
+		vector<int>().swap(siteCounts);
 		uniquePatterns.clear();
 		constStates.clear();
 		}
+	//sites must be added in order, so the siteNumber of the pattern should be the number already added
 	void AddPattern(const SitePattern &add){
-		patterns.push_back(add);
+		assert(add.stateVec.size() == numTax);
+		assert(add.siteNumbers.size() == 1 && add.siteNumbers[0] == NumSites());
+		for(StateVector::const_iterator sit = add.stateVec.begin();sit != add.stateVec.end();sit++)
+			columns.push_back((unsigned char) *sit);
+		siteCounts.push_back(add.count);
+		}
+	void AddColumn(const unsigned char *states, int count){
+		columns.insert(columns.end(), states, states + numTax);
+		siteCounts.push_back(count);
+		}
+	int NumSites() const {return (int) siteCounts.size();}
+	//for filling the input matrix directly, with site s of taxon t at [s * numTax + t].  All counts are one.
+	unsigned char *AllocateColumns(int numSites){
+		columns.assign((size_t) numSites * numTax, 0);
+		siteCounts.assign(numSites, 1);
+		return &columns[0];
 		}
 	//these are named along the lines of the old DataMatrix members
 	int NChar() const {
@@ -222,6 +250,12 @@ protected:
 									//be avoided in the conditional likelihood calcs, but how this
 									//is done varies depending on the context
 									//only used when outputting something relative to input alignment
+
+	int		numUncompactedPatterns;	//if zero count bootstrap patterns have been compacted out of the matrix this is the
+									//full number of patterns, which numPatterns will be restored to, otherwise 0
+	int		uncompactedLastConstant;
+	vector<int> compactedOrder;		//compactedOrder[k] is the uncompacted column that is now at column k
+	vector<int> uncompactedConstStates;
 	
 	int		numMissingChars;
 	int		numConstantChars;
@@ -270,6 +304,9 @@ protected:
 	vector<string> newTaxonLabel;
 
 	char**          taxonLabel;
+	//tokenized taxon labels -> taxon numbers, built when first needed by TaxonNameToNumber
+	mutable map<string, int> taxonNumbers;
+	mutable int taxonNumbersNTax;
 	int 	lastConstant;
 	int 	*constStates;//the state (or states) that a constant site contains
 	unsigned char fullyAmbigChar;
@@ -289,6 +326,7 @@ protected:
 		void	DebugSaveQSortState( int top, int bottom, int ii, int jj, int xx, const char* title );
 		void	QSort( int top, int bottom );
 		void	ReplaceTaxonLabel( int i, const char* s );
+		void	PermutePatterns( bool restore );
 
 	public:
 		enum {
@@ -300,19 +338,21 @@ protected:
 
 	public:
 		DataMatrix() : dense(0), nTax(0), numPatterns(0), matrix(0), count(0),
-			number(0), taxonLabel(0), numStates(0),
+			number(0), taxonLabel(0), taxonNumbersNTax(-1), numStates(0),
 			numMissingChars(0), numConstantChars(0), numInformativeChars(0), numVariableUninformChars(0),
 			lastConstant(-1), constStates(0), origCounts(0),
 			fullyAmbigChar(15), useDefaultWeightsets(true), usePatternManager(true),
-			nTaxAllocated(0), origDataNumber(0), numConditioningPatterns(0)
+			nTaxAllocated(0), origDataNumber(0), numConditioningPatterns(0),
+			numUncompactedPatterns(0), uncompactedLastConstant(-1)
 			{ memset( info, 0x00, 80 ); }
 		DataMatrix( int ntax, int nchar )
 			: nTax(ntax), numPatterns(nchar), dense(0), matrix(0), count(0),
-			number(0), taxonLabel(0), numStates(0),
+			number(0), taxonLabel(0), taxonNumbersNTax(-1), numStates(0),
 			numMissingChars(0), numConstantChars(0), numInformativeChars(0), numVariableUninformChars(0),
 			lastConstant(-1), constStates(0), origCounts(0),
 			fullyAmbigChar(15), useDefaultWeightsets(true), usePatternManager(true),
-			nTaxAllocated(0), origDataNumber(0), numConditioningPatterns(0)
+			nTaxAllocated(0), origDataNumber(0), numConditioningPatterns(0),
+			numUncompactedPatterns(0), uncompactedLastConstant(-1)
 			{ memset( info, 0x00, 80 ); NewMatrix(ntax, nchar); }
 		virtual ~DataMatrix();
 
@@ -335,7 +375,11 @@ protected:
 		bool GetUsePatternManager() const {return usePatternManager;}
 		const PatternManager &GetPatternManager() const {return patman;};
 		void ProcessPatterns();
+		void FinishPatternProcessing();
 		void OutputDataSummary() const;
+		//binary form of a matrix processed with the pattern manager, see PatternCache
+		void WritePackedPatterns(FILE *out) const;
+		void ReadPackedPatterns(FILE *in);
 
 		void GetDataFromPatternManager();
 		// functions for getting the data in and out
@@ -356,6 +400,7 @@ protected:
 		int GapsIncludedNChar() const { return numRealSitesInOrigMatrix; }
 		void SetNChar(int nchar) { numPatterns = nchar; }
 		unsigned NumConditioningPatterns() const{return numConditioningPatterns;}
+		int MaxNumStates() const {return maxNumStates;}
 
 		int BootstrappedNChar() {return nonZeroCharCount;} 
 		void Flush() { NewMatrix( 0, 0 ); }
@@ -473,7 +518,7 @@ protected:
 		virtual void Collapse();
 		void EliminateAdjacentIdenticalColumns();
 		virtual void Pack();
-		void NewMatrix(int nt, int nc);	// flushes old matrix, creates new one
+		void NewMatrix(int nt, int nc, bool allocateMatrix = true);	// flushes old matrix, creates new one
 		void ResizeCharacterNumberDependentVariables(int nCh);
 		int PositionOf( char* s ) const; // returns pos (0..nTax-1) of taxon named s
 		void DumpCounts( const char* s );
@@ -520,6 +565,15 @@ protected:
       		}
       void Reweight(FLOAT_TYPE prob);
       virtual int BootstrapReweight(int seedToUse, FLOAT_TYPE resampleProportion);
+      //moves patterns with a bootstrap count of zero to the end of the matrix and leaves them out of numPatterns,
+      //so that the likelihood calcs only loop over patterns that contribute.  Returns false if there were none
+      virtual bool CompactZeroCountPatterns();
+      //puts the matrix back in its original order, which must be done before it is reweighted again
+      virtual bool RestoreUncompactedPatterns();
+      //keeps only every numSlices'th pattern starting at slice, so that the likelihood calculations can be divided among
+      //processes.  The others are compacted out as if they had a bootstrap count of zero
+      void KeepPatternSlice(int slice, int numSlices);
+      bool IsCompacted() const {return numUncompactedPatterns > 0;}
 	  void CountMissingCharsByColumn(vector<int> &vec);
 	  void MakeWeightSetString(NxsCharactersBlock &charblock, string &wtstring, string name);
       void MakeWeightSetString(std::string &wtstring, string name);
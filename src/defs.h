@@ -131,7 +131,8 @@ typedef double MODEL_FLOAT;
 	#endif
 #else
 	#define WRITE_TO_FILE(ptr, size, count) write((const char *) ptr, (streamsize) size*count)
-	#define OUTPUT_CLASS ofstream
+	//checkpoint sections are serialized to memory first, see CheckpointWriter
+	#define OUTPUT_CLASS ostream
 #endif
 
 //mpi message tags
@@ -156,6 +157,8 @@ typedef double MODEL_FLOAT;
 #define TAG_SUBTREE_DEFINE		18
 #define TAG_SUBTREE_ITERATION	19
 #define TAG_PERTURB				20
+#define TAG_UPDATE_HEADER		21
+#define TAG_PACKED_INDIVIDUAL	22
 #endif
 
 #endif
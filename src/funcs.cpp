@@ -26,12 +26,19 @@
 #	include <unistd.h>
 #endif
 
+#ifdef UNIX
+#include <sys/resource.h>
+#endif
+
+#include <float.h>
+
 #include "defs.h"
 #include "funcs.h"
 #include "population.h"
 #include "tree.h"
 #include "outputman.h"
 #include "garlireader.h"
+#include "utility.h"
 
 extern OutputManager outman;
 
@@ -1031,6 +1038,288 @@ FLOAT_TYPE CalculateHammingDistance(const char *str1, const char *str2, const in
 	return diff/(FLOAT_TYPE)effectiveChar;
 }
 
+//Fills the nTax x nTax dist matrix with corrected pairwise distances computed over all subsets of the partition.
+//Each row is first recoded so that a zero means missing/ambiguous and any other value is an unambiguous state,
+//which keeps the inner site loop free of branches.  Pairs are spread across threads when OpenMP is enabled.
+void CalculatePairwiseDistances(const DataPartition *dataPart, int nTax, FLOAT_TYPE **dist){
+	vector<double> diffs(nTax * nTax, 0.0);
+	vector<double> effs(nTax * nTax, 0.0);
+	double weightedStates = 0.0, totWeight = 0.0;
+
+	for(int p = 0;p < dataPart->NumSubsets();p++){
+		const SequenceData *data = dataPart->GetSubset(p);
+		const int first = data->NumConditioningPatterns();
+		const int nchar = data->NChar() - first;
+		if(nchar < 1)
+			continue;
+		const int *counts = data->GetCounts() + first;
+		const bool nuc = data->IsNucleotide();
+		const int maxStates = data->MaxNumStates();
+
+		unsigned char **recoded = New2DArray<unsigned char>(nTax, nchar);
+		for(int t = 0;t < nTax;t++){
+			const unsigned char *row = data->GetRow(t) + first;
+			for(int c = 0;c < nchar;c++){
+				if(nuc)
+					recoded[t][c] = (row[c] == 1 || row[c] == 2 || row[c] == 4 || row[c] == 8) ? row[c] : 0;
+				else
+					recoded[t][c] = (row[c] < maxStates ? row[c] + 1 : 0);
+				}
+			}
+
+		//rows get shorter as i increases, so hand them out dynamically
+#ifdef OPEN_MP
+#pragma omp parallel for schedule(dynamic)
+#endif
+		for(int i = 0;i < nTax - 1;i++){
+			const unsigned char *a = recoded[i];
+			for(int j = i + 1;j < nTax;j++){
+				const unsigned char *b = recoded[j];
+				int eff = 0, diff = 0;
+				for(int c = 0;c < nchar;c++){
+					const int w = (a[c] != 0) * (b[c] != 0) * counts[c];
+					eff += w;
+					diff += (a[c] != b[c]) * w;
+					}
+				effs[i * nTax + j] += eff;
+				diffs[i * nTax + j] += diff;
+				}
+			}
+		Delete2DArray(recoded);
+
+		int totCount = 0;
+		for(int c = 0;c < nchar;c++)
+			totCount += counts[c];
+		weightedStates += (nuc ? 4 : maxStates) * (double) totCount;
+		totWeight += totCount;
+		}
+
+	//when the patterns are divided among processes each one only has its part of the counts
+	if(Tree::numPatternSlices > 1){
+		Tree::SumAcrossSlices(&diffs[0], nTax * nTax);
+		Tree::SumAcrossSlices(&effs[0], nTax * nTax);
+		double weights[2] = {weightedStates, totWeight};
+		Tree::SumAcrossSlices(weights, 2);
+		weightedStates = weights[0];
+		totWeight = weights[1];
+		}
+
+	//Jukes-Cantor style correction, using the number of states averaged over subsets
+	const double k = (totWeight > 0.0 ? weightedStates / totWeight : 4.0);
+	const double maxP = 0.95 * (k - 1.0) / k;
+	double maxDist = 0.0;
+	for(int i = 0;i < nTax;i++){
+		dist[i][i] = ZERO_POINT_ZERO;
+		for(int j = i + 1;j < nTax;j++){
+			double d = -1.0;
+			if(effs[i * nTax + j] > 0.0){
+				double pdist = min(diffs[i * nTax + j] / effs[i * nTax + j], maxP);
+				d = -((k - 1.0) / k) * log(1.0 - (k / (k - 1.0)) * pdist);
+				if(d > maxDist)
+					maxDist = d;
+				}
+			dist[i][j] = dist[j][i] = (FLOAT_TYPE) d;
+			}
+		}
+	//pairs without any overlapping sites get the largest observed distance
+	if(maxDist == 0.0)
+		maxDist = 1.0;
+	for(int i = 0;i < nTax;i++)
+		for(int j = 0;j < nTax;j++)
+			if(dist[i][j] < ZERO_POINT_ZERO)
+				dist[i][j] = (FLOAT_TYPE) maxDist;
+	}
+
+class BionjNode{
+public:
+	int taxon;
+	vector<int> children;
+	vector<double> lengths;
+	BionjNode(int t) : taxon(t){}
+	};
+
+static void WriteBionjNode(const vector<BionjNode> &nodes, int n, double minLen, double maxLen, string &out){
+	const BionjNode &nd = nodes[n];
+	if(nd.children.empty()){
+		char num[20];
+		sprintf(num, "%d", nd.taxon + 1);
+		out += num;
+		return;
+		}
+	out += "(";
+	for(unsigned c = 0;c < nd.children.size();c++){
+		if(c > 0)
+			out += ",";
+		WriteBionjNode(nodes, nd.children[c], minLen, maxLen, out);
+		char len[40];
+		sprintf(len, ":%.8f", max(minLen, min(maxLen, nd.lengths[c])));
+		out += len;
+		}
+	out += ")";
+	}
+
+//BIONJ (Gascuel 1997, Mol. Biol. Evol. 14:685-695).  Builds an unrooted tree from the nTax x nTax distance matrix
+//and returns it as a newick string with taxon numbers rather than names.  The matrices are compacted as nodes are
+//joined so that the per-join work stays proportional to the number of remaining nodes.
+void MakeBionjTreeString(FLOAT_TYPE **dist, int nTax, FLOAT_TYPE minLen, FLOAT_TYPE maxLen, string &newick){
+	if(nTax < 3)
+		throw ErrorException("At least three taxa are required to make a BIONJ starting tree.");
+
+	double **D = New2DArray<double>(nTax, nTax);
+	double **V = New2DArray<double>(nTax, nTax);
+	vector<double> S(nTax, 0.0);
+	vector<int> slotNode(nTax);
+	vector<BionjNode> nodes;
+	nodes.reserve(2 * nTax);
+
+	for(int i = 0;i < nTax;i++){
+		nodes.push_back(BionjNode(i));
+		slotNode[i] = i;
+		for(int j = 0;j < nTax;j++)
+			D[i][j] = V[i][j] = dist[i][j];
+		}
+	for(int i = 0;i < nTax;i++)
+		for(int j = 0;j < nTax;j++)
+			S[i] += D[i][j];
+
+	int r = nTax;
+	while(r > 3){
+		//find the pair minimizing Q(i,j) = (r - 2) D_ij - S_i - S_j
+		int bestI = 0, bestJ = 1;
+		double bestQ = DBL_MAX;
+#ifdef OPEN_MP
+#pragma omp parallel
+#endif
+			{
+			int locI = 0, locJ = 1;
+			double locQ = DBL_MAX;
+#ifdef OPEN_MP
+#pragma omp for schedule(dynamic)
+#endif
+			for(int i = 0;i < r;i++){
+				const double *Di = D[i];
+				for(int j = i + 1;j < r;j++){
+					const double q = (r - 2) * Di[j] - S[i] - S[j];
+					if(q < locQ){
+						locQ = q;
+						locI = i;
+						locJ = j;
+						}
+					}
+				}
+#ifdef OPEN_MP
+#pragma omp critical
+#endif
+				{
+				if(locQ < bestQ || (locQ == bestQ && (locI < bestI || (locI == bestI && locJ < bestJ)))){
+					bestQ = locQ;
+					bestI = locI;
+					bestJ = locJ;
+					}
+				}
+			}
+		const int i = bestI, j = bestJ;
+
+		const double blI = 0.5 * D[i][j] + (S[i] - S[j]) / (2.0 * (r - 2));
+		const double blJ = D[i][j] - blI;
+
+		//lambda minimizes the variance of the new distances
+		double lambda = 0.5;
+		if(V[i][j] > 0.0){
+			double sumV = 0.0;
+			for(int k = 0;k < r;k++)
+				if(k != i && k != j)
+					sumV += V[j][k] - V[i][k];
+			lambda = 0.5 + sumV / (2.0 * (r - 2) * V[i][j]);
+			lambda = max(0.0, min(1.0, lambda));
+			}
+
+		BionjNode joined(-1);
+		joined.children.push_back(slotNode[i]);
+		joined.lengths.push_back(blI);
+		joined.children.push_back(slotNode[j]);
+		joined.lengths.push_back(blJ);
+		nodes.push_back(joined);
+
+		//the new node takes slot i, and the last slot is moved into slot j
+		S[i] = 0.0;
+		for(int k = 0;k < r;k++){
+			if(k == i || k == j)
+				continue;
+			const double dNew = lambda * (D[i][k] - blI) + (1.0 - lambda) * (D[j][k] - blJ);
+			const double vNew = lambda * V[i][k] + (1.0 - lambda) * V[j][k] - lambda * (1.0 - lambda) * V[i][j];
+			S[k] += dNew - D[i][k] - D[j][k];
+			S[i] += dNew;
+			D[i][k] = D[k][i] = dNew;
+			V[i][k] = V[k][i] = vNew;
+			}
+		D[i][i] = V[i][i] = 0.0;
+		slotNode[i] = nodes.size() - 1;
+
+		const int last = r - 1;
+		if(j != last){
+			for(int k = 0;k < r;k++){
+				D[j][k] = D[k][j] = D[last][k];
+				V[j][k] = V[k][j] = V[last][k];
+				}
+			D[j][j] = V[j][j] = 0.0;
+			S[j] = S[last];
+			slotNode[j] = slotNode[last];
+			}
+		r--;
+		}
+
+	//join the final three at a trifurcating root
+	BionjNode root(-1);
+	for(int k = 0;k < 3;k++){
+		const int a = (k + 1) % 3, b = (k + 2) % 3;
+		root.children.push_back(slotNode[k]);
+		root.lengths.push_back(0.5 * (D[k][a] + D[k][b] - D[a][b]));
+		}
+	nodes.push_back(root);
+
+	Delete2DArray(D);
+	Delete2DArray(V);
+
+	newick.clear();
+	WriteBionjNode(nodes, nodes.size() - 1, minLen, maxLen, newick);
+	newick += ";";
+	}
+
+//high water mark of the resident set size of this process, or -1 if it can't be determined
+long PeakResidentMemoryKB(){
+#ifdef UNIX
+	struct rusage usage;
+	if(getrusage(RUSAGE_SELF, &usage) != 0)
+		return -1;
+#ifdef __APPLE__
+	//reported in bytes on OS X, but KB everywhere else
+	return (long) (usage.ru_maxrss / 1024);
+#else
+	return (long) usage.ru_maxrss;
+#endif
+#else
+	return -1;
+#endif
+	}
+
+//current resident set size of this process, or -1 if it can't be determined
+long ResidentMemoryKB(){
+#ifdef __linux__
+	FILE *statm = fopen("/proc/self/statm", "r");
+	if(statm == NULL)
+		return -1;
+	long pages = -1, resident = -1;
+	int read = fscanf(statm, "%ld %ld", &pages, &resident);
+	fclose(statm);
+	if(read != 2)
+		return -1;
+	return resident * (sysconf(_SC_PAGESIZE) / 1024);
+#else
+	return -1;
+#endif
+	}
+
 void SampleBranchLengthCurve(FLOAT_TYPE (*func)(TreeNode*, Tree*, FLOAT_TYPE, bool), TreeNode *thisnode, Tree *thistree){
 	for(FLOAT_TYPE len=(FLOAT_TYPE)effectiveMin;len<(FLOAT_TYPE)effectiveMax;len*=2.0)
 		(*func)(thisnode, thistree, len, true);
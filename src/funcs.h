@@ -150,6 +150,10 @@ void DirichletRandomVariable (FLOAT_TYPE *alp, FLOAT_TYPE *z, int n);
 
 void InferStatesFromCla(vector<InternalState> &stateVec, const FLOAT_TYPE *cla, int nchar, int nstates);
 FLOAT_TYPE CalculateHammingDistance(const char *str1, const char *str2, const int *counts, int nchar, int nstates);
+void CalculatePairwiseDistances(const DataPartition *dataPart, int nTax, FLOAT_TYPE **dist);
+void MakeBionjTreeString(FLOAT_TYPE **dist, int nTax, FLOAT_TYPE minLen, FLOAT_TYPE maxLen, string &newick);
+long PeakResidentMemoryKB();
+long ResidentMemoryKB();
 
 void SampleBranchLengthCurve(FLOAT_TYPE (*func)(TreeNode*, Tree*, FLOAT_TYPE, bool), TreeNode *thisnode, Tree *thistree);
 
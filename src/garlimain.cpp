@@ -36,6 +36,8 @@
 #include "mpi.h"
 #endif
 
+#include <sstream>
+
 #include "defs.h"
 #include "population.h"
 #include "individual.h"
@@ -47,6 +49,10 @@
 #include "tree.h"
 #include "errorexception.h"
 #include "outputman.h"
+#include "patterncache.h"
+#ifdef GARLI_BENCH
+#include "kernelbench.h"
+#endif
 
 #ifdef WIN32
 #include <process.h>
@@ -133,6 +139,13 @@ void UsageMessage(char *execName){
 	outman.UserMessage("  mpirun [MPI OPTIONS] %s -[# of times to execute config file]", execName);
 	outman.UserMessage("Specifying the number of times to execute the config file is mandatory.");
 	outman.UserMessage("This version will expect a config file named \"garli.conf\".");
+	outman.UserMessage("When more than one process is used, process 0 only hands out runs to the others");
+	outman.UserMessage("as they become free.  Runs that were completed by an earlier invocation in the");
+	outman.UserMessage("same directory (recorded in \"mpi_jobs.journal\") are not repeated.");
+	outman.UserMessage("\nAlternatively, for datasets too large for the memory of one machine, use");
+	outman.UserMessage("  mpirun [MPI OPTIONS] %s --splitpatterns", execName);
+	outman.UserMessage("to do a single search with the data patterns divided among all of the processes.");
+	outman.UserMessage("Each only holds and calculates the likelihood for its share of the patterns.");
 	outman.UserMessage("Consult your cluster documentation for details on running MPI jobs\n");
 #elif defined (OLD_SUBROUTINE_GARLI)
 	OutputVersion();
@@ -145,6 +158,8 @@ void UsageMessage(char *execName){
 	outman.UserMessage("Most likely it will look something like the following:");
 	outman.UserMessage("  mpirun [MPI OPTIONS] %s [# of provided config files]", execName);
 	outman.UserMessage("This version will expect config files named \"run0.conf\", \"run1.conf\", etc.");
+	outman.UserMessage("When more than one process is used, process 0 only hands out runs to the others");
+	outman.UserMessage("as they become free.");
 	outman.UserMessage("Consult your cluster documentation for details on running MPI jobs\n");
 #else
 	outman.UserMessage    ("Usage: %s [OPTION] [config filename]", execName);
@@ -162,6 +177,11 @@ void UsageMessage(char *execName){
 	outman.UserMessage                 ("				and constraint files, print required memory and selected model, then exit");
 #ifdef CUDA_GPU
 	outman.UserMessage    ("  --device d_number	use specified CUDA device");
+#endif
+#ifdef GARLI_BENCH
+	KernelBenchmark::Usage();
+	outman.UserMessage("The benchmark writes its own data, starting tree and config, so no config file is needed.\n");
+	return;
 #endif
 	outman.UserMessage("NOTE: If no config filename is passed on the command line the program\n   will look in the current directory for a file named \"garli.conf\"\n");
 #endif
@@ -187,7 +207,7 @@ int boinc_garli_main( int argc, char* argv[] )	{
 	outman.SetNoOutput(true);
 
 #elif defined( SUBROUTINE_GARLI ) || defined(OLD_SUBROUTINE_GARLI)
-int SubGarliMain(int rank)	
+int SubGarliMain(int rank, int jobSeed)	
 	{
 	int argc=1;
 	char **argv=NULL;
@@ -239,6 +259,9 @@ int main( int argc, char* argv[] )	{
 
 	bool runTests = false;
 	bool validateMode = false;
+#ifdef GARLI_BENCH
+	KernelBenchmark bench;
+#endif
     if (argc > 1) {
     	int curarg=1;
         while(curarg<argc){
@@ -288,6 +311,10 @@ int main( int argc, char* argv[] )	{
 						validateMode = true;
 #ifdef CUDA_GPU
 					else if(!_stricmp(argv[curarg], "--device")) cuda_device_number = atoi(argv[++curarg]);
+#endif
+#ifdef GARLI_BENCH
+					else if(bench.ParseArgument(argc, argv, curarg))
+						;//the option and its value have been read
 #endif
 					else {
 						outman.UserMessage("Unknown command line option %s", argv[curarg]);
@@ -314,6 +341,11 @@ int main( int argc, char* argv[] )	{
 		try{
 			MasterGamlConfig conf;
 			bool confOK;
+#ifdef GARLI_BENCH
+			conf_name = bench.WriteSyntheticInput();
+			if(bench.SimulateOnly())
+				return 0;
+#endif
 			confOK = ((conf.Read(conf_name.c_str()) < 0) == false);
 
 #ifdef SUBROUTINE_GARLI
@@ -322,10 +354,23 @@ int main( int argc, char* argv[] )	{
 			if(rank < 10) sprintf(temp, ".run0%d", rank);
 			else sprintf(temp, ".run%d", rank);
 			conf.ofprefix += temp;
+			//when the patterns are divided among processes they all run the same search, and only the first
+			//writes the normal output files
+			if(Tree::patternSlice > 0){
+				char sliceStr[20];
+				sprintf(sliceStr, ".slice%d", Tree::patternSlice);
+				conf.ofprefix += sliceStr;
+				}
 #endif
 
 			// now set the random seed
 			int randomSeed;
+#if defined(SUBROUTINE_GARLI) || defined(OLD_SUBROUTINE_GARLI)
+			//the MPI scheduler hands each job its own seed
+			if(conf.randseed < 1 && jobSeed > 0)
+				randomSeed = jobSeed;
+			else
+#endif
 			if(conf.randseed < 1){
 				//Add in the pid with the time to get the seed.  Otherwise forking a bunch
 				//of runs simultaneously has a good chance of giving identical seeds
@@ -390,6 +435,8 @@ int main( int argc, char* argv[] )	{
 
 			if(conf.restart) outman.SetLogFileForAppend(temp_buf);
 			else outman.SetLogFile(temp_buf);
+			if(Tree::patternSlice > 0)
+				outman.SetNoOutput(true);
 
 			outman.UserMessage("Running %s Version %s.%s.%s (%s)", PROGRAM_NAME, MAJOR_VERSION, MINOR_VERSION, svnRev.c_str(), svnDate.c_str());
 
@@ -466,30 +513,74 @@ int main( int argc, char* argv[] )	{
 			//read the datafile with the NCL-based GarliReader - should allow nexus, phylip and fasta
 			outman.UserMessage("###################################################\nREADING OF DATA");
 			GarliReader &reader = GarliReader::GetInstance();
-			bool usedNCL = reader.ReadData(datafile.c_str(), *modSpecSet.GetModSpec(0));
+			bool usedNCL;
+			//packed nucleotide and amino acid subsets can be read from or written to a cache of the processed patterns.
+			//If the cache holds all of the data the datafile isn't read at all.
+			PatternCache patCache;
+			bool allFromPatternCache = false;
+			if(conf.patternCache){
+				string settings = (conf.usePatternManager ? "patman" : "nopatman");
+				for(vector<ConfigModelSettings>::iterator cit = conf.configModelSets.begin();cit != conf.configModelSets.end();cit++)
+					settings += " " + (*cit).datatype;
+				patCache.Initialize(datafile, settings);
+				allFromPatternCache = patCache.HoldsAllData() && conf.usePatternManager;
+				}
+			//large unpartitioned fasta or phylip alignments can optionally be read straight into the pattern manager,
+			//leaving NCL to only create the taxa block.  If that fails for any reason NCL reads the file as usual.
+			SequenceData *plainData = NULL;
+			const ModelSpecification *firstSpec = modSpecSet.GetModSpec(0);
+			if(!allFromPatternCache && conf.streamingReader && conf.usePatternManager && conf.configModelSets.size() == 1 && FileExists(datafile.c_str()) && !FileIsNexus(datafile.c_str())
+				&& (firstSpec->IsNucleotide() || (firstSpec->IsAminoAcid() && firstSpec->IsCodonAminoAcid() == false))){
+				if(firstSpec->IsAminoAcid())
+					plainData = new AminoacidData();
+				else
+					plainData = new NucleotideData();
+				plainData->SetUsePatternManager(true);
+				if(plainData->ReadPlainAlignment(datafile.c_str(), FileIsFasta(datafile.c_str())))
+					reader.CreateTaxaBlockFromMatrix(plainData);
+				else{
+					delete plainData;
+					plainData = NULL;
+					}
+				}
+			if(plainData != NULL)
+				usedNCL = true;
+			else if(allFromPatternCache){
+				//the taxa block is created once the first subset has been read
+				outman.UserMessage("Reading data from pattern cache file %s.garli-pack\n\t(delete it to force the datafile to be reread)", datafile.c_str());
+				usedNCL = true;
+				}
+			else
+				usedNCL = reader.ReadData(datafile.c_str(), *modSpecSet.GetModSpec(0));
 			if(! usedNCL) 
 				throw ErrorException("There was a problem reading the data file.");
 			
 			//assuming a single taxa block
 			if(reader.GetNumTaxaBlocks() > 1) throw ErrorException("Expecting only one taxa block in datafile");
-			NxsTaxaBlock *taxblock = reader.GetTaxaBlock(0);
+			NxsTaxaBlock *taxblock = (allFromPatternCache ? NULL : reader.GetTaxaBlock(0));
 
 			//currently data subsets will be created for each separate characters block, and/or for each
 			//part of a char partition within a characters block
-			int numCharBlocks = reader.GetNumCharactersBlocks(taxblock);
-			if(numCharBlocks == 0) throw ErrorException("No character data (in characters/data blocks) found in datafile");
+			int numCharBlocks = (plainData != NULL ? 1 : (allFromPatternCache ? 0 : reader.GetNumCharactersBlocks(taxblock)));
+			if(numCharBlocks == 0 && !allFromPatternCache) throw ErrorException("No character data (in characters/data blocks) found in datafile");
 			vector<pair<NxsCharactersBlock *, NxsUnsignedSet> > effectiveMatrices;
+			//the subsets in a pattern cache were recorded when it was written, and have no characters blocks
+			for(int s = 0;s < (allFromPatternCache ? patCache.NumSubsets() : 0);s++){
+				dataSubInfo.push_back(patCache.SubsetInfo(s));
+				effectiveMatrices.push_back(make_pair((NxsCharactersBlock *) NULL, NxsUnsignedSet()));
+				}
 
 			outman.UserMessage("\n###################################################\nPARTITIONING OF DATA AND MODELS");
 			//loop over characters blocks
 			for(int c = 0;c < numCharBlocks;c++){
-				NxsCharactersBlock *charblock = reader.GetCharactersBlock(taxblock, c);
-				string cbName = charblock->GetTitle();
+				//there is no characters block for data from the streaming reader
+				NxsCharactersBlock *charblock = (plainData != NULL ? NULL : reader.GetCharactersBlock(taxblock, c));
+				string cbName = (charblock != NULL ? charblock->GetTitle() : "");
 				NxsAssumptionsBlock *assblock = NULL;
 				NxsUnsignedSet charSet;
 				bool foundCharPart = false;
 
-				int numAssBlocks = reader.GetNumAssumptionsBlocks(charblock);
+				int numAssBlocks = (charblock != NULL ? reader.GetNumAssumptionsBlocks(charblock) : 0);
 				if(numAssBlocks > 0){
 					//loop over assumptions blocks for this charblock
 					for(int a = 0;a < numAssBlocks;a++){
@@ -620,10 +711,12 @@ int main( int argc, char* argv[] )	{
 				//for nstate data the effective matrices will be further broken up into implied matrices that each have the same number of observed states
 				//the implied matrix number will be that number of states
 				int actuallyUsedImpliedMatrixIndex = 0;
-				int maxObservedStates = effectiveMatrices[dataChunk].first->GetMaxObsNumStates(false);
+				int maxObservedStates = (effectiveMatrices[dataChunk].first == NULL ? 0 : effectiveMatrices[dataChunk].first->GetMaxObsNumStates(false));
 				//for Mk the impliedMatrix number is the number of states
 				for(int impliedMatrix = 2;impliedMatrix < (modSpec->IsMkTypeModel() ? maxObservedStates + 1 : 3);impliedMatrix++){
-					if(modSpec->IsMkTypeModel() && !modSpec->IsOrientedGap()){
+					if(plainData != NULL)
+						data = plainData;
+					else if(modSpec->IsMkTypeModel() && !modSpec->IsOrientedGap()){
 						bool isOrdered = (modSpec->IsOrderedNState() || modSpec->IsOrderedNStateV());
 						bool isBinary = modSpec->IsBinary() || modSpec->IsBinaryNotAllZeros();
 						bool isConditioned =  (modSpec->IsNStateV() || modSpec->IsOrderedNStateV() || modSpec->IsBinaryNotAllZeros());
@@ -644,8 +737,31 @@ int main( int argc, char* argv[] )	{
 					else
 						data->SetUsePatternManager(0);
 					
+					bool cacheable = patCache.Enabled() && plainData == NULL && data->GetUsePatternManager() && (modSpec->IsNucleotide() || (modSpec->IsAminoAcid() && modSpec->IsCodonAminoAcid() == false));
+					PackKey subsetKey = 0;
+					if(allFromPatternCache){
+						if(!cacheable)
+							throw ErrorException("Pattern cache file %s.garli-pack does not match the model settings.\n\tDelete it and it will be recreated.", datafile.c_str());
+						subsetKey = patCache.SubsetKey(dataChunk);
+						}
+					else if(cacheable){
+						stringstream subsetStr;
+						subsetStr << dataChunk << " " << dataSubInfo[dataChunk].charblockName;
+						for(NxsUnsignedSet::const_iterator sit = effectiveMatrices[dataChunk].second.begin();sit != effectiveMatrices[dataChunk].second.end();sit++)
+							subsetStr << " " << *sit;
+						subsetKey = PatternCache::Hash(subsetStr.str());
+						}
+					bool fromCache = cacheable && patCache.ReadSubset(subsetKey, data);
+					if(allFromPatternCache){
+						if(!fromCache)
+							throw ErrorException("Pattern cache file %s.garli-pack appears to be corrupt.\n\tDelete it and it will be recreated.", datafile.c_str());
+						if(dataChunk == 0)
+							reader.CreateTaxaBlockFromMatrix(data);
+						}
+
 					//if no charpart was specified, the second argument here will be empty
-					data->CreateMatrixFromNCL(effectiveMatrices[dataChunk].first, effectiveMatrices[dataChunk].second);
+					if(fromCache == false && plainData == NULL)
+						data->CreateMatrixFromNCL(effectiveMatrices[dataChunk].first, effectiveMatrices[dataChunk].second);
 
 #ifdef SINGLE_PRECISION_FLOATS
 					if(modSpec->IsMkTypeModel() || modSpec->IsOrientedGap()) throw ErrorException("Sorry, Mk/Mkv type models have not yet been tested with single precision.");
@@ -740,7 +856,12 @@ int main( int argc, char* argv[] )	{
 							data->EliminateAdjacentIdenticalColumns();
 							}
 
-						data->ProcessPatterns();
+						if(fromCache)
+							data->FinishPatternProcessing();
+						else
+							data->ProcessPatterns();
+						if(cacheable)
+							patCache.AddSubset(subsetKey, dataSubInfo[dataChunk], data);
 
 						dataSubInfo[dataChunk + actuallyUsedImpliedMatrixIndex].totalCharacters = data->TotalNChar();
 						dataSubInfo[dataChunk + actuallyUsedImpliedMatrixIndex].uniqueCharacters = data->NChar();
@@ -760,6 +881,17 @@ int main( int argc, char* argv[] )	{
 							modSpecSet.SetInferSubsetRates(true);
 				}
 			
+			if(Tree::patternSlice == 0){
+				//the cache can only stand in for the datafile if it holds every subset, and nothing else (trees,
+				//a garli block or taxa missing from the matrices) came from the datafile
+				bool allData = allFromPatternCache;
+				if(!allData && patCache.NumAddedSubsets() == dataPart.NumSubsets() && rawPart.NumSubsets() == 0 && plainData == NULL){
+					NxsTaxaBlock *tax = reader.GetTaxaBlock(0);
+					allData = (reader.GetNumTreesBlocks(tax) == 0 && reader.FoundModelString() == false && (int) tax->GetNTax() == dataPart.NTax());
+					}
+				patCache.Write(allData);
+				}
+
 			//this depends on the fact that an extra taxon slot was allocated but not yet used
 			if(modSpecSet.AnyOrientedGap()){
 				NxsTaxaBlock *tax = reader.GetTaxaBlock(0);
@@ -767,6 +899,15 @@ int main( int argc, char* argv[] )	{
 					dataPart.AddDummyRoots();
 				}
 	
+			//each process keeps only its slice of the patterns of every subset, which is all that its CLAs need to hold
+			if(Tree::numPatternSlices > 1){
+				dataPart.KeepPatternSlice(Tree::patternSlice, Tree::numPatternSlices);
+				int kept = 0;
+				for(int p = 0;p < dataPart.NumSubsets();p++)
+					kept += dataPart.GetSubset(p)->NChar() - dataPart.GetSubset(p)->NumConditioningPatterns();
+				outman.UserMessage("\nPatterns divided among %d processes, with %d of them calculated by this one", Tree::numPatternSlices, kept);
+				}
+
 			outman.UserMessage("\n###################################################");
 			//could deallocate the storage in the NCL reader here, which saves a bit of memory but isn't critical
 			//reader.DeleteCharacterBlocksFromFactories();
@@ -777,6 +918,11 @@ int main( int argc, char* argv[] )	{
 			pop->Setup(&conf, &dataPart, &rawPart, 1, (validateMode == true ? -1 : 0));
 			pop->SetOutputDetails();
 
+#ifdef GARLI_BENCH
+			outman.UserMessage("STARTING KERNEL BENCHMARKS");
+			bench.Run(pop);
+			return 0;
+#endif
 			outman.UserMessage("STARTING RUN");
 			if(runTests){
 				outman.UserMessage("starting internal tests...");
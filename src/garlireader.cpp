@@ -43,6 +43,7 @@
 #include "outputman.h"
 #include "errorexception.h"
 #include "model.h"
+#include "datamatr.h"
 #include <sstream>
 #include <cassert>
 
@@ -380,11 +381,11 @@ bool GarliReader::ReadData(const char* filename, const ModelSpecification &mSpec
 					outman.UserMessage("Problem reading data file as %s format...\n", (*formIt).second.c_str());
 					success = false;
 					}
-			catch(ErrorException &err){
-				//Sometimes NCL raises a NxsException, but then catches it and passes it onto my NexusError,
-				//which throws an ErrorException.  So, need to catch both types of exceptions here
-				outman.UserMessage("Problem reading data file as %s format...\n", (*formIt).second.c_str());
-				success = false;
+			catch(ErrorException &err){
+				//Sometimes NCL raises a NxsException, but then catches it and passes it onto my NexusError,
+				//which throws an ErrorException.  So, need to catch both types of exceptions here
+				outman.UserMessage("Problem reading data file as %s format...\n", (*formIt).second.c_str());
+				success = false;
 				}
 			if(success) break;
 			}
@@ -396,6 +397,29 @@ bool GarliReader::ReadData(const char* filename, const ModelSpecification &mSpec
 	return true;
 	}
 
+void GarliReader::CreateTaxaBlockFromMatrix(const DataMatrix *dat){
+	//the matrix labels are already escaped for Nexus
+	string nex = "#NEXUS\nbegin taxa;\ndimensions ntax=";
+	char num[20];
+	sprintf(num, "%d", dat->NTax());
+	nex += num;
+	nex += ";\ntaxlabels";
+	for(int t = 0;t < dat->NTax();t++){
+		nex += " ";
+		nex += dat->TaxonLabel(t);
+		}
+	nex += ";\nend;\n";
+
+	istringstream inf(nex);
+	MyNexusToken token(inf);
+	try{
+		Execute(token);
+		}
+	catch(NxsException &x){
+		throw ErrorException("Problem creating taxa block: %s", x.msg.c_str());
+		}
+	}
+
 //verifies that we got the right number/type of blocks and returns the Characters block to be used
 const NxsCharactersBlock *GarliReader::CheckBlocksAndGetCorrectCharblock(const ModelSpecification &mSpec) const{
 	const int numTaxaBlocks = GetNumTaxaBlocks();
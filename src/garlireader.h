@@ -46,6 +46,7 @@
 #include "nxsmultiformat.h"
 
 class ModelSpecification;
+class DataMatrix;
 
 //the reader is no longer derived from NexusBlock itself which was done such that it was it's own
 //custom block (a bit weird).  Garli block is separate entity now.
@@ -196,6 +197,8 @@ class GarliReader
 		//Garli's matrices are created
 		void DeleteCharacterBlocksFromFactories();
 		bool ReadData(const char* filename, const ModelSpecification &modspec);
+		//builds a taxa block for data that was read without NCL, since trees and outgroups are resolved against it
+		void CreateTaxaBlockFromMatrix(const DataMatrix *dat);
 		const NxsCharactersBlock *CheckBlocksAndGetCorrectCharblock(const ModelSpecification &modspec) const;
 		static string GetDefaultIntWeightSet(const NxsCharactersBlock *charblock, vector<int> &wset);
 		};
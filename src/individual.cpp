@@ -124,6 +124,28 @@ void Individual::DuplicateIndivWithoutCLAs(const Individual *sourceOfInformation
 	treeStruct->modPart = &modPart;
 	}
 
+void Individual::Pack(PackedIndividual &packed) const{
+	treeStruct->PackTopology(packed);
+	packed.modelParams.clear();
+	modPart.PackParameters(packed.modelParams);
+	if(!dirty)
+		packed.lnL = fitness;
+	}
+
+//replaces the tree and model with packed ones, which needs a tree to already exist and new clas
+void Individual::Unpack(const PackedIndividual &packed){
+	assert(treeStruct != NULL);
+	modPart.UnpackParameters(packed.modelParams);
+	treeStruct->RemoveTreeFromAllClas();
+	treeStruct->UnpackTopology(packed);
+	treeStruct->AssignCLAsFromMaster();
+	treeStruct->modPart = &modPart;
+	treeStruct->root->CheckTreeFormation();
+	mutation_type = 0;
+	parent = -1;
+	SetDirty();
+	}
+
 void Individual::Mutate(FLOAT_TYPE optPrecision, Adaptation *adap){
 	//this is the original version of mutate, and will be called by both 
 	//master and remote when they are mutating a tree that does not have
@@ -286,6 +308,20 @@ void Individual::MakeRandomTree(int nTax){
 	treeStruct->AssignCLAsFromMaster();
 	}
 
+//builds a BIONJ tree from corrected pairwise distances.  If a dummy root taxon is being used it is left out
+//of the distance calculations, and is attached by the Tree constructor
+void Individual::MakeBionjTree(int nTax){
+	int numRealTax = (Tree::rootWithDummy ? nTax - 1 : nTax);
+	FLOAT_TYPE **dist = New2DArray<FLOAT_TYPE>(numRealTax, numRealTax);
+	CalculatePairwiseDistances(Tree::dataPart, numRealTax, dist);
+	string newick;
+	MakeBionjTreeString(dist, numRealTax, Tree::min_brlen, Tree::max_brlen, newick);
+	Delete2DArray(dist);
+
+	treeStruct = new Tree(newick.c_str(), true, false);
+	treeStruct->AssignCLAsFromMaster();
+	}
+
 void Individual::MakeStepwiseTree(int nTax, int attachesPerTaxon, FLOAT_TYPE optPrecision ){
 	treeStruct=new Tree();
 	treeStruct->modPart = &modPart;
@@ -744,7 +780,7 @@ void Individual::RefineStartingConditions(bool optModel, FLOAT_TYPE branchPrec){
 		CalcFitness(0);
 		FLOAT_TYPE passStart=Fitness();
 		
-		optImprove=treeStruct->OptimizeAllBranches(branchPrec);
+		optImprove=treeStruct->OptimizeAllBranchesFullTree(branchPrec);
 		CalcFitness(0);
 
 		FLOAT_TYPE trueImprove= Fitness() - passStart;
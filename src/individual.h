@@ -119,9 +119,12 @@ class Individual
 		void CopySecByStealingFirstTree(Individual * sourceOfTreePtr, const Individual *sourceOfInformation);
 		void CopySecByRearrangingNodesOfFirst(Tree * sourceOfTreePtr, const Individual *sourceOfInformation, bool CLAassigned=false);
 		void DuplicateIndivWithoutCLAs(const Individual *sourceOfInformation);
+		void Pack(PackedIndividual &packed) const;
+		void Unpack(const PackedIndividual &packed);
 		void ResetIndiv();
 		void MakeRandomTree(int nTax);
 		void MakeStepwiseTree(int nTax, int attemptsPerTaxon, FLOAT_TYPE optPrecision );
+		void MakeBionjTree(int nTax);
 	};
 
 
@@ -0,0 +1,539 @@
+// GARLI version 2.0 source code
+// Copyright 2005-2011 Derrick J. Zwickl
+// email: garli.support@gmail.com
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include "defs.h"
+#include "kernelbench.h"
+#include "population.h"
+#include "individual.h"
+#include "tree.h"
+#include "model.h"
+#include "condlike.h"
+#include "clamanager.h"
+#include "datamatr.h"
+#include "sequencedata.h"
+#include "profiler.h"
+#include "outputman.h"
+#include "errorexception.h"
+
+extern OutputManager outman;
+
+static const char *nucStates = "ACGT";
+static const char *aaStates = "ARNDCQEGHILKMFPSTWYV";
+
+//the sense codons of the standard code, in the order that the codon states are numbered
+static const char *SenseCodon(int state){
+	static vector<string> codons;
+	if(codons.empty()){
+		for(int c = 0;c < 64;c++){
+			string cod;
+			cod += nucStates[c / 16];
+			cod += nucStates[(c / 4) % 4];
+			cod += nucStates[c % 4];
+			if(cod != "TAA" && cod != "TAG" && cod != "TGA")
+				codons.push_back(cod);
+			}
+		}
+	return codons[state].c_str();
+	}
+
+KernelBenchmark::KernelBenchmark() : prefix("garli-bench"), ntax(32), nchar(10000), datatype("dna"), rateCats(4), partitions(1), seed(1),
+	minSeconds(0.5), simulateOnly(false), nstates(4), tree(NULL), first(NULL), second(NULL), dest(NULL), sink(ZERO_POINT_ZERO){
+	}
+
+KernelBenchmark::~KernelBenchmark(){
+	delete first;
+	delete second;
+	delete dest;
+	}
+
+bool KernelBenchmark::ParseArgument(int argc, char **argv, int &curarg){
+	const char *opt = argv[curarg];
+	if(!_stricmp(opt, "--simulateonly")){
+		simulateOnly = true;
+		return true;
+		}
+	if(_stricmp(opt, "--taxa") && _stricmp(opt, "--sites") && _stricmp(opt, "--datatype") && _stricmp(opt, "--ratecats")
+		&& _stricmp(opt, "--partitions") && _stricmp(opt, "--seed") && _stricmp(opt, "--mintime") && _stricmp(opt, "--prefix"))
+		return false;
+	//a missing value is left as an empty string and caught by the checks in WriteSyntheticInput
+	const char *val = (curarg + 1 < argc ? argv[++curarg] : "");
+	if(!_stricmp(opt, "--taxa")) ntax = atoi(val);
+	else if(!_stricmp(opt, "--sites")) nchar = atoi(val);
+	else if(!_stricmp(opt, "--datatype")) datatype = val;
+	else if(!_stricmp(opt, "--ratecats")) rateCats = atoi(val);
+	else if(!_stricmp(opt, "--partitions")) partitions = atoi(val);
+	else if(!_stricmp(opt, "--seed")) seed = atoi(val);
+	else if(!_stricmp(opt, "--mintime")) minSeconds = atof(val);
+	else prefix = val;
+	return true;
+	}
+
+void KernelBenchmark::Usage(){
+	outman.UserMessage("Benchmark options (garli-bench):");
+	outman.UserMessage("  --taxa <n>          number of simulated taxa (default 32)");
+	outman.UserMessage("  --sites <n>         number of simulated sites, codons for codon data (default 10000)");
+	outman.UserMessage("  --datatype <type>   dna, aa or codon (default dna)");
+	outman.UserMessage("  --ratecats <n>      rate categories, 1 for none (default 4)");
+	outman.UserMessage("  --partitions <n>    number of equal sized data subsets (default 1)");
+	outman.UserMessage("  --seed <n>          seed for the simulation and the run (default 1)");
+	outman.UserMessage("  --mintime <s>       minimum seconds spent timing each kernel (default 0.5)");
+	outman.UserMessage("  --prefix <name>     prefix of the generated input files and the .json results (default garli-bench)");
+	outman.UserMessage("  --simulateonly      write the data, tree and config and exit without timing anything");
+	}
+
+//random joining of subtrees, with the last three joined at a trifurcating root
+void KernelBenchmark::MakeRandomTree(){
+	vector<int> active;
+	for(int t = 0;t < ntax;t++)
+		active.push_back(t);
+	children.clear();
+	blens.assign(2 * ntax, 0.0);
+	while(active.size() > 3){
+		vector<int> kids;
+		for(int k = 0;k < 2;k++){
+			int a = simRnd.random_int((int) active.size());
+			kids.push_back(active[a]);
+			active.erase(active.begin() + a);
+			}
+		children.push_back(kids);
+		active.push_back(ntax + (int) children.size() - 1);
+		}
+	children.push_back(active);
+	for(int n = 0;n < (int) blens.size();n++)
+		blens[n] = max(0.001, (double) simRnd.exponential(20.0));
+	}
+
+//Jukes-Cantor like evolution among the states, each site scaled by its rate
+void KernelBenchmark::Simulate(int node, const vector<double> &siteRates){
+	const vector<int> &kids = children[node - ntax];
+	for(vector<int>::const_iterator it = kids.begin();it != kids.end();it++){
+		vector<unsigned char> &seq = seqs[*it];
+		seq = seqs[node];
+		double scale = nstates / (nstates - 1.0);
+		for(int s = 0;s < (int) seq.size();s++){
+			if(simRnd.uniform() < 1.0 - exp(-scale * blens[*it] * siteRates[s]))
+				seq[s] = (unsigned char) simRnd.random_int(nstates);
+			}
+		if(*it >= ntax)
+			Simulate(*it, siteRates);
+		}
+	}
+
+void KernelBenchmark::WriteNewick(ostream &out, int node) const{
+	if(node < ntax){
+		out << "t" << node + 1;
+		return;
+		}
+	const vector<int> &kids = children[node - ntax];
+	out << "(";
+	for(unsigned k = 0;k < kids.size();k++){
+		if(k > 0)
+			out << ",";
+		WriteNewick(out, kids[k]);
+		out << ":" << blens[kids[k]];
+		}
+	out << ")";
+	}
+
+string KernelBenchmark::StateString(int taxon) const{
+	string str;
+	const vector<unsigned char> &seq = seqs[taxon];
+	for(vector<unsigned char>::const_iterator it = seq.begin();it != seq.end();it++){
+		if(datatype == "codon")
+			str += SenseCodon(*it);
+		else if(datatype == "aa")
+			str += aaStates[*it];
+		else
+			str += nucStates[*it];
+		}
+	return str;
+	}
+
+void KernelBenchmark::WriteData(const string &name) const{
+	ofstream out(name.c_str());
+	if(!out.good())
+		throw ErrorException("could not open %s for writing", name.c_str());
+	int width = (datatype == "codon" ? 3 : 1);
+	out << "#NEXUS\n\nbegin data;\ndimensions ntax=" << ntax << " nchar=" << nchar * width << ";\n";
+	out << "format datatype=" << (datatype == "aa" ? "protein" : "dna") << " missing=? gap=-;\nmatrix\n";
+	for(int t = 0;t < ntax;t++)
+		out << "t" << t + 1 << " " << StateString(t) << "\n";
+	out << ";\nend;\n";
+	if(partitions > 1){
+		out << "\nbegin sets;\n";
+		for(int p = 0;p < partitions;p++)
+			out << "charset part" << p + 1 << " = " << (long) nchar * p / partitions * width + 1 << "-" << (long) nchar * (p + 1) / partitions * width << ";\n";
+		out << "charpartition bench = ";
+		for(int p = 0;p < partitions;p++)
+			out << (p > 0 ? ", " : "") << p + 1 << ":part" << p + 1;
+		out << ";\nend;\n";
+		}
+	out.close();
+	}
+
+void KernelBenchmark::WriteConfig(const string &name, const string &dataName, const string &treeName) const{
+	ofstream out(name.c_str());
+	if(!out.good())
+		throw ErrorException("could not open %s for writing", name.c_str());
+	//enough memory that the full set of clas for the population fits
+	double claMB = (double) nchar * nstates * rateCats * sizeof(FLOAT_TYPE) / (1024.0 * 1024.0);
+	int memory = max(256, (int) (claMB * ntax * 8) + 64);
+
+	out << "[general]\ndatafname = " << dataName << "\nconstraintfile = none\nstreefname = " << treeName << "\n";
+	out << "attachmentspertaxon = 50\nofprefix = " << prefix << "\nrandseed = " << seed << "\navailablememory = " << memory << "\n";
+	out << "logevery = 10\nsaveevery = 100\nrefineend = 0\nrefinestart = 0\noutputeachbettertopology = 0\noutputcurrentbesttopology = 0\n";
+	out << "enforcetermconditions = 1\ngenthreshfortopoterm = 100\nscorethreshforterm = 0.05\nsignificanttopochange = 0.01\n";
+	out << "outputphyliptree = 0\noutputmostlyuselessfiles = 0\nwritecheckpoints = 0\nrestart = 0\noutputsitelikelihoods = 0\n";
+	out << "collapsebranches = 1\nusepatternmanager = 1\nsearchreps = 1\n";
+	if(partitions > 1)
+		out << "linkmodels = 0\nsubsetspecificrates = 1\n";
+	out << "\n";
+	if(datatype == "codon"){
+		out << "datatype = codon\nratematrix = 2rate\nstatefrequencies = f3x4\n";
+		out << "ratehetmodel = " << (rateCats > 1 ? "nonsynonymous" : "none") << "\nnumratecats = " << rateCats << "\ninvariantsites = none\n";
+		}
+	else{
+		if(datatype == "aa")
+			out << "datatype = aminoacid\nratematrix = wag\nstatefrequencies = empirical\n";
+		else
+			out << "datatype = nucleotide\nratematrix = 6rate\nstatefrequencies = estimate\n";
+		out << "ratehetmodel = " << (rateCats > 1 ? "gamma" : "none") << "\nnumratecats = " << rateCats << "\ninvariantsites = none\n";
+		}
+
+	out << "\n[master]\nnindivs = 2\nholdover = 1\nselectionintensity = 0.5\nholdoverpenalty = 0\nstopgen = 1\nstoptime = 5000000\n\n";
+	out << "startoptprec = 0.5\nminoptprec = 0.01\nnumberofprecreductions = 1\ntreerejectionthreshold = 50.0\ntopoweight = 1.0\n";
+	out << "modweight = 0.05\nbrlenweight = 0.2\nrandnniweight = 0.1\nrandsprweight = 0.3\nlimsprweight =  0.6\nintervallength = 100\n";
+	out << "intervalstostore = 5\n\nlimsprrange = 6\nmeanbrlenmuts = 5\ngammashapebrlen = 1000\ngammashapemodel = 1000\n";
+	out << "uniqueswapbias = 0.1\ndistanceswapbias = 1.0\n\nbootstrapreps = 0\nresampleproportion = 1.0\ninferinternalstateprobs = 0\n";
+	out.close();
+	}
+
+string KernelBenchmark::WriteSyntheticInput(){
+	if(ntax < 4)
+		throw ErrorException("garli-bench needs at least 4 taxa (--taxa)");
+	if(nchar < 1)
+		throw ErrorException("garli-bench needs at least one site (--sites)");
+	if(rateCats < 1 || rateCats > 20)
+		throw ErrorException("--ratecats must be between 1 and 20");
+	if(partitions < 1 || partitions > nchar)
+		throw ErrorException("--partitions must be between 1 and the number of sites");
+	if(minSeconds <= 0.0)
+		throw ErrorException("--mintime must be greater than zero");
+	if(prefix.empty())
+		throw ErrorException("--prefix requires a value");
+	if(datatype == "dna")
+		nstates = 4;
+	else if(datatype == "aa")
+		nstates = 20;
+	else if(datatype == "codon")
+		nstates = 61;
+	else
+		throw ErrorException("unknown benchmark datatype \"%s\" (options are dna, aa and codon)", datatype.c_str());
+
+	simRnd.set_seed(seed);
+	MakeRandomTree();
+
+	int root = ntax + (int) children.size() - 1;
+	vector<double> siteRates(nchar, 1.0);
+	if(rateCats > 1)
+		for(int s = 0;s < nchar;s++)
+			siteRates[s] = simRnd.gamma(0.5);
+	seqs.assign(2 * ntax, vector<unsigned char>());
+	seqs[root].resize(nchar);
+	for(int s = 0;s < nchar;s++)
+		seqs[root][s] = (unsigned char) simRnd.random_int(nstates);
+	Simulate(root, siteRates);
+	//only the tips are needed from here on
+	seqs.resize(ntax);
+
+	string dataName = prefix + ".nex", treeName = prefix + ".tre", confName = prefix + ".conf";
+	WriteData(dataName);
+	ofstream tre(treeName.c_str());
+	tre << "#NEXUS\n\nbegin trees;\ntree sim = [&U] ";
+	WriteNewick(tre, root);
+	tre << ";\nend;\n";
+	tre.close();
+	WriteConfig(confName, dataName, treeName);
+	outman.UserMessage("Simulated %d taxa x %d %s sites (%d rate categories, %d subsets), written to %s", ntax, nchar, datatype.c_str(), rateCats, partitions, dataName.c_str());
+	return confName;
+	}
+
+void KernelBenchmark::CallKernel(int kernel, BenchSubset &sub){
+	CondLikeArray *L = first->GetCLA(sub.claIndex);
+	CondLikeArray *R = second->GetCLA(sub.claIndex);
+	CondLikeArray *D = dest->GetCLA(sub.claIndex);
+	int m = sub.modelIndex, d = sub.dataIndex;
+	FLOAT_TYPE d1 = ZERO_POINT_ZERO, d2 = ZERO_POINT_ZERO;
+
+	switch(kernel){
+		case TERM_TERM:
+			if(sub.isNucleotide)
+				tree->CalcFullCLATerminalTerminal(D, sub.Lpr, sub.Rpr, sub.tip1, sub.tip2, m, d);
+			else
+				tree->CalcFullCLATerminalTerminalNState(D, sub.Lpr, sub.Rpr, sub.tip1, sub.tip2, m, d);
+			break;
+		case INT_TERM:
+			if(sub.isNucleotide)
+				tree->CalcFullCLAInternalTerminal(D, L, sub.Lpr, sub.Rpr, sub.tip2, sub.ambig2, m, d);
+			else
+				tree->CalcFullCLAInternalTerminalNState(D, L, sub.Lpr, sub.Rpr, sub.tip2, m, d);
+			break;
+		case INT_INT:
+			if(sub.isNucleotide)
+				tree->CalcFullCLAInternalInternal(D, L, R, sub.Lpr, sub.Rpr, m, d);
+			else
+				tree->CalcFullCLAInternalInternalNState(D, L, R, sub.Lpr, sub.Rpr, m, d);
+			break;
+		case SCORE_TERM:
+			if(sub.isNucleotide)
+				sink = tree->GetScorePartialTerminalRateHet(L, sub.Lpr, sub.tip2, m, d);
+			else
+				sink = tree->GetScorePartialTerminalNState(L, sub.Lpr, sub.tip2, m, d);
+			break;
+		case SCORE_INT:
+			if(sub.isNucleotide)
+				sink = tree->GetScorePartialInternalRateHet(L, R, sub.Lpr, m, d);
+			else
+				sink = tree->GetScorePartialInternalNState(L, R, sub.Lpr, m, d);
+			break;
+		case DERIV_TERM:
+			if(sub.isNucleotide)
+				tree->GetDerivsPartialTerminal(L, **sub.prmat, **sub.deriv1, **sub.deriv2, sub.tip2, d1, d2, m, d, sub.ambig2);
+			else if(sub.rates > 1)
+				tree->GetDerivsPartialTerminalNStateRateHet(L, **sub.prmat, **sub.deriv1, **sub.deriv2, sub.tip2, d1, d2, m, d);
+			else
+				tree->GetDerivsPartialTerminalNState(L, **sub.prmat, **sub.deriv1, **sub.deriv2, sub.tip2, d1, d2, m, d);
+			sink = d1 + d2;
+			break;
+		case DERIV_INT:
+			if(sub.isNucleotide)
+				tree->GetDerivsPartialInternal(L, R, **sub.prmat, **sub.deriv1, **sub.deriv2, d1, d2, m, d);
+			else if(sub.rates > 1)
+				tree->GetDerivsPartialInternalNStateRateHet(L, R, **sub.prmat, **sub.deriv1, **sub.deriv2, d1, d2, m, d);
+			else
+				tree->GetDerivsPartialInternalNState(L, R, **sub.prmat, **sub.deriv1, **sub.deriv2, d1, d2, m, d);
+			sink = d1 + d2;
+			break;
+		case PMAT:
+			sub.mod->AltCalcPmat(0.1, sub.mod->pmat1);
+			break;
+		case EIGEN:
+			sub.mod->CalcEigenStuff();
+			break;
+		}
+	}
+
+//nominal counts for one call, per pattern and rate category for the CLA kernels
+double KernelBenchmark::Flops(int kernel, const BenchSubset &sub) const{
+	double n = sub.states, pr = (double) sub.patterns * sub.rates;
+	switch(kernel){
+		case TERM_TERM: return pr * n;
+		case INT_TERM: return pr * n * (2.0 * n + 1.0);
+		case INT_INT: return pr * n * (4.0 * n + 1.0);
+		case SCORE_TERM: return pr * 2.0 * n;
+		case SCORE_INT: return pr * (2.0 * n * n + 2.0 * n);
+		case DERIV_TERM: return pr * 6.0 * n;
+		case DERIV_INT: return pr * (6.0 * n * n + 6.0 * n);
+		case PMAT: return sub.rates * (2.0 * n * n * n + n);
+		case EIGEN: return 10.0 * n * n * n;
+		}
+	return 0.0;
+	}
+
+double KernelBenchmark::Bytes(int kernel, const BenchSubset &sub) const{
+	double n = sub.states, p = sub.patterns;
+	double cla = p * sub.rates * n * sizeof(FLOAT_TYPE) + p * sizeof(int);
+	switch(kernel){
+		case TERM_TERM: return cla + 2.0 * p;
+		case INT_TERM: return 2.0 * cla + p;
+		case INT_INT: return 3.0 * cla;
+		case SCORE_TERM: return cla + p;
+		case SCORE_INT: return 2.0 * cla;
+		case DERIV_TERM: return cla + p;
+		case DERIV_INT: return 2.0 * cla;
+		case PMAT: return (sub.rates + 2.0) * n * n * sizeof(MODEL_FLOAT);
+		case EIGEN: return 4.0 * n * n * sizeof(MODEL_FLOAT);
+		}
+	return 0.0;
+	}
+
+void KernelBenchmark::TimeKernel(int kernel, BenchSubset &sub, ostream &out, bool &firstResult){
+	static const char *nucNames[NUM_KERNELS] = {"CalcFullCLATerminalTerminal", "CalcFullCLAInternalTerminal", "CalcFullCLAInternalInternal",
+		"GetScorePartialTerminalRateHet", "GetScorePartialInternalRateHet", "GetDerivsPartialTerminal", "GetDerivsPartialInternal", "AltCalcPmat", "CalcEigenStuff"};
+	static const char *nstateNames[NUM_KERNELS] = {"CalcFullCLATerminalTerminalNState", "CalcFullCLAInternalTerminalNState", "CalcFullCLAInternalInternalNState",
+		"GetScorePartialTerminalNState", "GetScorePartialInternalNState", "GetDerivsPartialTerminalNState", "GetDerivsPartialInternalNState", "AltCalcPmat", "CalcEigenStuff"};
+	string name = (sub.isNucleotide ? nucNames[kernel] : nstateNames[kernel]);
+	if(!sub.isNucleotide && sub.rates > 1 && (kernel == DERIV_TERM || kernel == DERIV_INT))
+		name += "RateHet";
+
+	//one untimed call, then batches of doubling size until enough time has passed
+	CallKernel(kernel, sub);
+	unsigned long long calls = 0, batch = 1, elapsed = 0;
+	unsigned long long start = Profiler::Now();
+	do{
+		for(unsigned long long c = 0;c < batch;c++)
+			CallKernel(kernel, sub);
+		calls += batch;
+		batch *= 2;
+		elapsed = Profiler::Now() - start;
+		}while(elapsed < minSeconds * 1.0e9);
+
+	double seconds = elapsed * 1.0e-9;
+	double gflops = Flops(kernel, sub) * calls / seconds * 1.0e-9;
+	double gbs = Bytes(kernel, sub) * calls / seconds * 1.0e-9;
+	out << (firstResult ? "" : ",\n") << "\t\t{\"kernel\": " << Profiler::JSONString(name) << ", \"subset\": " << sub.specIndex;
+	out << ", \"patterns\": " << sub.patterns << ", \"states\": " << sub.states << ", \"rateCats\": " << sub.rates;
+	out << ", \"calls\": " << calls << ", \"seconds\": " << seconds << ", \"microsecondsPerCall\": " << seconds * 1.0e6 / calls;
+	out << ", \"gflops\": " << gflops << ", \"gbPerSec\": " << gbs << "}";
+	firstResult = false;
+	outman.UserMessage("%-42s %3d %12.3f us %9.3f GFLOP/s %9.3f GB/s", name.c_str(), sub.specIndex, seconds * 1.0e6 / calls, gflops, gbs);
+	}
+
+//collapsing, sorting and packing the whole simulated alignment, as done when the data is read
+void KernelBenchmark::TimePatternPacking(ostream &out, bool &firstResult){
+	//codon data is packed as the nucleotides that it is read as
+	int width = (datatype == "codon" ? 3 : 1);
+	int sites = nchar * width;
+	int maxStates = (datatype == "aa" ? 20 : 4);
+	vector<unsigned char> columns((size_t) sites * ntax);
+	for(int t = 0;t < ntax;t++){
+		for(int s = 0;s < nchar;s++){
+			if(datatype == "codon"){
+				const char *cod = SenseCodon(seqs[t][s]);
+				for(int pos = 0;pos < 3;pos++)
+					columns[(size_t) (s * 3 + pos) * ntax + t] = (unsigned char) (1 << (strchr(nucStates, cod[pos]) - nucStates));
+				}
+			else if(datatype == "aa")
+				columns[(size_t) s * ntax + t] = seqs[t][s];
+			else
+				columns[(size_t) s * ntax + t] = (unsigned char) (1 << seqs[t][s]);
+			}
+		}
+
+	PatternManager patman;
+	unsigned long long calls = 0, elapsed = 0;
+	unsigned long long start = Profiler::Now();
+	do{
+		patman.Initialize(ntax, maxStates, sites);
+		unsigned char *cols = patman.AllocateColumns(sites);
+		memcpy(cols, &columns[0], columns.size());
+		patman.ProcessPatterns();
+		calls++;
+		elapsed = Profiler::Now() - start;
+		}while(elapsed < minSeconds * 1.0e9);
+
+	double seconds = elapsed * 1.0e-9;
+	double gbs = (double) columns.size() * calls / seconds * 1.0e-9;
+	out << (firstResult ? "" : ",\n") << "\t\t{\"kernel\": \"PatternManager::ProcessPatterns\", \"subset\": -1, \"sites\": " << sites;
+	out << ", \"patterns\": " << patman.NChar() << ", \"calls\": " << calls << ", \"seconds\": " << seconds;
+	out << ", \"microsecondsPerCall\": " << seconds * 1.0e6 / calls << ", \"sitesPerSec\": " << (double) sites * calls / seconds;
+	out << ", \"gflops\": null, \"gbPerSec\": " << gbs << "}";
+	firstResult = false;
+	outman.UserMessage("%-42s %3d %12.3f us %9.3f Msites/s %9.3f GB/s", "PatternManager::ProcessPatterns", -1, seconds * 1.0e6 / calls, sites * calls / seconds * 1.0e-6, gbs);
+	}
+
+void KernelBenchmark::Run(Population *pop){
+	pop->SeedPopulationWithStartingTree(1);
+	tree = pop->indiv[0].treeStruct;
+	tree->Score();
+
+	//the benchmark's own clas, laid out like those of the ClaManager
+	CondLikeArraySet **sets[3] = {&first, &second, &dest};
+	for(int s = 0;s < 3;s++){
+		*sets[s] = new CondLikeArraySet;
+		for(vector<ClaSpecifier>::iterator specs = claSpecs.begin();specs != claSpecs.end();specs++){
+			const Model *mod = tree->modPart->GetModel((*specs).modelIndex);
+			(*sets[s])->AddCLA(new CondLikeArray(Tree::dataPart->GetSubset((*specs).dataIndex)->NChar(), mod->NStates(), mod->NRateCats()));
+			}
+		(*sets[s])->Allocate();
+		}
+
+	vector<BenchSubset> subs;
+	for(int c = 0;c < (int) claSpecs.size();c++){
+		BenchSubset sub;
+		sub.specIndex = c;
+		sub.modelIndex = claSpecs[c].modelIndex;
+		sub.dataIndex = claSpecs[c].dataIndex;
+		sub.claIndex = claSpecs[c].claIndex;
+		sub.mod = tree->modPart->GetModel(sub.modelIndex);
+		if(sub.mod->IsOrientedGap())
+			throw ErrorException("garli-bench does not handle gap models");
+		sub.isNucleotide = sub.mod->IsNucleotide();
+		sub.patterns = first->GetCLA(sub.claIndex)->NChar();
+		sub.states = sub.mod->NStates();
+		sub.rates = sub.mod->NRateCats();
+		sub.tip1 = tree->allNodes[1]->tipData[sub.dataIndex];
+		sub.tip2 = tree->allNodes[2]->tipData[sub.dataIndex];
+#ifdef OPEN_MP
+		sub.ambig2 = tree->allNodes[2]->ambigMap[sub.dataIndex];
+#else
+		sub.ambig2 = NULL;
+#endif
+		sub.mod->CalcDerivatives(0.1, sub.prmat, sub.deriv1, sub.deriv2);
+		sub.mod->CalcPmats(0.1, 0.05, sub.Lpr, sub.Rpr);
+
+		//fill the child clas from pairs of tips, so that they hold realistic values
+		char *tip3 = tree->allNodes[3]->tipData[sub.dataIndex], *tip4 = tree->allNodes[4]->tipData[sub.dataIndex];
+		if(sub.isNucleotide){
+			tree->CalcFullCLATerminalTerminal(first->GetCLA(sub.claIndex), sub.Lpr, sub.Rpr, sub.tip1, sub.tip2, sub.modelIndex, sub.dataIndex);
+			tree->CalcFullCLATerminalTerminal(second->GetCLA(sub.claIndex), sub.Lpr, sub.Rpr, tip3, tip4, sub.modelIndex, sub.dataIndex);
+			}
+		else{
+			tree->CalcFullCLATerminalTerminalNState(first->GetCLA(sub.claIndex), sub.Lpr, sub.Rpr, sub.tip1, sub.tip2, sub.modelIndex, sub.dataIndex);
+			tree->CalcFullCLATerminalTerminalNState(second->GetCLA(sub.claIndex), sub.Lpr, sub.Rpr, tip3, tip4, sub.modelIndex, sub.dataIndex);
+			}
+		subs.push_back(sub);
+		}
+
+	string name = prefix + ".json";
+	ofstream out(name.c_str());
+	if(!out.good())
+		throw ErrorException("could not open %s for writing", name.c_str());
+	out.setf(ios::fixed);
+	out.precision(6);
+#ifdef OPEN_MP
+	int threads = omp_get_max_threads();
+#else
+	int threads = 1;
+#endif
+	out << "{\n\t\"benchmark\": \"kernels\",\n\t\"taxa\": " << ntax << ",\n\t\"sites\": " << nchar << ",\n\t\"datatype\": " << Profiler::JSONString(datatype);
+	out << ",\n\t\"rateCats\": " << rateCats << ",\n\t\"partitions\": " << partitions << ",\n\t\"seed\": " << seed << ",\n\t\"threads\": " << threads;
+#ifdef SINGLE_PRECISION_FLOATS
+	out << ",\n\t\"precision\": \"single\"";
+#else
+	out << ",\n\t\"precision\": \"double\"";
+#endif
+	out << ",\n\t\"results\": [\n";
+
+	outman.UserMessage("\n%-42s %3s %15s %17s %14s", "kernel", "sub", "time/call", "rate", "bandwidth");
+	bool firstResult = true;
+	//the pmat and eigen kernels overwrite the model's matrices, so they go last
+	for(int k = 0;k < NUM_KERNELS;k++)
+		for(vector<BenchSubset>::iterator sit = subs.begin();sit != subs.end();sit++)
+			TimeKernel(k, *sit, out, firstResult);
+	TimePatternPacking(out, firstResult);
+	out << "\n\t]\n}" << endl;
+	out.close();
+	outman.UserMessage("\nResults written to %s", name.c_str());
+	}
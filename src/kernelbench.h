@@ -0,0 +1,120 @@
+// GARLI version 2.0 source code
+// Copyright 2005-2011 Derrick J. Zwickl
+// email: garli.support@gmail.com
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef GARLI_KERNELBENCH_H
+#define GARLI_KERNELBENCH_H
+
+#include <string>
+#include <vector>
+#include <ostream>
+
+#include "defs.h"
+#include "rng.h"
+
+using namespace std;
+
+class Population;
+class Tree;
+class Model;
+class CondLikeArraySet;
+
+//Timing of the individual likelihood kernels, for the garli-bench build (GARLI_BENCH defined).  A random tree and an
+//alignment simulated on it are written out along with a config that uses them, the normal data reading and population
+//setup is done on those files, and then each kernel is called repeatedly on its own with fixed inputs.  Rates are
+//reported from nominal floating point operation and memory traffic counts for one call, e.g. a CLA from two internal
+//children is about n*(4n+1) flops per pattern and rate category for n states, reading two CLAs and writing one.
+class KernelBenchmark{
+	enum{
+		TERM_TERM = 0,
+		INT_TERM,
+		INT_INT,
+		SCORE_TERM,
+		SCORE_INT,
+		DERIV_TERM,
+		DERIV_INT,
+		PMAT,
+		EIGEN,
+		NUM_KERNELS
+		};
+
+	//the fixed inputs for one data subset
+	struct BenchSubset{
+		int specIndex;
+		int modelIndex;
+		int dataIndex;
+		int claIndex;
+		Model *mod;
+		bool isNucleotide;
+		int patterns;
+		int states;
+		int rates;
+		FLOAT_TYPE *Lpr, *Rpr;
+		FLOAT_TYPE ***prmat, ***deriv1, ***deriv2;
+		char *tip1, *tip2;
+		unsigned *ambig2;
+		};
+
+	string prefix;
+	int ntax;
+	int nchar;
+	string datatype;
+	int rateCats;
+	int partitions;
+	int seed;
+	double minSeconds;
+	bool simulateOnly;
+
+	rng simRnd;
+	int nstates;
+	vector<vector<int> > children;	//for the internal nodes of the simulation tree, which are numbered from ntax
+	vector<double> blens;
+	vector<vector<unsigned char> > seqs;	//simulated states, one per taxon
+
+	Tree *tree;
+	CondLikeArraySet *first, *second, *dest;
+	volatile FLOAT_TYPE sink;
+
+	void MakeRandomTree();
+	void Simulate(int node, const vector<double> &siteRates);
+	void WriteNewick(ostream &out, int node) const;
+	string StateString(int taxon) const;
+	void WriteData(const string &name) const;
+	void WriteConfig(const string &name, const string &dataName, const string &treeName) const;
+
+	void CallKernel(int kernel, BenchSubset &sub);
+	double Flops(int kernel, const BenchSubset &sub) const;
+	double Bytes(int kernel, const BenchSubset &sub) const;
+	void TimeKernel(int kernel, BenchSubset &sub, ostream &out, bool &firstResult);
+	void TimePatternPacking(ostream &out, bool &firstResult);
+
+public:
+	KernelBenchmark();
+	~KernelBenchmark();
+	//consumes a benchmark command line option and its value, returning false for anything else
+	bool ParseArgument(int argc, char **argv, int &curarg);
+	static void Usage();
+	//writes the simulated data, tree and config, and returns the name of the config
+	string WriteSyntheticInput();
+	//only write the input files, e.g. as a larger workload for a full search
+	bool SimulateOnly() const {return simulateOnly;}
+	//times the kernels on the first individual of a population that has been Setup with the synthetic config,
+	//writing the results to <prefix>.json
+	void Run(Population *pop);
+	};
+
+#endif
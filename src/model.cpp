@@ -29,8 +29,8 @@ using namespace std;
 
 #undef ALIGN_MODEL
 
-Profiler ProfCalcPmat("CalcPmat      ");
-Profiler ProfCalcEigen("CalcEigen     ");
+Profiler ProfCalcPmat("CalcPmat");
+Profiler ProfCalcEigen("CalcEigen");
 					 
 extern rng rnd;
 extern vector<DataSubsetInfo> dataSubInfo;
@@ -849,6 +849,7 @@ void ChangeMatrixPrecision(int elements, double ***pmat, float ***fpmat){
 //is needed the other blen with be -1
 void Model::CalcPmats(FLOAT_TYPE blen1, FLOAT_TYPE blen2, FLOAT_TYPE *&mat1, FLOAT_TYPE *&mat2){
 	ProfCalcPmat.Start();
+	Profiler::Count(PROF_PMAT_CALCS, (blen1 < ZERO_POINT_ZERO ? 0 : 1) + (blen2 < ZERO_POINT_ZERO ? 0 : 1));
 	if(this->modSpec->IsOrientedGap()){
 		if(!(blen1 < ZERO_POINT_ZERO)){
 			CalcOrientedGapPmat(blen1, pmat1);
@@ -3597,122 +3598,106 @@ void Model::OutputBinaryFormattedModel(OUTPUT_CLASS &out) const{
 */
 
 void Model::OutputBinaryFormattedModel(OUTPUT_CLASS &out) const{
-	FLOAT_TYPE *r = new FLOAT_TYPE;
+	vector<FLOAT_TYPE> params;
+	PackParameters(params);
+	if(params.size() > 0)
+		out.WRITE_TO_FILE(&params[0], sizeof(FLOAT_TYPE), params.size());
+	}
+
+void Model::ReadBinaryFormattedModel(FILE *in){
+	//the number of values depends only on the model specification, so packing the current parameters gives it
+	vector<FLOAT_TYPE> params;
+	PackParameters(params);
+	for(unsigned i=0;i<params.size();i++){
+		assert(ferror(in) == false);
+		fread(&params[i], sizeof(FLOAT_TYPE), 1, in);
+		}
+	if(params.size() > 0)
+		UnpackParameters(&params[0]);
+	}
+
+//appends the free parameters to params
+void Model::PackParameters(vector<FLOAT_TYPE> &params) const{
 	// 1/17/14 The assert here was diallowing non-sequence data to be checkpointed.  Don't recall that being intentional, and tests run fine.
 	// Added check of number of rates to avoid section entirely in non-sequence case
 	if(NumRelRates() > 0 && (modSpec->IsAminoAcid() == false || modSpec->IsUserSpecifiedRateMatrix() || modSpec->IsEstimateAAMatrix() || modSpec->IsTwoSerineRateMatrix())){
 		if(modSpec->IsAminoAcid())
 			assert(NumRelRates() == 190 || NumRelRates() == 210);
-//		else
-//			assert(NumRelRates() == 6);
-		for(int i=0;i<NumRelRates();i++){
-			*r = Rates(i);
-			out.WRITE_TO_FILE(r, sizeof(FLOAT_TYPE), 1);
-			}
+		for(int i=0;i<NumRelRates();i++)
+			params.push_back(Rates(i));
 		}
 	//for codon models, output omega(s)
 	if(modSpec->IsCodon()){
 		for(int i=0;i<omegas.size();i++){
-			*r = *omegas[i];
-			out.WRITE_TO_FILE(r, sizeof(FLOAT_TYPE), 1);
-			*r = *omegaProbs[i];
-			out.WRITE_TO_FILE(r, sizeof(FLOAT_TYPE), 1);
+			params.push_back(*omegas[i]);
+			params.push_back(*omegaProbs[i]);
 			}
 		}
 
 	//these may not actually be free params, but output them anyway
-	for(int i=0;i<NStates();i++){
-		*r = StateFreq(i);
-		out.WRITE_TO_FILE(r, sizeof(FLOAT_TYPE), 1);
-		}
+	for(int i=0;i<NStates();i++)
+		params.push_back(StateFreq(i));
 	
 	if(modSpec->IsFlexRateHet()){
 		for(int i=0;i<NRateCats();i++){
-			out.WRITE_TO_FILE(&rateMults[i], sizeof(FLOAT_TYPE), 1);
-			out.WRITE_TO_FILE(&rateProbs[i], sizeof(FLOAT_TYPE), 1);
+			params.push_back(rateMults[i]);
+			params.push_back(rateProbs[i]);
 			}
 		}
-	else if(modSpec->IsGammaRateHet()){
-		*r = Alpha();
-		out.WRITE_TO_FILE(r, sizeof(FLOAT_TYPE), 1);
-		}
-	if(PropInvar()!=ZERO_POINT_ZERO){
-		*r = PropInvar();
-		out.WRITE_TO_FILE(r, sizeof(FLOAT_TYPE), 1);
-		}
+	else if(modSpec->IsGammaRateHet())
+		params.push_back(Alpha());
+	//go by the specification rather than the current value, so that the length never varies.  Pinv is only ever 
+	//zero when invariant sites aren't in the model, so this reads the same checkpoints as before
+	if(NoPinvInModel() == false)
+		params.push_back(PropInvar());
 
 	if(IsOrientedGap()){
-		*r = *insertRate;
-		out.WRITE_TO_FILE(r, sizeof(FLOAT_TYPE), 1);
-
-		*r = *deleteRate;
-		out.WRITE_TO_FILE(r, sizeof(FLOAT_TYPE), 1);
+		params.push_back(*insertRate);
+		params.push_back(*deleteRate);
 		}
-
-	delete r;
 	}
 
-void Model::ReadBinaryFormattedModel(FILE *in){
-	// 1/17/14 The assert here was diallowing non-sequence data to be checkpointed.  Don't recall that being intentional, and tests run fine.
-	// Added check of number of rates to avoid section entirely in non-sequence case
+//sets the parameters from values written by PackParameters, returning the number used
+int Model::UnpackParameters(const FLOAT_TYPE *params){
+	const FLOAT_TYPE *p = params;
 	if(NumRelRates() > 0 && (modSpec->IsAminoAcid() == false || modSpec->IsUserSpecifiedRateMatrix() || modSpec->IsEstimateAAMatrix() || modSpec->IsTwoSerineRateMatrix())){
 		if(modSpec->IsAminoAcid())
 			assert(NumRelRates() == 190 || NumRelRates() == 210);
-//		else
-//			assert(NumRelRates() == 6);
 		FLOAT_TYPE *r = new FLOAT_TYPE[NumRelRates()];
-		for(int i=0;i<NumRelRates();i++){
-			assert(ferror(in) == false);
-			fread(r+i, sizeof(FLOAT_TYPE), 1, in);
-			}
+		for(int i=0;i<NumRelRates();i++)
+			r[i] = *p++;
 		SetRmat(r, false, false);
 		delete []r;
 		}
 
 	if(modSpec->IsCodon()){
-		FLOAT_TYPE o;
 		for(int i=0;i<omegas.size();i++){
-			fread(&o, sizeof(FLOAT_TYPE), 1, in);
-			*omegas[i] = o;
-			fread(&o, sizeof(FLOAT_TYPE), 1, in);
-			*omegaProbs[i] = o;
+			*omegas[i] = *p++;
+			*omegaProbs[i] = *p++;
 			}
 		}	
 
 	FLOAT_TYPE *b = new FLOAT_TYPE[NStates()];
-	for(int i=0;i<NStates();i++){
-		fread((char*) &(b[i]), sizeof(FLOAT_TYPE), 1, in);
-		}
+	for(int i=0;i<NStates();i++)
+		b[i] = *p++;
 	SetPis(b, false, false);
 	delete []b;
 
 	if(modSpec->IsFlexRateHet()){
 		for(int i=0;i<NRateCats();i++){
-			fread((char*) &(rateMults[i]), sizeof(FLOAT_TYPE), 1, in);
-			fread((char*) &(rateProbs[i]), sizeof(FLOAT_TYPE), 1, in);
-			}
-		}
-	else{
-		if(modSpec->IsGammaRateHet()){
-			FLOAT_TYPE a;
-			assert(ferror(in) == false);
-			fread((char*) &a, sizeof(FLOAT_TYPE), 1, in);
-			SetAlpha(a, false);
+			rateMults[i] = *p++;
+			rateProbs[i] = *p++;
 			}
 		}
-	if(PropInvar()!=ZERO_POINT_ZERO){
-		FLOAT_TYPE p;
-		fread((char*) &p, sizeof(FLOAT_TYPE), 1, in);
-		SetPinv(p, false);
-		}
+	else if(modSpec->IsGammaRateHet())
+		SetAlpha(*p++, false);
+	if(NoPinvInModel() == false)
+		SetPinv(*p++, false);
 	if(IsOrientedGap()){
-		FLOAT_TYPE x;
-		fread((char*) &x, sizeof(FLOAT_TYPE), 1, in);
-		*insertRate = x;
-
-		fread((char*) &x, sizeof(FLOAT_TYPE), 1, in);
-		*deleteRate = x;
+		*insertRate = *p++;
+		*deleteRate = *p++;
 		}
+	return (int) (p - params);
 	}
 
 void Model::MultiplyByJonesAAMatrix(){
@@ -4964,3 +4949,30 @@ void ModelPartition::ReadModelPartitionCheckpoint(FILE *in) {
 		}	
 	}
 
+void ModelPartition::PackParameters(vector<FLOAT_TYPE> &params) const{
+	if(NumModelSets() > 1){
+		for(int s = 0;s < NumSubsetRates();s++)
+			params.push_back(subsetRates[s]);
+		}
+	for(int m = 0;m < modSets.size(); m++){
+		GetModelSet(m)->PackModelSetParameters(params);
+		}
+	}
+
+void ModelPartition::UnpackParameters(const vector<FLOAT_TYPE> &params){
+	vector<FLOAT_TYPE> current;
+	PackParameters(current);
+	if(params.size() != current.size())
+		throw ErrorException("Received %d model parameters, but the model has %d.", (int) params.size(), (int) current.size());
+	const FLOAT_TYPE *p = (params.empty() ? NULL : &params[0]);
+	if(NumModelSets() > 1){
+		vector<FLOAT_TYPE> rates(p, p + NumSubsetRates());
+		p += NumSubsetRates();
+		SetSubsetRates(rates, false);
+		}
+	for(int m = 0;m < modSets.size(); m++){
+		p += GetModelSet(m)->UnpackModelSetParameters(p);
+		}
+	assert(p == (params.empty() ? NULL : &params[0] + params.size()));
+	}
+
@@ -1085,6 +1085,7 @@ class Model{
 
 	friend class ModelPartition;
 	friend class ModelSet;
+	friend class KernelBenchmark;
 
 	int nst;
 	int nstates;
@@ -1209,6 +1210,9 @@ class Model{
 	void OutputAminoAcidRMatrixMessage(ostream &out);
 
 	void ReadBinaryFormattedModel(FILE *);
+	//the free parameters in checkpoint order, also used to exchange individuals (see PackedIndividual)
+	void PackParameters(vector<FLOAT_TYPE> &params) const;
+	int UnpackParameters(const FLOAT_TYPE *params);
 	void FillQMatLookup();
 	void SetJonesAAFreqs();
 	void SetMtMamAAFreqs();
@@ -1425,6 +1429,15 @@ class Model{
 		eigenDirty = true;
 		}
 
+	//sets all of the frequencies at once from relative values, which are rescaled to sum to 1.0
+	void SetAllEquilibriumFreqs(const vector<FLOAT_TYPE> &vals){
+		assert(vals.size() == nstates);
+		for(int b=0;b<nstates;b++)
+			*stateFreqs[b] = vals[b];
+		NormalizeSumConstrainedValues(&stateFreqs[0], nstates, 1.0, 1e-4, -1);
+		eigenDirty = true;
+		}
+
 	void SetRelativeNucRate(int which, FLOAT_TYPE val){
 		//this has the potential to do GT (fixed at 1.0) although that won't work with
 		//OptBounded currently
@@ -2047,6 +2060,18 @@ public:
 			(*modit)->ReadBinaryFormattedModel(in);
 			}
 		}
+	void PackModelSetParameters(vector<FLOAT_TYPE> &params) const{
+		for(vector<Model*>::const_iterator modit = mods.begin();modit != mods.end();modit++){
+			(*modit)->PackParameters(params);
+			}
+		}
+	int UnpackModelSetParameters(const FLOAT_TYPE *params){
+		int used = 0;
+		for(vector<Model*>::iterator modit = mods.begin();modit != mods.end();modit++){
+			used += (*modit)->UnpackParameters(params + used);
+			}
+		return used;
+		}
 	void SetDefaultModelSetParameters(SequenceData *data){
 		for(vector<Model*>::iterator modit = mods.begin();modit != mods.end();modit++){
 			(*modit)->SetDefaultModelParameters(data);
@@ -2201,6 +2226,8 @@ public:
 	void FillGarliFormattedModelStrings(string &s) const;
 	void WriteModelPartitionCheckpoint(OUTPUT_CLASS &out) const;
 	void ReadModelPartitionCheckpoint(FILE *in);
+	void PackParameters(vector<FLOAT_TYPE> &params) const;
+	void UnpackParameters(const vector<FLOAT_TYPE> &params);
 	};
 
 typedef void (Model::*SetParamFunc) (int, FLOAT_TYPE);
@@ -47,11 +47,19 @@ FILE *fhandle;
 
 int MPIMain(int argc, char** argv)	{
 
-	MPI_Init(&argc, &argv);
+	//the master's communication and GA threads both make MPI calls
+	int provided;
+	MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided);
 	
 	int rank, nprocs;
 	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 	MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+	if(provided < MPI_THREAD_MULTIPLE){
+		debug_mpi("ERROR: MPI library does not provide MPI_THREAD_MULTIPLE");
+		if(rank == 0)
+			cout << "ERROR: the MPI version of GARLI requires an MPI library providing MPI_THREAD_MULTIPLE...aborting." << endl;
+		MPI_Abort(MPI_COMM_WORLD, -1);
+		}
 
 	bool poo=true;
 	//if(rank==0) while (poo) ;
@@ -184,11 +192,10 @@ int MasterMaster(MasterGamlConfig& conf, NucleotideData& data)	{
 	// start the thread
 	pthread_t thread;
 	thread_arg_t targ;
-	pthread_mutex_init(&lock_pm, NULL);
-	pthread_mutex_init(&lock_pop, NULL);
-	pthread_cond_init(&cond_pm, NULL);
 	g_quit_time = false;
-	g_processing_message = false;
+	g_comm_thread_done = false;
+	g_comm_thread_woken = false;
+	pthread_mutex_init(&lock_wake, NULL);
 	targ.conf = &const_cast<MasterGamlConfig&>(conf);
 	targ.pop = &pop;
 	targ.nprocs = nprocs;
@@ -199,7 +206,8 @@ int MasterMaster(MasterGamlConfig& conf, NucleotideData& data)	{
 
 	pop.gen=0;
 	while (!g_quit_time){
-		pthread_mutex_lock(&lock_pop);
+			//only this thread touches the population, so anything from the remotes is applied here
+			process_remote_updates(&targ, true);
 			pop.keepTrack();
 			pop.OutputFate();
 			if (pop.gen % conf.logevery == 0) pop.OutputLog();
@@ -244,23 +252,17 @@ int MasterMaster(MasterGamlConfig& conf, NucleotideData& data)	{
 				pop.CheckPerturbParallel();
 #endif
 				}
-		pthread_mutex_unlock(&lock_pop);
-		pthread_mutex_lock(&lock_pm);
-			while (g_processing_message)
-				pthread_cond_wait(&cond_pm, &lock_pm);
-		pthread_mutex_unlock(&lock_pm);
 		}
 	
-	//DJZ 3-1-06 Need to give control back to the thread one more time so that it can deal with any final messages
-	pthread_mutex_unlock(&lock_pop);
-	pthread_mutex_lock(&lock_pm);
-		while (g_processing_message)
-			pthread_cond_wait(&cond_pm, &lock_pm);
-	pthread_mutex_unlock(&lock_pm);
-		
+	//if the thread is still waiting on the remotes, have it tell them to quit, then include whatever they sent last
+	wake_comm_thread();
+	g_quit_time = true;
+	pthread_join(thread, NULL);
+	pthread_mutex_destroy(&lock_wake);
+	process_remote_updates(&targ, false);
+
 	pop.FinalOptimization();
 	pop.FinalizeOutputStreams();
-	pthread_join(thread, NULL);
 	return 0;
 }
 
@@ -1080,20 +1082,26 @@ int RemoteAlphaMaleReplication(Population& pop, const GeneralGamlConfig& conf)	{
 */
 
 void RemoteSendBestTree(Population& pop){
+	//the master holds the last tree we sent, so only what has changed since then needs to go
+	static PackedIndividual lastSent;
+	static bool sentAny=false;
 	int *which=new int;
-	char *tree_strings;
-	double *models;
 	
+	int header=UPDATE_TREE;
+	MPI_Send(&header, 1, MPI_INT, 0, TAG_UPDATE_HEADER, MPI_COMM_WORLD);
+
 	pop.GetNBestIndivIndices(&which, 1);
-	pop.GetSpecifiedTreeStrings(&tree_strings, 1, which);
-	int size=strlen2(tree_strings)+2;
-//	debug_mpi("about to send treestrings...");
-	SendMPIMessage(tree_strings, size, 0, TAG_TREE_STRINGS);
-	debug_mpi("\tsent ind %d, lnL %f", *which, pop.indiv[*which].Fitness());
-//	debug_mpi("about to send modelstrings...");
-	int model_size=pop.GetSpecifiedModels(&models, 1, which);
-	SendMPIMessage((char*) models, sizeof(double)*model_size, 0, TAG_MODEL);
-//	debug_mpi("about to send subdef...");
+	PackedIndividual packed;
+	pop.indiv[*which].Pack(packed);
+	packed.lnL = pop.indiv[*which].Fitness();
+	vector<char> buf;
+	if(sentAny) packed.SerializeDelta(lastSent, buf);
+	else packed.Serialize(buf);
+	SendMPIMessage(&buf[0], (int) buf.size(), 0, TAG_PACKED_INDIVIDUAL);
+	debug_mpi("\tsent ind %d, lnL %f (%d bytes)", *which, pop.indiv[*which].Fitness(), (int) buf.size());
+	lastSent=packed;
+	sentAny=true;
+
 	char std[5];
 	sprintf(std, "%d", pop.subtreeDefNumber);
 	SendMPIMessage(std, strlen(std)+2, 0, TAG_SUBTREE_ITERATION);
@@ -1106,14 +1114,8 @@ void RemoteSendBestTree(Population& pop){
 		}
 	else
 		debug_mpi("\tno defined subtree");
-		
-	//finally, send the score
-	double score = pop.indiv[*which].Fitness();
-	SendMPIMessage((char*)&score, sizeof(double), 0, TAG_SCORE);	
 	
 	delete which;
-	delete [] tree_strings;
-	delete [] models;
 	}
 	
 
@@ -1125,6 +1127,7 @@ int RemoteSubtreeWorker(Population& pop, const GeneralGamlConfig& conf){
 	bool perturb;
 	
 	which=new int[5];
+	PackedIndividual fromMaster;
 	
 	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 		
@@ -1190,13 +1193,12 @@ int RemoteSubtreeWorker(Population& pop, const GeneralGamlConfig& conf){
 			int recievedDefNumber;
 			debug_mpi("SYNCH COMM (node 0)");
 			gotmessage=true;
-			assert(tag == TAG_TREE_STRINGS || tag==TAG_PERTURB);
+			assert(tag == TAG_PACKED_INDIVIDUAL || tag==TAG_PERTURB);
 			if(firstmessage==false) debug_mpi("\tfound a newer message...");
 			if(tag != TAG_PERTURB){
 				gotNewIndiv=true;
-				RecvMPIMessage(&buf, &size, 0, &tag, true);
-				assert(tag == TAG_MODEL);
-				models=(double*) buf;
+				//the master may send only what changed since its last tree
+				fromMaster.Deserialize(tree_strings, size);
 			
 				debug_mpi("\tgot new ind" );
 				RecvMPIMessage(&buf, &size, 0, &tag, true);
@@ -1226,7 +1228,7 @@ int RemoteSubtreeWorker(Population& pop, const GeneralGamlConfig& conf){
 			if(gotNewIndiv){
 				*which=(int)pop.cumfit[0][0];
 				debug_mpi("\treplacing indiv %d", *which);
-				pop.ReplaceSpecifiedIndividuals(1, which, tree_strings, models);
+				pop.indiv[*which].Unpack(fromMaster);
 				if(recievedDefNumber!=pop.subtreeDefNumber || (pop.subtreeNode!=0 && subtreeNode!=0)){
 					pop.AssignSubtree(subtreeNode, *which);
 					pop.CalcAverageFitness();
@@ -1236,7 +1238,6 @@ int RemoteSubtreeWorker(Population& pop, const GeneralGamlConfig& conf){
 					pop.subtreeDefNumber=recievedDefNumber;
 					}
 
-				delete [] models;
 				delete [] buf;
 				}
 #ifdef INCLUDE_PERTURBATION
@@ -1276,7 +1277,8 @@ int RemoteSubtreeWorker(Population& pop, const GeneralGamlConfig& conf){
 			}
 		}
 
-	SendMPIMessage(NULL, 0, 0, TAG_QUIT);
+	int header=UPDATE_QUIT;
+	MPI_Send(&header, 1, MPI_INT, 0, TAG_UPDATE_HEADER, MPI_COMM_WORLD);
 	debug_mpi("\tsent: quit message");
 	delete [] which;
 	pop.FinalizeOutputStreams();
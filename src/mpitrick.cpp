@@ -25,11 +25,12 @@
 #include "string.h"
 #include <time.h>
 #include "funcs.h"
+#include "tree.h"
 #include "outputman.h"
 
 using namespace std;
 
-int SubGarliMain(int);
+int SubGarliMain(int, int);
 
 void UsageMessage(char *execName);
 
@@ -38,7 +39,26 @@ extern OutputManager outman;
 //old (parallel batch) and new (parallel replicates) mpi behavior now rolled into a single function
 
 #if(1)
-int jobloop(int, int, MPI_Comm, int numJobs);
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <unistd.h>
+
+//Rank 0 hands out jobs to the other ranks as they ask for them, so that uneven run times don't leave processes idle
+//while others still have a queue of assigned runs.  Starts and completions are recorded in a journal file (which
+//only rank 0 writes), so that a later invocation in the same directory skips completed runs and redoes interrupted
+//ones.  Each job's random seed is derived from a base seed stored in the journal and the job number, so concurrently
+//started runs can't share a seed, and a redone job uses the same seed as before.
+#define JOB_JOURNAL "mpi_jobs.journal"
+
+enum{
+	JOB_REQUEST_TAG = 1,	//worker -> rank 0: {last job number or -1, its return value}
+	JOB_ASSIGN_TAG = 2		//rank 0 -> worker: {job number or -1 for no more jobs, seed}
+	};
+
+int masterloop(int ntids, MPI_Comm comm, int numJobs);
+int workerloop(int mytid, MPI_Comm comm);
+int splitloop(int mytid, int ntids, MPI_Comm comm);
 
 string MyFormattedTime(){
 	time_t rawtime;
@@ -50,6 +70,25 @@ string MyFormattedTime(){
 	return s;
 	}
 
+//a well mixed, positive int from the base seed and job number
+int JobSeed(unsigned base, int job){
+	unsigned long long z = ((unsigned long long) base << 32) + (unsigned) job + 0x9e3779b97f4a7c15ULL;
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	z ^= z >> 31;
+	return 1 + (int) (z % 2147483646ULL);
+	}
+
+void AppendToJournal(const char *fmt, int a, int b, int c){
+	FILE *j = fopen(JOB_JOURNAL, "a");
+	if(j == NULL){
+		outman.UserMessage("WARNING: could not write to job journal %s", JOB_JOURNAL);
+		return;
+		}
+	fprintf(j, fmt, a, b, c);
+	fclose(j);
+	}
+
 int main(int argc,char **argv){
 
   if(argc == 2){
@@ -66,14 +105,19 @@ int main(int argc,char **argv){
 	MPI_Abort(MPI_COMM_WORLD, rc);
 	}
 
-  MPI_Comm comm,mycomm; 
+  MPI_Comm comm; 
   int nproc, rank;
   comm = MPI_COMM_WORLD;
   MPI_Comm_size(comm,&nproc);
   MPI_Comm_rank(comm,&rank);
 
-  timespec wait;
   int numJobsTotal = 0;
+
+  //with --splitpatterns all of the processes do a single search together, each holding a slice of the data patterns
+  bool splitPatterns = false;
+#ifdef SUBROUTINE_GARLI
+  splitPatterns = (argc > 1 && !strcmp(argv[1], "--splitpatterns"));
+#endif
   
   if(rank == 0){
     	outman.SetLogFile("mpi_messages.log");
@@ -83,148 +127,225 @@ int main(int argc,char **argv){
 #ifdef OLD_SUBROUTINE_GARLI
         outman.UserMessage("This is the original batch MPI GARLI version.  It expects a series of configuration");
         outman.UserMessage("files named \"run0.conf\", \"run1.conf\", etc.  If no number is passed on the command");
-        outman.UserMessage("line after the executable name, then it assumes that the # configs = # processors.");
+        outman.UserMessage("line after the executable name, then it assumes one config per worker process.");
         outman.UserMessage("Otherwise it looks for the specified number of configs.\n");
 
 	if(argc > 1){
 		if(! isdigit(argv[1][0])){
 			outman.UserMessage("***ERROR***:GARLI is expecting <exe> <total # configs>\n\tor\n\t<exe> <nothing>\n\tGot <exe> %s", argv[1]);
 			UsageMessage(argv[0]);
-			MPI_Finalize();
-			return 1;
+			numJobsTotal = -1;
 			}
 		else numJobsTotal = atoi(argv[1]);
 		}
-	else numJobsTotal = nproc;
+	else numJobsTotal = (nproc > 1 ? nproc - 1 : 1);
 #else
-	if(argc == 1 || (argv[1][0] != '-' && !isdigit(argv[1][0]))){
+	if(splitPatterns)
+		numJobsTotal = 1;
+	else if(argc == 1 || (argv[1][0] != '-' && !isdigit(argv[1][0]))){
 		outman.UserMessage("***ERROR***:Garli is expecting the number of jobs to be run to follow\n\tthe executable name on the command line\n");
 		UsageMessage(argv[0]);
-		MPI_Finalize();
-		return 1;
+		numJobsTotal = -1;
 		}
 	else{
 		if(argv[1][0] == '-') numJobsTotal = atoi(&argv[1][1]);
 		else numJobsTotal = atoi(&argv[1][0]);
 		}
 #endif
-  	outman.UserMessage("#####%d total executions of the config file were requested######", numJobsTotal);
+	if(splitPatterns)
+		outman.UserMessage("#####A single search with the data patterns divided among %d processes was requested######", nproc);
+	else if(numJobsTotal > -1)
+		outman.UserMessage("#####%d total executions of the config file were requested######", numJobsTotal);
 	}
-  else{//wait a moment for proc 0 to output to the messages file, then attach to the stream
-	wait.tv_sec = 1;
-	wait.tv_nsec=0;
-	nanosleep(&wait, NULL);
-	outman.SetLogFileForAppend("mpi_messages.log");
-	}
- 
- 
- //These barriers really shouldn't be necessary, but adding them seemed to resolve a weird issue that Jelesko
- //was having where processes with rank >= 8 were hanging in the Bcast until some of the first 8 were completely 
- //finished and returned from the job loop
-  //outman.UserMessage("#####Process %d approaching barrier 1 at %s######", rank, MyFormattedTime().c_str());
-  MPI_Barrier(comm);
-  //outman.UserMessage("#####Process %d passed barrier 1 at %s######", rank, MyFormattedTime().c_str());
- 
-//send all of the processors the number of jobs total
+
+  //the workers only need to know whether there is anything to do at all
   MPI_Bcast(&numJobsTotal, 1, MPI_INT, 0, comm);
+  if(numJobsTotal < 0){
+	MPI_Finalize();
+	return 1;
+	}
 
-//  outman.UserMessage("#####Process %d passed broadcast, approaching barrier 2 at %s######", rank, MyFormattedTime().c_str());
-  MPI_Barrier(comm);
-//  outman.UserMessage("#####Process %d passed barrier 2 at %s######", rank, MyFormattedTime().c_str());
+  int jobsCompleted;
+  if(splitPatterns)
+	jobsCompleted = splitloop(rank, nproc, comm);
+  else if(rank == 0)
+	jobsCompleted = masterloop(nproc, comm, numJobsTotal);
+  else
+	jobsCompleted = workerloop(rank, comm);
 
-//DEBUG
-  //if startjob lockfiles exist at this point that must mean that a previous run bailed.  Remove them.
-  //Then processes will start those same runs and possibly restart from checkpoint (if any were being 
-  //written and restart=1 was specified).  Otherwise they will just start them over.
+  MPI_Barrier(comm);
   if(rank == 0){
-	for(int j = 0;j < numJobsTotal;j++){
-		char startfile[100], donefile[100];
-		sprintf(startfile, ".s-lock%d", j);
-		sprintf(donefile, ".d-lock%d", j);
-		if(FileExists(donefile)){
-			outman.UserMessage("It appears that run %d was completed in a previous MPI invocation.\n\tRun %d will not be re-run unless the hidden file \"%s\" and any checkpoint files for this run (if present) are deleted from this directory.", j, j, donefile);
+	outman.SetLogFileForAppend("mpi_messages.log");
+	outman.UserMessage("all processes completed at %s", MyFormattedTime().c_str());
+	}
+  MPI_Finalize();
+  return 0;
+}
+
+//Reads the journal left by any previous invocation in this directory, returning the jobs that still need to be run.  
+//Jobs that were never started come first, then those that were interrupted, which might be able to restart from
+//checkpoints and so are likely to be shorter.
+vector<int> ReadJournal(int numJobs, unsigned &baseSeed){
+	vector<int> state(numJobs, 0);//0 = never started, 1 = started, 2 = done
+	bool haveSeed = false;
+	ifstream in(JOB_JOURNAL);
+	string line;
+	while(getline(in, line)){
+		istringstream fields(line);
+		string what;
+		long val;
+		if(!(fields >> what >> val))
+			continue;
+		if(what == "seed"){
+			baseSeed = (unsigned) val;
+			haveSeed = true;
 			}
-		else if(FileExists(startfile)){
-			outman.UserMessage("It appears that run %d was started but not completed in a previous MPI invocation.\n\tRun %d will either be re-run or restarted from a checkpoint (if restart = 1 was specified in the GARLI config file).", j, j);
-			remove(startfile);
+		else if(val >= 0 && val < numJobs){
+			if(what == "start" && state[val] == 0)
+				state[val] = 1;
+			else if(what == "done")
+				state[val] = 2;
+			else if(what == "failed" && state[val] == 1)
+				state[val] = 0;
 			}
-  		}
-	}
+		}
+	in.close();
 
-  int jobsCompleted = jobloop(rank,nproc,mycomm,numJobsTotal);
-  outman.SetLogFileForAppend("mpi_messages.log");
-  if(jobsCompleted > -1){
-#ifdef OLD_SUBROUTINE_GARLI
- 	outman.UserMessage("process %d finished, did %d run(s), no more configs to execute at %s. Waiting for other procs...", rank, jobsCompleted,  MyFormattedTime().c_str());
-#else
- 	outman.UserMessage("process %d finished, did %d run(s), no further runs to do at %s. Waiting for other procs...", rank, jobsCompleted,  MyFormattedTime().c_str());
-#endif
+	if(!haveSeed){
+		//Add in the pid with the time, as is done for individual runs
+		baseSeed = (unsigned) time(NULL) + (unsigned) getpid();
+		AppendToJournal("seed %d\n", (int) (baseSeed & 0x7fffffff), 0, 0);
+		baseSeed &= 0x7fffffff;
+		}
+
+	vector<int> todo;
+	for(int j = 0;j < numJobs;j++){
+		if(state[j] == 2)
+			outman.UserMessage("It appears that run %d was completed in a previous MPI invocation.\n\tRun %d will not be re-run unless its entries in the file \"%s\" and any checkpoint files for this run (if present) are removed.", j, j, JOB_JOURNAL);
+		else if(state[j] == 0)
+			todo.push_back(j);
+		}
+	for(int j = 0;j < numJobs;j++){
+		if(state[j] == 1){
+			outman.UserMessage("It appears that run %d was started but not completed in a previous MPI invocation.\n\tRun %d will either be re-run or restarted from a checkpoint (if restart = 1 was specified in the GARLI config file).", j, j);
+			todo.push_back(j);
+			}
+		}
+	return todo;
 	}
 
-  MPI_Barrier(comm);
-  if(rank == 0)  outman.UserMessage("all processes completed at %s", MyFormattedTime().c_str());
-  else nanosleep(&wait, NULL);//this is just to keep proper ordering in the output file
- 
-  outman.UserMessage("process %d terminating", rank);
-  
-//Not sure if deleting lock files should or should not be done.
-/*  if(rank == 0){
-	char temp[100];
-	for(int i=0;i<numJobsTotal;i++){
-		sprintf(temp, ".lock%d", i);
-		remove(temp);
+//All of the processes run the same search from the same seed, each calculating the likelihood for only its slice of
+//the patterns.  The partial sums are totalled across processes (Tree::SumAcrossSlices) so that every one of them makes
+//identical decisions and the searches stay in lockstep, without any process needing to hold all of the data.
+int splitloop(int mytid, int ntids, MPI_Comm comm){
+	int seed = 0;
+	if(mytid == 0){
+		seed = JobSeed((unsigned) time(NULL) + (unsigned) getpid(), 0);
+		outman.UserMessage("starting search with the patterns divided among %d processes at %s", ntids, MyFormattedTime().c_str());
 		}
+	MPI_Bcast(&seed, 1, MPI_INT, 0, comm);
+	Tree::numPatternSlices = ntids;
+	Tree::patternSlice = mytid;
+	int err = SubGarliMain(0, seed);
+	//the others would otherwise wait forever for this process's part of the next likelihood
+	if(err != 0)
+		MPI_Abort(comm, err);
+	return 1;
 	}
-  */
-  MPI_Finalize();
-  return 0;
-}
 
-int jobloop(int mytid,int ntids,MPI_Comm comm, int numJobs){
+int RunJob(int mytid, int jobNum, int seed){
+	int err = SubGarliMain(jobNum, seed);
+	return err;
+	}
 
-	//to start off with each process takes the run = to its tid
-	int jobNum=mytid;	
-	char temp[100];
+int masterloop(int ntids, MPI_Comm comm, int numJobs){
+	unsigned baseSeed = 0;
+	vector<int> todo = ReadJournal(numJobs, baseSeed);
+	outman.UserMessage("base random seed for runs = %d", (int) baseSeed);
+	unsigned next = 0;
 	int jobsCompleted = 0;
 
-#ifdef SUBROUTINE_GARLI
-	//this wait ensures that two runs don't start with the same seed
-	timespec wait;
-	wait.tv_sec = mytid * 2;
-	wait.tv_nsec=0;
-	nanosleep(&wait, NULL);
-#endif
-	while(jobNum < numJobs){
-		//DEBUG
-		//sprintf(temp, ".lock%d", jobNum);
-		ofstream lock;
-		char startfile[100], donefile[100];
-		sprintf(startfile, ".s-lock%d", jobNum);
-		sprintf(donefile, ".d-lock%d", jobNum);
-		//DEBUG
-		
-		if(FileExists(donefile) || FileExists(startfile)) jobNum++;
-		else{
-			lock.open(startfile);
-			lock.close();
+	//with only one process there is no one to hand jobs to, so do them here
+	if(ntids == 1){
+		for(;next < todo.size();next++){
+			int job = todo[next];
+			AppendToJournal("start %d %d %d\n", job, 0, (int) time(NULL));
+			outman.UserMessage("process 0 starting run %d at %s", job, MyFormattedTime().c_str());
+			int err = RunJob(0, job, JobSeed(baseSeed, job));
 			outman.SetLogFileForAppend("mpi_messages.log");
-			outman.UserMessage("process %d starting run %d at %s", mytid, jobNum, MyFormattedTime().c_str());
-			int err = SubGarliMain(jobNum);
 			if(err){
-				outman.SetLogFileForAppend("mpi_messages.log");
-				outman.UserMessage("***process %d aborted run %d at %s", mytid, jobNum, MyFormattedTime().c_str());
+				AppendToJournal("failed %d %d %d\n", job, 0, 0);
+				outman.UserMessage("***process 0 aborted run %d at %s", job, MyFormattedTime().c_str());
 				outman.UserMessage("\tsee the <filename>.screen.log files for details on what went wrong");
 				return -1;
 				}
+			AppendToJournal("done %d %d %d\n", job, 0, 0);
 			jobsCompleted++;
-			lock.open(donefile);
-			lock.close();
-			remove(startfile);
-			jobNum++;
 			}
+		outman.UserMessage("process 0 finished, did %d run(s) at %s.", jobsCompleted, MyFormattedTime().c_str());
+		return jobsCompleted;
 		}
+
+	vector<int> started(ntids, 0);
+	int activeWorkers = ntids - 1;
+	while(activeWorkers > 0){
+		//this blocks until some worker wants a job, rather than polling
+		int report[2];
+		MPI_Status status;
+		MPI_Recv(report, 2, MPI_INT, MPI_ANY_SOURCE, JOB_REQUEST_TAG, comm, &status);
+		int from = status.MPI_SOURCE;
+		int assign[2] = {-1, 0};
+
+		if(report[0] >= 0){
+			if(report[1] == 0){
+				AppendToJournal("done %d %d %d\n", report[0], from, (int) (time(NULL) - started[from]));
+				outman.UserMessage("process %d finished run %d at %s", from, report[0], MyFormattedTime().c_str());
+				jobsCompleted++;
+				}
+			else{
+				//a worker that fails gets no more jobs, since the same thing will probably happen again
+				AppendToJournal("failed %d %d %d\n", report[0], from, 0);
+				outman.UserMessage("***process %d aborted run %d at %s", from, report[0], MyFormattedTime().c_str());
+				outman.UserMessage("\tsee the <filename>.screen.log files for details on what went wrong");
+				MPI_Send(assign, 2, MPI_INT, from, JOB_ASSIGN_TAG, comm);
+				activeWorkers--;
+				continue;
+				}
+			}
+
+		if(next < todo.size()){
+			assign[0] = todo[next++];
+			assign[1] = JobSeed(baseSeed, assign[0]);
+			started[from] = (int) time(NULL);
+			AppendToJournal("start %d %d %d\n", assign[0], from, started[from]);
+			outman.UserMessage("process %d starting run %d at %s", from, assign[0], MyFormattedTime().c_str());
+			}
+		else
+			activeWorkers--;
+		MPI_Send(assign, 2, MPI_INT, from, JOB_ASSIGN_TAG, comm);
+		}
+	if(next < todo.size())
+		outman.UserMessage("%d run(s) could not be started because of errors in other runs", (int) (todo.size() - next));
+	outman.UserMessage("%d run(s) completed by %d worker processes", jobsCompleted, ntids - 1);
 	return jobsCompleted;
-}
+	}
+
+int workerloop(int mytid, MPI_Comm comm){
+	int report[2] = {-1, 0};
+	int assign[2];
+	int jobsCompleted = 0;
+	while(true){
+		MPI_Send(report, 2, MPI_INT, 0, JOB_REQUEST_TAG, comm);
+		MPI_Recv(assign, 2, MPI_INT, 0, JOB_ASSIGN_TAG, comm, MPI_STATUS_IGNORE);
+		if(assign[0] < 0)
+			break;
+		report[0] = assign[0];
+		report[1] = RunJob(mytid, assign[0], assign[1]);
+		if(report[1] == 0)
+			jobsCompleted++;
+		}
+	return jobsCompleted;
+	}
 
 #elif defined(__OLD_SUBROUTINE_GARLI)
 void jobloop(int, int, MPI_Comm, int numJobs=-1);
@@ -278,7 +399,7 @@ void jobloop(int mytid,int ntids,MPI_Comm comm, int numJobs /*=-1*/){
 		wait.tv_sec = mytid * 2;
 		wait.tv_nsec=0;
 		nanosleep(&wait, NULL);
-		SubGarliMain(jobNum);
+		SubGarliMain(jobNum, -1);
 		jobNum += ntids;
 		}
 	return;
@@ -24,9 +24,9 @@
 //a bunch of functions from the Tree class, relating to optimization
 
 #include "utility.h"
-Profiler ProfIntDeriv ("IntDeriv      ");
-Profiler ProfTermDeriv("TermDeriv     ");
-Profiler ProfModDeriv ("ModDeriv      ");
+Profiler ProfIntDeriv ("IntDeriv");
+Profiler ProfTermDeriv("TermDeriv");
+Profiler ProfModDeriv ("ModDeriv");
 Profiler ProfNewton   ("Newton-Raphson");
 extern Profiler ProfEQVectors;
 
@@ -104,6 +104,607 @@ FLOAT_TYPE Tree::OptimizeAllBranches(FLOAT_TYPE optPrecision){
 	return improve;
 	}
 
+//Optimizes all branches for passes over a single tree that is being optimized end to end (initial and final
+//optimization).  If concurrentbranchopt is on, each branch is first optimized simultaneously with all of the
+//others given the current lengths of the rest, which allows the branches to be spread over threads.  These 
+//passes ignore the interactions between branches, so once they stop giving large gains the usual sequential
+//pass is done, which also makes the result consistent with what OptimizeAllBranches alone would converge to.
+FLOAT_TYPE Tree::OptimizeAllBranchesFullTree(FLOAT_TYPE optPrecision){
+	FLOAT_TYPE improve=ZERO_POINT_ZERO;
+	if(concurrentBranchOpt && CanOptimizeBranchesConcurrently()){
+		FLOAT_TYPE passImprove;
+		int pass = 0;
+		while(pass++ < 5 && ConcurrentBranchOptimizationPass(optPrecision, passImprove)){
+			improve += passImprove;
+			if(passImprove < optPrecision * (numNodesTotal - 1))
+				break;
+			}
+		}
+	improve += OptimizeAllBranches(optPrecision);
+	return improve;
+	}
+
+bool Tree::CanOptimizeBranchesConcurrently() const{
+#if defined(OPEN_MP) && !defined(EQUIV_CALCS)
+	//the concurrent passes need all of the CLAs for a batch of branches at once, and the per-thread pmats
+	//are only set up for the models that the derivative functions can handle without any shared scratch
+	if(omp_get_max_threads() < 2 || memLevel > 0 || useOptBoundedForBlen || rootWithDummy || sitelikeLevel != 0)
+		return false;
+	for(int m = 0;m < modPart->NumModels();m++){
+		if(modPart->GetModel(m)->GetModSpec()->IsNonsynonymousRateHet())
+			return false;
+		}
+	return true;
+#else
+	return false;
+#endif
+	}
+
+//One Jacobi style pass over the tree.  Branches are visited in preorder in batches, the CLAs needed for each 
+//batch are calculated and reserved, and the batch is then optimized in parallel without changing any branch
+//lengths, so no CLA is dirtied until the whole pass is done.  The new lengths are only kept if they improve 
+//the score, falling back to a half step and then to the original lengths.  Returns false if the pass could
+//not be done, in which case the tree is unchanged.
+bool Tree::ConcurrentBranchOptimizationPass(FLOAT_TYPE optPrecision, FLOAT_TYPE &improve){
+	improve = ZERO_POINT_ZERO;
+#ifdef OPEN_MP
+	Score();
+	FLOAT_TYPE startL = lnL;
+
+	vector<TreeNode *> order;
+	vector<TreeNode *> pending(1, root);
+	while(pending.empty() == false){
+		TreeNode *nd = pending.back();
+		pending.pop_back();
+		for(TreeNode *des = nd->left;des != NULL;des = des->next){
+			order.push_back(des);
+			if(des->IsInternal())
+				pending.push_back(des);
+			}
+		}
+
+	//the Model scratch used to calculate pmats and their derivatives isn't thread safe, so each thread gets a copy
+	int numThreads = omp_get_max_threads();
+	vector<ModelPartition *> threadMods;
+	for(int t = 0;t < numThreads;t++){
+		ModelPartition *mp = new ModelPartition();
+		mp->CopyModelPartition(modPart);
+		threadMods.push_back(mp);
+		}
+
+	const int batchSize = numThreads * 4;
+	vector<FLOAT_TYPE> newLens(order.size());
+	vector<CondLikeArraySet *> setOnes(batchSize), setTwos(batchSize);
+	vector<int> reserved;
+	bool ok = true;
+	for(int b = 0;ok && b < (int) order.size();b += batchSize){
+		int num = min(batchSize, (int) order.size() - b);
+		try{
+			for(int i = 0;i < num;i++){
+				TreeNode *nd = order[b + i];
+				int oneIndex;
+				if(nd->anc->left == nd){
+					setOnes[i] = GetClaUpLeft(nd->anc, true);
+					oneIndex = nd->anc->claIndexUL;
+					}
+				else if(nd->anc->right == nd){
+					setOnes[i] = GetClaUpRight(nd->anc, true);
+					oneIndex = nd->anc->claIndexUR;
+					}
+				else{
+					setOnes[i] = GetClaDown(nd->anc, true);
+					oneIndex = nd->anc->claIndexDown;
+					}
+				claMan->ReserveCla(oneIndex);
+				reserved.push_back(oneIndex);
+				setTwos[i] = NULL;
+				if(nd->IsInternal()){
+					setTwos[i] = GetClaDown(nd, true);
+					claMan->ReserveCla(nd->claIndexDown);
+					reserved.push_back(nd->claIndexDown);
+					}
+				}
+			}
+		catch(int){
+			//rescaling trouble or running out of clas, leave it to the sequential optimization to sort out
+			ok = false;
+			}
+		if(ok){
+			#pragma omp parallel for schedule(dynamic)
+			for(int i = 0;i < num;i++){
+				newLens[b + i] = ConcurrentNewtonRaphsonBranchLength(optPrecision, order[b + i], setOnes[i], setTwos[i], threadMods[omp_get_thread_num()]);
+				}
+			}
+		for(vector<int>::iterator it = reserved.begin();it != reserved.end();it++)
+			claMan->ClearTempReservation(*it);
+		reserved.clear();
+		}
+
+	for(int t = 0;t < numThreads;t++)
+		delete threadMods[t];
+
+	if(!ok){
+		MakeAllNodesDirty();
+		Score();
+		return false;
+		}
+
+	vector<FLOAT_TYPE> oldLens(order.size());
+	for(int n = 0;n < (int) order.size();n++){
+		oldLens[n] = order[n]->dlen;
+		SetBranchLength(order[n], newLens[n]);
+		}
+	Score();
+	if(lnL < startL){
+		for(int n = 0;n < (int) order.size();n++)
+			SetBranchLength(order[n], (oldLens[n] + newLens[n]) * ZERO_POINT_FIVE);
+		Score();
+		}
+	if(lnL < startL){
+		for(int n = 0;n < (int) order.size();n++)
+			SetBranchLength(order[n], oldLens[n]);
+		Score();
+		return true;
+		}
+	improve = lnL - startL;
+	return true;
+#else
+	return false;
+#endif
+	}
+
+//A stripped down Newton-Raphson branch length optimization that works only from the passed CLAs and pmat models, 
+//without touching the tree, so that it can be run for many branches at once.  The new length is returned.
+FLOAT_TYPE Tree::ConcurrentNewtonRaphsonBranchLength(FLOAT_TYPE precision, TreeNode *nd, CondLikeArraySet *setOne, CondLikeArraySet *setTwo, ModelPartition *pmatMods){
+	FLOAT_TYPE v = nd->dlen;
+	FLOAT_TYPE knownMin=min_brlen, knownMax=max_brlen;
+
+	for(int iter = 0;iter < 10;iter++){
+		pair<FLOAT_TYPE, FLOAT_TYPE> derivs = CalcDerivativesFromClas(nd, v, setOne, setTwo, pmatMods);
+		FLOAT_TYPE d1 = derivs.first;
+		FLOAT_TYPE d2 = derivs.second;
+
+		if(d1 <= ZERO_POINT_ZERO && v < knownMax) knownMax = v;
+		else if(d1 > ZERO_POINT_ZERO && v > knownMin) knownMin = v;
+
+		FLOAT_TYPE proposed;
+		bool converged = false;
+		if(d2 < ZERO_POINT_ZERO){
+			FLOAT_TYPE delta = -d1/d2;
+			converged = (d1*delta + d2*delta*delta*ZERO_POINT_FIVE) < precision;
+			proposed = v + delta;
+			}
+		else{//curvature is wrong for NR, so just move in the direction of the first derivative
+			if(d1 <= ZERO_POINT_ZERO && FloatingPointEquals(v, min_brlen, 1.0e-8))
+				break;
+			proposed = (d1 > ZERO_POINT_ZERO ? v * (FLOAT_TYPE) 4.0 : v * (FLOAT_TYPE) 0.25);
+			}
+		proposed = max(min(proposed, max_brlen), min_brlen);
+		//stay within the interval known to contain the peak
+		if(proposed < knownMin || proposed > knownMax)
+			proposed = (knownMin + knownMax) * ZERO_POINT_FIVE;
+		v = proposed;
+		if(converged)
+			break;
+		}
+	return v;
+	}
+
+//Fills grad with the first derivative of the lnL with respect to the length of each branch, indexed by 
+//nodeNum - 1.  Scoring leaves all of the downward CLAs clean, and visiting the branches in preorder means
+//that each upward CLA only needs to be calculated once from its parent's.  The tree lnL is left current.
+void Tree::CalcBranchLengthGradient(vector<FLOAT_TYPE> &grad){
+	grad.assign(numNodesTotal - 1, ZERO_POINT_ZERO);
+	bool scoreOK;
+	int attempts = 0;
+	do{
+		scoreOK = true;
+		try{
+			Score();
+			vector<TreeNode *> pending(1, root);
+			while(pending.empty() == false){
+				TreeNode *nd = pending.back();
+				pending.pop_back();
+				for(TreeNode *des = nd->left;des != NULL;des = des->next){
+					grad[des->nodeNum - 1] = CalcDerivativesRateHet(nd, des).first;
+					optCalcs++;
+					if(des->IsInternal())
+						pending.push_back(des);
+					}
+				}
+			}
+		catch(int err){
+			scoreOK = false;
+			//the failed sweep's temporary reservations would otherwise stay held through the retry
+			RemoveTempClaReservations();
+			MakeAllNodesDirty();
+			if(err == 1){
+				rescaleEvery -= 2;
+				if(rescaleEvery < 2) throw(ErrorException("Problem with rescaling in branchlength optimization.\nPlease report this error (and the details of your analysis) to garli.support@gmail.com."));
+				}
+			else if(++attempts > 2)
+				throw(ErrorException("Ran out of conditional likelihood arrays in branchlength optimization.\nTry increasing the availablememory setting."));
+			}
+		}while(scoreOK == false);
+	RemoveTempClaReservations();
+	}
+
+//Optimizes all branch lengths simultaneously with a limited memory quasi-Newton method (L-BFGS) projected 
+//onto the min_brlen/max_brlen bounds.  Branches sitting at a bound with the gradient pushing them past it are 
+//held fixed for that iteration, and steps that leave the box are clipped back onto it.  Each iteration needs 
+//only a single gradient pass plus the rescoring done by the backtracking line search, rather than the CLA 
+//updates for every Newton-Raphson step on every branch.  Returns the true improvement in score.
+FLOAT_TYPE Tree::GradientOptimizeAllBranches(FLOAT_TYPE optPrecision){
+	//without analytical derivatives, or with branches that are tied to each other, use the usual approach
+	if(useOptBoundedForBlen || rootWithDummy)
+		return OptimizeAllBranches(optPrecision);
+
+	const int numBranches = numNodesTotal - 1;
+	const int maxPairs = 6;
+	const int maxIter = 200;
+
+	//everything below is in terms of minimizing -lnL
+	vector<FLOAT_TYPE> x(numBranches), g(numBranches), d(numBranches), xNew(numBranches), gNew(numBranches);
+	list< vector<FLOAT_TYPE> > sHist, yHist;
+	list<FLOAT_TYPE> rhoHist;
+
+	for(int b = 0;b < numBranches;b++)
+		x[b] = allNodes[b + 1]->dlen;
+	CalcBranchLengthGradient(g);
+	for(int b = 0;b < numBranches;b++)
+		g[b] = -g[b];
+	FLOAT_TYPE f = -lnL;
+	const FLOAT_TYPE startL = lnL;
+	int numScores = 1, numGradients = 1, iter;
+
+	for(iter = 0;iter < maxIter;iter++){
+		//branches that are pinned at a bound by the gradient are fixed for this iteration
+		vector<bool> isFree(numBranches);
+		FLOAT_TYPE maxG = ZERO_POINT_ZERO;
+		for(int b = 0;b < numBranches;b++){
+			isFree[b] = !((x[b] <= min_brlen && g[b] > ZERO_POINT_ZERO) || (x[b] >= max_brlen && g[b] < ZERO_POINT_ZERO));
+			if(isFree[b])
+				maxG = max(maxG, (FLOAT_TYPE) fabs(g[b]));
+			}
+		if(maxG == ZERO_POINT_ZERO)
+			break;
+
+		//two loop recursion for the quasi-Newton direction over the free branches
+		for(int b = 0;b < numBranches;b++)
+			d[b] = (isFree[b] ? -g[b] : ZERO_POINT_ZERO);
+		vector<FLOAT_TYPE> alphas;
+		list< vector<FLOAT_TYPE> >::reverse_iterator sit = sHist.rbegin(), yit = yHist.rbegin();
+		list<FLOAT_TYPE>::reverse_iterator rit = rhoHist.rbegin();
+		for(;sit != sHist.rend();sit++, yit++, rit++){
+			FLOAT_TYPE a = ZERO_POINT_ZERO;
+			for(int b = 0;b < numBranches;b++)
+				if(isFree[b]) a += (*sit)[b] * d[b];
+			a *= *rit;
+			for(int b = 0;b < numBranches;b++)
+				if(isFree[b]) d[b] -= a * (*yit)[b];
+			alphas.push_back(a);
+			}
+		if(sHist.empty()){
+			//no curvature information yet, so limit the first step to a modest change in the longest moving branch
+			for(int b = 0;b < numBranches;b++)
+				d[b] *= (FLOAT_TYPE) 0.01 / maxG;
+			}
+		else{
+			FLOAT_TYPE sy = ZERO_POINT_ZERO, yy = ZERO_POINT_ZERO;
+			for(int b = 0;b < numBranches;b++){
+				sy += sHist.back()[b] * yHist.back()[b];
+				yy += yHist.back()[b] * yHist.back()[b];
+				}
+			for(int b = 0;b < numBranches;b++)
+				d[b] *= sy / yy;
+			}
+		list< vector<FLOAT_TYPE> >::iterator fsit = sHist.begin(), fyit = yHist.begin();
+		list<FLOAT_TYPE>::iterator frit = rhoHist.begin();
+		vector<FLOAT_TYPE>::reverse_iterator ait = alphas.rbegin();
+		for(;fsit != sHist.end();fsit++, fyit++, frit++, ait++){
+			FLOAT_TYPE beta = ZERO_POINT_ZERO;
+			for(int b = 0;b < numBranches;b++)
+				if(isFree[b]) beta += (*fyit)[b] * d[b];
+			beta *= *frit;
+			for(int b = 0;b < numBranches;b++)
+				if(isFree[b]) d[b] += (*fsit)[b] * (*ait - beta);
+			}
+
+		FLOAT_TYPE dg = ZERO_POINT_ZERO;
+		for(int b = 0;b < numBranches;b++)
+			dg += d[b] * g[b];
+		if(!(dg < ZERO_POINT_ZERO)){
+			//not a descent direction, so throw out the history and start over with steepest descent
+			sHist.clear();
+			yHist.clear();
+			rhoHist.clear();
+			for(int b = 0;b < numBranches;b++)
+				d[b] = (isFree[b] ? -g[b] * (FLOAT_TYPE) 0.01 / maxG : ZERO_POINT_ZERO);
+			}
+
+		//backtracking line search along the projected path, with an Armijo sufficient decrease condition
+		FLOAT_TYPE step = ONE_POINT_ZERO;
+		FLOAT_TYPE fNew = f;
+		bool accepted = false;
+		for(int ls = 0;ls < 20 && !accepted;ls++, step *= ZERO_POINT_FIVE){
+			FLOAT_TYPE predicted = ZERO_POINT_ZERO;
+			for(int b = 0;b < numBranches;b++){
+				xNew[b] = max(min(x[b] + step * d[b], max_brlen), min_brlen);
+				predicted += g[b] * (xNew[b] - x[b]);
+				SetBranchLength(allNodes[b + 1], xNew[b]);
+				}
+			Score();
+			numScores++;
+			fNew = -lnL;
+			accepted = (fNew <= f + (FLOAT_TYPE) 1.0e-4 * predicted);
+			}
+		if(!accepted){
+			for(int b = 0;b < numBranches;b++)
+				SetBranchLength(allNodes[b + 1], x[b]);
+			Score();
+			break;
+			}
+
+		CalcBranchLengthGradient(gNew);
+		numGradients++;
+		vector<FLOAT_TYPE> s(numBranches), y(numBranches);
+		FLOAT_TYPE sy = ZERO_POINT_ZERO;
+		for(int b = 0;b < numBranches;b++){
+			gNew[b] = -gNew[b];
+			s[b] = xNew[b] - x[b];
+			y[b] = gNew[b] - g[b];
+			sy += s[b] * y[b];
+			}
+		//only keep pairs that maintain a positive definite approximation
+		if(sy > (FLOAT_TYPE) 1.0e-10){
+			sHist.push_back(s);
+			yHist.push_back(y);
+			rhoHist.push_back(ONE_POINT_ZERO / sy);
+			if((int) sHist.size() > maxPairs){
+				sHist.pop_front();
+				yHist.pop_front();
+				rhoHist.pop_front();
+				}
+			}
+		FLOAT_TYPE gain = f - fNew;
+		x = xNew;
+		g = gNew;
+		f = fNew;
+		if(gain < optPrecision)
+			break;
+		}
+	outman.DebugMessage("L-BFGS branch optimization: %d iterations, %d scorings, %d gradient passes, improvement %.6f", iter, numScores, numGradients, lnL - startL);
+	return lnL - startL;
+	}
+
+//The model parameters that OptimizeModelParametersJointly takes care of.  Omega and flex rates have ordering 
+//constraints, and estimated amino acid matrices and oriented gap models have their own routines, so those are
+//left to the usual sequential optimizers.
+void Tree::JointModelParameterCoverage(const ModelSpecification *modSpec, bool &alpha, bool &pinv, bool &freqs, bool &relRates){
+	alpha = pinv = freqs = relRates = false;
+	if(modSpec->IsOrientedGap())
+		return;
+	alpha = (modSpec->numRateCats > 1 && !modSpec->IsCodon() && !modSpec->IsFlexRateHet() && !modSpec->fixAlpha);
+	pinv = (modSpec->includeInvariantSites && !modSpec->fixInvariantSites);
+	freqs = (!modSpec->IsCodon() && !modSpec->fixStateFreqs && !modSpec->IsEqualStateFrequencies() && !modSpec->IsEmpiricalStateFrequencies());
+	relRates = (modSpec->IsNucleotide() && !modSpec->fixRelativeRates && modSpec->Nst() > 1);
+	}
+
+//Sets all of the parameters to the values in x and returns the resulting lnL
+FLOAT_TYPE Tree::ScoreJointModelParameters(const vector<JointModelParam> &params, const vector<FLOAT_TYPE> &x){
+	vector< vector<FLOAT_TYPE> > freqs(modPart->NumModels());
+	vector<FLOAT_TYPE> subsetRates;
+	for(int p = 0;p < (int) params.size();p++){
+		const JointModelParam &par = params[p];
+		if(par.type == JointModelParam::SUBSETRATE){
+			if(subsetRates.empty())
+				subsetRates.resize(modPart->NumSubsetRates());
+			subsetRates[par.which] = exp(x[p]);
+			continue;
+			}
+		Model *mod = modPart->GetModel(par.modnum);
+		if(par.type == JointModelParam::ALPHA)
+			mod->SetAlpha(0, exp(x[p]));
+		else if(par.type == JointModelParam::PINV)
+			mod->SetPinv(0, x[p]);
+		else if(par.type == JointModelParam::RELRATE)
+			mod->SetRelativeNucRate(par.which, exp(x[p]));
+		else if(par.type == JointModelParam::FREQ){
+			if(freqs[par.modnum].empty())
+				freqs[par.modnum].resize(mod->NStates());
+			freqs[par.modnum][par.which] = exp(x[p]);
+			}
+		}
+	for(int m = 0;m < (int) freqs.size();m++){
+		if(freqs[m].empty() == false)
+			modPart->GetModel(m)->SetAllEquilibriumFreqs(freqs[m]);
+		}
+	if(subsetRates.empty() == false)
+		modPart->SetSubsetRates(subsetRates, true);
+	MakeAllNodesDirty();
+	Score();
+	return lnL;
+	}
+
+//Forward difference gradient of -lnL, where f is -lnL at x.  This leaves the model parameters perturbed.
+void Tree::JointModelParameterGradient(const vector<JointModelParam> &params, const vector<FLOAT_TYPE> &x, FLOAT_TYPE f, vector<FLOAT_TYPE> &g){
+	const FLOAT_TYPE h = 1.0e-4;
+	vector<FLOAT_TYPE> xh(x);
+	for(int p = 0;p < (int) params.size();p++){
+		FLOAT_TYPE step = (x[p] + h <= params[p].high ? h : -h);
+		xh[p] = x[p] + step;
+		g[p] = (-ScoreJointModelParameters(params, xh) - f) / step;
+		xh[p] = x[p];
+		}
+	}
+
+//Optimizes alpha, pinv, state frequencies, nucleotide relative rates and subset rates of all models together 
+//with the tree held fixed, using BFGS with forward difference gradients and a projected backtracking line 
+//search to respect the bounds.  Linked subsets share a Model, so each set of parameters appears only once.
+//Returns the improvement in score, and the number of likelihood evaluations used in numEvals.
+FLOAT_TYPE Tree::OptimizeModelParametersJointly(FLOAT_TYPE optPrecision, int &numEvals){
+	vector<JointModelParam> params;
+	vector<FLOAT_TYPE> x;
+	numEvals = 0;
+
+	for(int m = 0;m < modPart->NumModels();m++){
+		Model *mod = modPart->GetModel(m);
+		const ModelSpecification *modSpec = mod->GetCorrespondingSpec();
+		bool optAlpha, optPinv, optFreqs, optRelRates;
+		JointModelParameterCoverage(modSpec, optAlpha, optPinv, optFreqs, optRelRates);
+		if(optAlpha){
+			params.push_back(JointModelParam(JointModelParam::ALPHA, m, 0, log(min(0.05, mod->Alpha())), log(max(999.9, mod->Alpha()))));
+			x.push_back(log(mod->Alpha()));
+			}
+		if(optPinv){
+			params.push_back(JointModelParam(JointModelParam::PINV, m, 0, min(1.0e-8, mod->PropInvar()), max(mod->maxPropInvar, mod->PropInvar())));
+			x.push_back(mod->PropInvar());
+			}
+		if(optFreqs){
+			for(int s = 0;s < mod->NStates();s++){
+				params.push_back(JointModelParam(JointModelParam::FREQ, m, s, log(1.0e-4), ZERO_POINT_ZERO));
+				x.push_back(log(mod->StateFreq(s)));
+				}
+			}
+		if(optRelRates){
+			for(int r = 0;r < 5;r++){
+				//for K2P-like models only the transition rate is free, and rates aliased to others in arbitrary matrices are skipped
+				bool skip = (mod->Nst() == 2 && r != 1);
+				if(modSpec->IsArbitraryRateMatrix()){
+					const int *ind = mod->GetArbitraryRateMatrixIndeces();
+					skip = (ind[r] == ind[5]);
+					for(int prev = 0;prev < r;prev++)
+						if(ind[prev] == ind[r]) skip = true;
+					}
+				if(!skip){
+					params.push_back(JointModelParam(JointModelParam::RELRATE, m, r, log(min(1.0e-3, mod->Rates(r))), log(max(999.0, mod->Rates(r)))));
+					x.push_back(log(mod->Rates(r)));
+					}
+				}
+			}
+		}
+	if(modSpecSet.InferSubsetRates()){
+		for(int d = 0;d < modPart->NumSubsetRates();d++){
+			params.push_back(JointModelParam(JointModelParam::SUBSETRATE, -1, d, log(min(1.0e-5, modPart->SubsetRate(d))), log(max(100.0, modPart->SubsetRate(d)))));
+			x.push_back(log(modPart->SubsetRate(d)));
+			}
+		}
+
+	const int n = (int) params.size();
+	if(n == 0)
+		return ZERO_POINT_ZERO;
+
+	//minimizing -lnL from here on
+	const vector<FLOAT_TYPE> xStart(x);
+	FLOAT_TYPE f = -ScoreJointModelParameters(params, x);
+	numEvals++;
+	const FLOAT_TYPE startL = -f;
+	vector<FLOAT_TYPE> g(n), gNew(n), d(n), xNew(n), Hy(n);
+	JointModelParameterGradient(params, x, f, g);
+	numEvals += n;
+
+	//inverse Hessian approximation, rescaled after the first usable step
+	vector< vector<FLOAT_TYPE> > H(n, vector<FLOAT_TYPE>(n, ZERO_POINT_ZERO));
+	for(int i = 0;i < n;i++)
+		H[i][i] = ONE_POINT_ZERO;
+	bool haveCurvature = false;
+
+	for(int iter = 0;iter < 50;iter++){
+		vector<bool> isFree(n);
+		FLOAT_TYPE maxG = ZERO_POINT_ZERO;
+		for(int i = 0;i < n;i++){
+			isFree[i] = !((x[i] <= params[i].low && g[i] > ZERO_POINT_ZERO) || (x[i] >= params[i].high && g[i] < ZERO_POINT_ZERO));
+			if(isFree[i])
+				maxG = max(maxG, (FLOAT_TYPE) fabs(g[i]));
+			}
+		if(maxG == ZERO_POINT_ZERO)
+			break;
+
+		FLOAT_TYPE dg = ZERO_POINT_ZERO;
+		for(int i = 0;i < n;i++){
+			d[i] = ZERO_POINT_ZERO;
+			if(isFree[i]){
+				for(int j = 0;j < n;j++)
+					if(isFree[j]) d[i] -= H[i][j] * g[j];
+				if(!haveCurvature)
+					d[i] *= (FLOAT_TYPE) 0.1 / maxG;
+				}
+			dg += d[i] * g[i];
+			}
+		if(!(dg < ZERO_POINT_ZERO)){
+			//not a descent direction, so start over from steepest descent
+			for(int i = 0;i < n;i++){
+				for(int j = 0;j < n;j++)
+					H[i][j] = (i == j ? ONE_POINT_ZERO : ZERO_POINT_ZERO);
+				d[i] = (isFree[i] ? -g[i] * (FLOAT_TYPE) 0.1 / maxG : ZERO_POINT_ZERO);
+				}
+			haveCurvature = false;
+			}
+
+		FLOAT_TYPE step = ONE_POINT_ZERO;
+		FLOAT_TYPE fNew = f;
+		bool accepted = false;
+		for(int ls = 0;ls < 20 && !accepted;ls++, step *= ZERO_POINT_FIVE){
+			FLOAT_TYPE predicted = ZERO_POINT_ZERO;
+			for(int i = 0;i < n;i++){
+				xNew[i] = max(min(x[i] + step * d[i], params[i].high), params[i].low);
+				predicted += g[i] * (xNew[i] - x[i]);
+				}
+			fNew = -ScoreJointModelParameters(params, xNew);
+			numEvals++;
+			accepted = (fNew <= f + (FLOAT_TYPE) 1.0e-4 * predicted);
+			}
+		if(!accepted)
+			break;
+
+		JointModelParameterGradient(params, xNew, fNew, gNew);
+		numEvals += n;
+
+		vector<FLOAT_TYPE> s(n), y(n);
+		FLOAT_TYPE sy = ZERO_POINT_ZERO, yy = ZERO_POINT_ZERO;
+		for(int i = 0;i < n;i++){
+			s[i] = xNew[i] - x[i];
+			y[i] = gNew[i] - g[i];
+			sy += s[i] * y[i];
+			yy += y[i] * y[i];
+			}
+		if(sy > (FLOAT_TYPE) 1.0e-10){
+			if(!haveCurvature){
+				for(int i = 0;i < n;i++)
+					H[i][i] = sy / yy;
+				haveCurvature = true;
+				}
+			//BFGS update of the inverse Hessian
+			FLOAT_TYPE yHy = ZERO_POINT_ZERO;
+			for(int i = 0;i < n;i++){
+				Hy[i] = ZERO_POINT_ZERO;
+				for(int j = 0;j < n;j++)
+					Hy[i] += H[i][j] * y[j];
+				yHy += y[i] * Hy[i];
+				}
+			for(int i = 0;i < n;i++)
+				for(int j = 0;j < n;j++)
+					H[i][j] += ((sy + yHy) * s[i] * s[j]) / (sy * sy) - (Hy[i] * s[j] + s[i] * Hy[j]) / sy;
+			}
+
+		FLOAT_TYPE gain = f - fNew;
+		x = xNew;
+		g = gNew;
+		f = fNew;
+		if(gain < optPrecision)
+			break;
+		}
+
+	//the gradient calculation and line search leave the parameters elsewhere, so put them back at the best point
+	FLOAT_TYPE endL = ScoreJointModelParameters(params, x);
+	numEvals++;
+	if(endL < startL){
+		endL = ScoreJointModelParameters(params, xStart);
+		numEvals++;
+		}
+	return endL - startL;
+	}
+
 int Tree::PushBranchlengthsToMin(){
 	int num = 0;
 	pair<FLOAT_TYPE, FLOAT_TYPE> derivs;
@@ -454,22 +1055,18 @@ FLOAT_TYPE Tree::OptimizeBoundedParameter(int modnum, FLOAT_TYPE optPrecision, F
 	curves.precision(12);
 	curves << "\n";
 	ofprefix = "SLs";
-	string oname = ofprefix;
-	oname += ".sitelikes.log";
 	Model *mod = modPart->GetModel(modnum);
 	sitelikeLevel = 1;
 	double inc = curVal / 20.0;
 	for(double c = curVal / 20.0; c < curVal * 20.0 ; c += inc){
 		FLOAT_TYPE v = SetAndEvaluateParameter(modnum, which, c, bestKnownScore, bestKnownVal, SetParam);
 		curves << c << "\t" << v << "\n";
-		ofstream ordered(oname.c_str(), ios::app);
-		ordered.precision(10);
-		ordered << "1" << "\t" << -lnL << "\n";
-		ordered.close();
+		siteLikeOutput.EndTree(1, lnL, 10);
 
 		sitelikeLevel = -1;
 		}
 	curves.close();
+	siteLikeOutput.Close();
 	sitelikeLevel = 0;
 	SetAndEvaluateParameter(modnum, which, curVal, bestKnownScore, bestKnownVal, SetParam);
 /*	ofstream ordered(oname.c_str(), ios::app);
@@ -821,7 +1418,7 @@ FLOAT_TYPE Tree::OptimizeBranchLength(FLOAT_TYPE optPrecision, TreeNode *nd, boo
 /*	ofstream opttrees;
 	if(num == 1) opttrees.open("everyTree.tre");
 	else opttrees.open("everyTree.tre", ios::app);
-	char treeString[20000];
+	string treeString;
 	root->MakeNewick(treeString, false, true);
 	opttrees <<  "utree tree" << num++ << "_" << nd->nodeNum << "=" << treeString << ";" << endl;
 	opttrees.close();
@@ -1179,11 +1776,66 @@ pair<FLOAT_TYPE, FLOAT_TYPE> Tree::CalcDerivativesRateHet(TreeNode *nd1, TreeNod
 		d2tot += d2 * modPart->SubsetRate((*specs).dataIndex) * modPart->SubsetRate((*specs).dataIndex);
 		}
 
+	if(numPatternSlices > 1){
+		double tots[3] = {d1tot, d2tot, lnL};
+		SumAcrossSlices(tots, 3);
+		d1tot = tots[0];
+		d2tot = tots[1];
+		lnL = tots[2];
+		}
+
 	assert(d1 == d1);
 	assert(d2 == d2);
 	return pair<FLOAT_TYPE, FLOAT_TYPE>(d1tot, d2tot);
 }
 
+//Calculates the derivatives for nd's branch at length len from already calculated CLAs, with the pmats coming from 
+//pmatMods rather than the tree's own models.  This leaves the tree and its models untouched so that it can be used 
+//concurrently for different branches, with each thread passing its own copy of the models.
+pair<FLOAT_TYPE, FLOAT_TYPE> Tree::CalcDerivativesFromClas(TreeNode *nd, FLOAT_TYPE len, CondLikeArraySet *setOne, CondLikeArraySet *setTwo, ModelPartition *pmatMods){
+	FLOAT_TYPE ***deriv1, ***deriv2, ***prmat;
+	FLOAT_TYPE d1tot=ZERO_POINT_ZERO, d2tot=ZERO_POINT_ZERO, branchL=ZERO_POINT_ZERO;
+
+	for(vector<ClaSpecifier>::iterator specs = claSpecs.begin();specs != claSpecs.end();specs++){
+		FLOAT_TYPE d1=ZERO_POINT_ZERO, d2=ZERO_POINT_ZERO;
+		Model *mod = pmatMods->GetModel((*specs).modelIndex);
+		FLOAT_TYPE subsetRate = modPart->SubsetRate((*specs).dataIndex);
+		mod->CalcDerivatives(len * subsetRate, prmat, deriv1, deriv2);
+		CondLikeArray *claOne = setOne->GetCLA((*specs).claIndex);
+
+		if(nd->left == NULL){
+			char *childData=nd->tipData[(*specs).dataIndex];
+			if(mod->IsNucleotide() == false){
+				if(mod->NRateCats() > 1)
+					GetDerivsPartialTerminalNStateRateHet(claOne, **prmat, **deriv1, **deriv2, childData, d1, d2, (*specs).modelIndex, (*specs).dataIndex, &branchL);
+				else
+					GetDerivsPartialTerminalNState(claOne, **prmat, **deriv1, **deriv2, childData, d1, d2, (*specs).modelIndex, (*specs).dataIndex, &branchL);
+				}
+			else{
+	#ifdef OPEN_MP
+				GetDerivsPartialTerminal(claOne, **prmat, **deriv1, **deriv2, childData, d1, d2, (*specs).modelIndex, (*specs).dataIndex, nd->ambigMap[(*specs).dataIndex], &branchL);
+	#else
+				GetDerivsPartialTerminal(claOne, **prmat, **deriv1, **deriv2, childData, d1, d2, (*specs).modelIndex, (*specs).dataIndex, NULL, &branchL);
+	#endif
+				}
+			}
+		else{
+			CondLikeArray *claTwo = setTwo->GetCLA((*specs).claIndex);
+			if(mod->IsNucleotide() == false){
+				if(mod->NRateCats() > 1)
+					GetDerivsPartialInternalNStateRateHet(claOne, claTwo, **prmat, **deriv1, **deriv2, d1, d2, (*specs).modelIndex, (*specs).dataIndex, &branchL);
+				else
+					GetDerivsPartialInternalNState(claOne, claTwo, **prmat, **deriv1, **deriv2, d1, d2, (*specs).modelIndex, (*specs).dataIndex, &branchL);
+				}
+			else
+				GetDerivsPartialInternal(claOne, claTwo, **prmat, **deriv1, **deriv2, d1, d2, (*specs).modelIndex, (*specs).dataIndex, &branchL);
+			}
+		d1tot += d1 * subsetRate;
+		d2tot += d2 * subsetRate * subsetRate;
+		}
+	return pair<FLOAT_TYPE, FLOAT_TYPE>(d1tot, d2tot);
+	}
+
 FLOAT_TYPE Tree::BranchLike(TreeNode *optNode){
 
 	bool scoreOK=true;
@@ -2073,7 +2725,7 @@ inline FLOAT_TYPE CallBranchLikeRateHet(TreeNode *thisnode, Tree *thistree, FLOA
 	opt.close();
 
 	ofstream opttrees("opttrees.tre", ios::app);
-		char treeString[20000];
+		string treeString;
 		thistree->root->MakeNewick(treeString, false);
 		opttrees <<  "utree tree1=" << treeString << ";" << endl;
 		opttrees.close();
@@ -2398,7 +3050,7 @@ if(here->anc){
 	return initialScore - minScore;
 	}
 
-void Tree::GetDerivsPartialTerminal(const CondLikeArray *partialCLA, const FLOAT_TYPE *prmat, const FLOAT_TYPE *d1mat, const FLOAT_TYPE *d2mat, const char *Ldat, FLOAT_TYPE &d1Tot, FLOAT_TYPE &d2Tot, int modIndex, int dataIndex, const unsigned *ambigMap /*=NULL*/){
+void Tree::GetDerivsPartialTerminal(const CondLikeArray *partialCLA, const FLOAT_TYPE *prmat, const FLOAT_TYPE *d1mat, const FLOAT_TYPE *d2mat, const char *Ldat, FLOAT_TYPE &d1Tot, FLOAT_TYPE &d2Tot, int modIndex, int dataIndex, const unsigned *ambigMap /*=NULL*/, FLOAT_TYPE *lnLDest /*=NULL*/){
 	//this function assumes that the pmat is arranged with the 16 entries for the
 	//first rate, followed by 16 for the second, etc.
 	const FLOAT_TYPE *partial=partialCLA->arr;
@@ -2570,7 +3222,10 @@ void Tree::GetDerivsPartialTerminal(const CondLikeArray *partialCLA, const FLOAT
 
 	d1Tot = tot1;
 	d2Tot = tot2;
-	lnL += totL;
+	if(lnLDest != NULL)
+		*lnLDest += totL;
+	else
+		lnL += totL;
 
 /*	double poo = lnL;
 	MakeAllNodesDirty();
@@ -2578,7 +3233,7 @@ void Tree::GetDerivsPartialTerminal(const CondLikeArray *partialCLA, const FLOAT
 	assert(FloatingPointEquals(lnL, poo, 1e-8));
 */	}
 	
-void Tree::GetDerivsPartialTerminalNState(const CondLikeArray *partialCLA, const FLOAT_TYPE *prmat, const FLOAT_TYPE *d1mat, const FLOAT_TYPE *d2mat, const char *Ldat, FLOAT_TYPE &d1Tot, FLOAT_TYPE &d2Tot, int modIndex, int dataIndex){
+void Tree::GetDerivsPartialTerminalNState(const CondLikeArray *partialCLA, const FLOAT_TYPE *prmat, const FLOAT_TYPE *d1mat, const FLOAT_TYPE *d2mat, const char *Ldat, FLOAT_TYPE &d1Tot, FLOAT_TYPE &d2Tot, int modIndex, int dataIndex, FLOAT_TYPE *lnLDest /*=NULL*/){
 	//this function assumes that the pmat is arranged with nstates^2 entries for the
 	//first rate, followed by nstates^2 for the second, etc.
 	const FLOAT_TYPE *partial=partialCLA->arr;
@@ -2843,10 +3498,13 @@ void Tree::GetDerivsPartialTerminalNState(const CondLikeArray *partialCLA, const
 
 	d1Tot = tot1;
 	d2Tot = tot2;
-	lnL += totL;
+	if(lnLDest != NULL)
+		*lnLDest += totL;
+	else
+		lnL += totL;
 	}
 
-void Tree::GetDerivsPartialTerminalNStateRateHet(const CondLikeArray *partialCLA, const FLOAT_TYPE *prmat, const FLOAT_TYPE *d1mat, const FLOAT_TYPE *d2mat, const char *Ldat, FLOAT_TYPE &d1Tot, FLOAT_TYPE &d2Tot, int modIndex, int dataIndex){
+void Tree::GetDerivsPartialTerminalNStateRateHet(const CondLikeArray *partialCLA, const FLOAT_TYPE *prmat, const FLOAT_TYPE *d1mat, const FLOAT_TYPE *d2mat, const char *Ldat, FLOAT_TYPE &d1Tot, FLOAT_TYPE &d2Tot, int modIndex, int dataIndex, FLOAT_TYPE *lnLDest /*=NULL*/){
 	//this function assumes that the pmat is arranged with nstates^2 entries for the
 	//first rate, followed by nstates^2 for the second, etc.
 	const FLOAT_TYPE *partial=partialCLA->arr;
@@ -3046,10 +3704,13 @@ void Tree::GetDerivsPartialTerminalNStateRateHet(const CondLikeArray *partialCLA
 
 	d1Tot = tot1;
 	d2Tot = tot2;
-	lnL += totL;
+	if(lnLDest != NULL)
+		*lnLDest += totL;
+	else
+		lnL += totL;
 	}
 
-void Tree::GetDerivsPartialInternal(const CondLikeArray *partialCLA, const CondLikeArray *childCLA, const FLOAT_TYPE *prmat, const FLOAT_TYPE *d1mat, const FLOAT_TYPE *d2mat, FLOAT_TYPE &d1Tot, FLOAT_TYPE &d2Tot, int modIndex, int dataIndex){
+void Tree::GetDerivsPartialInternal(const CondLikeArray *partialCLA, const CondLikeArray *childCLA, const FLOAT_TYPE *prmat, const FLOAT_TYPE *d1mat, const FLOAT_TYPE *d2mat, FLOAT_TYPE &d1Tot, FLOAT_TYPE &d2Tot, int modIndex, int dataIndex, FLOAT_TYPE *lnLDest /*=NULL*/){
 	//this function assumes that the pmat is arranged with the 16 entries for the
 	//first rate, followed by 16 for the second, etc.
 	const FLOAT_TYPE *CL1=childCLA->arr;
@@ -3213,10 +3874,13 @@ void Tree::GetDerivsPartialInternal(const CondLikeArray *partialCLA, const CondL
 
 	d1Tot = tot1;
 	d2Tot = tot2;
-	lnL += totL;
+	if(lnLDest != NULL)
+		*lnLDest += totL;
+	else
+		lnL += totL;
 	}
 
-void Tree::GetDerivsPartialInternalNStateRateHet(const CondLikeArray *partialCLA, const CondLikeArray *childCLA, const FLOAT_TYPE *prmat, const FLOAT_TYPE *d1mat, const FLOAT_TYPE *d2mat, FLOAT_TYPE &d1Tot, FLOAT_TYPE &d2Tot, int modIndex, int dataIndex){
+void Tree::GetDerivsPartialInternalNStateRateHet(const CondLikeArray *partialCLA, const CondLikeArray *childCLA, const FLOAT_TYPE *prmat, const FLOAT_TYPE *d1mat, const FLOAT_TYPE *d2mat, FLOAT_TYPE &d1Tot, FLOAT_TYPE &d2Tot, int modIndex, int dataIndex, FLOAT_TYPE *lnLDest /*=NULL*/){
 	//this function assumes that the pmat is arranged with the nstates^2 entries for the
 	//first rate, followed by nstates^2 for the second, etc.
 	const FLOAT_TYPE *CL1=childCLA->arr;
@@ -3408,10 +4072,13 @@ void Tree::GetDerivsPartialInternalNStateRateHet(const CondLikeArray *partialCLA
 
 	d1Tot = tot1;
 	d2Tot = tot2;
-	lnL += totL;
+	if(lnLDest != NULL)
+		*lnLDest += totL;
+	else
+		lnL += totL;
 	}
 
-void Tree::GetDerivsPartialInternalNState(const CondLikeArray *partialCLA, const CondLikeArray *childCLA, const FLOAT_TYPE *prmat, const FLOAT_TYPE *d1mat, const FLOAT_TYPE *d2mat, FLOAT_TYPE &d1Tot, FLOAT_TYPE &d2Tot, int modIndex, int dataIndex){
+void Tree::GetDerivsPartialInternalNState(const CondLikeArray *partialCLA, const CondLikeArray *childCLA, const FLOAT_TYPE *prmat, const FLOAT_TYPE *d1mat, const FLOAT_TYPE *d2mat, FLOAT_TYPE &d1Tot, FLOAT_TYPE &d2Tot, int modIndex, int dataIndex, FLOAT_TYPE *lnLDest /*=NULL*/){
 	//this function assumes that the pmat is arranged with the nstates^2 entries for the
 	//first rate, followed by nstates^2 for the second, etc.
 	const FLOAT_TYPE *CL1=childCLA->arr;
@@ -3597,7 +4264,10 @@ void Tree::GetDerivsPartialInternalNState(const CondLikeArray *partialCLA, const
 
 	d1Tot = tot1;
 	d2Tot = tot2;
-	lnL += totL;
+	if(lnLDest != NULL)
+		*lnLDest += totL;
+	else
+		lnL += totL;
 	}
 
 void Tree::GetDerivsPartialInternalEQUIV(const CondLikeArray *partialCLA, const CondLikeArray *childCLA, const FLOAT_TYPE *prmat, const FLOAT_TYPE *d1mat, const FLOAT_TYPE *d2mat, FLOAT_TYPE &d1Tot, FLOAT_TYPE &d2Tot, char *equiv, int modIndex, int dataIndex){
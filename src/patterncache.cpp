@@ -0,0 +1,208 @@
+// GARLI version 2.0 source code
+// Copyright 2005-2011 Derrick J. Zwickl
+// email: garli.support@gmail.com
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <cstring>
+#include <sstream>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef UNIX
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+#include "defs.h"
+#include "patterncache.h"
+#include "datamatr.h"
+#include "sequencedata.h"
+#include "outputman.h"
+#include "errorexception.h"
+
+extern OutputManager outman;
+
+//the format version is part of the magic string, so bump it if the layout written by
+//DataMatrix::WritePackedPatterns ever changes
+static const char packMagic[] = "GARLIPK2";
+
+//FNV-1a
+PackKey PatternCache::Hash(const void *bytes, size_t len, PackKey h){
+	const unsigned char *b = (const unsigned char *) bytes;
+	for(size_t i = 0;i < len;i++){
+		h ^= (PackKey) b[i];
+		h *= 1099511628211ULL;
+		}
+	return h;
+	}
+
+void PatternCache::Close(){
+	if(in != NULL){
+		fclose(in);
+		in = NULL;
+		}
+	}
+
+static void ReadCacheValues(void *dest, size_t size, size_t num, FILE *in){
+	if(num > 0 && fread(dest, size, num, in) != num)
+		throw ErrorException("Pattern cache file appears to be truncated or corrupt.\n\tDelete it and it will be recreated.");
+	}
+
+static void ReadCacheString(string &str, FILE *in){
+	int len;
+	ReadCacheValues(&len, sizeof(int), 1, in);
+	if(len < 0)
+		throw ErrorException("Pattern cache file appears to be corrupt.\n\tDelete it and it will be recreated.");
+	vector<char> buf(len + 1, '\0');
+	ReadCacheValues(&buf[0], sizeof(char), len, in);
+	str = &buf[0];
+	}
+
+static void WriteCacheString(const string &str, FILE *out){
+	int len = (int) str.length();
+	fwrite(&len, sizeof(int), 1, out);
+	fwrite(str.c_str(), sizeof(char), len, out);
+	}
+
+void PatternCache::Initialize(const string &dataFile, const string &settings){
+	Close();
+	subsets.clear();
+	contents.clear();
+	numRead = 0;
+	complete = holdsAllData = false;
+	cacheName = dataFile + ".garli-pack";
+
+	//reading the whole datafile to hash it would cost about as much as the packing that the cache saves,
+	//so a changed file is recognized by its size and modification time
+	struct stat st;
+	if(stat(dataFile.c_str(), &st) != 0){
+		key = 0;
+		return;
+		}
+	//sizes of the types are included so that a cache from a different build is never used
+	stringstream desc;
+	desc << sizeof(int) << " " << sizeof(PackKey) << " " << (long long) st.st_size << " " << (long long) st.st_mtime;
+	key = Hash(settings, Hash(desc.str()));
+	//zero means disabled
+	if(key == 0)
+		key = 1;
+
+	in = fopen(cacheName.c_str(), "rb");
+	if(in == NULL)
+		return;
+	char magic[sizeof(packMagic)];
+	PackKey fileKey;
+	if(fread(magic, sizeof(char), sizeof(packMagic), in) != sizeof(packMagic) || memcmp(magic, packMagic, sizeof(packMagic)) != 0
+		|| fread(&fileKey, sizeof(PackKey), 1, in) != 1 || fileKey != key){
+		outman.UserMessage("NOTE: Pattern cache file %s does not match the current data and settings.\n\tIt will be recreated.", cacheName.c_str());
+		Close();
+		return;
+		}
+	int vals[2];
+	ReadCacheValues(vals, sizeof(int), 2, in);
+	if(vals[1] < 0)
+		throw ErrorException("Pattern cache file appears to be corrupt.\n\tDelete it and it will be recreated.");
+	contents.resize(vals[1]);
+	for(vector<CachedSubset>::iterator it = contents.begin();it != contents.end();it++){
+		ReadCacheValues(&(it->key), sizeof(PackKey), 1, in);
+		ReadCacheValues(&(it->charblockNum), sizeof(int), 1, in);
+		ReadCacheValues(&(it->partitionSubsetNum), sizeof(int), 1, in);
+		ReadCacheString(it->charblockName, in);
+		ReadCacheString(it->partitionSubsetName, in);
+		it->data = NULL;
+		}
+	holdsAllData = (vals[0] != 0 && contents.empty() == false);
+	complete = true;
+	}
+
+DataSubsetInfo PatternCache::SubsetInfo(int s) const{
+	//the types are set from the model specifications, as for subsets read with NCL
+	return DataSubsetInfo(s, contents[s].charblockNum, contents[s].charblockName, contents[s].partitionSubsetNum, contents[s].partitionSubsetName, DataSubsetInfo::NUCLEOTIDE, DataSubsetInfo::NUCLEOTIDE);
+	}
+
+bool PatternCache::ReadSubset(PackKey subsetKey, DataMatrix *data){
+	if(!complete || in == NULL)
+		return false;
+	if(numRead >= (int) contents.size() || contents[numRead].key != subsetKey){
+		complete = false;
+		Close();
+		return false;
+		}
+	data->ReadPackedPatterns(in);
+	numRead++;
+	outman.UserMessage("\tRead packed patterns from cache file %s", cacheName.c_str());
+	return true;
+	}
+
+void PatternCache::AddSubset(PackKey subsetKey, const DataSubsetInfo &info, const DataMatrix *data){
+	CachedSubset sub;
+	sub.key = subsetKey;
+	sub.charblockNum = info.charblockNum;
+	sub.charblockName = info.charblockName;
+	sub.partitionSubsetNum = info.partitionSubsetNum;
+	sub.partitionSubsetName = info.partitionSubsetName;
+	sub.data = data;
+	subsets.push_back(sub);
+	}
+
+void PatternCache::Write(bool allData){
+	Close();
+	//if everything came from the cache it only needs rewriting to record that it can now stand in for the datafile
+	if(!Enabled() || subsets.empty() || (complete && (holdsAllData || !allData)))
+		return;
+
+	//write to a temporary file and rename, so that another run reading the cache never sees it half written
+	stringstream tmp;
+	tmp << cacheName << ".tmp";
+#ifdef UNIX
+	tmp << getpid();
+#endif
+	FILE *out = fopen(tmp.str().c_str(), "wb");
+	if(out == NULL){
+		outman.UserMessage("NOTE: Could not write pattern cache file %s", cacheName.c_str());
+		return;
+		}
+	fwrite(packMagic, sizeof(char), sizeof(packMagic), out);
+	fwrite(&key, sizeof(PackKey), 1, out);
+	int vals[] = {(allData ? 1 : 0), (int) subsets.size()};
+	fwrite(vals, sizeof(int), 2, out);
+	for(vector<CachedSubset>::const_iterator it = subsets.begin();it != subsets.end();it++){
+		fwrite(&(it->key), sizeof(PackKey), 1, out);
+		fwrite(&(it->charblockNum), sizeof(int), 1, out);
+		fwrite(&(it->partitionSubsetNum), sizeof(int), 1, out);
+		WriteCacheString(it->charblockName, out);
+		WriteCacheString(it->partitionSubsetName, out);
+		}
+	for(vector<CachedSubset>::const_iterator it = subsets.begin();it != subsets.end();it++)
+		it->data->WritePackedPatterns(out);
+	bool ok = (ferror(out) == 0);
+	if(fclose(out) != 0)
+		ok = false;
+	if(ok){
+#ifndef UNIX
+		//rename won't replace an existing file on windows
+		remove(cacheName.c_str());
+#endif
+		ok = (rename(tmp.str().c_str(), cacheName.c_str()) == 0);
+		}
+	if(ok)
+		outman.UserMessage("Wrote packed patterns to cache file %s", cacheName.c_str());
+	else{
+		remove(tmp.str().c_str());
+		outman.UserMessage("NOTE: Could not write pattern cache file %s", cacheName.c_str());
+		}
+	complete = true;
+	}
@@ -0,0 +1,90 @@
+// GARLI version 2.0 source code
+// Copyright 2005-2011 Derrick J. Zwickl
+// email: garli.support@gmail.com
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef _PATTERNCACHE_
+#define _PATTERNCACHE_
+
+#include <string>
+#include <vector>
+#include <stdio.h>
+
+using namespace std;
+
+class DataMatrix;
+class DataSubsetInfo;
+
+typedef unsigned long long PackKey;
+
+//Binary cache of packed data subsets, written next to the datafile (as datafile.garli-pack) after the
+//patterns are first processed.  It is keyed by the size and modification time of the datafile and the
+//datatype settings, and each subset by a hash of its characters block and charset, so a stale or
+//mismatched cache is just ignored and rewritten.  The cache starts with a table of its subsets, and when
+//it holds every subset of the data and nothing else was needed from the datafile, later runs read the data
+//entirely from it without parsing the datafile with NCL.  Otherwise the packed subsets are still used in
+//place of extracting and packing them again.
+class PatternCache{
+	struct CachedSubset{
+		PackKey key;
+		int charblockNum;
+		string charblockName;
+		int partitionSubsetNum;
+		string partitionSubsetName;
+		const DataMatrix *data;	//only for subsets being written
+		};
+
+	string cacheName;
+	PackKey key;
+	FILE *in;
+	bool complete;		//every subset requested so far was read from the cache
+	bool holdsAllData;	//the cache being read can stand in for the datafile
+	vector<CachedSubset> contents;	//the table of the cache being read
+	int numRead;
+	vector<CachedSubset> subsets;	//the subsets to be written
+
+	void Close();
+
+public:
+	PatternCache() : key(0), in(NULL), complete(false), holdsAllData(false), numRead(0){}
+	~PatternCache(){
+		Close();
+		}
+
+	void Initialize(const string &dataFile, const string &settings);
+	bool Enabled() const {return key != 0;}
+	//the data can be read entirely from the cache, in which case the subsets are the ones listed by
+	//SubsetInfo and SubsetKey and must be read in order
+	bool HoldsAllData() const {return holdsAllData;}
+	int NumSubsets() const {return (int) contents.size();}
+	DataSubsetInfo SubsetInfo(int s) const;
+	PackKey SubsetKey(int s) const {return contents[s].key;}
+	//returns false if the next subset in the cache doesn't match, in which case the data must be read normally
+	bool ReadSubset(PackKey subsetKey, DataMatrix *data);
+	//all subsets that go into the cache must be added, whether or not they were read from it
+	void AddSubset(PackKey subsetKey, const DataSubsetInfo &info, const DataMatrix *data);
+	int NumAddedSubsets() const {return (int) subsets.size();}
+	//rewrites the cache if any subset had to be read normally.  allData indicates that the added subsets are
+	//all of the data and that nothing else was read from the datafile
+	void Write(bool allData);
+
+	static PackKey Hash(const void *bytes, size_t len, PackKey h = 14695981039346656037ULL);
+	static PackKey Hash(const string &str, PackKey h = 14695981039346656037ULL){
+		return Hash(str.c_str(), str.length(), h);
+		}
+	};
+
+#endif
@@ -36,6 +36,12 @@ using namespace std;
 #include <windows.h>
 #endif
 
+#ifdef UNIX
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
+
 #ifdef MAC_FRONTEND
 #import <Foundation/Foundation.h>
 #import "MFEInterfaceClient.h"
@@ -55,23 +61,12 @@ using namespace std;
 #include "outputman.h"
 #include "model.h"
 #include "garlireader.h"
+#include "checkpoint.h"
 
-#ifdef ENABLE_CUSTOM_PROFILER
 #include "utility.h"
-extern Profiler ProfIntInt;
-extern Profiler ProfIntTerm;
-extern Profiler ProfTermTerm;
-extern Profiler ProfRescale;
-extern Profiler ProfScoreInt;
-extern Profiler ProfScoreTerm;
-extern Profiler ProfIntDeriv;
-extern Profiler ProfTermDeriv;
-extern Profiler ProfCalcPmat;
-extern Profiler ProfCalcEigen;
-extern Profiler ProfModDeriv;
-extern Profiler ProfNewton;
-extern Profiler ProfEQVectors;
-#endif
+
+Profiler ProfGeneration("Generation");
+Profiler ProfFinalOpt("FinalOptimization");
 
 extern OutputManager outman;
 extern bool interactive;
@@ -287,6 +282,8 @@ Population::~Population()
 		MEM_DELETE_ARRAY(newindiv); // newindiv has length params.nindivs
 
 	ClearStoredTrees();
+	ClearInitialOptSnapshot();
+	AbandonSubtreeSearchRound();
 
 	if( cumfit!=NULL ) {
 		for( unsigned i = 0; i < total_size; i++ )
@@ -294,9 +291,6 @@ Population::~Population()
 		MEM_DELETE_ARRAY(cumfit); // cumfit has length params.nindivs
 	}
 
-	if( treeString!=NULL)
-		MEM_DELETE_ARRAY(treeString);
-
 	for(vector<Tree*>::iterator vit=unusedTrees.begin();vit!=unusedTrees.end();vit++){
 		delete *vit;
 		}
@@ -386,6 +380,34 @@ void Population::CheckForIncompatibleConfigEntries(){
 
 	if(!conf->checkpoint && conf->workPhaseDivision)
 		throw ErrorException("workphasedivision mode only makes sense if checkpoints are written (writecheckpoints = 1)");
+	if(conf->numIslands > 1 && conf->checkpoint)
+		throw ErrorException("Sorry, island model searches (numislands > 1) can't currently write checkpoints (writecheckpoints = 1)");
+	if(conf->numIslands > 1 && conf->bootstrapReps > 0 && conf->bootstrapWorkers > 1)
+		throw ErrorException("numislands and bootstrapworkers can't both be greater than 1");
+	if(conf->subtreeWorkers > 1 && conf->checkpoint)
+		throw ErrorException("Sorry, subtree searches (subtreeworkers > 1) can't currently write checkpoints (writecheckpoints = 1)");
+	if(conf->subtreeWorkers > 1 && conf->numIslands > 1)
+		throw ErrorException("numislands and subtreeworkers can't both be greater than 1");
+
+	//processes sharing the likelihood calculations must all make the same calculations in the same order, so
+	//anything that needs every site or depends on one process's own timing or data can't be used
+	if(Tree::numPatternSlices > 1){
+		for(int ms = 0;ms < modSpecSet.NumSpecs();ms++){
+			const ModelSpecification *modSpec = modSpecSet.GetModSpec(ms);
+			if(! (modSpec->IsNucleotide() || modSpec->IsAminoAcid() || modSpec->IsCodon()))
+				throw ErrorException("Sorry, only nucleotide, amino acid and codon data can be divided among processes (--splitpatterns)");
+			}
+		if(conf->bootstrapReps > 0)
+			throw ErrorException("Sorry, bootstrapping can't be done with the patterns divided among processes (--splitpatterns)");
+		if(conf->inferInternalStateProbs || conf->outputSitelikelihoods > 0 || conf->optimizeInputOnly || conf->runmode != 0)
+			throw ErrorException("Sorry, site likelihoods and internal states can't be output with the patterns divided among processes (--splitpatterns)");
+		if(conf->checkpoint || conf->restart)
+			throw ErrorException("Sorry, checkpoints can't be written or read with the patterns divided among processes (--splitpatterns)");
+		if(conf->concurrentBranchOpt || conf->gradientBranchOpt)
+			throw ErrorException("concurrentbranchopt and gradientbranchopt can't be used with the patterns divided among processes (--splitpatterns)");
+		if(conf->numIslands > 1 || conf->subtreeWorkers > 1 || conf->bootstrapWorkers > 1)
+			throw ErrorException("numislands, subtreeworkers and bootstrapworkers can't be used with the patterns divided among processes (--splitpatterns)");
+		}
 	}
 
 void Population::Setup(GeneralGamlConfig *c, DataPartition *d, DataPartition *rawD, int nprocs, int r){
@@ -407,6 +429,8 @@ void Population::Setup(GeneralGamlConfig *c, DataPartition *d, DataPartition *ra
 
 	CheckForIncompatibleConfigEntries();
 
+	Profiler::Enable(conf->profile);
+
 	//put info that was read from the config file in its place
 
 	if(rank == 0) total_size = conf->nindivs + nprocs-1;
@@ -458,12 +482,10 @@ void Population::Setup(GeneralGamlConfig *c, DataPartition *d, DataPartition *ra
 			nuc->MakeAmbigStrings();
 		}
 		
-	//allocate the treeString
+	//reserve room for the treeString, which will still grow if needed
 	//remember that we also encode internal node numbers sometimes
 	FLOAT_TYPE taxsize=log10((FLOAT_TYPE) ((FLOAT_TYPE)dataPart->NTax())*dataPart->NTax()*2);
-	stringSize=(int)((dataPart->NTax()*2)*(10+DEF_PRECISION)+taxsize);
-	treeString=new char[stringSize];
-	treeString[stringSize - 1]='\0';
+	treeString.reserve((size_t)((dataPart->NTax()*2)*(10+DEF_PRECISION)+taxsize));
 
 	//allocate the indiv array
 	indiv = new Individual[total_size];
@@ -499,6 +521,8 @@ void Population::Setup(GeneralGamlConfig *c, DataPartition *d, DataPartition *ra
 		
 	const int KB = 1024;
 	double claSizePerNodeKB = indiv[0].modPart.CalcRequiredCLAsizeKB(dataPart);
+	//processes holding different slices of the patterns must all end up with the same number of CLAs
+	Tree::MaxAcrossSlices(&claSizePerNodeKB, 1);
 	int numNodesPerIndiv = dataPart->NTax()-2;
 	int idealClas =  3 * total_size * numNodesPerIndiv;
 	int maxClas = (int)((memToUse*KB)/ claSizePerNodeKB);
@@ -587,7 +611,7 @@ void Population::Setup(GeneralGamlConfig *c, DataPartition *d, DataPartition *ra
 	GetConstraints();
 
 	//try to get nexus starting tree/trees from file, which we don't want to do within the PerformSearch loop
-	if((_stricmp(conf->streefname.c_str(), "random") != 0)  && (_stricmp(conf->streefname.c_str(), "stepwise") != 0))
+	if(!StartingTreeIsGenerated())
 		if(FileIsNexus(conf->streefname.c_str())){
 			LoadNexusStartingConditions();
 			}
@@ -679,6 +703,9 @@ void Population::Reset(){
 			}
 		}
 	Tree::attemptedSwaps.ClearAttemptedSwaps();
+	//cached scores aren't valid once the data are reweighted for the next bootstrap replicate
+	if(conf->bootstrapReps > 0)
+		Tree::topologyCache.Clear();
 	}
 
 void Population::ApplyNSwaps(int numSwaps){
@@ -757,6 +784,15 @@ void Population::GenerateTreesOnly(int nTrees){
 			if(!(i % 100)) outman.UserMessageNoCR("%d ", i);
 			}
 		}
+	else if((_stricmp(conf->streefname.c_str(), "bionj") == 0)){
+		//BIONJ is deterministic, so there is only one tree to make
+		outman.UserMessageNoCR("Making BIONJ tree... ");
+		indiv[0].MakeBionjTree(dataPart->NTax());
+		AppendTreeToTreeLog(-1, 0);
+		indiv[0].treeStruct->RemoveTreeFromAllClas();
+		delete indiv[0].treeStruct;
+		indiv[0].treeStruct=NULL;
+		}
 	FinalizeOutputStreams(0);
 	}
 
@@ -880,6 +916,46 @@ void Population::RunTests(){
 			throw ErrorException("failed derivative scoring test: %f diff vs %f allowed",  tree0->lnL - tree1->lnL, tol);
 			}
 		}
+
+	//check the compact encoding used for exchanges between processes.  Change the tree and model of ind0, then 
+	//send it to ind1 both in full and as a delta against ind1, which should reproduce it exactly
+	ind0->modPart.PerformModelMutation();
+	tree0->TopologyMutator(adap->branchOptPrecision, -1, 0);
+	ind0->SetDirty();
+	tree0->MakeAllNodesDirty();
+	ind0->CalcFitness(0);
+
+	PackedIndividual sent, base, received;
+	ind0->Pack(sent);
+	ind1->Pack(base);
+	for(int delta = 0;delta < 2;delta++){
+		vector<char> buf;
+		received = base;
+		if(delta)
+			sent.SerializeDelta(base, buf);
+		else
+			sent.Serialize(buf);
+		if(received.Deserialize(&buf[0], (int) buf.size()) != (int) buf.size())
+			throw ErrorException("failed packed individual test: %s encoding not fully read", delta ? "delta" : "full");
+		if(received.anc != sent.anc || received.lengths != sent.lengths || received.modelParams != sent.modelParams)
+			throw ErrorException("failed packed individual test: %s encoding changed the individual", delta ? "delta" : "full");
+		}
+
+	ind1->Unpack(received);
+	ind1->SetDirty();
+	tree1->MakeAllNodesDirty();
+	ind1->CalcFitness(0);
+	if(FloatingPointEquals(ind0->Fitness(), ind1->Fitness(), tol) == false)
+		throw ErrorException("failed packed individual test: %f diff vs %f allowed after unpacking", ind0->Fitness() - ind1->Fitness(), tol);
+
+	//setting some parameters renormalizes them, so they may not come back bit for bit
+	PackedIndividual repacked;
+	ind1->Pack(repacked);
+	if(repacked.anc != sent.anc || repacked.lengths != sent.lengths || repacked.modelParams.size() != sent.modelParams.size())
+		throw ErrorException("failed packed individual test: individual changed by unpacking and packing again");
+	for(unsigned i = 0;i < sent.modelParams.size();i++)
+		if(FloatingPointEquals(repacked.modelParams[i], sent.modelParams[i], 1.0e-6) == false)
+			throw ErrorException("failed packed individual test: model parameter %d changed from %f to %f by unpacking", i, sent.modelParams[i], repacked.modelParams[i]);
 	}
 
 void Population::ResetMemLevel(int numNodesPerIndiv, int numClas){
@@ -925,180 +1001,180 @@ void Population::GetConstraints(){
 
 //This is a stripped down version of SeedPopWithStartingTree that loads and validates
 //starting conditions but doesn't score or require CLAs to have been allocated
-void Population::ValidateInput(int rep){
-
-	//create the first indiv, and then copy the tree and clas
-
-	//this is really annoying and hacky - the maxPinv value is held by each model, and is data dependent (maxPinv can't be > obs pinv)
-	//But, since a single model may apply to multiple data, need to be sure that the maxPinv is > the highest obs pinv of any of them
-	//now always setting the model default for each data subset (which due to linkage might reset the model several times), but this 
-	//shouldn't be problematic.  Note that the other data dependent model thing is empirical base freqs, but that will be disallowed
-	//elsewhere when there is linkage.
-	FLOAT_TYPE maxPinv = ZERO_POINT_ZERO;
-	for(vector<ClaSpecifier>::iterator c = claSpecs.begin();c != claSpecs.end();c++){
-		for(int m = 0;m < indiv[0].modPart.NumModels();m++){
-			if((*c).modelIndex == m){
-				indiv[0].modPart.GetModel(m)->SetDefaultModelParameters(dataPart->GetSubset((*c).dataIndex));
-				if(indiv[0].modPart.GetModel(m)->MaxPinv() > maxPinv) maxPinv = indiv[0].modPart.GetModel(m)->MaxPinv();
-				}
-			}
-		}
-	//we should only need to do this crap if the models are linked, but not currently allowing linking of some models but not others
-	if(conf->linkModels && modSpecSet.GetModSpec(0)->includeInvariantSites == true){
-		assert(indiv[0].modPart.NumModels() == 1);
-		if(maxPinv > ZERO_POINT_ZERO == false) throw ErrorException("invariantsites = estimate was specified, but no data subsets contained constant characters!");
-		indiv[0].modPart.GetModel(0)->SetMaxPinv(maxPinv);
-		indiv[0].modPart.GetModel(0)->SetPinv(maxPinv * 0.25, false);
-		}
-
-	//DEBUG - need to stick this in somewhere more natural so that it gets reset after a rep completes
-	indiv[0].modPart.Reset();
-
-	//This is getting very complicated.  Here are the allowable combinations.
-	//streefname not specified (random or stepwise)
-		//Case 1 - no gblock in datafile	
-		//Case 2 - found gblock in datafile
-	//streefname specified
-		//specified file is same as datafile
-			//Case 3 - Found trees block only
-			//Case 4 - Found gblock only (create random tree)
-			//Case 5 - Found both
-		//specified file not same as datafile
-			//NOTE that all of these are also possible with a gblock found in the datafile
-			//3/25/08 Change - a second gblock is not allowed (it will throw an exception
-			//upon reading the second in GarliReader::EnteringBlock), nor are both a garli block
-			//with the data and model params in the old format in the streefname
-			//specified streefname is Nexus
-				//Case 6 - Found trees block only
-				//Case 7 - Found gblock only (create random tree) (if a gblock was already read it will crap out)
-				//Case 8 - Found both (if a gblock was already read it will crap out)
-			//specified streefname is not Nexus
-				//Case 9 - found a tree
-				//Case 10 - found a model (create random tree) (if a gblock was already read it will crap out)
-				//Case 11 - found both (if a gblock was already read it will crap out)
-
-	GarliReader & reader = GarliReader::GetInstance();
-
-#ifdef INPUT_RECOMBINATION
-	if(0)
-#else
-	if((_stricmp(conf->streefname.c_str(), "random") != 0) && (_stricmp(conf->streefname.c_str(), "stepwise") != 0))
-		//some starting file has been specified - Cases 3-11
-#endif
-	{
-		//we already checked in Setup whether NCL has trees for us.  A starting model in Garli block will
-		//be handled below, although both a garli block (in the data) and an old style model specification
-		//are not allowed
-		if(startingTreeInNCL){//cases 3, 5, 6 and 8
-			//CAREFUL here - we may have more than one trees block because a tree could appear with the
-			//dataset and in a different starting tree file.  The factory api allows this fine, so we
-			//need to be sure to grab the last trees block.  Checking for whether the starting tree
-			//file contained multiple trees blocks was already done in LoadNexusStartingConditions
-			const NxsTreesBlock *treesblock = reader.GetTreesBlock(reader.GetTaxaBlock(0), reader.GetNumTreesBlocks(reader.GetTaxaBlock(0)) - 1);
-			assert(treesblock != NULL);
-			//this should verify some aspects of the tree description and change everything to taxon numbers
-			treesblock->ProcessAllTrees();
-			int numTrees = treesblock->GetNumTrees();
-			if(numTrees > 0){
-				int treeNum = (rank+rep-1) % numTrees;
-				indiv[0].GetStartingTreeFromNCL(treesblock, treeNum, dataPart->NTax());
-				outman.UserMessage("Obtained starting tree %d from Nexus", treeNum+1);
-				}
-			else throw ErrorException("Problem getting tree(s) from NCL!");
-			}
-		else if(strcmp(conf->streefname.c_str(), conf->datafname.c_str()) != 0 && !FileIsNexus(conf->streefname.c_str())){
-			//cases 9-11 if the streef file is not the same as the datafile, and it isn't Nexus
-			//use the old garli starting model/tree format
-			outman.UserMessage("Obtaining starting conditions from file %s", conf->streefname.c_str());
-			indiv[0].GetStartingConditionsFromFile(conf->streefname.c_str(), rank + rep - 1, dataPart->NTax());
-			}
-		indiv[0].SetDirty();
-		}
-
-	if(reader.FoundModelString()) 
-		startingModelInNCL = true;
-
-	if(startingModelInNCL || conf->parameterValueString.length() > 0){
-		//crap out if we already got some parameters above in an old style starting conditions file
-#ifndef SUBROUTINE_GARLI
-		if(modSpecSet.GotAnyParametersFromFile() && (currentSearchRep == 1 && (conf->bootstrapReps == 0 || currentBootstrapRep == 1)))
-			throw ErrorException("Found model parameters specified in a Nexus GARLI block with the dataset,\n\tand in the starting condition file (streefname).\n\tPlease use one or the other.");
-#endif
-		if(startingModelInNCL && conf->parameterValueString.length() > 0)
-			throw ErrorException("Found model parameters specified in the configuration file and in the dataset or starting condition file (streefname).\n\tPlease use one or the other.");
-		//model string from garli block, which could have come either in starting condition file
-		//or in file with Nexus dataset.  Cases 2, 4, 5, 7 and 8 come through here.
-
-		string modString;
-		if(startingModelInNCL)
-			modString = reader.GetModelString();
-		else
-			modString = conf->parameterValueString;
-
-		if(modString.length() > 0)
-			indiv[0].modPart.ReadGarliFormattedModelStrings(modString);
-
-		if(startingModelInNCL)
-			outman.UserMessage("Obtained starting or fixed model parameter values from Nexus:");
-		else
-			outman.UserMessage("Obtained starting or fixed model parameter values from configuration file:");
-		}
-
-	//The model params should be set to their initial values by now, so report them
-	if(conf->bootstrapReps == 0 || (currentBootstrapRep == 1 && currentSearchRep == 1)){
-		outman.UserMessage("MODEL REPORT - Parameters are at their INITIAL values (not yet optimized)");
-		indiv[0].modPart.OutputHumanReadableModelReportWithParams();
-		}
-
-	outman.UserMessage("Starting with seed=%d\n", rnd.seed());
-
-	//Here we'll error out if something was fixed but didn't appear
-	for(int ms = 0;ms < modSpecSet.NumSpecs();ms++){
-		const ModelSpecification *modSpec = modSpecSet.GetModSpec(ms);
-		if((_stricmp(conf->streefname.c_str(), "random") == 0) || (_stricmp(conf->streefname.c_str(), "stepwise") == 0)){
-			//if no streefname file was specified, the param values should be in a garli block with the dataset
-			if(modSpec->IsNucleotide() && modSpec->IsUserSpecifiedStateFrequencies() && !modSpec->gotStateFreqsFromFile) 
-				throw(ErrorException("state frequencies specified as fixed, but no\n\tGarli block found in %s!!" , conf->datafname.c_str()));
-			else if(modSpec->fixAlpha && !modSpec->gotAlphaFromFile) 
-				throw(ErrorException("alpha parameter specified as fixed, but no\n\tGarli block found in %s!!" , conf->datafname.c_str()));
-			else if(modSpec->fixInvariantSites && !modSpec->gotPinvFromFile) 
-				throw(ErrorException("proportion of invariant sites specified as fixed, but no\n\tGarli block found in %s!!" , conf->datafname.c_str()));
-			else if(modSpec->IsUserSpecifiedRateMatrix() && !modSpec->gotRmatFromFile) 
-				throw(ErrorException("relative rate matrix specified as fixed, but no\n\tGarli block found in %s!!" , conf->datafname.c_str()));
+void Population::ValidateInput(int rep){
+
+	//create the first indiv, and then copy the tree and clas
+
+	//this is really annoying and hacky - the maxPinv value is held by each model, and is data dependent (maxPinv can't be > obs pinv)
+	//But, since a single model may apply to multiple data, need to be sure that the maxPinv is > the highest obs pinv of any of them
+	//now always setting the model default for each data subset (which due to linkage might reset the model several times), but this 
+	//shouldn't be problematic.  Note that the other data dependent model thing is empirical base freqs, but that will be disallowed
+	//elsewhere when there is linkage.
+	FLOAT_TYPE maxPinv = ZERO_POINT_ZERO;
+	for(vector<ClaSpecifier>::iterator c = claSpecs.begin();c != claSpecs.end();c++){
+		for(int m = 0;m < indiv[0].modPart.NumModels();m++){
+			if((*c).modelIndex == m){
+				indiv[0].modPart.GetModel(m)->SetDefaultModelParameters(dataPart->GetSubset((*c).dataIndex));
+				if(indiv[0].modPart.GetModel(m)->MaxPinv() > maxPinv) maxPinv = indiv[0].modPart.GetModel(m)->MaxPinv();
+				}
+			}
+		}
+	//we should only need to do this crap if the models are linked, but not currently allowing linking of some models but not others
+	if(conf->linkModels && modSpecSet.GetModSpec(0)->includeInvariantSites == true){
+		assert(indiv[0].modPart.NumModels() == 1);
+		if(maxPinv > ZERO_POINT_ZERO == false) throw ErrorException("invariantsites = estimate was specified, but no data subsets contained constant characters!");
+		indiv[0].modPart.GetModel(0)->SetMaxPinv(maxPinv);
+		indiv[0].modPart.GetModel(0)->SetPinv(maxPinv * 0.25, false);
+		}
+
+	//DEBUG - need to stick this in somewhere more natural so that it gets reset after a rep completes
+	indiv[0].modPart.Reset();
+
+	//This is getting very complicated.  Here are the allowable combinations.
+	//streefname not specified (random or stepwise)
+		//Case 1 - no gblock in datafile	
+		//Case 2 - found gblock in datafile
+	//streefname specified
+		//specified file is same as datafile
+			//Case 3 - Found trees block only
+			//Case 4 - Found gblock only (create random tree)
+			//Case 5 - Found both
+		//specified file not same as datafile
+			//NOTE that all of these are also possible with a gblock found in the datafile
+			//3/25/08 Change - a second gblock is not allowed (it will throw an exception
+			//upon reading the second in GarliReader::EnteringBlock), nor are both a garli block
+			//with the data and model params in the old format in the streefname
+			//specified streefname is Nexus
+				//Case 6 - Found trees block only
+				//Case 7 - Found gblock only (create random tree) (if a gblock was already read it will crap out)
+				//Case 8 - Found both (if a gblock was already read it will crap out)
+			//specified streefname is not Nexus
+				//Case 9 - found a tree
+				//Case 10 - found a model (create random tree) (if a gblock was already read it will crap out)
+				//Case 11 - found both (if a gblock was already read it will crap out)
+
+	GarliReader & reader = GarliReader::GetInstance();
+
+#ifdef INPUT_RECOMBINATION
+	if(0)
+#else
+	if(!StartingTreeIsGenerated())
+		//some starting file has been specified - Cases 3-11
+#endif
+	{
+		//we already checked in Setup whether NCL has trees for us.  A starting model in Garli block will
+		//be handled below, although both a garli block (in the data) and an old style model specification
+		//are not allowed
+		if(startingTreeInNCL){//cases 3, 5, 6 and 8
+			//CAREFUL here - we may have more than one trees block because a tree could appear with the
+			//dataset and in a different starting tree file.  The factory api allows this fine, so we
+			//need to be sure to grab the last trees block.  Checking for whether the starting tree
+			//file contained multiple trees blocks was already done in LoadNexusStartingConditions
+			const NxsTreesBlock *treesblock = reader.GetTreesBlock(reader.GetTaxaBlock(0), reader.GetNumTreesBlocks(reader.GetTaxaBlock(0)) - 1);
+			assert(treesblock != NULL);
+			//this should verify some aspects of the tree description and change everything to taxon numbers
+			treesblock->ProcessAllTrees();
+			int numTrees = treesblock->GetNumTrees();
+			if(numTrees > 0){
+				int treeNum = (rank+rep-1) % numTrees;
+				indiv[0].GetStartingTreeFromNCL(treesblock, treeNum, dataPart->NTax());
+				outman.UserMessage("Obtained starting tree %d from Nexus", treeNum+1);
+				}
+			else throw ErrorException("Problem getting tree(s) from NCL!");
+			}
+		else if(strcmp(conf->streefname.c_str(), conf->datafname.c_str()) != 0 && !FileIsNexus(conf->streefname.c_str())){
+			//cases 9-11 if the streef file is not the same as the datafile, and it isn't Nexus
+			//use the old garli starting model/tree format
+			outman.UserMessage("Obtaining starting conditions from file %s", conf->streefname.c_str());
+			indiv[0].GetStartingConditionsFromFile(conf->streefname.c_str(), rank + rep - 1, dataPart->NTax());
+			}
+		indiv[0].SetDirty();
+		}
+
+	if(reader.FoundModelString()) 
+		startingModelInNCL = true;
+
+	if(startingModelInNCL || conf->parameterValueString.length() > 0){
+		//crap out if we already got some parameters above in an old style starting conditions file
+#ifndef SUBROUTINE_GARLI
+		if(modSpecSet.GotAnyParametersFromFile() && (currentSearchRep == 1 && (conf->bootstrapReps == 0 || currentBootstrapRep == 1)))
+			throw ErrorException("Found model parameters specified in a Nexus GARLI block with the dataset,\n\tand in the starting condition file (streefname).\n\tPlease use one or the other.");
+#endif
+		if(startingModelInNCL && conf->parameterValueString.length() > 0)
+			throw ErrorException("Found model parameters specified in the configuration file and in the dataset or starting condition file (streefname).\n\tPlease use one or the other.");
+		//model string from garli block, which could have come either in starting condition file
+		//or in file with Nexus dataset.  Cases 2, 4, 5, 7 and 8 come through here.
+
+		string modString;
+		if(startingModelInNCL)
+			modString = reader.GetModelString();
+		else
+			modString = conf->parameterValueString;
+
+		if(modString.length() > 0)
+			indiv[0].modPart.ReadGarliFormattedModelStrings(modString);
+
+		if(startingModelInNCL)
+			outman.UserMessage("Obtained starting or fixed model parameter values from Nexus:");
+		else
+			outman.UserMessage("Obtained starting or fixed model parameter values from configuration file:");
+		}
+
+	//The model params should be set to their initial values by now, so report them
+	if(conf->bootstrapReps == 0 || (currentBootstrapRep == 1 && currentSearchRep == 1)){
+		outman.UserMessage("MODEL REPORT - Parameters are at their INITIAL values (not yet optimized)");
+		indiv[0].modPart.OutputHumanReadableModelReportWithParams();
+		}
+
+	outman.UserMessage("Starting with seed=%d\n", rnd.seed());
+
+	//Here we'll error out if something was fixed but didn't appear
+	for(int ms = 0;ms < modSpecSet.NumSpecs();ms++){
+		const ModelSpecification *modSpec = modSpecSet.GetModSpec(ms);
+		if(StartingTreeIsGenerated()){
+			//if no streefname file was specified, the param values should be in a garli block with the dataset
+			if(modSpec->IsNucleotide() && modSpec->IsUserSpecifiedStateFrequencies() && !modSpec->gotStateFreqsFromFile) 
+				throw(ErrorException("state frequencies specified as fixed, but no\n\tGarli block found in %s!!" , conf->datafname.c_str()));
+			else if(modSpec->fixAlpha && !modSpec->gotAlphaFromFile) 
+				throw(ErrorException("alpha parameter specified as fixed, but no\n\tGarli block found in %s!!" , conf->datafname.c_str()));
+			else if(modSpec->fixInvariantSites && !modSpec->gotPinvFromFile) 
+				throw(ErrorException("proportion of invariant sites specified as fixed, but no\n\tGarli block found in %s!!" , conf->datafname.c_str()));
+			else if(modSpec->IsUserSpecifiedRateMatrix() && !modSpec->gotRmatFromFile) 
+				throw(ErrorException("relative rate matrix specified as fixed, but no\n\tGarli block found in %s!!" , conf->datafname.c_str()));
 			else if(modSpec->IsCodon() && modSpec->fixOmega && !modSpec->gotOmegasFromFile) 
 				throw(ErrorException("rate het model set to nonsynonymousfixed, but no\n\tGarli block found in %s!!" , conf->datafname.c_str()));
-			}
-		else{
-			if((modSpec->IsNucleotide() || modSpec->IsAminoAcid()) && modSpec->IsUserSpecifiedStateFrequencies() && !modSpec->gotStateFreqsFromFile) 
-				throw ErrorException("state frequencies specified as fixed, but no\n\tparameter values found in %s or %s!", conf->streefname.c_str(), conf->datafname.c_str());
-			else if(modSpec->fixAlpha && !modSpec->gotAlphaFromFile) 
-				throw ErrorException("alpha parameter specified as fixed, but no\n\tparameter values found in %s or %s!", conf->streefname.c_str(), conf->datafname.c_str());
-			else if(modSpec->fixInvariantSites && !modSpec->gotPinvFromFile) 
-				throw ErrorException("proportion of invariant sites specified as fixed, but no\n\tparameter values found in %s or %s!", conf->streefname.c_str(), conf->datafname.c_str());
-			else if(modSpec->IsUserSpecifiedRateMatrix() && !modSpec->gotRmatFromFile) 
-				throw ErrorException("relative rate matrix specified as fixed, but no\n\tparameter values found in %s or %s!", conf->streefname.c_str(), conf->datafname.c_str());
+			}
+		else{
+			if((modSpec->IsNucleotide() || modSpec->IsAminoAcid()) && modSpec->IsUserSpecifiedStateFrequencies() && !modSpec->gotStateFreqsFromFile) 
+				throw ErrorException("state frequencies specified as fixed, but no\n\tparameter values found in %s or %s!", conf->streefname.c_str(), conf->datafname.c_str());
+			else if(modSpec->fixAlpha && !modSpec->gotAlphaFromFile) 
+				throw ErrorException("alpha parameter specified as fixed, but no\n\tparameter values found in %s or %s!", conf->streefname.c_str(), conf->datafname.c_str());
+			else if(modSpec->fixInvariantSites && !modSpec->gotPinvFromFile) 
+				throw ErrorException("proportion of invariant sites specified as fixed, but no\n\tparameter values found in %s or %s!", conf->streefname.c_str(), conf->datafname.c_str());
+			else if(modSpec->IsUserSpecifiedRateMatrix() && !modSpec->gotRmatFromFile) 
+				throw ErrorException("relative rate matrix specified as fixed, but no\n\tparameter values found in %s or %s!", conf->streefname.c_str(), conf->datafname.c_str());
 			else if(modSpec->IsCodon() && modSpec->fixOmega && !modSpec->gotOmegasFromFile) 
-				throw ErrorException("rate het model set to nonsynonymousfixed, but no\n\tparameter values found in %s or %s!", conf->streefname.c_str(), conf->datafname.c_str());
-			}
-		}
-
-	//the treestruct could be null if there was a start file that contained no tree
-	if((_stricmp(conf->streefname.c_str(), "random") != 0) && (_stricmp(conf->streefname.c_str(), "stepwise") != 0) && (indiv[0].treeStruct != NULL)){
-		bool foundPolytomies = indiv[0].treeStruct->ArbitrarilyBifurcate();
-		if(foundPolytomies) outman.UserMessage("WARNING: Polytomies found in start tree.  These were arbitrarily resolved.");
-	
-		indiv[0].treeStruct->root->CheckTreeFormation();
-		indiv[0].treeStruct->root->CheckforPolytomies();
-		}
-	
-	//if there are not mutable params in the model, remove any weight assigned to the model
-	if(indiv[0].modPart.NumMutableParams() == 0) {
-		if((conf->bootstrapReps == 0 && currentSearchRep == 1) || (currentBootstrapRep == 1 && currentSearchRep == 1))
-			outman.UserMessage("NOTE: Model contains no mutable parameters!\nSetting model mutation weight to zero.\n");
-		adap->modelMutateProb=ZERO_POINT_ZERO;
-		adap->UpdateProbs();
-		}
-	}
+				throw ErrorException("rate het model set to nonsynonymousfixed, but no\n\tparameter values found in %s or %s!", conf->streefname.c_str(), conf->datafname.c_str());
+			}
+		}
+
+	//the treestruct could be null if there was a start file that contained no tree
+	if(!StartingTreeIsGenerated() && (indiv[0].treeStruct != NULL)){
+		bool foundPolytomies = indiv[0].treeStruct->ArbitrarilyBifurcate();
+		if(foundPolytomies) outman.UserMessage("WARNING: Polytomies found in start tree.  These were arbitrarily resolved.");
+	
+		indiv[0].treeStruct->root->CheckTreeFormation();
+		indiv[0].treeStruct->root->CheckforPolytomies();
+		}
+	
+	//if there are not mutable params in the model, remove any weight assigned to the model
+	if(indiv[0].modPart.NumMutableParams() == 0) {
+		if((conf->bootstrapReps == 0 && currentSearchRep == 1) || (currentBootstrapRep == 1 && currentSearchRep == 1))
+			outman.UserMessage("NOTE: Model contains no mutable parameters!\nSetting model mutation weight to zero.\n");
+		adap->modelMutateProb=ZERO_POINT_ZERO;
+		adap->UpdateProbs();
+		}
+	}
 
 void Population::SeedPopulationWithStartingTree(int rep){
 	for(unsigned i=0;i<total_size;i++){
@@ -1161,7 +1237,7 @@ void Population::SeedPopulationWithStartingTree(int rep){
 #ifdef INPUT_RECOMBINATION
 	if(0)
 #else
-	if((_stricmp(conf->streefname.c_str(), "random") != 0) && (_stricmp(conf->streefname.c_str(), "stepwise") != 0))
+	if(!StartingTreeIsGenerated())
 		//some starting file has been specified - Cases 3-11
 #endif
 	{
@@ -1226,7 +1302,7 @@ void Population::SeedPopulationWithStartingTree(int rep){
 	//Here we'll error out if something was fixed but didn't appear
 	for(int ms = 0;ms < modSpecSet.NumSpecs();ms++){
 		const ModelSpecification *modSpec = modSpecSet.GetModSpec(ms);
-		if((_stricmp(conf->streefname.c_str(), "random") == 0) || (_stricmp(conf->streefname.c_str(), "stepwise") == 0)){
+		if(StartingTreeIsGenerated()){
 			//if no streefname file was specified, the param values should be in a garli block with the dataset
 			if(modSpec->IsNucleotide() && modSpec->IsUserSpecifiedStateFrequencies() && !modSpec->gotStateFreqsFromFile) 
 				throw(ErrorException("state frequencies specified as fixed, but no\n\tGarli block found in %s!!" , conf->datafname.c_str()));
@@ -1279,6 +1355,13 @@ void Population::SeedPopulationWithStartingTree(int rep){
 		assert(!indiv[0].treeStruct->rootWithDummy);
 		indiv[0].MakeStepwiseTree(dataPart->NTax(), conf->attachmentsPerTaxon, adap->branchOptPrecision);
 		}
+	else if(_stricmp(conf->streefname.c_str(), "bionj") == 0){
+		if(!Tree::constraints.empty())
+			throw ErrorException("Sorry, BIONJ starting trees cannot currently be used with constraints.\n\tTry streefname = random or stepwise, or provide your own starting tree.");
+		outman.UserMessage("creating BIONJ distance starting tree...");
+		indiv[0].MakeBionjTree(dataPart->NTax());
+		indiv[0].SetDirty();
+		}
 	else if(_stricmp(conf->streefname.c_str(), "random") == 0 || indiv[0].treeStruct == NULL){
 		if(Tree::constraints.empty()) outman.UserMessage("creating random starting tree...");
 		else outman.UserMessage("creating random starting tree (compatible with constraints)...");
@@ -1296,6 +1379,21 @@ void Population::SeedPopulationWithStartingTree(int rep){
 	if(!indiv[0].treeStruct->rootWithDummy)
 		indiv[0].treeStruct->CheckBalance();
 	indiv[0].treeStruct->modPart=&indiv[0].modPart;
+
+	//if an earlier search rep started from exactly the same tree and model (e.g., a single user specified
+	//starting tree) its initial optimization would just be repeated, so start from the result of it instead
+	string startKey;
+	bool reuseInitialOpt = false;
+	if(conf->shareInitialOpt && conf->searchReps > 1 && conf->refineStart && !conf->scoreOnly && !conf->optimizeInputOnly){
+		GetStartingConditionsKey(&indiv[0], startKey);
+		reuseInitialOpt = (initialOptSnapshot != NULL && startKey == initialOptKey);
+		}
+	if(reuseInitialOpt){
+		indiv[0].treeStruct->RemoveTreeFromAllClas();
+		delete indiv[0].treeStruct;
+		indiv[0].treeStruct = NULL;
+		indiv[0].DuplicateIndivWithoutCLAs(initialOptSnapshot);
+		}
 	
 	try{
 		indiv[0].CalcFitness(0);
@@ -1305,11 +1403,13 @@ void Population::SeedPopulationWithStartingTree(int rep){
 		}
 
 	//check the current likelihood now to know how accurate we can expect them to be later
+	if(!reuseInitialOpt){
 #ifdef SINGLE_PRECISION_FLOATS
-	Tree::expectedPrecision = pow(10.0, - (double) ((int) FLT_DIG - ceil(log10(-indiv[0].Fitness()))));
+		Tree::expectedPrecision = pow(10.0, - (double) ((int) FLT_DIG - ceil(log10(-indiv[0].Fitness()))));
 #else
-	Tree::expectedPrecision = pow(10.0, - (double) ((int) DBL_DIG - ceil(log10(-indiv[0].Fitness()))));
+		Tree::expectedPrecision = pow(10.0, - (double) ((int) DBL_DIG - ceil(log10(-indiv[0].Fitness()))));
 #endif
+		}
 //	outman.UserMessage("expected likelihood precision = %.4e", Tree::expectedPrecision);
 
 	//if there are not mutable params in the model, remove any weight assigned to the model
@@ -1321,14 +1421,17 @@ void Population::SeedPopulationWithStartingTree(int rep){
 		}
 
 	outman.precision(10);
-	outman.UserMessage("Initial ln Likelihood: %.4f", indiv[0].Fitness());
+	if(reuseInitialOpt)
+		outman.UserMessage("Starting conditions are identical to those of search rep %d.\nReusing its initial optimization, lnL: %.4f", initialOptSnapshotRep, indiv[0].Fitness());
+	else
+		outman.UserMessage("Initial ln Likelihood: %.4f", indiv[0].Fitness());
 #ifdef MAC_FRONTEND
 	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
 	[[MFEInterfaceClient sharedClient] didBeginInitializingSearch];
 	[pool release];
 #endif		
 
-	if(conf->refineStart==true && !conf->scoreOnly){
+	if(conf->refineStart==true && !conf->scoreOnly && !reuseInitialOpt){
 		//12/26/07 now only passing the first argument here ("optModel") as false if no model muts are used
 		//if single parameters are fixed that will be checked in the Refine function itself
 		//5/15/14 Moved the initial refinement phase to the Population level, which makes more sense and
@@ -1337,6 +1440,12 @@ void Population::SeedPopulationWithStartingTree(int rep){
 		InitialOptimization(&indiv[0], adap->modWeight != ZERO_POINT_ZERO, adap->branchOptPrecision);
 		indiv[0].CalcFitness(0);
 		outman.UserMessage("lnL after optimization: %.4f", indiv[0].Fitness());
+		if(startKey.length() > 0){
+			ClearInitialOptSnapshot();
+			initialOptSnapshot = new Individual(&indiv[0]);
+			initialOptKey = startKey;
+			initialOptSnapshotRep = currentSearchRep;
+			}
 		}	
 
 	globalBest=bestFitness=prevBestFitness=indiv[0].Fitness();
@@ -1373,6 +1482,23 @@ void Population::SeedPopulationWithStartingTree(int rep){
 	CalcAverageFitness();
 	}
 
+//The tree (with branch lengths) and model parameters that an initial optimization starts from.  Initial
+//optimization is deterministic, so two individuals with the same key will end up at the same result
+void Population::GetStartingConditionsKey(const Individual *ind, string &key) const{
+	key.clear();
+	ind->treeStruct->root->MakeNewick(key, dataPart, false, true, false, true);
+	string modString;
+	ind->modPart.FillGarliFormattedModelStrings(modString);
+	key += modString;
+	}
+
+void Population::ClearInitialOptSnapshot(){
+	if(initialOptSnapshot != NULL)
+		delete initialOptSnapshot;
+	initialOptSnapshot = NULL;
+	initialOptKey.clear();
+	}
+
 //Copied almost exactly from Individual::RefineStartingConditions.  For various reasons it is easier 
 //to have it at the population level.
 void Population::InitialOptimization(Individual *ind, bool optModel, FLOAT_TYPE branchPrec){
@@ -1438,7 +1564,7 @@ void Population::InitialOptimization(Individual *ind, bool optModel, FLOAT_TYPE
 		ind->CalcFitness(0);
 		FLOAT_TYPE passStart = ind->Fitness();
 		
-		optImprove=treeStruct->OptimizeAllBranches(branchPrec);
+		optImprove=treeStruct->OptimizeAllBranchesFullTree(branchPrec);
 		ind->CalcFitness(0);
 
 		FLOAT_TYPE trueImprove = ind->Fitness() - passStart;
@@ -1644,7 +1770,7 @@ void Population::WriteStateFiles(){
 //#define OLD_CHECK
 
 #ifdef OLD_CHECK
-void Population::WriteStateFiles(){
+void Population::WriteStateFiles(bool background){
 	char name[100];
 
 	//write the adaptation info checkpoint in binary format
@@ -1689,7 +1815,9 @@ void Population::WriteStateFiles(){
 	}
 
 #else
-void Population::WriteStateFiles(){
+//With background = true the checkpoint is only serialized to memory here, and is written to disk by
+//another thread while the search continues
+void Population::WriteStateFiles(bool background){
 	char aname[128];
 	char pname[128];
 	char sname[128];
@@ -1738,25 +1866,60 @@ void Population::WriteStateFiles(){
 
 	boinc_checkpoint_completed();
 #else
-	//it would be nice to be able to do something like what is done for BOINC above (buffering output and
-	//then writing all at once), maybe with a stringstream, but I couldn't get that to work
-	ofstream aout(aname, ios::out | ios::binary);
-	adap->WriteToCheckpoint(aout);
-	aout.close();
-	
-	ofstream pout(pname, ios::out | ios::binary);
-	WritePopulationCheckpoint(pout);
-	pout.close();
-
-	if(conf->uniqueSwapBias != ONE_POINT_ZERO){
-		ofstream sout(sname, ios::out | ios::binary);
-		Tree::attemptedSwaps.WriteSwapCheckpoint(sout);
-		sout.close();
+	//the swap log state for this checkpoint depends on how the last one went
+	FinishBackgroundCheckpoint();
+	CheckpointJob &job = checkWriter.Job();
+	job.Clear();
+
+	//The swaps are appended to their log first.  If anything fails after that the previous population
+	//checkpoint still refers to an intact earlier part of the log.
+	bool logSwaps = (conf->uniqueSwapBias != ONE_POINT_ZERO);
+	if(logSwaps){
+		job.writeSwaps = true;
+		Tree::attemptedSwaps.PrepareSwapLogBlock(sname, job.swapBlock);
+		}
+
+	//each file is written in full to a temporary and then renamed, see CheckpointWriter
+	CheckpointWriter aout(aname);
+	adap->WriteToCheckpoint(aout.BeginSection(ADAPTATION_SECTION));
+	aout.EndSection();
+	job.AddFile(aout);
+
+	CheckpointWriter pout(pname);
+	WritePopulationCheckpoint(pout.BeginSection(POPULATION_SECTION));
+	pout.EndSection();
+	if(logSwaps){
+		Tree::attemptedSwaps.WriteSwapLogPosition(pout.BeginSection(SWAP_LOG_SECTION));
+		pout.EndSection();
+		}
+	job.AddFile(pout);
+
+	if(background)
+		checkWriter.Start();
+	else{
+		job.Write();
+		CheckpointWritten(job);
 		}
 #endif
 	}
 #endif
 
+void Population::FinishBackgroundCheckpoint(){
+	if(checkWriter.Wait())
+		CheckpointWritten(checkWriter.Job());
+	}
+
+void Population::CheckpointWritten(const CheckpointJob &job){
+	if(!job.swapsOK || !job.filesOK)
+		outman.UserMessage("WARNING: Problem writing checkpoint file %s.\n\tThe previous checkpoint (if any) was left in place.", job.failedName.c_str());
+	if(job.writeSwaps){
+		if(!job.swapsOK)
+			Tree::attemptedSwaps.SwapLogWriteFailed();
+		else if(job.filesOK)
+			Tree::attemptedSwaps.SwapLogCommitted();
+		}
+	}
+
 //Returns whether or not checkpoints were actually found and read
 bool Population::ReadStateFiles(){
 	char name[100];
@@ -1780,11 +1943,13 @@ bool Population::ReadStateFiles(){
 		}
 	in = fopen(name, "rb");
 #endif
-	adap->ReadFromCheckpoint(in);
-	fclose(in);
+	//this verifies the checksums of newer checkpoints, and closes the file
+	CheckpointReader adapIn(in, name);
+	adap->ReadFromCheckpoint(adapIn.BeginSection(ADAPTATION_SECTION));
+	adapIn.EndSection();
 
-	//Read the population checkpoint
-	ReadPopulationCheckpoint();
+	//Read the population checkpoint, and the swaps from their log if it points to one
+	bool readSwaps = ReadPopulationCheckpoint();
 
 	//need to reset these here, although really only because asserts check that the values never decrease
 	rep_fraction_done = tot_fraction_done = 0.0;
@@ -1793,8 +1958,8 @@ bool Population::ReadStateFiles(){
 	boinc_fraction_done(tot_fraction_done);
 #endif
 
-	//Read the swap checkpoint, if necessary
-	if(conf->uniqueSwapBias != ONE_POINT_ZERO){
+	//Read an old style swap checkpoint, if necessary
+	if(conf->uniqueSwapBias != ONE_POINT_ZERO && readSwaps == false){
 		sprintf(name, "%s.swaps.check", conf->ofprefix.c_str());
 		FILE *sin;
 #ifdef BOINC
@@ -1862,7 +2027,8 @@ void Population::WritePopulationCheckpoint(OUTPUT_CLASS &out) {
 	}
 
 
-void Population::ReadPopulationCheckpoint(){
+//returns whether the swaps were also read from the swap log
+bool Population::ReadPopulationCheckpoint(){
 	char str[100];
 	sprintf(str, "%s.pop.check", conf->ofprefix.c_str());
 	if(FileExists(str) == false) throw(ErrorException("Could not find checkpoint file %s!\nEither the previous run was not writing checkpoints (checkpoint = 0),\nthe file was moved/deleted or the ofprefix setting\nin the config file was changed.", str));
@@ -1875,6 +2041,8 @@ void Population::ReadPopulationCheckpoint(){
 #else
 	FILE *pin = fopen(str, "rb");
 #endif
+	CheckpointReader popIn(pin, str);
+	pin = popIn.BeginSection(POPULATION_SECTION);
 
 	long seed;
 	fread((char *) &seed, sizeof(seed), 1, pin);
@@ -1941,6 +2109,15 @@ void Population::ReadPopulationCheckpoint(){
 		ind->treeStruct->RemoveTreeFromAllClas();
 		storedTrees.push_back(ind);
 		}
+	popIn.EndSection();
+
+	bool readSwaps = false;
+	if(conf->uniqueSwapBias != ONE_POINT_ZERO && popIn.HasSection(SWAP_LOG_SECTION)){
+		sprintf(str, "%s.swaps.check", conf->ofprefix.c_str());
+		Tree::attemptedSwaps.ReadSwapLog(popIn.BeginSection(SWAP_LOG_SECTION), str);
+		popIn.EndSection();
+		readSwaps = true;
+		}
 
 	//as far as the TopologyList is concerned, each individual will be considered different
 	ntopos = total_size;
@@ -1948,6 +2125,7 @@ void Population::ReadPopulationCheckpoint(){
 		throw ErrorException("Problem reading checkpoint files.  Scores of stored trees don't match calculated scores.");
 	CalcAverageFitness();
 	globalBest = bestFitness;
+	return readSwaps;
 	}
 
 //Depending on the generation, output to various files during the GA search
@@ -2005,6 +2183,8 @@ void Population::Run(){
 
 	outman.precision(6);
 
+	subtreeRoundGen = gen;
+
 	outman.UserMessageNoCR("%-8s %-14s %-8s  %-14s ", "gen", "current_lnL", "precision", "last_tree_imp");
 
 	if(swapBasedTerm)
@@ -2031,13 +2211,22 @@ void Population::Run(){
 	if(conf->outputMostlyUselessFiles) 
 		OutputFate();	
 
+	ThroughputSample throughputStart;
+	SampleThroughput(throughputStart);
+	if(conf->telemetryInterval > 0){
+		telemetryStart = telemetryLast = throughputStart;
+		WriteTelemetry("generations", true);
+		}
+
 	gen++;
 	for (; gen < conf->stopgen+1; ++gen){
 		//this is set true if the generation loop was exited normally but final optimization was not done
 		if(finishedGenerations)
 			break;
 
+		ProfGeneration.Start();
 		NextGeneration();
+		ProfGeneration.Stop();
 		UpdateFractionDone(2);
 		if(swapBasedTerm){
 			if(uniqueSwapTried){
@@ -2048,9 +2237,11 @@ void Population::Run(){
 		keepTrack();
 		
         WriteGenerationOutput();
+		if(conf->telemetryInterval > 0)
+			WriteTelemetry("generations", false);
 			
 #ifndef BOINC
-		userTermination = CheckForUserSignal();
+		userTermination = Tree::AnySlice(CheckForUserSignal());
 		if(userTermination){
 			outman.UserMessage("NOTE: ****Run terminated by user interuption ...");
 			break;
@@ -2073,7 +2264,11 @@ void Population::Run(){
 			if(gen-(max(lastTopoImprove, lastPrecisionReduction)) >= adap->intervalsToStore*adap->intervalLength){
 				//this allows the program to bail if numPrecReductions < 0, which can be handy to get to this point
 				//with checkpointing in and then restart from the same checkpoint with various values of numPrecReductions
-				if(adap->numPrecReductions < 0) return;
+				if(adap->numPrecReductions < 0){
+					if(subtreeBuffer != NULL)
+						FinishSubtreeSearchRound();
+					return;
+					}
 				reduced=adap->ReducePrecision();
 				}
 			//optimize params if we just reduced prec or if we are at the min prec and we've run for a while since the last reduction
@@ -2194,10 +2389,25 @@ void Population::Run(){
 #endif
 			}
 
-		if(ShouldCheckpoint(true) == true)
-			WriteStateFiles();
+		if(islandBuffer != NULL)
+			ExchangeMigrants();
+
+		if(conf->subtreeWorkers > 1 && gen - subtreeRoundGen >= conf->subtreeGens){
+			if(subtreeBuffer == NULL)
+				StartSubtreeSearchRound();
+			else
+				FinishSubtreeSearchRound();
+			}
+
+		if(ShouldCheckpoint(true) == true){
+			//the treelog is only flushed when its buffer fills, so make sure it isn't behind the checkpoint
+			if(treeLog.is_open())
+				treeLog.flush();
+			WriteStateFiles(conf->backgroundCheckpoints);
+			}
 
-		if(stopwatch.ThisExecutionSplitTime() > conf->stoptime){
+		//processes sharing the likelihood calculations must all stop at the same generation
+		if(Tree::AnySlice(stopwatch.ThisExecutionSplitTime() > conf->stoptime)){
 			outman.UserMessage("NOTE: ****Specified time limit (%d seconds) reached...", conf->stoptime);
 			//Time termination can be used a sort of "pause" along with checkpointing.  Checkpoints may be
 			//written very infrequently though (large saveevery), so spit one out now.
@@ -2227,6 +2437,18 @@ void Population::Run(){
 			}
 #endif
 		}
+	if(subtreeBuffer != NULL)
+		FinishSubtreeSearchRound();
+
+	//only the generations are measured, final optimization is a different sort of work
+	if(conf->throughputReport){
+		ThroughputSample throughputEnd;
+		SampleThroughput(throughputEnd);
+		WriteThroughputReport(throughputStart, throughputEnd);
+		}
+	if(conf->telemetryInterval > 0)
+		WriteTelemetry("generationsfinished", true);
+
 	//Allow killing during FinalOpt
 	TurnOffSignalCatching();
 
@@ -2265,6 +2487,9 @@ void Population::Run(){
 			AppendTreeToTreeLog(-1);
 		}
 
+	if(conf->telemetryInterval > 0)
+		WriteTelemetry("finished", true);
+
 	//outman.UserMessage("Maximum # clas used = %d out of %d", claMan->MaxUsedClas(), claMan->NumClas());
 	//outman.UserMessage("%d conditional likelihood calculations\n%d branch optimization passes", calcCount, optCalcs);
 	UpdateFractionDone(4);
@@ -2477,6 +2702,7 @@ void Population::UpdateFractionDone(int phase){
 
 //this is a final opt adapted from final opt of trunk version 1.0
 void Population::BetterFinalOptimization(){
+	ProfFinalOpt.Start();
 	outman.setf(ios::fixed);
 	outman.precision(5);
 	outman.UserMessage("Current score = %.4f", BestFitness());
@@ -2509,13 +2735,17 @@ void Population::BetterFinalOptimization(){
 	finalRefinePass = 1;
 
 	double freqOptImprove, nucRateOptImprove, pinvOptImprove, alphaOptImprove, omegaOptImprove, flexOptImprove, subRateOpt, insDelOptImprove;
-	double paramOpt, blenOptImprove;
-	paramOpt = blenOptImprove = freqOptImprove = nucRateOptImprove = pinvOptImprove = alphaOptImprove = omegaOptImprove = flexOptImprove = subRateOpt = insDelOptImprove = ZERO_POINT_ZERO;
+	double paramOpt, blenOptImprove, jointOptImprove;
+	paramOpt = blenOptImprove = jointOptImprove = freqOptImprove = nucRateOptImprove = pinvOptImprove = alphaOptImprove = omegaOptImprove = flexOptImprove = subRateOpt = insDelOptImprove = ZERO_POINT_ZERO;
 
 	FLOAT_TYPE precThisPass = max(adap->branchOptPrecision * pow(ZERO_POINT_FIVE, finalRefinePass), (FLOAT_TYPE)1e-10);
 	FLOAT_TYPE paramPrecThisPass = max(adap->branchOptPrecision*0.1, 0.01);
 	bool optAnyModel = FloatingPointEquals(conf->modWeight, ZERO_POINT_ZERO, 1e-8) == false;
 	bool goingToExit;
+	//the time and number of likelihood evaluations spent on model parameters, to allow comparison of the
+	//joint and sequential approaches
+	double modelOptSeconds = ZERO_POINT_ZERO;
+	unsigned long modelOptScorings = 0;
 
 	Individual *optInd = &indiv[bestIndiv];
 	Tree *optTree = optInd->treeStruct;
@@ -2541,7 +2771,10 @@ void Population::BetterFinalOptimization(){
 		optTree->StoreBranchlengths(blens);
 
 		//remember that what is returned from OptAllBranches isn't the true increase in score, just an estimate
-		incr=optTree->OptimizeAllBranches(precThisPass);
+		if(conf->gradientBranchOpt)
+			incr=optTree->GradientOptimizeAllBranches(precThisPass);
+		else
+			incr=optTree->OptimizeAllBranchesFullTree(precThisPass);
 		optInd->CalcFitness(0);
 
 		FLOAT_TYPE trueImprove= optInd->Fitness() - passStart;
@@ -2568,8 +2801,21 @@ void Population::BetterFinalOptimization(){
 		//these strings will be overwritten each time one of the parameter types are optimized
 		//always with the sum total of improvement due to that param, be it over models, passes, etc.
 		//this means that each will only appear once, even in partitioned models
-		string omegaS, alphaS, flexS, pinvS, freqsS, relRatesS, insDelS, subsetS;
-		omegaS = alphaS = flexS = pinvS = freqsS = relRatesS = insDelS = subsetS = "";
+		string omegaS, alphaS, flexS, pinvS, freqsS, relRatesS, insDelS, subsetS, jointS;
+		omegaS = alphaS = flexS = pinvS = freqsS = relRatesS = insDelS = subsetS = jointS = "";
+		double modelOptStart = stopwatch.SplitTimeDouble();
+		unsigned long scoringsStart = Tree::numScorings;
+		if(conf->jointModelOpt){
+			int evals;
+			paramOpt = optTree->OptimizeModelParametersJointly(paramPrecThisPass, evals);
+			if(paramOpt < ZERO_POINT_ZERO && paramOpt > -1e-8)//avoid printing very slightly negative values
+				paramOpt = ZERO_POINT_ZERO;
+			jointOptImprove += paramOpt;
+			sprintf(temp, "  model= %4.4f", jointOptImprove);
+			jointS = temp;
+			incr += paramOpt;
+			optInd->CalcFitness(0);
+			}
 		for(int m = 0;m < indiv[bestIndiv].modPart.NumModels();m++){
 			Model *mod = indiv[bestIndiv].modPart.GetModel(m);
 			const ModelSpecification *modSpec = mod->GetCorrespondingSpec();
@@ -2598,6 +2844,16 @@ void Population::BetterFinalOptimization(){
 			if(modSpec->IsOrientedGap())
 				optInsDel = true;
 
+			//anything already handled by the joint optimization above is skipped
+			if(conf->jointModelOpt){
+				bool jointAlpha, jointPinv, jointFreqs, jointRelRates;
+				Tree::JointModelParameterCoverage(modSpec, jointAlpha, jointPinv, jointFreqs, jointRelRates);
+				optAlpha = optAlpha && !jointAlpha;
+				optPinv = optPinv && !jointPinv;
+				optFreqs = optFreqs && !jointFreqs;
+				optRelRates = optRelRates && !jointRelRates;
+				}
+
 			//this is taken from the improved version in the trunk, and is a bit redundant in this context.  
 			//the output strings will be generated every time that any of the params are optimized, and will
 			//then be updated the next time the same parameter type is optimized in a different model.  The
@@ -2676,7 +2932,7 @@ void Population::BetterFinalOptimization(){
 			optInd->CalcFitness(0);
 			}
 		
-		if(modSpecSet.InferSubsetRates()){
+		if(modSpecSet.InferSubsetRates() && !conf->jointModelOpt){
 			paramOpt = indiv[bestIndiv].treeStruct->OptimizeSubsetRates(max(adap->branchOptPrecision*0.1, 0.001));
 			if(paramOpt < ZERO_POINT_ZERO && paramOpt > -1e-8)//avoid printing very slightly negative values
 				paramOpt = ZERO_POINT_ZERO;
@@ -2686,8 +2942,10 @@ void Population::BetterFinalOptimization(){
 			paramOpt += subRateOpt;
 			}
 		optInd->CalcFitness(0);
+		modelOptSeconds += stopwatch.SplitTimeDouble() - modelOptStart;
+		modelOptScorings += Tree::numScorings - scoringsStart;
 		
-		outString = blenS + omegaS + alphaS + flexS + pinvS + freqsS + relRatesS + insDelS + subsetS;
+		outString = blenS + jointS + omegaS + alphaS + flexS + pinvS + freqsS + relRatesS + insDelS + subsetS;
 		goingToExit = !(incr > 1.0e-5 || precThisPass > 1.0e-4 || finalRefinePass < 10);
 
 		UpdateFractionDone(3);
@@ -2698,7 +2956,7 @@ void Population::BetterFinalOptimization(){
 			if(conf->reportRunProgress)
 				outman.UserMessageNoCR(" %14.2f %14.2f", 0.01 * (int) ceil(rep_fraction_done * 100), 0.01 * (int) ceil(tot_fraction_done * 100));
 			outman.UserMessage("");
-			paramOpt = blenOptImprove = freqOptImprove = nucRateOptImprove = pinvOptImprove = alphaOptImprove = omegaOptImprove = flexOptImprove = subRateOpt = insDelOptImprove = ZERO_POINT_ZERO;
+			paramOpt = blenOptImprove = jointOptImprove = freqOptImprove = nucRateOptImprove = pinvOptImprove = alphaOptImprove = omegaOptImprove = flexOptImprove = subRateOpt = insDelOptImprove = ZERO_POINT_ZERO;
 			}
 
 		finalRefinePass++;
@@ -2718,6 +2976,7 @@ void Population::BetterFinalOptimization(){
 #endif
 
 	outman.UserMessage("Final score = %.4f", indiv[bestIndiv].Fitness());
+	outman.UserMessage("Model parameter optimization (%s): %lu likelihood evaluations, %.2f seconds", (conf->jointModelOpt ? "joint" : "sequential"), modelOptScorings, modelOptSeconds);
 	unsigned totalSecs = stopwatch.SplitTime();
 	unsigned secs = totalSecs % 60;
 	totalSecs -= secs;
@@ -2749,87 +3008,9 @@ void Population::BetterFinalOptimization(){
 	if(conf->outputTreelog && treeLog.is_open())
 		AppendTreeToTreeLog(-1);
 
-#ifdef ENABLE_CUSTOM_PROFILER
-	char fname[100];
-	sprintf(fname, "%s.profileresults.log", conf->ofprefix.c_str());
-#ifdef BOINC
-	char physical_name[100];
-	boinc_resolve_filename(fname, physical_name, sizeof(physical_name));
-	ofstream prof(physical_name);
-	//MFILE prof;
-	//prof.open(physical_name, "w");
-#else
-	ofstream prof(fname);
-#endif
-
-	/*
-//FROM WRITETREEFILE
-#ifdef BOINC
-	char physical_name[100];
-	boinc_resolve_filename(fname, physical_name, sizeof(physical_name));
-	MFILE outf;
-	outf.open(physical_name, "w");
-#else
-	ofstream outf;
-	outf.open( filename.c_str() );
-	outf.precision(8);
-#endif
-//...
-#ifdef BOINC
-	const char *s = trans.c_str();
-	outf.write(s, sizeof(char), trans.length());
-	s = str.c_str();
-	outf.write(s, sizeof(char), str.length());
-	theInd->treeStruct->root->MakeNewick(treeString, false, true);
-	size_t len = strlen(treeString);
-	outf.write(treeString, sizeof(char), len);
-	str = ";\nend;\n";
-	s = str.c_str();
-	outf.write(s, sizeof(char), str.length());
-#else
-	outf << trans;
-	outf << str;
-	outf.setf( ios::floatfield, ios::fixed );
-	outf.setf( ios::showpoint );
-	theInd->treeStruct->root->MakeNewick(treeString, false, true);
-	outf << treeString << ";\n";
-	outf << "end;\n";
-#endif	
-*/
-	char str[256];
-	sprintf(str, "dataset: %s\tstart:%s\n", conf->datafname.c_str(), conf->streefname.c_str());
-	
-	prof << "dataset: " << conf->datafname << "\t" << "start: " << conf->streefname << endl;
-	prof << "seed: " << conf->randseed << "\t" << "refine: " << (conf->refineStart == true) << endl;
-	prof << "start prec: " << conf->startOptPrec << "\t" << "final prec: " << adap->branchOptPrecision << endl;
-
-#ifdef SINGLE_PRECISION_FLOATS
-	prof << "Single precision\n";
-#else
-	prof << "Double precision\n";
-#endif
-	unsigned s = stopwatch.SplitTime();
-	prof << "Total Runtime: " << s << "\tnumgen: " << gen << "\tFinalScore: " << indiv[bestIndiv].Fitness() << "\n";
-	outman.SetOutputStream(prof);
-	indiv[bestIndiv].modPart.OutputHumanReadableModelReportWithParams();
-
-	prof << "Function\t\tcalls\ttime\tTperC\t%runtime" << endl;
-	ProfIntInt.Report(prof, s);
-	ProfIntTerm.Report(prof, s);
-	ProfTermTerm.Report(prof, s);
-	ProfRescale.Report(prof, s);
-	ProfScoreInt.Report(prof, s);
-	ProfScoreTerm.Report(prof, s);
-	ProfIntDeriv.Report(prof, s);
-	ProfTermDeriv.Report(prof, s);
-	ProfCalcPmat.Report(prof, s);
-	ProfCalcEigen.Report(prof, s);
-	ProfModDeriv.Report(prof, s);
-	ProfNewton.Report(prof, s);
-	ProfEQVectors.Report(prof, s);
-	prof.close();
-	outman.SetOutputStream(cout);
-#endif
+	ProfFinalOpt.Stop();
+	if(Profiler::Enabled())
+		WriteProfileReport();
 	/*	cout << "intterm calls " << inttermcalls << " time " << inttermtime/(double)(ticspersec.QuadPart) << endl;
 	cout << "termterm calls " << termtermcalls << " time " << termtermtime/(double)(ticspersec.QuadPart) << endl;
 	cout << "rescale calls " << rescalecalls << " time " << rescaletime/(double)(ticspersec.QuadPart) << " numrescales " << numactualrescales << endl;
@@ -2898,7 +3079,10 @@ void Population::FinalOptimization(){
 		}while(paramOpt > ZERO_POINT_ZERO);
 
 	do{
-		incr=indiv[bestIndiv].treeStruct->OptimizeAllBranches(max(adap->branchOptPrecision * pow(ZERO_POINT_FIVE, pass), (FLOAT_TYPE)1e-10));
+		if(conf->gradientBranchOpt)
+			incr=indiv[bestIndiv].treeStruct->GradientOptimizeAllBranches(max(adap->branchOptPrecision * pow(ZERO_POINT_FIVE, pass), (FLOAT_TYPE)1e-10));
+		else
+			incr=indiv[bestIndiv].treeStruct->OptimizeAllBranchesFullTree(max(adap->branchOptPrecision * pow(ZERO_POINT_FIVE, pass), (FLOAT_TYPE)1e-10));
 
 		indiv[bestIndiv].CalcFitness(0);
 		outman.UserMessage("\tpass %d %.4f", pass++, indiv[bestIndiv].Fitness());
@@ -2924,41 +3108,8 @@ void Population::FinalOptimization(){
 
 	outman.unsetf(ios::fixed);
 	
-#ifdef ENABLE_CUSTOM_PROFILER
-	char fname[100];
-	sprintf(fname, "%s.profileresults.log", conf->ofprefix.c_str());
-	ofstream prof(fname);
-	prof << "dataset: " << conf->datafname << "\t" << "start: " << conf->streefname << endl;
-	prof << "seed: " << conf->randseed << "\t" << "refine: " << (conf->refineStart == true) << endl;
-	prof << "start prec: " << conf->startOptPrec << "\t" << "final prec: " << adap->branchOptPrecision << endl;
-
-#ifdef SINGLE_PRECISION_FLOATS
-	prof << "Single precision\n";
-#else
-	prof << "Double precision\n";
-#endif
-	unsigned s = stopwatch.SplitTime();
-	prof << "Total Runtime: " << s << "\tnumgen: " << gen << "\tFinalScore: " << indiv[bestIndiv].Fitness() << "\n";
-	outman.SetOutputStream(prof);
-	indiv[bestIndiv].modPart.OutputHumanReadableModelReportWithParams();
-
-	prof << "Function\t\tcalls\ttime\tTperC\t%runtime" << endl;
-	ProfIntInt.Report(prof, s);
-	ProfIntTerm.Report(prof, s);
-	ProfTermTerm.Report(prof, s);
-	ProfRescale.Report(prof, s);
-	ProfScoreInt.Report(prof, s);
-	ProfScoreTerm.Report(prof, s);
-	ProfIntDeriv.Report(prof, s);
-	ProfTermDeriv.Report(prof, s);
-	ProfCalcPmat.Report(prof, s);
-	ProfCalcEigen.Report(prof, s);
-	ProfModDeriv.Report(prof, s);
-	ProfNewton.Report(prof, s);
-	ProfEQVectors.Report(prof, s);
-	prof.close();
-	outman.SetOutputStream(cout);
-#endif
+	if(Profiler::Enabled())
+		WriteProfileReport();
 	/*	cout << "intterm calls " << inttermcalls << " time " << inttermtime/(double)(ticspersec.QuadPart) << endl;
 	cout << "termterm calls " << termtermcalls << " time " << termtermtime/(double)(ticspersec.QuadPart) << endl;
 	cout << "rescale calls " << rescalecalls << " time " << rescaletime/(double)(ticspersec.QuadPart) << " numrescales " << numactualrescales << endl;
@@ -2971,6 +3122,187 @@ void Population::FinalOptimization(){
 	cout << "pmat calls " << pmatcalls << " time " << pmattime/(double)(ticspersec.QuadPart) << endl;
 */	}
 
+//writes the accumulated profile of all searches so far as json, and as folded stacks for flame graphs
+void Population::WriteProfileReport(){
+	string jsonName = conf->ofprefix + ".profile.json";
+	string foldedName = conf->ofprefix + ".profile.folded";
+#ifdef BOINC
+	char physical_name[100];
+	boinc_resolve_filename(jsonName.c_str(), physical_name, sizeof(physical_name));
+	jsonName = physical_name;
+	boinc_resolve_filename(foldedName.c_str(), physical_name, sizeof(physical_name));
+	foldedName = physical_name;
+#endif
+	ofstream prof(jsonName.c_str());
+	if(!prof.good())
+		throw ErrorException("could not open profile output file %s", jsonName.c_str());
+	double runSeconds = stopwatch.SplitTimeDouble();
+	prof.setf(ios::fixed);
+	prof.precision(6);
+	prof << "{\n\"dataset\": " << Profiler::JSONString(conf->datafname) << ",\n\"start\": " << Profiler::JSONString(conf->streefname) << ",\n";
+	prof << "\"seed\": " << conf->randseed << ",\n\"refine\": " << (conf->refineStart ? "true" : "false") << ",\n";
+	prof << "\"startPrecision\": " << conf->startOptPrec << ",\n\"finalPrecision\": " << adap->branchOptPrecision << ",\n";
+#ifdef SINGLE_PRECISION_FLOATS
+	prof << "\"precision\": \"single\",\n";
+#else
+	prof << "\"precision\": \"double\",\n";
+#endif
+	prof << "\"generations\": " << gen << ",\n\"finalScore\": " << indiv[bestIndiv].Fitness() << ",\n\"profile\": ";
+	Profiler::WriteJSON(prof, runSeconds);
+	prof << "}" << endl;
+	prof.close();
+
+	ofstream folded(foldedName.c_str());
+	Profiler::WriteFolded(folded);
+	folded.close();
+	outman.UserMessage("Profile written to %s and %s", jsonName.c_str(), foldedName.c_str());
+	}
+
+//sample.gen is the last generation completed.  The generation loop leaves gen one past stopgen when it runs
+//out normally, but no generation beyond stopgen is ever run.
+void Population::SampleThroughput(ThroughputSample &sample) const{
+	sample.gen = min(gen, conf->stopgen);
+	sample.nanoseconds = Profiler::Now();
+	sample.claUpdates = Tree::numClaUpdates;
+	sample.scorings = Tree::numScorings;
+	sample.claRecycles = claMan->NumRecycles();
+	sample.clasReclaimed = claMan->NumReclaimed();
+	sample.rescales = Tree::numRescales;
+	}
+
+//writes the search throughput between two samples as json, one file per search replicate when there are several
+void Population::WriteThroughputReport(const ThroughputSample &start, const ThroughputSample &end){
+	char suffix[50];
+	if(conf->searchReps > 1 && conf->bootstrapReps == 0)
+		sprintf(suffix, ".rep%d.throughput.json", currentSearchRep);
+	else
+		sprintf(suffix, ".throughput.json");
+	string name = conf->ofprefix + suffix;
+#ifdef BOINC
+	char physical_name[100];
+	boinc_resolve_filename(name.c_str(), physical_name, sizeof(physical_name));
+	name = physical_name;
+#endif
+	ofstream out(name.c_str());
+	if(!out.good())
+		throw ErrorException("could not open throughput output file %s", name.c_str());
+
+	unsigned gens = end.gen - start.gen;
+	double seconds = (end.nanoseconds - start.nanoseconds) * 1.0e-9;
+	double perSec = (seconds > 0.0 ? 1.0 / seconds : 0.0);
+	unsigned long long claUpdates = end.claUpdates - start.claUpdates;
+	unsigned long long scorings = end.scorings - start.scorings;
+	int numPatterns = 0;
+	for(int d = 0;d < dataPart->NumSubsets();d++)
+		numPatterns += dataPart->GetSubset(d)->NChar();
+
+	out.setf(ios::fixed);
+	out.precision(3);
+	out << "{\n\"dataset\": " << Profiler::JSONString(conf->datafname) << ",\n\"seed\": " << conf->randseed << ",\n\"replicate\": " << currentSearchRep << ",\n";
+	out << "\"numTaxa\": " << dataPart->NTax() << ",\n\"numSubsets\": " << dataPart->NumSubsets() << ",\n\"numPatterns\": " << numPatterns << ",\n";
+#ifdef OPEN_MP
+	out << "\"threads\": " << omp_get_max_threads() << ",\n";
+#else
+	out << "\"threads\": 1,\n";
+#endif
+	out << "\"generations\": " << gens << ",\n\"seconds\": " << seconds << ",\n\"generationsPerSec\": " << gens * perSec << ",\n";
+	out << "\"claUpdates\": " << claUpdates << ",\n\"claUpdatesPerSec\": " << claUpdates * perSec << ",\n";
+	out << "\"scorings\": " << scorings << ",\n\"scoringsPerSec\": " << scorings * perSec << ",\n";
+	out << "\"peakRSSKB\": " << PeakResidentMemoryKB() << ",\n";
+	out << "\"numClas\": " << claMan->NumClas() << ",\n\"maxUsedClas\": " << claMan->MaxUsedClas() << ",\n";
+	out << "\"claRecycles\": " << end.claRecycles - start.claRecycles << ",\n\"clasReclaimed\": " << end.clasReclaimed - start.clasReclaimed << ",\n";
+	out << "\"rescales\": " << end.rescales - start.rescales << ",\n";
+	out.precision(4);
+	out << "\"bestScore\": " << BestFitness() << "\n}" << endl;
+	out.close();
+	outman.UserMessage("Search throughput written to %s", name.c_str());
+	}
+
+//rewrites <ofprefix>.telemetry.json with the current state of the search, at most every telemetryinterval
+//seconds unless forced.  Rates are given both since the last write and since the start of the generations.
+//The file is written under a temporary name and renamed, so that readers never see a partial file.
+void Population::WriteTelemetry(const char *phase, bool force){
+	ThroughputSample now;
+	SampleThroughput(now);
+	if(!force && (now.nanoseconds - telemetryLast.nanoseconds) * 1.0e-9 < conf->telemetryInterval)
+		return;
+
+	string name = conf->ofprefix + ".telemetry.json";
+#ifdef BOINC
+	char physical_name[100];
+	boinc_resolve_filename(name.c_str(), physical_name, sizeof(physical_name));
+	name = physical_name;
+#endif
+	string tempName = name + ".tmp";
+	ofstream out(tempName.c_str());
+	if(!out.good())
+		throw ErrorException("could not open telemetry output file %s", tempName.c_str());
+
+	out.setf(ios::fixed);
+	out.precision(3);
+	out << "{\n\"phase\": " << Profiler::JSONString(phase) << ",\n\"dataset\": " << Profiler::JSONString(conf->datafname) << ",\n";
+	out << "\"replicate\": " << currentSearchRep << ",\n\"elapsedSeconds\": " << stopwatch.SplitTimeDouble() << ",\n";
+	out << "\"generation\": " << gen << ",\n\"lastTopoImprove\": " << lastTopoImprove << ",\n";
+	out << "\"precision\": " << adap->branchOptPrecision << ",\n";
+	out.precision(4);
+	out << "\"bestScore\": " << BestFitness() << ",\n";
+	out.precision(3);
+
+	//the interval rates are for the latest interval, the run ones from the start of the generations
+	const ThroughputSample *from[2] = {&telemetryLast, &telemetryStart};
+	const char *label[2] = {"interval", "run"};
+	for(int r = 0;r < 2;r++){
+		double seconds = (now.nanoseconds - from[r]->nanoseconds) * 1.0e-9;
+		double perSec = (seconds > 0.0 ? 1.0 / seconds : 0.0);
+		out << "\"" << label[r] << "\": {\"seconds\": " << seconds;
+		out << ", \"generationsPerSec\": " << (now.gen - from[r]->gen) * perSec;
+		out << ", \"likelihoodEvalsPerSec\": " << (now.scorings - from[r]->scorings) * perSec;
+		out << ", \"claUpdatesPerSec\": " << (now.claUpdates - from[r]->claUpdates) * perSec;
+		out << ", \"rescales\": " << now.rescales - from[r]->rescales;
+		out << ", \"claRecycles\": " << now.claRecycles - from[r]->claRecycles;
+		out << ", \"clasReclaimed\": " << now.clasReclaimed - from[r]->clasReclaimed << "},\n";
+		}
+
+	//Adaptation keeps the number of times each mutation type was applied and the total lnL gain that
+	//it produced for each of the last intervalsToStore intervals
+	out << "\"mutationWindowGenerations\": " << adap->intervalsToStore * adap->intervalLength << ",\n\"mutations\": {";
+	const char *mutName[7] = {"randNNI", "randSPR", "limSPR", "brlenOnly", "model", "randRecom", "bipartRecom"};
+	const int *mutNum[7] = {adap->randNNInum, adap->randSPRnum, adap->limSPRnum, adap->onlyBrlennum, adap->anyModelnum, adap->randRecomnum, adap->bipartRecomnum};
+	const FLOAT_TYPE *mutGain[7] = {adap->randNNI, adap->randSPR, adap->limSPR, adap->onlyBrlen, adap->anyModel, adap->randRecom, adap->bipartRecom};
+	//recombination isn't chosen with a probability, so only the first five have one
+	const FLOAT_TYPE mutProb[5] = {adap->topoMutateProb * adap->randNNIprob, adap->topoMutateProb * adap->randSPRprob, adap->topoMutateProb * adap->limSPRprob,
+		ONE_POINT_ZERO - adap->topoMutateProb - adap->modelMutateProb, adap->modelMutateProb};
+	for(int m = 0;m < 7;m++){
+		int attempts = 0;
+		FLOAT_TYPE gain = ZERO_POINT_ZERO;
+		for(unsigned i = 0;i < adap->intervalsToStore;i++){
+			attempts += mutNum[m][i];
+			gain += mutGain[m][i];
+			}
+		out << (m > 0 ? "," : "") << "\n  \"" << mutName[m] << "\": {\"attempts\": " << attempts << ", \"lnLGain\": " << gain;
+		out << ", \"gainPerAttempt\": " << (attempts > 0 ? gain / attempts : ZERO_POINT_ZERO);
+		if(m < 5)
+			out << ", \"probability\": " << mutProb[m];
+		out << "}";
+		}
+	out << "\n},\n";
+
+	int clean = 0, tempReserved = 0, reserved = 0, assigned = 0;
+	claMan->CountClaTotals(clean, tempReserved, reserved, assigned);
+	out << "\"clas\": {\"total\": " << claMan->NumClas() << ", \"free\": " << claMan->NumFreeClas() << ", \"maxUsed\": " << claMan->MaxUsedClas();
+	out << ", \"clean\": " << clean << ", \"tempReserved\": " << tempReserved << ", \"reserved\": " << reserved << ", \"holdersAssigned\": " << assigned << "},\n";
+	out << "\"residentKB\": " << ResidentMemoryKB() << ",\n\"peakResidentKB\": " << PeakResidentMemoryKB() << "\n}" << endl;
+	out.close();
+
+#ifdef WIN32
+	//rename won't replace an existing file on windows
+	remove(name.c_str());
+#endif
+	if(rename(tempName.c_str(), name.c_str()) != 0)
+		throw ErrorException("could not rename telemetry output file %s to %s", tempName.c_str(), name.c_str());
+	telemetryLast = now;
+	}
+
 //figures out the best individual that has been stored and returns index, optionally summarizes the final trees/models that have been stored
 int Population::EvaluateStoredTrees(bool report){
 	double bestL=-FLT_MAX;
@@ -3122,6 +3454,15 @@ void Population::ClearStoredTrees(){
 
 void Population::Bootstrap(){
 
+	if(conf->bootstrapWorkers > 1 && conf->restart == false){
+		if(conf->checkpoint || conf->workPhaseDivision)
+			outman.UserMessage("NOTE: bootstrapworkers is ignored when writing checkpoints or using workphasedivision.\nBootstrap replicates will be run one at a time.");
+		else{
+			BootstrapWithWorkers();
+			return;
+			}
+		}
+
 	//if we're not restarting
 	if(conf->restart == false) 
 		currentBootstrapRep = 1;
@@ -3144,7 +3485,7 @@ void Population::Bootstrap(){
 					nextBootstrapSeed = rnd.seed();
 				}
 			lastBootstrapSeed = nextBootstrapSeed;
-			nextBootstrapSeed = dataPart->BootstrapReweight(lastBootstrapSeed, conf->resampleProportion);
+			ReweightBootstrapData();
 			}
 		
 		PerformSearch();
@@ -3171,6 +3512,484 @@ void Population::Bootstrap(){
 		}
 	}
 
+//Resamples the data for the current replicate from lastBootstrapSeed.  With compactbootstrappatterns the patterns
+//that weren't resampled are then moved out of the range that the likelihood calcs loop over, and the clas are told
+//how many sites are left.  The matrix has to be put back in its original order before each reweighting
+void Population::ReweightBootstrapData(){
+	//a previous initial optimization isn't valid for the new data
+	ClearInitialOptSnapshot();
+	if(conf->compactBootstrapPatterns)
+		dataPart->RestoreUncompactedPatterns();
+	nextBootstrapSeed = dataPart->BootstrapReweight(lastBootstrapSeed, conf->resampleProportion);
+	if(conf->compactBootstrapPatterns){
+		dataPart->CompactZeroCountPatterns();
+		for(int d = 0;d < dataPart->NumSubsets();d++){
+			claMan->SetActiveSites(d, dataPart->GetSubset(d)->NChar());
+			outman.DebugMessage("subset %d: %d patterns after compacting unsampled patterns", d + 1, dataPart->GetSubset(d)->NChar());
+			}
+		}
+	}
+
+//Runs the bootstrap replicates in several worker processes at once.  The workers are forked after the data
+//have been read and packed, so the pattern matrix and tip data are shared (copy-on-write) rather than being
+//re-read by each one.  Only the pattern counts, the population and the search state are private to a worker.
+//The reweighting seeds are chained exactly as in a serial run, so replicate N sees the same resampled data
+//whether or not workers are used.  Worker w runs replicates w+1, w+1+numWorkers, etc, and writes all of its
+//output with the prefix ofprefix.workerW.  Its bootstrap trees are then merged back into ofprefix.boot.tre
+void Population::BootstrapWithWorkers(){
+#if defined(UNIX) && !defined(MPI_VERSION) && !defined(BOINC) && !defined(SUBROUTINE_GARLI) && !defined(MAC_FRONTEND)
+	int numWorkers = min((int) conf->bootstrapWorkers, (int) conf->bootstrapReps);
+
+	vector<int> bootSeeds;
+	int seed = (conf->bootstrapSeed > 0 ? conf->bootstrapSeed : rnd.seed());
+	for(unsigned r = 0;r < conf->bootstrapReps;r++){
+		bootSeeds.push_back(seed);
+		seed = dataPart->BootstrapReweight(seed, conf->resampleProportion);
+		}
+
+	//each worker gets its own random number stream for the searches
+	vector<int> workerSeeds;
+	for(int w = 0;w < numWorkers;w++)
+		workerSeeds.push_back(rnd.random_int(RAND_MAX) + 1);
+
+	outman.UserMessage("\nRunning %d bootstrap replicates in %d worker processes", conf->bootstrapReps, numWorkers);
+	outman.UserMessage("Output from worker N will be written to files beginning with %s.workerN\n", conf->ofprefix.c_str());
+	outman.flush();
+
+	vector<pid_t> pids;
+	for(int w = 0;w < numWorkers;w++){
+		pid_t pid = fork();
+		if(pid < 0)
+			throw ErrorException("Could not start bootstrap worker process %d", w + 1);
+		if(pid == 0){
+			char temp_buf[100];
+			sprintf(temp_buf, ".worker%d", w + 1);
+			conf->ofprefix += temp_buf;
+			sprintf(temp_buf, "%s.screen.log", conf->ofprefix.c_str());
+			outman.SetLogFile(temp_buf);
+			outman.SetNoOutput(true);
+			rnd.set_seed(workerSeeds[w]);
+
+			int status = 0;
+			try{
+				for(currentBootstrapRep = w + 1;currentBootstrapRep <= conf->bootstrapReps;currentBootstrapRep += numWorkers){
+					outman.UserMessage("\nBootstrap reweighting...");
+					lastBootstrapSeed = bootSeeds[currentBootstrapRep - 1];
+					ReweightBootstrapData();
+					PerformSearch();
+					Reset();
+					if(userTermination || timeTermination){
+						if(userTermination)
+							outman.UserMessage("abandoning bootstrap rep %d.... terminating\n", currentBootstrapRep);
+						break;
+						}
+					}
+				FinalizeOutputStreams(2);
+				}
+			catch(ErrorException &err){
+				outman.UserMessage("\nERROR: %s\n\n", err.message);
+				FinalizeOutputStreams(0);
+				FinalizeOutputStreams(1);
+				FinalizeOutputStreams(2);
+				status = 1;
+				}
+			outman.CloseLogFile();
+			_exit(status);
+			}
+		pids.push_back(pid);
+		}
+
+	int numFailed = 0;
+	for(int w = 0;w < numWorkers;w++){
+		int status;
+		if(waitpid(pids[w], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0){
+			outman.UserMessage("WARNING: bootstrap worker %d did not finish normally.  See %s.worker%d.screen.log", w + 1, conf->ofprefix.c_str(), w + 1);
+			numFailed++;
+			}
+		}
+
+	MergeWorkerBootstrapTrees(numWorkers);
+	if(numFailed > 0)
+		throw ErrorException("%d of %d bootstrap workers failed", numFailed, numWorkers);
+#else
+	throw ErrorException("Sorry, bootstrapworkers > 1 is only supported by the serial Unix version of GARLI.");
+#endif
+	}
+
+//Collects the trees written by each bootstrap worker into the normal bootstrap tree file(s), in replicate order
+void Population::MergeWorkerBootstrapTrees(int numWorkers){
+	if(bootlog_output == DONT_OUTPUT)
+		return;
+
+	char temp_buf[100];
+	char suffix[100];
+	string mainPrefix = conf->ofprefix;
+	vector< vector<string> > nexusTrees(numWorkers);
+	vector< vector<string> > phylipTrees(numWorkers);
+	string line;
+
+	for(int w = 0;w < numWorkers;w++){
+		char workerStr[20];
+		sprintf(workerStr, ".worker%d", w + 1);
+		conf->ofprefix = mainPrefix + workerStr;
+
+		sprintf(suffix, "boot.tre");
+		DetermineFilename(bootlog_output, temp_buf, suffix);
+		ifstream nex(temp_buf);
+		while(getline(nex, line))
+			if(line.find("tree bootrep") != string::npos)
+				nexusTrees[w].push_back(line);
+		nex.close();
+
+		if(conf->outputPhylipTree){
+			sprintf(suffix, "boot.phy");
+			DetermineFilename(bootlog_output, temp_buf, suffix);
+			ifstream phy(temp_buf);
+			while(getline(phy, line))
+				if(line.length() > 0)
+					phylipTrees[w].push_back(line);
+			phy.close();
+			}
+		}
+	conf->ofprefix = mainPrefix;
+
+	sprintf(suffix, "boot.tre");
+	DetermineFilename(bootlog_output, temp_buf, suffix);
+	bootLog.open(temp_buf);
+	bootLog.precision(10);
+	dataPart->BeginNexusTreesBlock(bootLog);
+	if(conf->outputPhylipTree){
+		sprintf(suffix, "boot.phy");
+		DetermineFilename(bootlog_output, temp_buf, suffix);
+		bootLogPhylip.open(temp_buf);
+		}
+
+	//replicates were dealt out to the workers in turn
+	int numMerged = 0;
+	for(unsigned r = 0;r < conf->bootstrapReps;r++){
+		int w = r % numWorkers;
+		unsigned index = r / numWorkers;
+		if(index < nexusTrees[w].size()){
+			bootLog << nexusTrees[w][index] << endl;
+			numMerged++;
+			}
+		if(conf->outputPhylipTree && index < phylipTrees[w].size())
+			bootLogPhylip << phylipTrees[w][index] << endl;
+		}
+	sprintf(suffix, "boot.tre");
+	DetermineFilename(bootlog_output, temp_buf, suffix);
+	outman.UserMessage("\nMerged %d of %d bootstrap trees from %d workers into %s", numMerged, conf->bootstrapReps, numWorkers, temp_buf);
+	}
+
+//Runs the generations of the current search replicate as an island model GA.  The population is forked into
+//numislands processes once it has been seeded, so each island starts from the same optimized population but
+//searches with its own random number stream.  Islands share nothing but the migration slots, so this is safe
+//despite the static tree and cla state.  Every sendinterval seconds each island publishes its best individual and
+//takes in any newer migrants that beat its worst one.  Island 0 is this process, and island N writes its output
+//with the prefix ofprefix.islandN.  When all have finished, the best final individual of any island becomes the
+//result of the replicate.
+void Population::RunIslands(){
+#if defined(UNIX) && !defined(MPI_VERSION) && !defined(BOINC) && !defined(SUBROUTINE_GARLI) && !defined(MAC_FRONTEND)
+	int numIslands = conf->numIslands;
+
+	//the number of nodes and model parameters are fixed by the data and model specification, so the full
+	//encoding of any individual is the same length as this one
+	PackedIndividual packed;
+	indiv[bestIndiv].Pack(packed);
+	vector<char> sizing;
+	packed.Serialize(sizing);
+	MigrationBuffer buffer;
+	buffer.Allocate(numIslands, (int) sizing.size());
+
+	vector<int> islandSeeds;
+	for(int i = 1;i < numIslands;i++)
+		islandSeeds.push_back(rnd.random_int(RAND_MAX) + 1);
+
+	outman.UserMessage("Searching with %d islands, exchanging best individuals every %.0f seconds", numIslands, conf->sendInterval);
+	outman.UserMessage("Output from island N will be written to files beginning with %s.islandN\n", conf->ofprefix.c_str());
+	outman.flush();
+	FlushOutputStreams();
+
+	vector<pid_t> pids;
+	for(int i = 1;i < numIslands;i++){
+		pid_t pid = fork();
+		if(pid < 0)
+			throw ErrorException("Could not start island process %d", i);
+		if(pid == 0){
+			//the inherited output files belong to island 0
+			CloseInheritedOutputStreams();
+			bootlog_output = DONT_OUTPUT;
+
+			char temp_buf[100];
+			sprintf(temp_buf, ".island%d", i);
+			conf->ofprefix += temp_buf;
+			sprintf(temp_buf, "%s.screen.log", conf->ofprefix.c_str());
+			outman.SetLogFile(temp_buf);
+			outman.SetNoOutput(true);
+			rnd.set_seed(islandSeeds[i - 1]);
+			islandIndex = i;
+			islandBuffer = &buffer;
+			lastMigrationTime = stopwatch.SplitTime();
+
+			int status = 0;
+			try{
+				InitializeOutputStreams();
+				Run();
+				indiv[bestIndiv].Pack(packed);
+				buffer.Publish(i, packed, true);
+				FinalizeOutputStreams(2);
+				}
+			catch(ErrorException &err){
+				outman.UserMessage("\nERROR: %s\n\n", err.message);
+				FinalizeOutputStreams(0);
+				FinalizeOutputStreams(1);
+				FinalizeOutputStreams(2);
+				status = 1;
+				}
+			outman.CloseLogFile();
+			_exit(status);
+			}
+		pids.push_back(pid);
+		}
+
+	islandIndex = 0;
+	islandBuffer = &buffer;
+	lastMigrationTime = stopwatch.SplitTime();
+	try{
+		Run();
+		}
+	catch(ErrorException &){
+		islandBuffer = NULL;
+		throw;
+		}
+	islandBuffer = NULL;
+
+	for(int i = 1;i < numIslands;i++){
+		int status;
+		if(waitpid(pids[i - 1], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			outman.UserMessage("WARNING: island %d did not finish normally.  See %s.island%d.screen.log", i, conf->ofprefix.c_str(), i);
+		}
+
+	int bestIsland = 0;
+	PackedIndividual best;
+	for(int i = 1;i < numIslands;i++){
+		if(buffer.Finished(i) && buffer.Read(i, packed, false)){
+			outman.UserMessage("island %d final lnL = %.4f", i, packed.lnL);
+			if(packed.lnL > (bestIsland == 0 ? indiv[bestIndiv].Fitness() : best.lnL)){
+				bestIsland = i;
+				best.Swap(packed);
+				}
+			}
+		}
+	if(bestIsland != 0){
+		outman.UserMessage("Taking the final result of island %d, which beat that of island 0 (lnL = %.4f)", bestIsland, indiv[bestIndiv].Fitness());
+		indiv[bestIndiv].Unpack(best);
+		CalcAverageFitness();
+		}
+#else
+	throw ErrorException("Sorry, numislands > 1 is only supported by the serial Unix version of GARLI.");
+#endif
+	}
+
+//Output files are inherited by forked processes (islands and subtree workers), so anything buffered in them must
+//be written before forking or it would be written twice
+void Population::FlushOutputStreams(){
+	log.flush();
+	fate.flush();
+	probLog.flush();
+	swapLog.flush();
+	treeLog.flush();
+	bootLog.flush();
+	bootLogPhylip.flush();
+	}
+
+//In a forked process, closes the output files that belong to the parent without writing anything to them
+void Population::CloseInheritedOutputStreams(){
+	log.close();
+	fate.close();
+	probLog.close();
+	swapLog.close();
+	treeLog.close();
+	bootLog.close();
+	bootLogPhylip.close();
+	}
+
+//Publishes this island's best individual for the others, and replaces the worst individual with each newer
+//migrant that beats it.  Only does anything once every sendinterval seconds.
+void Population::ExchangeMigrants(){
+	if(stopwatch.SplitTime() - lastMigrationTime < conf->sendInterval)
+		return;
+	lastMigrationTime = stopwatch.SplitTime();
+
+	PackedIndividual packed;
+	indiv[bestIndiv].Pack(packed);
+	islandBuffer->Publish(islandIndex, packed, false);
+
+	for(int i = 0;i < islandBuffer->NumSlots();i++){
+		if(i == islandIndex || !islandBuffer->Read(i, packed, true))
+			continue;
+		int worst = (int) cumfit[0][0];
+		if(packed.lnL > indiv[worst].Fitness()){
+			outman.UserMessage("   Migrant from island %d accepted (lnL = %.4f)", i, packed.lnL);
+			indiv[worst].Unpack(packed);
+			CalcAverageFitness();
+			}
+		}
+	}
+
+//Starts a round of subtree-partitioned search (subtreeworkers > 1).  Up to subtreeworkers disjoint clades of the
+//best tree are chosen and the population is filled with copies of it.  Each clade but the first is then searched 
+//for subtreegens generations by a forked worker process, while this process searches the first during its normal
+//generations.  Topology mutations are confined to the clade (see Tree::SetSearchSubtree), so only the clas within
+//it and on the path from it to the root are recalculated, and the workers share this process's copies of the
+//rest (copy-on-write).  Rounds alternate with subtreegens unrestricted generations, which can rearrange the 
+//backbone between the clades.
+void Population::StartSubtreeSearchRound(){
+#if defined(UNIX) && !defined(MPI_VERSION) && !defined(BOINC) && !defined(SUBROUTINE_GARLI) && !defined(MAC_FRONTEND)
+	subtreeRoundGen = gen;
+	indiv[bestIndiv].treeStruct->ChooseSearchSubtrees(conf->subtreeWorkers, 8, searchSubtrees);
+	if(searchSubtrees.size() < 2){
+		outman.DebugMessage("too few large clades for a subtree search round");
+		searchSubtrees.clear();
+		return;
+		}
+	FillPopWithClonesOfBest();
+
+	//any individual's full encoding is the same length as this one (see RunIslands)
+	PackedIndividual packed;
+	indiv[bestIndiv].Pack(packed);
+	vector<char> sizing;
+	packed.Serialize(sizing);
+	subtreeBuffer = new MigrationBuffer;
+	subtreeBuffer->Allocate((int) searchSubtrees.size(), (int) sizing.size());
+
+	vector<int> workerSeeds;
+	for(unsigned w = 1;w < searchSubtrees.size();w++)
+		workerSeeds.push_back(rnd.random_int(RAND_MAX) + 1);
+
+	try{
+		int smallest = dataPart->NTax(), largest = 0;
+		for(unsigned w = 0;w < searchSubtrees.size();w++){
+			int taxa = indiv[bestIndiv].treeStruct->allNodes[searchSubtrees[w]]->CountTerminals(0);
+			smallest = min(smallest, taxa);
+			largest = max(largest, taxa);
+			}
+		outman.UserMessage("   Subtree search: %d clades of %d to %d taxa", (int) searchSubtrees.size(), smallest, largest);
+		outman.flush();
+		FlushOutputStreams();
+
+		for(unsigned w = 1;w < searchSubtrees.size();w++){
+			pid_t pid = fork();
+			if(pid < 0)
+				throw ErrorException("Could not start subtree worker process %d", w);
+			if(pid == 0){
+				//the other workers aren't this one's to clean up
+				subtreeWorkerPids.clear();
+				CloseInheritedOutputStreams();
+				char temp_buf[100];
+				sprintf(temp_buf, "%s.subtree%d.screen.log", conf->ofprefix.c_str(), w);
+				outman.SetLogFile(temp_buf);
+				outman.SetNoOutput(true);
+				rnd.set_seed(workerSeeds[w - 1]);
+
+				int status = 0;
+				try{
+					indiv[bestIndiv].treeStruct->SetSearchSubtree(searchSubtrees[w]);
+					for(unsigned g = 0;g < conf->subtreeGens;g++){
+						gen++;
+						NextGeneration();
+						if(CheckForUserSignal() || stopwatch.ThisExecutionSplitTime() > conf->stoptime)
+							break;
+						}
+					indiv[bestIndiv].Pack(packed);
+					subtreeBuffer->Publish(w, packed, true);
+					}
+				catch(ErrorException &err){
+					outman.UserMessage("\nERROR: %s\n\n", err.message);
+					status = 1;
+					}
+				outman.CloseLogFile();
+				_exit(status);
+				}
+			subtreeWorkerPids.push_back(pid);
+			}
+
+		indiv[bestIndiv].treeStruct->SetSearchSubtree(searchSubtrees[0]);
+		}
+	catch(...){
+		AbandonSubtreeSearchRound();
+		throw;
+		}
+#else
+	throw ErrorException("Sorry, subtreeworkers > 1 is only supported by the serial Unix version of GARLI.");
+#endif
+	}
+
+//Ends the current round of subtree search, grafting the clade searched by each worker onto the best tree found by
+//this process.  The clades are disjoint and their node numbers are the same in every tree, so this just means
+//copying the ancestors and branch lengths of their nodes.  The combined tree replaces the worst individual, and 
+//will become the best if it scores better.
+void Population::FinishSubtreeSearchRound(){
+#if defined(UNIX) && !defined(MPI_VERSION) && !defined(BOINC) && !defined(SUBROUTINE_GARLI) && !defined(MAC_FRONTEND)
+	Tree::ClearSearchSubtree();
+	subtreeRoundGen = gen;
+	FLOAT_TYPE before = BestFitness();
+
+	PackedIndividual merged, result;
+	indiv[bestIndiv].Pack(merged);
+	vector<int> members;
+	int numMerged = 0;
+	try{
+		for(unsigned w = 1;w < searchSubtrees.size();w++){
+			int status;
+			if(waitpid(subtreeWorkerPids[w - 1], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+				outman.UserMessage("WARNING: subtree worker %d did not finish normally.  See %s.subtree%d.screen.log", w, conf->ofprefix.c_str(), w);
+			//reaped, so the pid may be reused
+			subtreeWorkerPids[w - 1] = 0;
+			if(!subtreeBuffer->Finished(w) || !subtreeBuffer->Read(w, result, false) || !result.SameShape(merged))
+				continue;
+			indiv[bestIndiv].treeStruct->GetCladeMembers(searchSubtrees[w], members);
+			for(vector<int>::iterator it = members.begin();it != members.end();it++){
+				merged.anc[*it] = result.anc[*it];
+				merged.lengths[*it] = result.lengths[*it];
+				}
+			numMerged++;
+			}
+		}
+	catch(...){
+		AbandonSubtreeSearchRound();
+		throw;
+		}
+	AbandonSubtreeSearchRound();
+
+	if(numMerged > 0){
+		int worst = (int) cumfit[0][0];
+		indiv[worst].Unpack(merged);
+		CalcAverageFitness();
+		}
+	outman.UserMessage("   Subtree search: merged %d worker clades, lnL %.4f -> %.4f", numMerged, before, BestFitness());
+#endif
+	}
+
+//Ends the current round of subtree search (if any) without merging anything.  This is also the cleanup when an
+//error ends the search during a round: any workers still running are killed and reaped, and topology mutations
+//are no longer confined to a clade.
+void Population::AbandonSubtreeSearchRound(){
+#if defined(UNIX) && !defined(MPI_VERSION) && !defined(BOINC) && !defined(SUBROUTINE_GARLI) && !defined(MAC_FRONTEND)
+	Tree::ClearSearchSubtree();
+	for(vector<int>::iterator it = subtreeWorkerPids.begin();it != subtreeWorkerPids.end();it++){
+		if(*it > 0){
+			kill(*it, SIGKILL);
+			waitpid(*it, NULL, 0);
+			}
+		}
+	subtreeWorkerPids.clear();
+	searchSubtrees.clear();
+	delete subtreeBuffer;
+	subtreeBuffer = NULL;
+#endif
+	}
+
 /* OLD VERSION
 void Population::Bootstrap(){
 	
@@ -3291,8 +4110,20 @@ void Population::PerformSearch(){
 		//Start catching Ctrl-C's
 		TurnOnSignalCatching();
 #endif				
-		if(!conf->scoreOnly)
-			Run();
+		if(!conf->scoreOnly){
+			if(conf->numIslands > 1)
+				RunIslands();
+			else{
+				try{
+					Run();
+					}
+				catch(...){
+					//don't leave subtree workers running
+					AbandonSubtreeSearchRound();
+					throw;
+					}
+				}
+			}
 
 		//for most purposes, these two types of termination are premature and treated identically
 		//gen termination is treated as normal termination besides some warnings
@@ -3372,23 +4203,16 @@ void Population::PerformSearch(){
 			//existing file here the first time through and put in the header
 			indiv[bestIndiv].treeStruct->sitelikeLevel = -(int) conf->outputSitelikelihoods;
 
-			ofstream ordered;
 			indiv[bestIndiv].treeStruct->ofprefix = conf->ofprefix;
-			string oname = indiv[bestIndiv].treeStruct->ofprefix + ".sitelikes.log";
-			if(currentSearchRep == 1){
-				ordered.open(oname.c_str());
-				ordered << "Tree\t-lnL\tSite\t-lnL";
-				if(conf->outputSitelikelihoods > 1) 
-					ordered << "\tunder1\tunder2";
-				ordered << "\n";
-				ordered.close();
-				}
+			if(currentSearchRep == 1)
+				Tree::siteLikeOutput.Start(conf->ofprefix, conf->outputSitelikelihoods > 1);
+			else if(!Tree::siteLikeOutput.IsOpenFor(conf->ofprefix))
+				Tree::siteLikeOutput.Resume(conf->ofprefix);
 	
 			indiv[bestIndiv].treeStruct->Score();
-			ordered.open(oname.c_str(), ios::app);
-			ordered.precision(12);
-			ordered << currentSearchRep << "\t" << -indiv[bestIndiv].treeStruct->lnL << "\n";
-			ordered.close();
+			Tree::siteLikeOutput.EndTree(currentSearchRep, indiv[bestIndiv].treeStruct->lnL, 12);
+			//get each finished rep onto the disk
+			Tree::siteLikeOutput.Flush();
 			}
 
 		//warn if the normal auto-term conditions weren't used
@@ -3604,15 +4428,11 @@ void Population::OptimizeInputAndWriteSitelikelihoods(){
 	//find out how many trees we have
 	GarliReader & reader = GarliReader::GetInstance();
 	const NxsTreesBlock *treesblock = reader.GetTreesBlock(reader.GetTaxaBlock(0), reader.GetNumTreesBlocks(reader.GetTaxaBlock(0)) - 1);
-	if(treesblock == NULL || !strcmp(conf->streefname.c_str(), "random") || !strcmp(conf->streefname.c_str(), "stepwise"))
+	if(treesblock == NULL || StartingTreeIsGenerated())
 		throw ErrorException("You must specify a nexus treefile to use this runmode.");
 	int numTrees = treesblock->GetNumTrees();
 
-	string oname = conf->ofprefix + ".sitelikes.log";
-	ofstream ordered;
-	ordered.open(oname.c_str());
-	ordered << "Tree\t-lnL\tSite\t-lnL\n";
-	ordered.close();
+	Tree::siteLikeOutput.Start(conf->ofprefix, conf->outputSitelikelihoods > 1);
 
 	bestIndiv = 0;
 	conf->searchReps = numTrees;
@@ -3632,16 +4452,13 @@ void Population::OptimizeInputAndWriteSitelikelihoods(){
 		indiv[0].treeStruct->sitelikeLevel = - (max((int)conf->outputSitelikelihoods, 1));
 		indiv[0].treeStruct->ofprefix = conf->ofprefix;
 		indiv[0].treeStruct->Score();
-		
-		ordered.open(oname.c_str(), ios::app);
-		ordered.precision(10);
-		ordered << t << "\t" << -indiv[0].treeStruct->lnL << "\n";
-		ordered.close();
+		Tree::siteLikeOutput.EndTree(t, indiv[0].treeStruct->lnL, 10);
 
 		Individual *repResult = new Individual(&indiv[0]);
 		storedTrees.push_back(repResult);
 		Reset();
 		}
+	Tree::siteLikeOutput.Close();
 	bool coll = conf->collapseBranches;
 	conf->collapseBranches = false;
 	EvaluateStoredTrees(true);
@@ -3670,11 +4487,7 @@ void Population::OptimizeInputAndWriteSitelikelihoodsAndTryRootings(){
 	bestIndiv = 0;
 
 	//start the sitelike file
-	string oname = conf->ofprefix + ".sitelikes.log";
-	ofstream ordered;
-	ordered.open(oname.c_str());
-	ordered << "Tree\t-lnL\tSite\t-lnL\n";
-	ordered.close();
+	Tree::siteLikeOutput.Start(conf->ofprefix, false);
 
 	Tree::useOptBoundedForBlen = true;
 
@@ -3716,12 +4529,8 @@ void Population::OptimizeInputAndWriteSitelikelihoodsAndTryRootings(){
 	indiv[0].treeStruct->Score();
 	
 	//put the score of the initial indiv in the file
-	ordered.open(oname.c_str(), ios::app);
-	ordered.precision(10);
-	ordered << "0\t" << -indiv[0].treeStruct->lnL << "\t";
 	indiv[0].treeStruct->root->MakeNewick(treeString, false, true, false);
-	ordered << treeString << "\n";
-	ordered.close();
+	Tree::siteLikeOutput.EndTree(0, indiv[0].treeStruct->lnL, 10, treeString.c_str());
 
 	//store the indiv 
 	Individual *repResult = new Individual(&indiv[0]);
@@ -3776,12 +4585,8 @@ void Population::OptimizeInputAndWriteSitelikelihoodsAndTryRootings(){
 		indiv1Tree->Score();
 
 		//add the total score and the tree
-		ordered.open(oname.c_str(), ios::app);
-		ordered.precision(10);
-		ordered << tnum << "\t" << -indiv1Tree->lnL << "\t";
 		indiv[1].treeStruct->root->MakeNewick(treeString, false, true, false);
-		ordered << treeString << "\n";
-		ordered.close();
+		Tree::siteLikeOutput.EndTree(tnum, indiv1Tree->lnL, 10, treeString.c_str());
 
 		//store the indiv and write the tree to file
 		repResult = new Individual(&indiv[1]);
@@ -3790,6 +4595,7 @@ void Population::OptimizeInputAndWriteSitelikelihoodsAndTryRootings(){
 		indiv[1].CopySecByRearrangingNodesOfFirst(indiv1Tree, &indiv[0], true);
 		tnum++;
 		}
+	Tree::siteLikeOutput.Close();
 	bool coll = conf->collapseBranches;
 	conf->collapseBranches = false;
 	EvaluateStoredTrees(true);
@@ -4391,13 +5197,15 @@ void Population::PerformMutation(int indNum){
 				 	if(ind->accurateSubtrees==false || paraMan->subtreeModeActive==false){
 
 			       		ind->Mutate(adap->branchOptPrecision, adap);
+						if(Tree::topologyCache.Enabled() && ind->Fitness() > -FLT_MAX)
+							ind->treeStruct->AddToTopologyCache(ind->Fitness());
 
 						if(output_tree){
 							treeLog << "  tree gen" << gen <<  "." << indNum << "= [&U] [" << ind->Fitness() << "][ ";
 							string modstr;
 							ind->modPart.FillGarliFormattedModelStrings(modstr);
 							ind->treeStruct->root->MakeNewick(treeString, false, true);
-							treeLog << modstr.c_str() << "]" << treeString << ";" << endl;
+							treeLog << modstr.c_str() << "]" << treeString << ";\n";
 							output_tree=false;
 							}
 
@@ -4686,7 +5494,7 @@ void Population::AppendTreeToTreeLog(int mutType, int indNum /*=-1*/){
 	string modstr;
 	ind->modPart.FillGarliFormattedModelStrings(modstr);
 	theInd->treeStruct->root->MakeNewick(treeString, false, true);
-	treeLog << modstr.c_str() << "]" << treeString << ";" << endl;
+	treeLog << modstr.c_str() << "]" << treeString << ";\n";
 	}
 
 
@@ -4824,8 +5632,7 @@ void Population::WriteTreeFile( const char* treefname, int indnum, bool collapse
 	s = str.c_str();
 	outf.write(s, sizeof(char), str.length());
 	theInd->treeStruct->root->MakeNewick(treeString, false, true);
-	size_t len = strlen(treeString);
-	outf.write(treeString, sizeof(char), len);
+	outf.write(treeString.c_str(), sizeof(char), treeString.length());
 	str = ";\nend;\n";
 	s = str.c_str();
 	outf.write(s, sizeof(char), str.length());
@@ -4996,7 +5803,7 @@ void Population::WriteStoredTrees( const char* treefname ){
 //on the fly and outputs everything to the string passed in, which needs to 
 //be already open
 void Population::WritePhylipTree(ofstream &phytree){
-	char *loc=treeString;
+	const char *loc=treeString.c_str();
 	NxsString temp;
 	while(*loc){
 		if(*loc == ':'){
@@ -5032,11 +5839,10 @@ void Population::WritePhylipTree(ofstream &phytree){
 	}
 
 
-char * Population::MakeNewick(int i, bool internalNodes)
+const char * Population::MakeNewick(int i, bool internalNodes)
 {
 	indiv[i].treeStruct->root->MakeNewick(treeString, internalNodes, true);
-	assert(!treeString[stringSize-1]);
-	return treeString;
+	return treeString.c_str();
 }
 
 //DZ 7-7 This function will get rid of multiple references to the same treeStruct
@@ -5289,6 +6095,12 @@ void Population::OutputLog()	{
 	else{
 		CalcAverageFitness();
 		log << "Final\t" << BestFitness() << "\t" << stopwatch.SplitTime() << "\t" << adap->branchOptPrecision << endl;
+		if(Tree::topologyCache.Enabled()){
+			const TopologyCache &cache = Tree::topologyCache;
+			char str[300];
+			sprintf(str, "Topology cache: %u topologies stored, %u hits in %u lookups (%.1f%%), %u optimizations skipped, %u scored under other model parameters, %u branch length warm starts", cache.NumEntries(), cache.hits, cache.lookups, (cache.lookups > 0 ? (100.0 * cache.hits) / cache.lookups : 0.0), cache.skipped, cache.stale, cache.warmStarts);
+			log << str << endl;
+			}
 		}
 	}
 /*
@@ -7094,6 +7906,8 @@ void Population::InitializeOutputStreams(){
 			sprintf(suffix, "treelog0%d.tre", rank);
 			DetermineFilename(treelog_output, temp_buf, suffix);
 
+			treeLogBuffer.resize(1024 * 1024);
+			treeLog.rdbuf()->pubsetbuf(&treeLogBuffer[0], treeLogBuffer.size());
 			if(treelog_output & APPEND)
 				treeLog.open(temp_buf, ios::app);
 			else 
@@ -7231,6 +8045,8 @@ void Population::InitializeOutputStreams(){
 		else
 			sprintf(temp_buf, "%s%s.treelog0%d.tre", conf->ofprefix.c_str(), restart, rank);
 
+		treeLogBuffer.resize(1024 * 1024);
+		treeLog.rdbuf()->pubsetbuf(&treeLogBuffer[0], treeLogBuffer.size());
 		treeLog.open(temp_buf);
 		treeLog.precision(10);
 
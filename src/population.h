@@ -31,6 +31,7 @@ using namespace std;
 #include "individual.h"
 #include "stopwatch.h"
 #include "errorexception.h"
+#include "checkpoint.h"
 
 class CondLikeArray;
 class Tree;
@@ -265,6 +266,17 @@ class PerturbManager{
 	};
 #endif
 
+//a snapshot of the running work counters, differences between two of these give throughput
+struct ThroughputSample{
+	unsigned gen;
+	unsigned long long nanoseconds;
+	unsigned long long claUpdates;
+	unsigned long long scorings;
+	unsigned long long claRecycles;
+	unsigned long long clasReclaimed;
+	unsigned long long rescales;
+	};
+
 class Population{
 
 private: 
@@ -325,14 +337,17 @@ private:
 	ofstream fate;
 	ofstream log;
 	ofstream treeLog;
+	vector<char> treeLogBuffer;//trees are written very often, so treeLog gets a large buffer of its own
 	ofstream probLog;
 	ofstream bootLog;
 	ofstream bootLogPhylip;
 	ofstream swapLog;
 
+	//used for periodic checkpoints with backgroundcheckpoints
+	BackgroundCheckpointWriter checkWriter;
+
 	string besttreefile;
-	char *treeString;
-	int stringSize;
+	string treeString;
 
 	//if the user killed the run
 	bool userTermination;
@@ -352,6 +367,28 @@ private:
 	//trees that are being stored for some reason, for example the
 	//best from a number of reps
 	vector<Individual *> storedTrees;
+	//the result of the initial optimization, and the starting conditions (tree and model strings) it came
+	//from, so that later search reps with identical starting conditions can skip it (shareinitialopt)
+	Individual *initialOptSnapshot;
+	string initialOptKey;
+	int initialOptSnapshotRep;
+
+	//island model search (numislands > 1): the island that this process is running, and the migration slots shared
+	//with the others, which only exist while an island search is in progress
+	int islandIndex;
+	MigrationBuffer *islandBuffer;
+	FLOAT_TYPE lastMigrationTime;
+
+	//subtree search (subtreeworkers > 1): the clades being searched in the current round, the processes searching
+	//all but the first of them, the slots that they return their results in and the generation the round started
+	vector<int> searchSubtrees;
+	vector<int> subtreeWorkerPids;
+	MigrationBuffer *subtreeBuffer;
+	unsigned subtreeRoundGen;
+
+	//the start of the generation loop and the last telemetry write, between which the telemetry rates are measured
+	ThroughputSample telemetryStart;
+	ThroughputSample telemetryLast;
 
 	public:
 		enum { nomem=1, nofile, baddimen };
@@ -413,10 +450,11 @@ private:
 			bestFitness(-(FLT_MAX)), bestIndiv(0), currentSearchRep(1), 
 			prevBestFitness(-(FLT_MAX)),indiv(NULL), newindiv(NULL),
 			cumfit(NULL), gen(0), paraMan(NULL), subtreeDefNumber(0), claMan(NULL), 
-			treeString(NULL), adap(NULL), rep_fraction_done(ZERO_POINT_ZERO), tot_fraction_done(ZERO_POINT_ZERO),
+			adap(NULL), rep_fraction_done(ZERO_POINT_ZERO), tot_fraction_done(ZERO_POINT_ZERO),
 			userTermination(false), timeTermination(false), genTermination(false), workPhaseTermination(false), restartedAfterTermination(false),
 			currentBootstrapRep(0), finishedRep(false), lastBootstrapSeed(0), nextBootstrapSeed(0), dataPart(NULL), rawPart(NULL), swapTermThreshold(0),
-			finishedGenerations(false), initialRefinePass(0), finalRefinePass(0)
+			finishedGenerations(false), initialRefinePass(0), finalRefinePass(0), initialOptSnapshot(NULL), initialOptSnapshotRep(0),
+			islandIndex(0), islandBuffer(NULL), lastMigrationTime(ZERO_POINT_ZERO), subtreeBuffer(NULL), subtreeRoundGen(0)
 #ifdef INCLUDE_PERTURBATION			 
 			pertMan(NULL), allTimeBest(NULL), bestSinceRestart(NULL),
 #endif
@@ -448,12 +486,14 @@ private:
 		void ClearStoredTrees();
 
 		char *TreeStructToNewick(int i);
-		char *MakeNewick(int, bool);
+		const char *MakeNewick(int, bool);
 		void CreateGnuPlotFile();
 		void WritePopulationCheckpoint(OUTPUT_CLASS &out) ;
 
-		void ReadPopulationCheckpoint();
-		void WriteStateFiles();
+		bool ReadPopulationCheckpoint();
+		void WriteStateFiles(bool background = false);
+		void FinishBackgroundCheckpoint();
+		void CheckpointWritten(const CheckpointJob &job);
 		bool ReadStateFiles();
 		void GetConstraints();
 		void WriteTreeFile( const char* treefname, int indnum, bool collapse = false);
@@ -559,10 +599,26 @@ private:
 		void CheckForIncompatibleConfigEntries();
 
 		void Bootstrap();
+		void BootstrapWithWorkers();
+		void MergeWorkerBootstrapTrees(int numWorkers);
+		void RunIslands();
+		void ExchangeMigrants();
+		void StartSubtreeSearchRound();
+		void FinishSubtreeSearchRound();
+		void AbandonSubtreeSearchRound();
+		void FlushOutputStreams();
+		void CloseInheritedOutputStreams();
+		void ReweightBootstrapData();
 		void FindLostClas();
 		void FinalOptimization();
 		void BetterFinalOptimization();
+		void WriteProfileReport();
+		void SampleThroughput(ThroughputSample &sample) const;
+		void WriteThroughputReport(const ThroughputSample &start, const ThroughputSample &end);
+		void WriteTelemetry(const char *phase, bool force);
 		void InitialOptimization(Individual *ind, bool optModel, FLOAT_TYPE branchPrec);
+		void GetStartingConditionsKey(const Individual *ind, string &key) const;
+		void ClearInitialOptSnapshot();
 		void ResetMemLevel(int numNodesPerIndiv, int numClas);
 		void SetNewBestIndiv(int indivIndex);
 		void LogNewBestFromRemote(FLOAT_TYPE, int);
@@ -573,6 +629,10 @@ private:
 		string TerminationWarningMessage(){
 			return string("\nNOTE: ***Search was terminated before full auto-termination condition was reached!\nLikelihood scores, topologies and model estimates obtained may not be fully optimal!***\n");
 			}
+		//true if the starting tree is to be built by the program rather than read from file
+		bool StartingTreeIsGenerated() const{
+			return (_stricmp(conf->streefname.c_str(), "random") == 0 || _stricmp(conf->streefname.c_str(), "stepwise") == 0 || _stricmp(conf->streefname.c_str(), "bionj") == 0);
+			}
 		bool ShouldCheckpoint(bool checkGeneration) const{
 #ifndef BOINC
 			//non-BOINC checkpointing
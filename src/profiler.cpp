@@ -0,0 +1,256 @@
+// GARLI version 2.0 source code
+// Copyright 2005-2011 Derrick J. Zwickl
+// email: garli.support@gmail.com
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <iomanip>
+
+#ifdef _MSC_VER
+#include <windows.h>
+#else
+#include <time.h>
+#include <sys/time.h>
+#endif
+
+#include "defs.h"
+#include "profiler.h"
+
+bool Profiler::enabled = false;
+vector<ProfileThread *> Profiler::threads;
+
+static const char *counterNames[PROF_NUM_COUNTERS] = {"claUpdates", "pmatCalcs", "rescales", "bytes"};
+
+ProfileNode::ProfileNode(int p, ProfileNode *par) : prof(p), parent(par), calls(0), totalNs(0), childNs(0){
+	for(int c = 0;c < PROF_NUM_COUNTERS;c++)
+		counts[c] = 0;
+	}
+
+ProfileNode::~ProfileNode(){
+	for(vector<ProfileNode *>::iterator it = children.begin();it != children.end();it++)
+		delete *it;
+	}
+
+//the profilers are globals in a number of files, so they can't rely on a static member already being constructed
+vector<Profiler *> &Profiler::AllProfilers(){
+	static vector<Profiler *> all;
+	return all;
+	}
+
+Profiler::Profiler(const string &n) : name(n){
+	index = (int) AllProfilers().size();
+	AllProfilers().push_back(this);
+	}
+
+void Profiler::Enable(bool e){
+	if(e && threads.empty()){
+#ifdef OPEN_MP
+		int num = omp_get_max_threads();
+#else
+		int num = 1;
+#endif
+		for(int t = 0;t < num;t++)
+			threads.push_back(new ProfileThread);
+		}
+	enabled = e;
+	}
+
+unsigned long long Profiler::Now(){
+#ifdef _MSC_VER
+	static LARGE_INTEGER freq = {0};
+	if(freq.QuadPart == 0)
+		QueryPerformanceFrequency(&freq);
+	LARGE_INTEGER count;
+	QueryPerformanceCounter(&count);
+	return (unsigned long long) (count.QuadPart * (1.0e9 / freq.QuadPart));
+#elif defined(CLOCK_MONOTONIC)
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#else
+	timeval tv;
+	gettimeofday(&tv, NULL);
+	return (unsigned long long) tv.tv_sec * 1000000000ULL + tv.tv_usec * 1000ULL;
+#endif
+	}
+
+ProfileThread *Profiler::CurrentThread(){
+#ifdef OPEN_MP
+	int t = omp_get_thread_num();
+#else
+	int t = 0;
+#endif
+	return (t < (int) threads.size() ? threads[t] : NULL);
+	}
+
+void Profiler::Push(){
+	ProfileThread *t = CurrentThread();
+	if(t == NULL)
+		return;
+	ProfileNode *node = NULL;
+	for(vector<ProfileNode *>::iterator it = t->cur->children.begin();it != t->cur->children.end();it++){
+		if((*it)->prof == index){
+			node = *it;
+			break;
+			}
+		}
+	if(node == NULL){
+		node = new ProfileNode(index, t->cur);
+		t->cur->children.push_back(node);
+		}
+	node->calls++;
+	t->cur = node;
+	t->starts.push_back(Now());
+	}
+
+void Profiler::Pop(){
+	ProfileThread *t = CurrentThread();
+	if(t == NULL)
+		return;
+	//a Stop without a matching Start (e.g. profiling was turned on in between) is ignored
+	ProfileNode *node = t->cur;
+	while(node->prof != index && node->parent != NULL)
+		node = node->parent;
+	if(node->parent == NULL)
+		return;
+
+	unsigned long long now = Now();
+	bool done;
+	do{
+		ProfileNode *open = t->cur;
+		unsigned long long elapsed = now - t->starts.back();
+		t->starts.pop_back();
+		open->totalNs += elapsed;
+		open->parent->childNs += elapsed;
+		t->cur = open->parent;
+		done = (open == node);
+		}while(!done);
+	}
+
+void Profiler::AddCount(ProfileCounter c, unsigned long long n){
+	ProfileThread *t = CurrentThread();
+	if(t != NULL)
+		t->cur->counts[c] += n;
+	}
+
+//inclusive time is only added for the outermost of any recursive entries into a section, so that it isn't double counted
+void Profiler::Totals(const ProfileNode *node, vector<int> &onStack, vector<unsigned long long> &calls, vector<unsigned long long> &totalNs, vector<unsigned long long> &selfNs, vector<unsigned long long> &counts){
+	int p = node->prof;
+	if(p >= 0){
+		calls[p] += node->calls;
+		if(onStack[p] == 0)
+			totalNs[p] += node->totalNs;
+		selfNs[p] += node->totalNs - node->childNs;
+		for(int c = 0;c < PROF_NUM_COUNTERS;c++)
+			counts[p * PROF_NUM_COUNTERS + c] += node->counts[c];
+		onStack[p]++;
+		}
+	for(vector<ProfileNode *>::const_iterator it = node->children.begin();it != node->children.end();it++)
+		Totals(*it, onStack, calls, totalNs, selfNs, counts);
+	if(p >= 0)
+		onStack[p]--;
+	}
+
+void Profiler::WriteNodeJSON(ostream &out, const ProfileNode *node, int indent){
+	string pad(indent, '\t');
+	unsigned long long total = node->totalNs;
+	//the root isn't timed itself, so it covers whatever its sections did
+	if(node->parent == NULL)
+		total = node->childNs;
+	out << pad << "{\"name\": " << JSONString(node->prof < 0 ? "all" : AllProfilers()[node->prof]->name) << ", \"calls\": " << node->calls;
+	out << ", \"totalSeconds\": " << total * 1.0e-9 << ", \"selfSeconds\": " << (total - node->childNs) * 1.0e-9;
+	for(int c = 0;c < PROF_NUM_COUNTERS;c++)
+		if(node->counts[c] > 0)
+			out << ", \"" << counterNames[c] << "\": " << node->counts[c];
+	if(node->children.empty()){
+		out << "}";
+		return;
+		}
+	out << ", \"children\": [\n";
+	for(unsigned ch = 0;ch < node->children.size();ch++){
+		WriteNodeJSON(out, node->children[ch], indent + 1);
+		out << (ch + 1 < node->children.size() ? ",\n" : "\n");
+		}
+	out << pad << "]}";
+	}
+
+void Profiler::WriteJSON(ostream &out, double runSeconds){
+	vector<Profiler *> &all = AllProfilers();
+	int num = (int) all.size();
+	vector<int> onStack(num, 0);
+	vector<unsigned long long> calls(num, 0), totalNs(num, 0), selfNs(num, 0), counts(num * PROF_NUM_COUNTERS, 0);
+	vector<unsigned long long> grand(PROF_NUM_COUNTERS, 0);
+	for(unsigned t = 0;t < threads.size();t++){
+		Totals(&threads[t]->root, onStack, calls, totalNs, selfNs, counts);
+		for(int c = 0;c < PROF_NUM_COUNTERS;c++)
+			grand[c] += threads[t]->root.counts[c];
+		}
+	for(int i = 0;i < num * PROF_NUM_COUNTERS;i++)
+		grand[i % PROF_NUM_COUNTERS] += counts[i];
+
+	out.setf(ios::fixed);
+	out.precision(6);
+	out << "{\n\t\"runSeconds\": " << runSeconds << ",\n\t\"threads\": " << threads.size() << ",\n\t\"counters\": {";
+	for(int c = 0;c < PROF_NUM_COUNTERS;c++)
+		out << (c > 0 ? ", " : "") << "\"" << counterNames[c] << "\": " << grand[c];
+	out << "},\n\t\"sections\": [\n";
+	bool first = true;
+	for(int p = 0;p < num;p++){
+		if(calls[p] == 0)
+			continue;
+		out << (first ? "" : ",\n") << "\t\t{\"name\": " << JSONString(all[p]->name) << ", \"calls\": " << calls[p];
+		out << ", \"totalSeconds\": " << totalNs[p] * 1.0e-9 << ", \"selfSeconds\": " << selfNs[p] * 1.0e-9;
+		out << ", \"percentOfRun\": " << (runSeconds > 0.0 ? totalNs[p] * 1.0e-7 / runSeconds : 0.0);
+		for(int c = 0;c < PROF_NUM_COUNTERS;c++)
+			out << ", \"" << counterNames[c] << "\": " << counts[p * PROF_NUM_COUNTERS + c];
+		out << "}";
+		first = false;
+		}
+	out << "\n\t],\n\t\"callTrees\": [\n";
+	for(unsigned t = 0;t < threads.size();t++){
+		WriteNodeJSON(out, &threads[t]->root, 2);
+		out << (t + 1 < threads.size() ? ",\n" : "\n");
+		}
+	out << "\t]\n}" << endl;
+	}
+
+string Profiler::JSONString(const string &str){
+	string ret = "\"";
+	for(string::const_iterator it = str.begin();it != str.end();it++){
+		if(*it == '"' || *it == '\\')
+			ret += '\\';
+		if((unsigned char) *it >= 0x20)
+			ret += *it;
+		}
+	return ret + "\"";
+	}
+
+void Profiler::WriteNodeFolded(ostream &out, const ProfileNode *node, const string &stack){
+	string here = stack;
+	if(node->prof >= 0){
+		here += (stack.empty() ? "" : ";") + AllProfilers()[node->prof]->name;
+		unsigned long long selfMicros = (node->totalNs - node->childNs) / 1000;
+		if(selfMicros > 0)
+			out << here << " " << selfMicros << "\n";
+		}
+	for(vector<ProfileNode *>::const_iterator it = node->children.begin();it != node->children.end();it++)
+		WriteNodeFolded(out, *it, here);
+	}
+
+void Profiler::WriteFolded(ostream &out){
+	for(unsigned t = 0;t < threads.size();t++)
+		WriteNodeFolded(out, &threads[t]->root, "");
+	out.flush();
+	}
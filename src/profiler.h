@@ -0,0 +1,124 @@
+// GARLI version 2.0 source code
+// Copyright 2005-2011 Derrick J. Zwickl
+// email: garli.support@gmail.com
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef GARLI_PROFILER_H
+#define GARLI_PROFILER_H
+
+#include <string>
+#include <vector>
+#include <ostream>
+
+using namespace std;
+
+//event counts, which are attributed to whatever profiled section is running when they occur
+enum ProfileCounter{
+	PROF_CLA_UPDATES = 0,
+	PROF_PMAT_CALCS = 1,
+	PROF_RESCALES = 2,
+	PROF_BYTES = 3,
+	PROF_NUM_COUNTERS = 4
+	};
+
+//One entry in a thread's call tree, i.e. a section as reached through a particular chain of enclosing sections
+class ProfileNode{
+public:
+	int prof;	//index of the Profiler, -1 for the root
+	ProfileNode *parent;
+	vector<ProfileNode *> children;
+	unsigned long long calls;
+	unsigned long long totalNs;
+	unsigned long long childNs;
+	unsigned long long counts[PROF_NUM_COUNTERS];
+
+	ProfileNode(int p, ProfileNode *par);
+	~ProfileNode();
+	};
+
+class ProfileThread{
+public:
+	ProfileNode root;
+	ProfileNode *cur;
+	vector<unsigned long long> starts;
+
+	ProfileThread() : root(-1, NULL), cur(&root){}
+	};
+
+//Times a named section of code.  Sections can nest, including recursively, and each thread builds a tree of the
+//chains of sections that were actually entered, so that time can be split between a section and those that it
+//calls.  Nothing is recorded unless profiling is turned on at runtime (the profile config entry), and otherwise
+//Start and Stop only check a flag.  A Stop for a section that isn't the innermost one closes any sections that
+//were left open inside of it, as happens when an exception skips their Stops.
+class Profiler{
+	string name;
+	int index;
+
+	static bool enabled;
+	static vector<ProfileThread *> threads;
+
+	static vector<Profiler *> &AllProfilers();
+	static ProfileThread *CurrentThread();
+	static void AddCount(ProfileCounter c, unsigned long long n);
+	void Push();
+	void Pop();
+
+	static void Totals(const ProfileNode *node, vector<int> &onStack, vector<unsigned long long> &calls, vector<unsigned long long> &totalNs, vector<unsigned long long> &selfNs, vector<unsigned long long> &counts);
+	static void WriteNodeJSON(ostream &out, const ProfileNode *node, int indent);
+	static void WriteNodeFolded(ostream &out, const ProfileNode *node, const string &stack);
+
+public:
+	Profiler(const string &n);
+
+	//monotonic clock in nanoseconds
+	static unsigned long long Now();
+
+	void Start(){
+		if(enabled)
+			Push();
+		}
+	void Stop(){
+		if(enabled)
+			Pop();
+		}
+	static void Count(ProfileCounter c, unsigned long long n = 1){
+		if(enabled)
+			AddCount(c, n);
+		}
+
+	static void Enable(bool e);
+	static bool Enabled() {return enabled;}
+	//per section totals and the full call tree of each thread.  runSeconds is only used for percentages
+	static void WriteJSON(ostream &out, double runSeconds);
+	//quotes and escapes a string for the JSON reports
+	static string JSONString(const string &str);
+	//one line per call chain with its exclusive time in microseconds, as used by flamegraph.pl and speedscope
+	static void WriteFolded(ostream &out);
+	};
+
+//starts a profiled section for the rest of the enclosing scope
+class ProfileScope{
+	Profiler &prof;
+public:
+	ProfileScope(Profiler &p) : prof(p){
+		prof.Start();
+		}
+	~ProfileScope(){
+		prof.Stop();
+		}
+	};
+
+#endif
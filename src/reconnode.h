@@ -21,9 +21,12 @@
 
 
 #include <list>
+#include <vector>
+#include <string>
 #include <algorithm>
 #include <functional>
 #include "rng.h"
+#include "checkpoint.h"
 #ifdef UNIX
 #include "unistd.h"
 #endif
@@ -264,8 +267,8 @@ public:
 		fread(&count, scalarSize, 1, in);
 		}
 
-	void Increment(){
-		count++;	
+	void Increment(int by = 1){
+		count += by;	
 		}
 
 	int Count()const {
@@ -297,6 +300,27 @@ public:
 		out.WRITE_TO_FILE(&count, (streamsize) scalarSize, 1);
 		}
 
+	//fixed size records for the swap log
+	static size_t RecordSize(){
+		return Bipartition::nBlocks * sizeof(unsigned int) + 4 * sizeof(unsigned short);
+		}
+	void AppendRecord(vector<char> &buf) const{
+		size_t start = buf.size();
+		buf.resize(start + RecordSize());
+		memcpy(&buf[start], b.rep, Bipartition::nBlocks * sizeof(unsigned int));
+		unsigned short scalars[4] = {count, cutnum, brokenum, reconDist};
+		memcpy(&buf[start + Bipartition::nBlocks * sizeof(unsigned int)], scalars, sizeof(scalars));
+		}
+	void ReadRecord(const char *rec){
+		memcpy(b.rep, rec, Bipartition::nBlocks * sizeof(unsigned int));
+		unsigned short scalars[4];
+		memcpy(scalars, rec + Bipartition::nBlocks * sizeof(unsigned int), sizeof(scalars));
+		count = scalars[0];
+		cutnum = scalars[1];
+		brokenum = scalars[2];
+		reconDist = scalars[3];
+		}
+
 	unsigned BipartitionBlock(int block) const{
 		return b.rep[block];	
 		}
@@ -345,11 +369,33 @@ class AttemptedSwapList{
 	list<list<Swap>::iterator> indeces;
 	unsigned unique;
 	unsigned total;
+
+	//Swaps are checkpointed incrementally.  Once logging starts each new swap is recorded as it is added, and
+	//the records are appended to the swap log file at each checkpoint.  The population checkpoint stores which
+	//log file and how many bytes of it it corresponds to.  When the list is cleared or the log gets much bigger
+	//than the list, the list is written compactly to the other of the two log files, so the one that the last
+	//committed population checkpoint refers to is never touched.
+	vector<char> pendingLog;
+	unsigned pendingRecords;
+	bool logging;
+	bool logReset;
+	int activeLog;
+	int committedLog;
+	long logBytes;
+
+	static string SwapLogName(const char *base, int index){
+		return (index == 0 ? string(base) : string(base) + ".alt");
+		}
 	
 public:
 
 	AttemptedSwapList(){
 		unique=total=0;
+		pendingRecords=0;
+		logging=logReset=false;
+		activeLog=0;
+		committedLog=1;
+		logBytes=0;
 		}
 
 	int GetUnique() {return unique;}
@@ -359,7 +405,24 @@ public:
 		swaps.clear();
 		indeces.clear();
 		unique=total=0;
+		if(logging){
+			logReset=true;
+			pendingLog.clear();
+			pendingRecords=0;
+			}
+		}
+
+	//these are defined in checkpoint.cpp
+	void PrepareSwapLogBlock(const char *base, SwapLogBlock &block);
+	void WriteSwapLogPosition(OUTPUT_CLASS &out) const;
+	void SwapLogCommitted(){
+		committedLog = activeLog;
 		}
+	//the next checkpoint will write a complete new log
+	void SwapLogWriteFailed(){
+		logReset = true;
+		}
+	void ReadSwapLog(FILE *position, const char *base);
 
 	list<Swap>::iterator end(){
 		return swaps.end();
@@ -395,6 +458,8 @@ public:
 			swaps.push_back(s);
 			}
 		IndexSwaps();
+		//the swaps will be written to a new log, which must not be the old style file just read
+		committedLog = 0;
 
 		assert(swaps.size() == unique);
 		int tot=0;
@@ -442,7 +507,15 @@ public:
 
 		Swap swap;
 		swap.Setup(bip, cut, broke, dist);
+		if(logging){
+			swap.AppendRecord(pendingLog);
+			pendingRecords++;
+			}
+		return MergeSwap(swap);
+		}
 
+	//adds a swap that may have a count other than one, returning true if it wasn't already in the list
+	bool MergeSwap(Swap &swap){
 		bool found;
 		list<Swap>::iterator it = FindSwap(swap, found);
 
@@ -452,12 +525,12 @@ public:
 			if(it == swaps.begin() && indeces.empty()==false) reindex=true;
 			swaps.insert(it, swap);
 			unique++;
-			total++;
+			total += swap.Count();
 			if(unique==100 || (unique % 1000)==0 || reindex==true) IndexSwaps(); 
 			}
 		else{
-			(*it).Increment();
-			total++;
+			(*it).Increment(swap.Count());
+			total += swap.Count();
 			}
 		assert(swaps.size() == unique);
 		return (found == false);//return value is true if the swap is _unique_
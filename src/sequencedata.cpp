@@ -47,6 +47,191 @@ void SequenceData::AddDummyRootToExistingMatrix(){
 		}
 	}
 
+//Large block reads, which are much faster than getc on huge alignments
+class BufferedAlignmentFile{
+	FILE *in;
+	vector<char> buf;
+	size_t pos;
+	size_t len;
+
+public:
+	BufferedAlignmentFile(const char *name) : buf(1 << 22), pos(0), len(0){
+		in = fopen(name, "rb");
+		if(in == NULL)
+			throw ErrorException("could not open file: %s!", name);
+		}
+	~BufferedAlignmentFile(){
+		fclose(in);
+		}
+	int Get(){
+		if(pos == len){
+			pos = 0;
+			len = fread(&buf[0], sizeof(char), buf.size(), in);
+			if(len == 0)
+				return EOF;
+			}
+		return (unsigned char) buf[pos++];
+		}
+	void Rewind(){
+		rewind(in);
+		pos = len = 0;
+		}
+	int SkipLine(){
+		int c;
+		do{
+			c = Get();
+			}while(c != '\n' && c != '\r' && c != EOF);
+		return c;
+		}
+	string GetToken(int &c){
+		string tok;
+		while(c != EOF && !isspace(c)){
+			tok += (char) c;
+			c = Get();
+			}
+		return tok;
+		}
+	};
+
+//The states are translated with CharToDatum as they are read, and written directly into the pattern manager's
+//column-major input matrix, so the only full copy of the data is one byte per taxon per site.  Fasta files
+//take two passes, the first just finding the names and sequence lengths.  Phylip files must be sequential, with
+//each taxon starting on a new line and names separated from sequences by whitespace.  Anything else is left to NCL.
+bool SequenceData::ReadPlainAlignment(const char *filename, bool fasta){
+	assert(usePatternManager);
+	outman.UserMessage("Attempting to read data file %s as\n\t%s format (streaming reader) ...", filename, (fasta ? "Fasta" : "sequential relaxed Phylip"));
+
+	try{
+		BufferedAlignmentFile in(filename);
+		//the datum for each input character, filled in as they are first seen
+		short datum[256];
+		for(int i = 0;i < 256;i++)
+			datum[i] = -1;
+		vector<string> names;
+		int numSites = -1;
+		int c;
+		unsigned char *cols = NULL;
+
+		if(fasta){
+			int len = -1;
+			do{
+				c = in.Get();
+				if(c == '>' || c == EOF){
+					if(len > -1){
+						if(numSites < 0)
+							numSites = len;
+						else if(len != numSites)
+							throw ErrorException("# of characters for taxon %s (%d) not equal\n\tto the # of characters for first taxon (%d)", names.back().c_str(), len, numSites);
+						}
+					if(c == '>'){
+						do{
+							c = in.Get();
+							}while(c == ' ' || c == '\t');
+						names.push_back(in.GetToken(c));
+						if(names.back().empty())
+							throw ErrorException("missing taxon name after >");
+						if(c != '\n' && c != '\r')
+							in.SkipLine();
+						len = 0;
+						}
+					}
+				else if(!isspace(c)){
+					if(len < 0)
+						throw ErrorException("expected > at the start of the file");
+					len++;
+					}
+				}while(c != EOF);
+			if(numSites < 1)
+				throw ErrorException("no sequence data found");
+
+			NewMatrix((int) names.size(), numSites, false);
+			patman.Initialize(nTax, maxNumStates);
+			cols = patman.AllocateColumns(numSites);
+
+			in.Rewind();
+			int tax = -1;
+			size_t offset = 0;
+			while((c = in.Get()) != EOF){
+				if(c == '>'){
+					in.SkipLine();
+					offset = ++tax;
+					}
+				else if(!isspace(c)){
+					if(datum[c] < 0)
+						datum[c] = CharToDatum((char) c);
+					cols[offset] = (unsigned char) datum[c];
+					offset += nTax;
+					}
+				}
+			}
+		else{
+			int dims[2] = {0, 0};
+			for(int d = 0;d < 2;d++){
+				do{
+					c = in.Get();
+					}while(c != EOF && isspace(c));
+				if(!isdigit(c))
+					throw ErrorException("expected the number of taxa and characters at the start of the file");
+				while(isdigit(c)){
+					dims[d] = dims[d] * 10 + (c - '0');
+					c = in.Get();
+					}
+				}
+			if(dims[0] < 1 || dims[1] < 1)
+				throw ErrorException("bad number of taxa or characters");
+			if(c != '\n' && c != '\r')
+				in.SkipLine();
+			numSites = dims[1];
+
+			NewMatrix(dims[0], numSites, false);
+			patman.Initialize(nTax, maxNumStates);
+			cols = patman.AllocateColumns(numSites);
+
+			for(int tax = 0;tax < nTax;tax++){
+				do{
+					c = in.Get();
+					}while(c == '\n' || c == '\r');
+				if(c == EOF || isspace(c))
+					throw ErrorException("expected the name of taxon %d at the start of a line", tax + 1);
+				names.push_back(in.GetToken(c));
+				size_t offset = tax;
+				for(int site = 0;site < numSites;){
+					c = in.Get();
+					if(c == EOF)
+						throw ErrorException("file ended while reading taxon %s", names.back().c_str());
+					if(isspace(c))
+						continue;
+					if(datum[c] < 0)
+						datum[c] = CharToDatum((char) c);
+					cols[offset] = (unsigned char) datum[c];
+					offset += nTax;
+					site++;
+					}
+				//if the sequence doesn't end its line this is probably interleaved, or the dimensions are wrong
+				do{
+					c = in.Get();
+					}while(c == ' ' || c == '\t');
+				if(c != '\n' && c != '\r' && c != EOF)
+					throw ErrorException("more than %d characters for taxon %s (interleaved files aren't supported)", numSites, names.back().c_str());
+				}
+			while((c = in.Get()) != EOF)
+				if(!isspace(c))
+					throw ErrorException("more than %d taxa found", nTax);
+			}
+
+		for(int t = 0;t < nTax;t++)
+			SetTaxonLabel(t, NxsString::GetEscaped(names[t]).c_str());
+		}
+	catch(ErrorException &err){
+		outman.UserMessage("Problem reading data file with the streaming reader:\n\t%s\n", err.message);
+		patman.Reset();
+		NewMatrix(0, 0);
+		return false;
+		}
+	outman.UserMessage("\nData read successfully (%d taxa, %d characters).", nTax, numPatterns);
+	return true;
+	}
+
 //this depends on the fact that a spare taxon was allocated
 void NucleotideData::AddDummyRootToExistingMatrix(){
 	assert(nTaxAllocated > nTax);
@@ -308,55 +493,70 @@ void NucleotideData::MakeAmbigStrings(){
 			}
 	
 		char *thisString=new char[totalStates];
-
+		unsigned *thisMap=NULL;
 #ifdef OPEN_MP
-		unsigned *thisMap=new unsigned[NChar()];
+		thisMap=new unsigned[NChar()];
 #endif
-
-		//now do it for real
-		int index=0;
-		for(int j=0;j<NChar();j++){
-
+		FillAmbigString(i, thisString, thisMap);
+		ambigStrings.push_back(thisString);
 #ifdef OPEN_MP
-			thisMap[j]=index;
+		ambigToCharMap.push_back(thisMap);
 #endif
-			char thisbase=thisdata[j];
-			int numstates=0;
-			char thiscode;
-			if(thisbase&1){
-				numstates++;
-				thiscode=0;
-				}
-			if(thisbase&2){
-				numstates++;
-				thiscode=1;
-				}
-			if(thisbase&4){
-				numstates++;
-				thiscode=2;
-				}
-			if(thisbase&8){
-				numstates++;
-				thiscode=3;
-				}
-			
-			if(numstates==1){
-				thisString[index++]=thiscode;
-				}
-			else if(numstates==4||numstates==0){
-				thisString[index++] = -4;
-				}
-			else{
-				thisString[index++] = -numstates;
-				if(thisbase&1) thisString[index++] = 0;
-				if(thisbase&2) thisString[index++] = 1;
-				if(thisbase&4) thisString[index++] = 2;			
-				if(thisbase&8) thisString[index++] = 3;		
-				}
+		}
+	}
+
+//encodes the row for taxon tax in the ambiguity format, in place.  thisMap (used by the OpenMP kernels)
+//maps each column to its start in the string, and can be NULL
+void NucleotideData::FillAmbigString(int tax, char *thisString, unsigned *thisMap) const{
+	const unsigned char* thisdata=GetRow(tax);
+	int index=0;
+	for(int j=0;j<NChar();j++){
+		if(thisMap != NULL)
+			thisMap[j]=index;
+		char thisbase=thisdata[j];
+		int numstates=0;
+		char thiscode;
+		if(thisbase&1){
+			numstates++;
+			thiscode=0;
 			}
-		ambigStrings.push_back(thisString);
+		if(thisbase&2){
+			numstates++;
+			thiscode=1;
+			}
+		if(thisbase&4){
+			numstates++;
+			thiscode=2;
+			}
+		if(thisbase&8){
+			numstates++;
+			thiscode=3;
+			}
+		
+		if(numstates==1){
+			thisString[index++]=thiscode;
+			}
+		else if(numstates==4||numstates==0){
+			thisString[index++] = -4;
+			}
+		else{
+			thisString[index++] = -numstates;
+			if(thisbase&1) thisString[index++] = 0;
+			if(thisbase&2) thisString[index++] = 1;
+			if(thisbase&4) thisString[index++] = 2;			
+			if(thisbase&8) thisString[index++] = 3;		
+			}
+		}
+	}
+
+//rewrites the existing ambiguity strings after the matrix columns are reordered.  The columns are the same
+//characters in a different order (or fewer of them), so the strings never need to grow
+void NucleotideData::RefillAmbigStrings(){
+	for(int i=0;i<(int)ambigStrings.size();i++){
 #ifdef OPEN_MP
-		ambigToCharMap.push_back(thisMap);
+		FillAmbigString(i, ambigStrings[i], ambigToCharMap[i]);
+#else
+		FillAmbigString(i, ambigStrings[i], NULL);
 #endif
 		}
 	}
@@ -374,7 +574,7 @@ void CodonData::FillCodonMatrixFromDNA(const NucleotideData *dnaData, bool ignor
 	nTax = dnaData->NTax();
 	if(dnaData->NChar() % 3 != 0) throw ErrorException("Codon datatype specified, but number of nucleotides not divisible by 3!");  
 	NewMatrix(nTax, numPatterns);
-	patman.Initialize(nTax, maxNumStates);
+	patman.Initialize(nTax, maxNumStates, (usePatternManager ? numPatterns : 0));
 
 	//this will just map from the bitwise format to the index format (A, C, G, T = 0, 1, 2, 3)
 	//partial ambiguity is mapped to total ambiguity currently
@@ -484,7 +684,7 @@ void AminoacidData::FillAminoacidMatrixFromDNA(const NucleotideData *dnaData, Ge
 	if(dnaData->NChar() % 3 != 0)
 		throw ErrorException("Codon to Aminoacid translation specified, but number of nucleotides not divisible by 3!");  
 	NewMatrix(nTax, numPatterns);
-	patman.Initialize(nTax, maxNumStates);
+	patman.Initialize(nTax, maxNumStates, (usePatternManager ? numPatterns : 0));
 
 	int tax=0, thisCodonNum;
 	for(int tax=0;tax<NTax();tax++){
@@ -828,7 +1028,7 @@ void NucleotideData::CreateMatrixFromNCL(const NxsCharactersBlock *charblock, Nx
 		}
 
 	NewMatrix( numActiveTaxa, numActiveChar );
-	patman.Initialize(numActiveTaxa, maxNumStates);
+	patman.Initialize(numActiveTaxa, maxNumStates, (usePatternManager ? numActiveChar : 0));
 
 	//get weightset if one was specified
 	vector<int> charWeights;
@@ -941,7 +1141,7 @@ void AminoacidData::CreateMatrixFromNCL(const NxsCharactersBlock *charblock, Nxs
 		}
 
 	NewMatrix( numActiveTaxa, numActiveChar );
-	patman.Initialize(numActiveTaxa, maxNumStates);
+	patman.Initialize(numActiveTaxa, maxNumStates, (usePatternManager ? numActiveChar : 0));
 
 	//get weightset if one was specified
 	vector<int> charWeights;
@@ -55,6 +55,9 @@ public:
 		for(int i=0;i<maxNumStates;i++) f[i]=empStateFreqs[i];
 		}
 	virtual void AddDummyRootToExistingMatrix();
+	//reads a plain fasta or relaxed sequential phylip file straight into the pattern manager without NCL.
+	//Returns false if the file couldn't be read this way, in which case NCL should be used instead
+	bool ReadPlainAlignment(const char *filename, bool fasta);
 
 	virtual bool IsNucleotide() const {return false;}
 	virtual bool IsCodon() const {return false;}
@@ -177,6 +180,20 @@ public:
 	void CalcEmpiricalFreqs();
 	void CreateMatrixFromNCL(const NxsCharactersBlock *charblock, NxsUnsignedSet &charset);
 	void MakeAmbigStrings();
+	void FillAmbigString(int tax, char *thisString, unsigned *thisMap) const;
+	void RefillAmbigStrings();
+	bool CompactZeroCountPatterns(){
+		if(SequenceData::CompactZeroCountPatterns() == false)
+			return false;
+		RefillAmbigStrings();
+		return true;
+		}
+	bool RestoreUncompactedPatterns(){
+		if(SequenceData::RestoreUncompactedPatterns() == false)
+			return false;
+		RefillAmbigStrings();
+		return true;
+		}
 	void AddDummyRootToExistingMatrix();
 	char *GetAmbigString(int i) const{
 		return ambigStrings[i];
@@ -752,6 +769,18 @@ public:
 			}
 		return nextSeed;
 		}
+	void CompactZeroCountPatterns(){
+		for(int p = 0;p < NumSubsets();p++)
+			dataSubsets[p]->CompactZeroCountPatterns();
+		}
+	void RestoreUncompactedPatterns(){
+		for(int p = 0;p < NumSubsets();p++)
+			dataSubsets[p]->RestoreUncompactedPatterns();
+		}
+	void KeepPatternSlice(int slice, int numSlices){
+		for(int p = 0;p < NumSubsets();p++)
+			dataSubsets[p]->KeepPatternSlice(slice, numSlices);
+		}
 	};
 
 class DataSubsetInfo{
@@ -48,6 +48,9 @@ class Stopwatch	{
 			time(&end_time);
 			return (int)(end_time - this_execution_start_time);		
 			}
+		double SplitTimeDouble()	{
+			return (double) SplitTime();
+			}
 		//this is for restarting
 		void AddPreviousTime(time_t t){
 			start_time -= t;
@@ -68,6 +71,11 @@ class Stopwatch	{
 			gettimeofday(&end_time, NULL);
 			return end_time.tv_sec - this_execution_start_time.tv_sec;
 			}
+		//the same as SplitTime, but with sub-second resolution for timing short stretches of code
+		double SplitTimeDouble()	{
+			gettimeofday(&end_time, NULL);
+			return (end_time.tv_sec - start_time.tv_sec) + (end_time.tv_usec - start_time.tv_usec) * 1.0e-6;
+			}
 		//this is for restarting
 		void AddPreviousTime(int t){
 			start_time.tv_sec -= t;
@@ -2,6 +2,8 @@
 #define THREADDCLS_H
 
 #include <pthread.h>
+#include <stdlib.h>
+#include "treeexchange.h"
 
 class MasterGamlConfig;
 class Population;
@@ -21,23 +23,87 @@ struct thread_arg_t	{
 	Population *pop;
 };
 
+//remotes precede each exchange with a single int header message, so the master can keep a fixed size
+//receive posted for every remote and wait on all of them at once
+enum{
+	UPDATE_TREE = 1,
+	UPDATE_QUIT = 2
+	};
+
+//everything a subtree worker sends the master in one exchange
+struct RemoteUpdate	{
+	int who;
+	int kind;
+	PackedIndividual packed;
+	int subtreeDef;
+	int subtreeNode;
+	RemoteUpdate *next;
+	RemoteUpdate() : who(0), kind(UPDATE_TREE), subtreeDef(0), subtreeNode(0), next(NULL){}
+};
+
+//Unbounded single producer/single consumer queue.  The communication thread pushes updates as they arrive and the
+//GA thread drains them at generation boundaries, so neither ever waits on the other.  head is always a dummy node
+//that only the consumer touches, tail is only touched by the producer.
+class RemoteUpdateQueue	{
+	RemoteUpdate *head;
+	RemoteUpdate *tail;
+public:
+	RemoteUpdateQueue(){
+		head = tail = new RemoteUpdate;
+		}
+	~RemoteUpdateQueue(){
+		RemoteUpdate *u;
+		while(head){
+			u = head->next;
+			delete head;
+			head = u;
+			}
+		}
+	void Push(RemoteUpdate *u){
+		u->next = NULL;
+		//the update must be complete before it becomes visible to the consumer
+		__sync_synchronize();
+		*((RemoteUpdate * volatile *) &tail->next) = u;
+		tail = u;
+		}
+	//returns NULL if nothing is waiting.  The caller owns the returned update
+	RemoteUpdate *Pop(){
+		RemoteUpdate *next = *((RemoteUpdate * volatile *) &head->next);
+		if(next == NULL)
+			return NULL;
+		__sync_synchronize();
+		//next becomes the new dummy, so its contents move to a new object
+		RemoteUpdate *u = new RemoteUpdate;
+		u->who = next->who;
+		u->kind = next->kind;
+		u->subtreeDef = next->subtreeDef;
+		u->subtreeNode = next->subtreeNode;
+		u->packed.Swap(next->packed);
+		delete head;
+		head = next;
+		return u;
+		}
+};
+
 extern transferred_data_t *node_results;
-extern pthread_mutex_t lock_pm;
-extern pthread_mutex_t lock_pop;
-extern pthread_cond_t cond_pm;
 extern bool g_quit_time;
-extern bool g_processing_message;
+extern volatile bool g_comm_thread_done;
+extern bool g_comm_thread_woken;
+extern pthread_mutex_t lock_wake;
+extern RemoteUpdateQueue remoteUpdates;
 
 void *master_poller(void *varg);
 void *thread_func2(void *varg);
+void wake_comm_thread();
+void process_remote_updates(thread_arg_t *targ, bool reply);
 void purge_results(transferred_data_t *r);
 void copy_results(transferred_data_t *lhs, transferred_data_t rhs);
 bool valid_results(transferred_data_t r);
 void send_quit_messages(int);
-int process_message(char *buf, int size, int who, int tag, thread_arg_t *targ);
+RemoteUpdate *receive_remote_update(int who);
 void DoMasterSM(char *buf, int size, int who, int tag, thread_arg_t *targ);
 void DoMasterAMR(char *buf, int size, int who, int tag, thread_arg_t *targ);
 
-int DoMasterSW(char *buf, int size, int who, int tag, thread_arg_t *targ);
+void DoMasterSW(RemoteUpdate *update, thread_arg_t *targ, bool reply);
 
 #endif
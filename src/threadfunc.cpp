@@ -20,6 +20,7 @@
 
 #ifdef MPI_VERSION
 
+#include <vector>
 #include "defs.h"
 #include "threaddcls.h"
 #include "mpifuncs.h"
@@ -27,12 +28,12 @@
 
 // local vars
 transferred_data_t *node_results;
-pthread_mutex_t lock_pm;
-pthread_mutex_t lock_pop;
-pthread_cond_t cond_pm;
 bool g_quit_time;
-bool g_processing_message;
-int remote_types[32];
+volatile bool g_comm_thread_done;
+bool g_comm_thread_woken;
+pthread_mutex_t lock_wake;
+RemoteUpdateQueue remoteUpdates;
+vector<int> remote_types;
 
 #define AMR  1
 #define SM   2
@@ -40,114 +41,157 @@ int remote_types[32];
 
 extern int calcCount;
 
+//The master's communication thread.  A persistent receive for the update header is kept posted for every
+//remote, and the thread sleeps in MPI_Waitany until one of them (or the GA thread, through slot 0) has
+//something.  The rest of that remote's exchange is received and queued for the GA thread, which does all
+//of the work on the population.
 void *thread_func2(void *varg)	{
-	int who, size, tag, quits = 0;
+	int who, quits = 0;
 	thread_arg_t *targs = (thread_arg_t*)varg;
-	
-	MasterGamlConfig *conf = targs->conf;
-	char *buf;
-
-	bool poo=true;
-//	while(poo);
+	int nprocs = targs->nprocs;
 	
 	//initialize the array that shows what type of remote each node is
-	int method = 0, nprocs = targs->nprocs;
-	
+	remote_types.assign(nprocs, SW);
+	//make all remotes SubtreeWorkers
+	/*if (conf->gc.method == "sm" || (conf->gc.method == "hybrid" && who <= (int) (conf->gc.hybridpercent*(nprocs -1))))
+		remote_types[who]=SM;
+	else if (conf->gc.method == "amr" || (conf->gc.method == "hybrid" && who > conf->gc.hybridpercent*(nprocs -1)))
+		remote_types[who]=AMR;
+	else
+		debug_mpi("ERROR: can't determine method proper type of remote, remote #%d", who);
+	*/
+
+	vector<int> headers(nprocs);
+	vector<MPI_Request> requests(nprocs);
+	vector<bool> active(nprocs, true);
 	for(who=0;who<nprocs;who++){
-		//make all remotes SubtreeWorkers
-		remote_types[who]=SW;
-		
-		/*if (conf->gc.method == "sm" || (conf->gc.method == "hybrid" && who <= (int) (conf->gc.hybridpercent*(nprocs -1))))
-			remote_types[who]=SM;
-		else if (conf->gc.method == "amr" || (conf->gc.method == "hybrid" && who > conf->gc.hybridpercent*(nprocs -1)))
-			remote_types[who]=AMR;
-		else
-			debug_mpi("ERROR: can't determine method proper type of remote, remote #%d", who);
-		*/
+		MPI_Recv_init(&headers[who], 1, MPI_INT, who, TAG_UPDATE_HEADER, MPI_COMM_WORLD, &requests[who]);
+		MPI_Start(&requests[who]);
 		}
-	timespec sleepTime;
-	sleepTime.tv_nsec=50000000;
-	sleepTime.tv_sec=0;
-	int nextStart=1, nextRemote;
-	int maxNumReceives=2, numReceives;
-	while (quits < targs->nprocs-1)	{
-		nextRemote=nextStart;
-		bool checkedAll=false, received=false;
-		do{
-			who=nextRemote;
-			received=RecvMPIMessage(&buf, &size, who, &tag, false);
-			if(received==true) assert(tag==TAG_TREE_STRINGS || tag==TAG_QUIT);
-			nextRemote=(nextRemote<(targs->nprocs-1) ? nextRemote+1 : 1);
-			if(nextRemote==nextStart) checkedAll=true;
-			}while(received==false && checkedAll==false);
-		nextStart=(nextStart<(targs->nprocs-1) ? nextStart+1 : 1);
-		if(checkedAll==true) nanosleep(&sleepTime, NULL);
-		if(received==true){
-			if (tag == TAG_QUIT){
-				++quits;
-				debug_mpi("received quit message from %d.  %d quits received.", who, quits);
-				}
-			else	{
-				pthread_mutex_lock(&lock_pm);
-					g_processing_message = true;
-				pthread_mutex_unlock(&lock_pm);
-			
-				pthread_mutex_lock(&lock_pop);
-					quits += process_message(buf, size, who, tag, targs);
-				pthread_mutex_unlock(&lock_pop);
-			
-//				if(numReceives == maxNumReceives){
-					pthread_mutex_lock(&lock_pm);
-						g_processing_message = false;
-						pthread_cond_signal(&cond_pm);
-					pthread_mutex_unlock(&lock_pm);
-//					numReceives=0;
-//					}
-//				else numReceives++;
-				}
-			delete []buf;
-			numReceives++;
-			}
-		
-		if(g_quit_time == true){
+
+	while (quits < nprocs-1)	{
+		int index;
+		MPI_Status status;
+		//inactive requests (remotes that have quit) are ignored by Waitany
+		MPI_Waitany(nprocs, &requests[0], &index, &status);
+		active[index] = false;
+		if(index == 0){
+			//the GA thread is done
 			send_quit_messages(nprocs);
 			break;
 			}
+		who = index;
+		if(headers[who] == UPDATE_QUIT){
+			++quits;
+			debug_mpi("received quit message from %d.  %d quits received.", who, quits);
+			RemoteUpdate *update = new RemoteUpdate;
+			update->who = who;
+			update->kind = UPDATE_QUIT;
+			remoteUpdates.Push(update);
+			continue;
+			}
+		if(remote_types[who] == SW)
+			remoteUpdates.Push(receive_remote_update(who));
+		else debug_mpi("ERROR: can't determine method to use for remote #%d", who);
+		MPI_Start(&requests[who]);
+		active[who] = true;
+		}
+
+	//after this the GA thread won't send a wake up, but it may already have sent one that hasn't arrived yet.
+	//That has to be received rather than cancelled, or it would be left unmatched
+	pthread_mutex_lock(&lock_wake);
+	g_comm_thread_done = true;
+	bool woken = g_comm_thread_woken;
+	pthread_mutex_unlock(&lock_wake);
 
-/*		if((checkedAll==true && g_processing_message==true) || (received==true && numReceives >=  maxNumReceives)){
-			pthread_mutex_lock(&lock_pm);
-				g_processing_message = false;
-				pthread_cond_signal(&cond_pm);
-			pthread_mutex_unlock(&lock_pm);
-			numReceives=0;
-			}*/
-//		else numReceives++;
+	for(who=0;who<nprocs;who++){
+		if(active[who]){
+			if(who != 0 || woken == false)
+				MPI_Cancel(&requests[who]);
+			MPI_Wait(&requests[who], MPI_STATUS_IGNORE);
+			}
+		MPI_Request_free(&requests[who]);
 		}
 	debug_mpi("thread terminating");
 	g_quit_time = true;
+	return NULL;
 }
 
+//called by the GA thread to tell the communication thread to shut things down.  Does nothing if the thread
+//has already finished on its own (all remotes quit), since nothing would receive the message
+void wake_comm_thread(){
+	static int header = UPDATE_QUIT;
+	pthread_mutex_lock(&lock_wake);
+	if(g_comm_thread_done == false){
+		MPI_Request req;
+		MPI_Isend(&header, 1, MPI_INT, 0, TAG_UPDATE_HEADER, MPI_COMM_WORLD, &req);
+		MPI_Request_free(&req);
+		g_comm_thread_woken = true;
+		}
+	pthread_mutex_unlock(&lock_wake);
+	}
+
 void send_quit_messages(int np){
 	for(int i=1;i<np;i++){
 		SendMPIMessage(NULL, 0, i, TAG_QUIT);
 		}
 	}
 
-int process_message(char *buf, int size, int who, int tag, thread_arg_t *targ)	{
-	MasterGamlConfig *conf = targ->conf;
-	Population *pop = targ->pop;
-	int method = 0, nprocs = targ->nprocs;
-	int foundQuit=0;
-
-	if(remote_types[who]==SM) DoMasterSM(buf, size, who, tag, targ);
-	else if(remote_types[who]==AMR) DoMasterAMR(buf, size, who, tag, targ);
-
-	else if(remote_types[who]==SW) foundQuit=DoMasterSW(buf, size, who, tag, targ);
-
-	else debug_mpi("ERROR: can't determine method to use in process_message(), remote #%d", who);
+//receives the remainder of an exchange from a subtree worker, following its header.  Trees after the first
+//from each remote are deltas against the one before, so the last one is kept here.  Only the communication
+//thread uses this.
+RemoteUpdate *receive_remote_update(int who)	{
+	static vector<PackedIndividual> receivedFrom;
+	if(receivedFrom.size() <= (unsigned) who)
+		receivedFrom.resize(who + 1);
+	RemoteUpdate *update = new RemoteUpdate;
+	char *buf;
+	int size;
+	update->who = who;
+
+	RecvMPIMessage(&buf, &size, who, TAG_PACKED_INDIVIDUAL, true);
+	receivedFrom[who].Deserialize(buf, size);
+	update->packed = receivedFrom[who];
+	delete []buf;
+
+	//determine what the remote was doing when it sent this tree
+	RecvMPIMessage(&buf, &size, who, TAG_SUBTREE_ITERATION, true);
+	update->subtreeDef=atoi(buf);
+	delete []buf;
+	if(update->subtreeDef>0){
+		RecvMPIMessage(&buf, &size, who, TAG_SUBTREE_DEFINE, true);
+		update->subtreeNode=atoi(buf);
+		delete []buf;
+		}
+	return update;
+	}
 
-	return foundQuit;
-}
+//Called by the GA thread between generations.  If there are multiple updates from a remote, only the most recent
+//is used.  After the communication thread has told the remotes to quit, reply should be false.
+void process_remote_updates(thread_arg_t *targ, bool reply){
+	static vector<bool> quit;
+	quit.resize(targ->nprocs, false);
+	vector<RemoteUpdate *> latest(targ->nprocs, (RemoteUpdate *) NULL);
+	RemoteUpdate *update;
+	while((update = remoteUpdates.Pop()) != NULL){
+		if(update->kind == UPDATE_QUIT){
+			quit[update->who] = true;
+			delete update;
+			continue;
+			}
+		if(latest[update->who] != NULL){
+			debug_mpi("	found another tree from remote %d", update->who);
+			delete latest[update->who];
+			}
+		latest[update->who] = update;
+		}
+	for(int who=1;who<targ->nprocs;who++){
+		if(latest[who] != NULL){
+			DoMasterSW(latest[who], targ, reply && !quit[who]);
+			delete latest[who];
+			}
+		}
+	}
 
 void DoMasterSM(char *buf, int size, int who, int tag, thread_arg_t *targ)	{
 	MasterGamlConfig *conf = targ->conf;
@@ -243,77 +287,27 @@ void DoMasterAMR(char *buf, int size, int who, int tag, thread_arg_t *targ)	{
 	delete [] models;
 	}
 
-int DoMasterSW(char *buf, int size, int who, int tag, thread_arg_t *targ)	{
+void DoMasterSW(RemoteUpdate *update, thread_arg_t *targ, bool reply)	{
 	MasterGamlConfig *conf = targ->conf;
 	Population *pop = targ->pop;
-	int count, start_shield, *which = new int;//[conf->gc.numshields];
-	char *tree_strings, *model_buf;
-	char *out_tree_strings;
-	char *defbuf, *subbuf;
-	double *out_models;
-	double *models;
-	int remoteSubtreeDef, remoteSubtreeNode;
+	int who = update->who;
+	int start_shield, *which = new int;//[conf->gc.numshields];
+	int remoteSubtreeDef = update->subtreeDef, remoteSubtreeNode = update->subtreeNode;
 	ParallelManager *paraMan=(pop->paraMan);
 
-//first get the tree and model from the remote and include it in
-//the master population.  If there are multiple messages, chuck 
-//earlier ones and just get the most recent
-	bool firstmessage=true;
-	do{
-		debug_mpi("Remote %d", who);
-		assert(tag == TAG_TREE_STRINGS || tag == TAG_QUIT);
-		if(tag==TAG_QUIT) return 1;
-		tree_strings = buf;
-		count = CountTreeStrings(tree_strings);
-		
-//		debug_mpi("about to get model strings...");
-
-		RecvMPIMessage(&buf, &size, who, &tag, true);
-		assert(tag == TAG_MODEL);
-		models=(double*)buf;
-		
-//		debug_mpi("about to get subdef strings...");
-
-		//determine what the remote was doing when it sent this tree
-		RecvMPIMessage(&defbuf, &size, who, &tag, true);
-		assert(tag==TAG_SUBTREE_ITERATION);
-		remoteSubtreeDef=atoi(defbuf);
-		
-		if(remoteSubtreeDef>0){
-			RecvMPIMessage(&subbuf, &size, who, &tag, true);
-			assert(tag==TAG_SUBTREE_DEFINE);
-			remoteSubtreeNode=atoi(subbuf);
-			if(remoteSubtreeDef==paraMan->subtreeDefNumber)
-				paraMan->localSubtreeAssign[who]=remoteSubtreeNode;
-			else paraMan->localSubtreeAssign[who]=0;
-			delete []subbuf;
-			}
-		//DJZ 5-18-05
-		else {
-			paraMan->localSubtreeAssign[who]=0;
-			remoteSubtreeNode=0;
-			}
-		
-		double score;
-		char *scoreBuf;
-		RecvMPIMessage(&scoreBuf, &size, who, &tag, true);
-		assert(tag==TAG_SCORE);
-		memcpy(&score, scoreBuf, sizeof(double));
-//		debug_mpi("recieved score of %f", score);
-		delete []scoreBuf;
-		
-		if(firstmessage==false) debug_mpi("\tfound another tree from remote %d", who);
-
-		*which = start_shield = pop->params->nindivs + (who-1);
-		pop->ReplaceSpecifiedIndividuals(count, which, tree_strings, models);
-	
-		pop->indiv[*which].SetFitness(score);
-		if(firstmessage==false) delete []tree_strings;
-		delete [](char*)models;
-		delete []defbuf;
+//first include the tree and model from the remote in the master population
+	debug_mpi("Remote %d", who);
+	if(remoteSubtreeDef>0){
+		if(remoteSubtreeDef==paraMan->subtreeDefNumber)
+			paraMan->localSubtreeAssign[who]=remoteSubtreeNode;
+		else paraMan->localSubtreeAssign[who]=0;
+		}
+	//DJZ 5-18-05
+	else paraMan->localSubtreeAssign[who]=0;
 
-		firstmessage=false;
-		}while(RecvMPIMessage(&buf, &size, who, &tag, false)==true);
+	*which = start_shield = pop->params->nindivs + (who-1);
+	pop->indiv[*which].Unpack(update->packed);
+	pop->indiv[*which].SetFitness(update->packed.lnL);
 	
 	bool subtreesCurrent = ((remoteSubtreeDef == paraMan->subtreeDefNumber) && remoteSubtreeDef > 0);
 	
@@ -406,7 +400,10 @@ int DoMasterSW(char *buf, int size, int who, int tag, thread_arg_t *targ)	{
 			}
 		}
 
-	if(paraMan->needToSend[who]){
+	if(reply == false)
+		send = false;
+
+	if(reply && paraMan->needToSend[who]){
 		char pertbuf[5];
 		int perttype = (pop->pertMan->pertType > 0 ? pop->pertMan->pertType : (int)(rnd.uniform() * 2 + 1));
 		sprintf(pertbuf, "%d", perttype);
@@ -417,13 +414,17 @@ int DoMasterSW(char *buf, int size, int who, int tag, thread_arg_t *targ)	{
 
 
 	if(send==true){
-		pop->GetSpecifiedTreeStrings(&out_tree_strings, 1, which);
-		
-		assert(*out_tree_strings == '(');
-		int model_size=pop->GetSpecifiedModels(&out_models, 1, which);
-		
-		SendMPIMessage(out_tree_strings, strlen2(out_tree_strings)+2, who, TAG_TREE_STRINGS);
-		SendMPIMessage((char*)out_models, sizeof(double)*model_size, who, TAG_MODEL);
+		//remotes keep the last tree we sent them, so only what has changed since then needs to go
+		static vector<PackedIndividual> sentTo;
+		if(sentTo.size() < (unsigned) targ->nprocs)
+			sentTo.resize(targ->nprocs);
+		PackedIndividual packed;
+		pop->indiv[*which].Pack(packed);
+		vector<char> buf;
+		if(sentTo[who].NumNodes() > 0) packed.SerializeDelta(sentTo[who], buf);
+		else packed.Serialize(buf);
+		SendMPIMessage(&buf[0], (int) buf.size(), who, TAG_PACKED_INDIVIDUAL);
+		sentTo[who].Swap(packed);
 
 /*		if(paraMan->needToSend[who]){
 			char pertbuf[5];
@@ -449,9 +450,6 @@ int DoMasterSW(char *buf, int size, int who, int tag, thread_arg_t *targ)	{
 			
 //			}
 		paraMan->remoteSubtreeAssign[who]=subtreeNum;
-		
-		delete []out_models;
-		delete []out_tree_strings;		
 		}
 #ifndef NDEBUG
 	if(paraMan->subtreeModeActive && paraMan->subtreeDefNumber==remoteSubtreeDef){
@@ -460,12 +458,9 @@ int DoMasterSW(char *buf, int size, int who, int tag, thread_arg_t *targ)	{
 		}
 #endif
 	
-	//the tree_strings that were passed in will be deleted back
-	//where the initial call to RecvMPIMessage was made
 	delete [] which;
 
 	pop->CalcAverageFitness();
-	return 0;
 }
 
 void purge_results(transferred_data_t *r)	{
@@ -0,0 +1,146 @@
+// GARLI version 2.0 source code
+// Copyright 2005-2011 Derrick J. Zwickl
+// email: garli.support@gmail.com
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef _TOPOLOGYCACHE_
+#define _TOPOLOGYCACHE_
+
+#include <map>
+#include <list>
+#include <vector>
+#include <algorithm>
+#include <float.h>
+
+#include "defs.h"
+#include "bipartition.h"
+
+using namespace std;
+
+typedef unsigned long long TopoHash;
+typedef pair<TopoHash, FLOAT_TYPE> BipartLength;
+
+//The best score and branch lengths seen for a single topology.  Terminal branches are indexed by
+//taxon number - 1, internal branches are kept sorted by the hash of their standardized bipartition.
+//The score is only comparable to others under the same model parameters, which are identified by their hash.
+class CachedTopology{
+public:
+	TopoHash model;
+	FLOAT_TYPE lnL;
+	vector<FLOAT_TYPE> tipLengths;
+	vector<BipartLength> internalLengths;
+
+	CachedTopology() : model(0), lnL(-FLT_MAX){}
+
+	bool FindInternalLength(TopoHash bip, FLOAT_TYPE &len) const{
+		vector<BipartLength>::const_iterator it = lower_bound(internalLengths.begin(), internalLengths.end(), BipartLength(bip, (FLOAT_TYPE) -FLT_MAX));
+		if(it == internalLengths.end() || it->first != bip)
+			return false;
+		len = it->second;
+		return true;
+		}
+	};
+
+//Cache of scored topologies, shared by all individuals (and search replicates on the same data).
+//Topologies are identified by an order independent combination of the hashes of their standardized
+//bipartitions, so the same unrooted tree always gets the same key however it is rooted or ordered.
+//When full, the oldest entries are discarded first.
+class TopologyCache{
+	map<TopoHash, CachedTopology> entries;
+	list<TopoHash> insertionOrder;
+	unsigned maxEntries;
+	bool enabled;
+
+public:
+	unsigned lookups;
+	unsigned hits;
+	unsigned skipped;
+	unsigned stale;
+	unsigned warmStarts;
+
+	TopologyCache() : maxEntries(0), enabled(false){
+		ResetStats();
+		}
+
+	void Initialize(bool use, unsigned maxSize){
+		enabled = use && maxSize > 0;
+		maxEntries = maxSize;
+		Clear();
+		}
+	bool Enabled() const {return enabled;}
+	unsigned NumEntries() const {return (unsigned) entries.size();}
+
+	void ResetStats(){
+		lookups = hits = skipped = stale = warmStarts = 0;
+		}
+	//the cached scores are only meaningful for the current data, so this must be called whenever it changes
+	void Clear(){
+		entries.clear();
+		insertionOrder.clear();
+		ResetStats();
+		}
+
+	//FNV-1a over the bipartition blocks, followed by a final avalanche so that
+	//summing the hashes of a tree's bipartitions doesn't produce systematic collisions
+	static TopoHash HashBipartition(const Bipartition &bip){
+		TopoHash h = 14695981039346656037ULL;
+		for(int b = 0;b < Bipartition::nBlocks;b++){
+			h ^= (TopoHash) bip.rep[b];
+			h *= 1099511628211ULL;
+			}
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ULL;
+		h ^= h >> 33;
+		return h;
+		}
+
+	//FNV-1a over the bytes of the packed model parameters
+	static TopoHash HashModelParameters(const vector<FLOAT_TYPE> &params){
+		TopoHash h = 14695981039346656037ULL;
+		const unsigned char *bytes = (const unsigned char *) (params.empty() ? NULL : &params[0]);
+		for(size_t b = 0;b < params.size() * sizeof(FLOAT_TYPE);b++){
+			h ^= (TopoHash) bytes[b];
+			h *= 1099511628211ULL;
+			}
+		return h;
+		}
+
+	const CachedTopology *Find(TopoHash topo){
+		lookups++;
+		map<TopoHash, CachedTopology>::const_iterator it = entries.find(topo);
+		if(it == entries.end())
+			return NULL;
+		hits++;
+		return &(it->second);
+		}
+
+	//returns the entry to be filled if lnL beats anything already cached for the topology under the same model,
+	//otherwise NULL.  An entry scored under different model parameters is always replaced.
+	CachedTopology *EntryToUpdate(TopoHash topo, TopoHash model, FLOAT_TYPE lnL){
+		map<TopoHash, CachedTopology>::iterator it = entries.find(topo);
+		if(it != entries.end())
+			return (it->second.model != model || lnL > it->second.lnL ? &(it->second) : NULL);
+		if(entries.size() >= maxEntries){
+			entries.erase(insertionOrder.front());
+			insertionOrder.pop_front();
+			}
+		insertionOrder.push_back(topo);
+		return &(entries[topo]);
+		}
+	};
+
+#endif
@@ -24,6 +24,9 @@
 #ifdef UNIX
 	#include <sys/mman.h>
 #endif
+#ifdef SUBROUTINE_GARLI
+	#include "mpi.h"
+#endif
 
 using namespace std;
 
@@ -38,13 +41,13 @@ using namespace std;
 #include "garlireader.h"
 
 #include "utility.h"
-Profiler ProfIntInt   ("ClaIntInt     ");
-Profiler ProfIntTerm  ("ClaIntTerm    ");
-Profiler ProfTermTerm ("ClaTermTerm   ");
-Profiler ProfRescale  ("Rescale       ");
-Profiler ProfScoreInt ("ScoreInt      ");
-Profiler ProfScoreTerm("ScoreTerm     ");
-Profiler ProfEQVectors("EQVectors     ");
+Profiler ProfIntInt   ("ClaIntInt");
+Profiler ProfIntTerm  ("ClaIntTerm");
+Profiler ProfTermTerm ("ClaTermTerm");
+Profiler ProfRescale  ("Rescale");
+Profiler ProfScoreInt ("ScoreInt");
+Profiler ProfScoreTerm("ScoreTerm");
+Profiler ProfEQVectors("EQVectors");
 
 extern bool swapBasedTerm;
 
@@ -57,6 +60,7 @@ int precalcIncr[30] = {1, 3, 5, 7, 10, 12, 14, 17, 19, 21, 24, 26, 28, 30, 33, 3
 extern rng rnd;
 extern bool output_tree;
 extern bool uniqueSwapTried;
+extern FLOAT_TYPE globalBest;
 
 #ifdef VARIABLE_OPTIMIZATION
 ofstream var("variable.log");
@@ -91,7 +95,12 @@ FLOAT_TYPE Tree::reduceRescaleBelow;
 FLOAT_TYPE Tree::bailOutBelow;
 FLOAT_TYPE Tree::treeRejectionThreshold;
 vector<Constraint> Tree::constraints;
+int Tree::searchSubtreeRoot = 0;
+vector<int> Tree::searchSubtreeNodes;
+vector<bool> Tree::inSearchSubtree;
 AttemptedSwapList Tree::attemptedSwaps;
+TopologyCache Tree::topologyCache;
+SiteLikelihoodOutput Tree::siteLikeOutput;
 FLOAT_TYPE Tree::uniqueSwapBias;
 FLOAT_TYPE Tree::distanceSwapBias;
 FLOAT_TYPE Tree::expectedPrecision;
@@ -99,6 +108,7 @@ bool Tree::rootWithDummy;
 bool Tree::dummyRootBranchMidpoint;
 bool Tree::someOrientedGap;
 bool Tree::useOptBoundedForBlen;
+bool Tree::concurrentBranchOpt;
 
 FLOAT_TYPE Tree::uniqueSwapPrecalc[500];
 FLOAT_TYPE Tree::distanceSwapPrecalc[1000];
@@ -110,6 +120,11 @@ int Tree::rescalePrecalcIncr[RESCALE_ARRAY_LENGTH];
 Bipartition *Tree::outgroup = NULL;
 
 int Tree::siteToScore = -1;
+unsigned long Tree::numScorings = 0;
+unsigned long long Tree::numClaUpdates = 0;
+unsigned long long Tree::numRescales = 0;
+int Tree::numPatternSlices = 1;
+int Tree::patternSlice = 0;
 
 void InferStatesFromCla(char *states, FLOAT_TYPE *cla, int nchar);
 FLOAT_TYPE CalculateHammingDistance(const char *str1, const char *str2, int nchar);
@@ -181,6 +196,9 @@ void Tree::SetTreeStatics(ClaManager *claMan, const DataPartition *data, const G
 	Tree::meanBrlenMuts	= conf->meanBrlenMuts;
 	Tree::alpha		= conf->gammaShapeBrlen;
 	Tree::treeRejectionThreshold = conf->treeRejectionThreshold;
+	Tree::topologyCache.Initialize(conf->useTopologyCache, conf->topologyCacheSize);
+	Tree::siteLikeOutput.SetFormat(conf->siteLikelihoodFormat);
+	Tree::concurrentBranchOpt = conf->concurrentBranchOpt;
 	Tree::min_brlen = conf->minBrlen;
 	Tree::max_brlen = conf->maxBrlen;
 	Tree::exp_starting_brlen = conf->startingBrlen;
@@ -426,8 +444,8 @@ Tree::Tree(const char* s, bool numericalTaxa, bool allowPolytomies /*=false*/, b
 						if(taxonnodeNum > numTipsTotal) throw ErrorException("Taxon number in tree description (%d) is greater than\n\tnumber of taxa in dataset!", taxonnodeNum);
 						}
 					else{
-						while(*(s+1) != ':' && *(s+1) != ',' && *(s+1) != ')'){
-							assert(*s);
+						//stop at the end of the string too, so that a malformed description is reported below rather than overrun
+						while(*(s+1) && *(s+1) != ':' && *(s+1) != ',' && *(s+1) != ')'){
 							name += *++s;
 							}
 						//This is a bit annoying.  If the tree string came directly from NCL then GetEscaped should get any
@@ -1534,10 +1552,8 @@ void Tree::DeterministicSwapperByCut(Individual *source, double optPrecision, in
 	
 	//allocate a treeString
 	double taxsize=log10((double) ((double)dataPart->NTax())*dataPart->NTax()*2);
-	int stringSize=(int)((dataPart->NTax()*2)*(10+DEF_PRECISION));
-	char *treeString=new char[stringSize];
-	stringSize--;
-	treeString[stringSize]='\0';
+	string treeString;
+	treeString.reserve((dataPart->NTax()*2)*(10+DEF_PRECISION));
 	bool newBest=false;
 	attemptedSwaps.ClearAttemptedSwaps();
 	
@@ -1614,7 +1630,6 @@ void Tree::DeterministicSwapperByCut(Individual *source, double optPrecision, in
 
 	better << "end;";
 	better.close();
-	delete []treeString;
 	fclose(log);
 
 	tempIndiv.treeStruct->RemoveTreeFromAllClas();
@@ -1671,10 +1686,8 @@ void Tree::DeterministicSwapperByDist(Individual *source, double optPrecision, i
 	
 	//allocate a treeString
 	double taxsize=log10((double) ((double)dataPart->NTax())*dataPart->NTax()*2);
-	int stringSize=(int)((dataPart->NTax()*2)*(10+DEF_PRECISION));
-	char *treeString=new char[stringSize];
-	stringSize--;
-	treeString[stringSize]='\0';
+	string treeString;
+	treeString.reserve((dataPart->NTax()*2)*(10+DEF_PRECISION));
 	bool newBest=false;
 	attemptedSwaps.ClearAttemptedSwaps();
 	int startC, c=1;
@@ -1758,7 +1771,6 @@ void Tree::DeterministicSwapperByDist(Individual *source, double optPrecision, i
 
 	better << "end;";
 	better.close();
-	delete []treeString;
 	fclose(log);
 
 	tempIndiv.treeStruct->RemoveTreeFromAllClas();
@@ -1828,10 +1840,8 @@ void Tree::DeterministicSwapperRandom(Individual *source, double optPrecision, i
 
 	//allocate a treeString
 	double taxsize=log10((double) ((double)dataPart->NTax())*dataPart->NTax()*2);
-	int stringSize=(int)((dataPart->NTax()*2)*(10+DEF_PRECISION));
-	char *treeString=new char[stringSize];
-	stringSize--;
-	treeString[stringSize]='\0';
+	string treeString;
+	treeString.reserve((dataPart->NTax()*2)*(10+DEF_PRECISION));
 	bool newBest=false;
 	attemptedSwaps.ClearAttemptedSwaps();
 	int c=1;
@@ -1917,7 +1927,6 @@ void Tree::DeterministicSwapperRandom(Individual *source, double optPrecision, i
 
 					better << "end;";
 					better.close();
-					delete []treeString;
 					fclose(log);
 
 					tempIndiv.treeStruct->RemoveTreeFromAllClas();
@@ -2017,10 +2026,8 @@ void Tree::GenerateTopologiesAtSprDistance(Individual *source, double optPrecisi
 
 	//allocate a treeString
 	double taxsize=log10((double) ((double)dataPart->NTax())*dataPart->NTax()*2);
-	int stringSize=(int)((dataPart->NTax()*2)*(10+DEF_PRECISION));
-	char *treeString=new char[stringSize];
-	stringSize--;
-	treeString[stringSize]='\0';
+	string treeString;
+	treeString.reserve((dataPart->NTax()*2)*(10+DEF_PRECISION));
 	//bool newBest=false;
 
 	int acceptedSwaps = 0;
@@ -2096,7 +2103,14 @@ int Tree::TopologyMutator(FLOAT_TYPE optPrecision, int range, int subtreeNode){
 	int tryNum = 0;
 	do{
 		do{
-			cut=allNodes[GetRandomNonRootNode()];
+			if(searchSubtreeRoot != 0){
+				//a direct descendent of the clade root can't be cut, since its anc (the clade root) would be moved
+				do{
+					cut=allNodes[searchSubtreeNodes[rnd.random_int((int) searchSubtreeNodes.size())]];
+					}while(cut->anc->nodeNum == searchSubtreeRoot);
+				}
+			else
+				cut=allNodes[GetRandomNonRootNode()];
 			GatherValidReconnectionNodes(range, cut, NULL);
 			}while(sprRang.size()==0);
 
@@ -2140,7 +2154,7 @@ int Tree::TopologyMutator(FLOAT_TYPE optPrecision, int range, int subtreeNode){
 					if(unique == true) ReorientSubtreeSPRMutateDummy(cut->nodeNum, broken, optPrecision);
 					else return broken->reconDist * -1;
 				#endif
-				ReorientSubtreeSPRMutate(cut->nodeNum, broken, optPrecision);	
+				ReorientSubtreeSPRMutate(cut->nodeNum, broken, optPrecision, topologyCache.Enabled());	
 				ret=broken->reconDist * -1;
 				}
 			else{
@@ -2151,7 +2165,7 @@ int Tree::TopologyMutator(FLOAT_TYPE optPrecision, int range, int subtreeNode){
 					if(unique == true) err=SPRMutateDummy(cut->nodeNum, broken, optPrecision, subtreeNode);
 					else return broken->reconDist;
 				#endif
-				err=SPRMutate(cut->nodeNum, broken, optPrecision, subtreeNode);
+				err=SPRMutate(cut->nodeNum, broken, optPrecision, subtreeNode, topologyCache.Enabled());
 				ret=broken->reconDist;
 				}
 			#ifdef OUTPUT_UNIQUE_TREES
@@ -2179,6 +2193,80 @@ int Tree::TopologyMutator(FLOAT_TYPE optPrecision, int range, int subtreeNode){
 	return ret;
 	}
 
+//The node numbers of everything below node, not including node itself
+void Tree::GetCladeMembers(int node, vector<int> &members) const{
+	members.clear();
+	vector<TreeNode *> stack;
+	for(TreeNode *des = allNodes[node]->left;des != NULL;des = des->next)
+		stack.push_back(des);
+	while(!stack.empty()){
+		TreeNode *nd = stack.back();
+		stack.pop_back();
+		members.push_back(nd->nodeNum);
+		for(TreeNode *des = nd->left;des != NULL;des = des->next)
+			stack.push_back(des);
+		}
+	}
+
+//Picks up to num disjoint clades of at least minTaxa taxa, each being the smallest clade reaching a target size of
+//about ntax / (2 * num) on its path to the root.  The largest are returned if more than num qualify.
+void Tree::ChooseSearchSubtrees(int num, int minTaxa, vector<int> &roots) const{
+	roots.clear();
+	int target = max(minTaxa, numTipsTotal / (2 * num));
+
+	//order the nodes so that descendents come before their ancestors
+	vector<TreeNode *> order;
+	vector<TreeNode *> stack(1, root);
+	while(!stack.empty()){
+		TreeNode *nd = stack.back();
+		stack.pop_back();
+		order.push_back(nd);
+		for(TreeNode *des = nd->left;des != NULL;des = des->next)
+			stack.push_back(des);
+		}
+
+	vector<int> taxa(numNodesTotal, 0);
+	vector<bool> containsChosen(numNodesTotal, false);
+	vector< pair<int, int> > chosen;
+	for(vector<TreeNode *>::reverse_iterator it = order.rbegin();it != order.rend();it++){
+		TreeNode *nd = *it;
+		if(nd->IsTerminal()){
+			taxa[nd->nodeNum] = 1;
+			continue;
+			}
+		for(TreeNode *des = nd->left;des != NULL;des = des->next){
+			taxa[nd->nodeNum] += taxa[des->nodeNum];
+			if(containsChosen[des->nodeNum])
+				containsChosen[nd->nodeNum] = true;
+			}
+		if(nd->IsNotRoot() && !containsChosen[nd->nodeNum] && taxa[nd->nodeNum] >= target){
+			chosen.push_back(pair<int, int>(taxa[nd->nodeNum], nd->nodeNum));
+			containsChosen[nd->nodeNum] = true;
+			}
+		}
+	sort(chosen.begin(), chosen.end());
+	for(vector< pair<int, int> >::reverse_iterator it = chosen.rbegin();it != chosen.rend() && (int) roots.size() < num;it++)
+		roots.push_back(it->second);
+	}
+
+//Confines all later topology mutations (of any tree) to rearrangements within the clade below node.  The node
+//numbers within the clade don't change under such swaps, so neither does the clade root or the rest of the tree.
+//This requires that the trees being mutated all have the same topology outside of the clade.
+void Tree::SetSearchSubtree(int node) const{
+	assert(node != 0);
+	searchSubtreeRoot = node;
+	GetCladeMembers(node, searchSubtreeNodes);
+	inSearchSubtree.assign(numNodesTotal, false);
+	for(vector<int>::iterator it = searchSubtreeNodes.begin();it != searchSubtreeNodes.end();it++)
+		inSearchSubtree[*it] = true;
+	}
+
+void Tree::ClearSearchSubtree(){
+	searchSubtreeRoot = 0;
+	searchSubtreeNodes.clear();
+	inSearchSubtree.clear();
+	}
+
 void Tree::GatherValidReconnectionNodes(int maxDist, TreeNode *cut, const TreeNode *subtreeNode, Bipartition *partialMask /*=NULL*/){
 	/* 7/11/06 making this function more multipurpose
 	It now assumes that the cut branch has NOT YET BEEN DETACHED. This is important so that
@@ -2276,6 +2364,17 @@ void Tree::GatherValidReconnectionNodes(int maxDist, TreeNode *cut, const TreeNo
 	sprRang.RemoveNodesOfDist(0); //remove branches adjacent to cut
 //	if(maxDist != 1)
 //		sprRang.RemoveNodesOfDist(1); //remove branches equivalent to NNIs
+
+	//keep the swap within the clade being searched.  Reorienting the cut subtree is skipped, since the rest
+	//of the tree would be what moves
+	if(searchSubtreeRoot != 0){
+		listIt it=sprRang.begin();
+		while(it != sprRang.end()){
+			if(it->withinCutSubtree || !inSearchSubtree[it->nodeNum])
+				it=sprRang.RemoveElement(it);
+			else it++;
+			}
+		}
 	
 	//now deal with constraints, if any
 	if(constraints.size() > 0){
@@ -2553,7 +2652,7 @@ int Tree::SPRMutateDummy(int cutnum, ReconNode *broke, FLOAT_TYPE optPrecision,
 
 // 7/21/06 This function is now called by TopologyMutator to actually do the rearrangement
 //It has the cut and broken nodenums passed in.  It also does NNI's
-int Tree::SPRMutate(int cutnum, ReconNode *broke, FLOAT_TYPE optPrecision, int subtreeNode){
+int Tree::SPRMutate(int cutnum, ReconNode *broke, FLOAT_TYPE optPrecision, int subtreeNode, bool useTopoCache /*=false*/){
 	//if the optPrecision passed in is < 0 it means that we're just trying to 
 	//make the tree structure for some reason, but don't have CLAs allocated
 	//and don't intend to do blen opt
@@ -2665,17 +2764,23 @@ int Tree::SPRMutate(int cutnum, ReconNode *broke, FLOAT_TYPE optPrecision, int s
 	SetBranchLength(connector, max(min_brlen, broken->dlen*ZERO_POINT_FIVE));
 	SetBranchLength(broken, connector->dlen);
 
+	bipartCond = DIRTY;
+	bool knownWorse = false;
 	if(createTopologyOnly == false){
 		SweepDirtynessOverTree(connector, cut);
-		if(broke->reconDist > 1)
-			OptimizeBranchesWithinRadius(connector, optPrecision, subtreeNode, sib);
-		else 
-			OptimizeBranchesWithinRadius(connector, optPrecision, subtreeNode, NULL);
+		if(useTopoCache)
+			knownWorse = ConsultTopologyCache();
+		if(knownWorse == false){
+			if(broke->reconDist > 1)
+				OptimizeBranchesWithinRadius(connector, optPrecision, subtreeNode, sib);
+			else 
+				OptimizeBranchesWithinRadius(connector, optPrecision, subtreeNode, NULL);
+			}
 		}
 	bipartCond = DIRTY;
 
 //#ifdef EXTRA_ROOT_OPT
-	if(createTopologyOnly == false && cut == dummyRoot){
+	if(createTopologyOnly == false && knownWorse == false && cut == dummyRoot){
 		//do some extra optimization when the root branch is moved, since it is a tough move to accept
 		outman.DebugMessageNoCR("root move: %.4f ", lnL);
 		for(int modnum = 0;modnum < modPart->NumModels();modnum++){
@@ -2759,7 +2864,7 @@ void Tree::ReorientSubtreeSPRMutateDummy(int oroot, ReconNode *nroot, FLOAT_TYPE
 #endif
 	}
 
-void Tree::ReorientSubtreeSPRMutate(int oroot, ReconNode *nroot, FLOAT_TYPE optPrecision){
+void Tree::ReorientSubtreeSPRMutate(int oroot, ReconNode *nroot, FLOAT_TYPE optPrecision, bool useTopoCache /*=false*/){
 	//this is used to allow the other half of SPR rearrangements in which
 	//the part of the tree containing the root is considered the subtree
 	//to be attached.  Terminology is VERY confusing here. newRoot is the 
@@ -2840,8 +2945,11 @@ void Tree::ReorientSubtreeSPRMutate(int oroot, ReconNode *nroot, FLOAT_TYPE optP
 		SweepDirtynessOverTree(oldroot);
 		SweepDirtynessOverTree(tempRoot);
 		SweepDirtynessOverTree(prunePoint);
-		if(nroot->reconDist > 1) OptimizeBranchesWithinRadius(oldroot, optPrecision, 0, prunePoint);
-		else OptimizeBranchesWithinRadius(oldroot, optPrecision, 0, NULL);
+		bipartCond = DIRTY;
+		if(useTopoCache == false || ConsultTopologyCache() == false){
+			if(nroot->reconDist > 1) OptimizeBranchesWithinRadius(oldroot, optPrecision, 0, prunePoint);
+			else OptimizeBranchesWithinRadius(oldroot, optPrecision, 0, NULL);
+			}
 		}
 	bipartCond = DIRTY;
 	}
@@ -3803,10 +3911,10 @@ void Tree::GetTotalScore(CondLikeArraySet *partialCLAset, CondLikeArraySet *chil
 	FLOAT_TYPE modlnL;
 	lnL = ZERO_POINT_ZERO;
 
-	//NOTE: for sitelike output the caller should already have set the sitelike mode on the tree and prepared
-	//the sitelike output file (ofprefix + ".sitelikes.log"), adding a header or clearing it out first.  The sitelike
-	//level should generally be negative when partitioned so that each subset appends on to the file.  See how
-	//this is done in PerformSearch.  This function IS responsible for resetting the sitelike level and turning off
+	//NOTE: for sitelike output the caller should already have set the sitelike mode on the tree and started
+	//the sitelike output (Tree::siteLikeOutput), and afterwards end the tree's entry with siteLikeOutput.EndTree.
+	//The sitelike level should generally be negative when partitioned so that each subset appends on to the output.
+	//See how this is done in PerformSearch.  This function IS responsible for resetting the sitelike level and turning off
 	//sitelike output for future scorings.
 
 	for(vector<ClaSpecifier>::iterator specs = claSpecs.begin();specs != claSpecs.end();specs++){
@@ -3843,12 +3951,42 @@ void Tree::GetTotalScore(CondLikeArraySet *partialCLAset, CondLikeArraySet *chil
 
 			ProfScoreTerm.Stop();
 			}
+		if(Profiler::Enabled())
+			Profiler::Count(PROF_BYTES, (unsigned long long) partialCLA->NChar() * partialCLA->NStates() * partialCLA->NRateCats() * sizeof(FLOAT_TYPE) * (childCLA != NULL ? 2 : 1));
 		lnL += modlnL;
 		}
+	if(numPatternSlices > 1){
+		double tot = lnL;
+		SumAcrossSlices(&tot, 1);
+		lnL = tot;
+		}
 	//sitelike output is non-persistent, so clear it out here
 	sitelikeLevel = 0;
 	}
 
+//Every process must call these at the same point, which is the case as long as they all run the same search from
+//the same seed.  The combined values come back identical on every process, so their decisions stay in step.
+void Tree::SumAcrossSlices(double *vals, int num){
+#ifdef SUBROUTINE_GARLI
+	if(numPatternSlices > 1)
+		MPI_Allreduce(MPI_IN_PLACE, vals, num, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+#endif
+	}
+
+void Tree::MaxAcrossSlices(double *vals, int num){
+#ifdef SUBROUTINE_GARLI
+	if(numPatternSlices > 1)
+		MPI_Allreduce(MPI_IN_PLACE, vals, num, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+#endif
+	}
+
+//for decisions that aren't based on the likelihood, like the time limit and user interruption
+bool Tree::AnySlice(bool flag){
+	double any = (flag ? 1.0 : 0.0);
+	MaxAcrossSlices(&any, 1);
+	return any > 0.0;
+	}
+
 //this is more or less a clone of GetTotalScore that fills a cla set with the necessary values to calculate internal state reconstructions
 //and returns the corresponding cla index
 int Tree::FillStatewiseUnscaledPosteriors(CondLikeArraySet *partialCLAset, CondLikeArraySet *childCLAset, TreeNode *child, FLOAT_TYPE blen1){
@@ -3891,6 +4029,7 @@ void Tree::UpdateCLAs(CondLikeArraySet *destCLAset, CondLikeArraySet *firstCLAse
 	FLOAT_TYPE *Rprmat = NULL, *Lprmat = NULL;
 	CondLikeArray *destCLA=NULL, *firstCLA=NULL, *secCLA=NULL;
 
+	numClaUpdates++;
 	for(vector<ClaSpecifier>::iterator specs = claSpecs.begin();specs != claSpecs.end();specs++){
 		Model *mod = modPart->GetModel((*specs).modelIndex);
 		mod->CalcPmats(blen1 * modPart->SubsetRate((*specs).dataIndex), blen2 * modPart->SubsetRate((*specs).dataIndex), Lprmat, Rprmat);
@@ -3972,8 +4111,16 @@ void Tree::UpdateCLAs(CondLikeArraySet *destCLAset, CondLikeArraySet *firstCLAse
 	#endif
 			ProfIntTerm.Stop();
 			}
+		if(Profiler::Enabled()){
+			//the destination is written and each internal child read
+			unsigned long long claBytes = (unsigned long long) destCLA->NChar() * destCLA->NStates() * destCLA->NRateCats() * sizeof(FLOAT_TYPE);
+			Profiler::Count(PROF_CLA_UPDATES);
+			Profiler::Count(PROF_BYTES, claBytes * (1 + (firstCLAset != NULL) + (secCLAset != NULL)));
+			}
 		if(destCLA->rescaleRank >= rescaleEvery){
 			ProfRescale.Start();
+			Profiler::Count(PROF_RESCALES);
+			numRescales++;
 			if(isNucleotide)
 				RescaleRateHet(destCLA, (*specs).dataIndex);
 			else
@@ -3987,6 +4134,7 @@ void Tree::UpdateCLAs(CondLikeArraySet *destCLAset, CondLikeArraySet *firstCLAse
 int Tree::Score(int rootNodeNum /*=0*/){
 
 	TreeNode *rootNode=allNodes[rootNodeNum];
+	numScorings++;
 
 #ifdef EQUIV_CALCS
 	if(dirtyEQ){
@@ -4478,6 +4626,88 @@ void Tree::CalcBipartitions(bool standardize){
 //	root->VerifyBipartition(standardize);
 	}
 	
+//order independent combination of the standardized bipartition hashes of all internal branches
+TopoHash Tree::TopologyHash(){
+	CalcBipartitions(true);
+	TopoHash topo = 0;
+	for(int n = numTipsTotal + 1;n < numNodesTotal;n++){
+		if(allNodes[n]->attached && allNodes[n]->IsInternal() && allNodes[n]->IsNotRoot())
+			topo += TopologyCache::HashBipartition(*allNodes[n]->bipart);
+		}
+	return topo;
+	}
+
+TopoHash Tree::ModelHash() const{
+	vector<FLOAT_TYPE> params;
+	modPart->PackParameters(params);
+	return TopologyCache::HashModelParameters(params);
+	}
+
+//Called just after a topology mutation, before the branches around the rearrangement are optimized.
+//Returns true if the topology is already known to score far enough below the current best that it
+//isn't worth optimizing, in which case the tree is left to simply be rescored.  Otherwise, if the
+//topology has been seen before the best branch lengths found for it are used as a starting point.
+//Scores found under other model parameters say nothing about the current ones, so those entries are
+//only used for their branch lengths, and are replaced once the tree has been rescored.
+bool Tree::ConsultTopologyCache(){
+	const CachedTopology *cached = topologyCache.Find(TopologyHash());
+	if(cached == NULL)
+		return false;
+
+	if(cached->model != ModelHash())
+		topologyCache.stale++;
+	else if(cached->lnL < globalBest - treeRejectionThreshold){
+		topologyCache.skipped++;
+		lnL = -ONE_POINT_ZERO;
+		return true;
+		}
+
+	//the branches attached to the dummy root are tied together, so don't bother
+	if(rootWithDummy)
+		return false;
+
+	bool changed = false;
+	for(int n = 1;n < numNodesTotal;n++){
+		TreeNode *nd = allNodes[n];
+		if(nd->attached == false || nd->IsRoot())
+			continue;
+		FLOAT_TYPE len;
+		if(nd->IsTerminal())
+			len = cached->tipLengths[nd->nodeNum - 1];
+		else if(cached->FindInternalLength(TopologyCache::HashBipartition(*nd->bipart), len) == false)
+			continue;
+		if(!FloatingPointEquals(len, nd->dlen, max(1.0e-8, GARLI_FP_EPS * 2.0))){
+			SetBranchLength(nd, len);
+			SweepDirtynessOverTree(nd);
+			changed = true;
+			}
+		}
+	if(changed)
+		topologyCache.warmStarts++;
+	return false;
+	}
+
+void Tree::AddToTopologyCache(FLOAT_TYPE score){
+	TopoHash model = ModelHash();
+	CachedTopology *entry = topologyCache.EntryToUpdate(TopologyHash(), model, score);
+	if(entry == NULL)
+		return;
+	entry->model = model;
+	entry->lnL = score;
+	entry->tipLengths.resize(numTipsTotal);
+	entry->internalLengths.clear();
+	for(int n = 1;n < numNodesTotal;n++){
+		TreeNode *nd = allNodes[n];
+		if(nd->attached == false || nd->IsRoot())
+			continue;
+		if(nd->IsTerminal())
+			entry->tipLengths[nd->nodeNum - 1] = nd->dlen;
+		else
+			entry->internalLengths.push_back(BipartLength(TopologyCache::HashBipartition(*nd->bipart), nd->dlen));
+		}
+	sort(entry->internalLengths.begin(), entry->internalLengths.end());
+	}
+
 void Tree::OutputBipartitions(){
 	ofstream out("biparts.log", ios::app);
 	root->OutputBipartition(out);
@@ -5184,7 +5414,9 @@ void Tree::RecursivelyCalculateInternalStateProbs(TreeNode *nd, ofstream &out){
 			for(int s=data->NumConditioningPatterns();s<data->GapsIncludedNChar() + data->NumConditioningPatterns();s++){
 				//out << s+1 << "\t";
 				out << data->OrigDataNumber(s) + 1 << "\t";
-				if(data->Number(s) > -1)
+				if(data->Number(s) >= data->NChar())
+					out << "Character not resampled in this bootstrap replicate\n";
+				else if(data->Number(s) > -1)
 					stateProbs[data->Number(s)].Output(out, *states);
 				else 
 					out << "Entirely uninformative character (gaps,N's or ?'s)\n";
@@ -5244,47 +5476,60 @@ void Tree::OutputSiteLikelihoods(int partNum, vector<FLOAT_TYPE> &likes, const i
 	//a negative sitelike level means append, but the absolute value meanings are the same
 	bool append = sitelikeLevel < 0;
 	int effectiveSitelikeLevel = abs(sitelikeLevel);
-	ofstream ordered, packed;
-	string oname = ofprefix + ".sitelikes.log";
-	ordered.open(oname.c_str(), (append == true ? ios::app : ios::out));
+	assert(effectiveSitelikeLevel > 0);
+	assert(likes.size() == data->NChar());;
+
+	//the output normally stays open across trees and subsets, and is started by the caller
+	if(!append)
+		siteLikeOutput.Start(ofprefix, effectiveSitelikeLevel > 1);
+	else if(!siteLikeOutput.IsOpenFor(ofprefix))
+		siteLikeOutput.Resume(ofprefix);
+	ofstream packed;
 	if(effectiveSitelikeLevel > 1){
 		string pname = ofprefix + ".packedSiteLikes.log";
 		packed.open(pname.c_str(), (append == true ? ios::app : ios::out));
 		}
-	assert(effectiveSitelikeLevel > 0);
-	assert(likes.size() == data->NChar());;
-	if(!append){
-		ordered << "Tree\t-lnL\tSite\t-lnL";
-		if(effectiveSitelikeLevel > 1) 
-			ordered << "\tunder1\tunder2";
-		ordered << "\n";
-		}
-	ordered.setf(ios::fixed, ios::floatfield);
-	ordered.precision(8);
 	packed.precision(8);
-	
-	int startPat = (effectiveSitelikeLevel > 1 ? 0 : data->NumConditioningPatterns());
+
+	BufferedOutputFile &ordered = siteLikeOutput.Text();
+	bool text = siteLikeOutput.WritingText();
+	int userStartPat = data->NumConditioningPatterns();
+	int startPat = (effectiveSitelikeLevel > 1 ? 0 : userStartPat);
 
 	for(int site = startPat;site < data->GapsIncludedNChar() + data->NumConditioningPatterns();site++){
 		int col = data->Number(site);
-		int origCol = data->OrigDataNumber(site);
-		if(col == -1){
-			ordered << "\t\t" << origCol + 1 << "\t-";
+		//patterns that weren't resampled may have been compacted out of a bootstrapped matrix
+		bool missing = (col == -1 || col >= data->NChar());
+		if(site >= userStartPat){
+			if(missing)
+				siteLikeOutput.AddMissingSite();
+			else
+				siteLikeOutput.AddSite(likes[col]);
+			}
+		if(!text)
+			continue;
+		ordered.Put("\t\t");
+		ordered.PutInt(data->OrigDataNumber(site) + 1);
+		if(missing){
+			ordered.Put("\t-");
 			if(effectiveSitelikeLevel > 1) 
-				ordered << "\t-\t-";
-			ordered << "\n";
+				ordered.Put("\t-\t-");
 			}
 		else{
-			ordered << "\t\t" << origCol + 1 << "\t" << -likes[col];
+			ordered.Put('\t');
+			ordered.PutFixed(-likes[col], 8);
 			if(effectiveSitelikeLevel > 1){
-				ordered << "\t" << under1[col];
-				if(under2 != NULL)
-					ordered << "\t" << under2[col];
+				ordered.Put('\t');
+				ordered.PutInt(under1[col]);
+				if(under2 != NULL){
+					ordered.Put('\t');
+					ordered.PutInt(under2[col]);
+					}
 				else
-					ordered << "\t-";
+					ordered.Put("\t-");
 				}
-			ordered << "\n";
 			}
+		ordered.Put('\n');
 		}
 	if(effectiveSitelikeLevel > 1){
 		packed << "Partition subset " << partNum + 1 << "\npackedIndex\ttruelnL\tunder1\tunder2" << endl;
@@ -5295,10 +5540,8 @@ void Tree::OutputSiteLikelihoods(int partNum, vector<FLOAT_TYPE> &likes, const i
 			else
 				packed << "\t-" << endl;
 			}
-		}
-	ordered.close();
-	if(packed.is_open())
 		packed.close();
+		}
 	}
 
 void Tree::OutputSiteDerivatives(int partNum, vector<double> &likes, vector<double> &d1s, vector<double> &d2s, const int *under1, const int *under2, ofstream &ordered, ofstream &packed){
@@ -5314,6 +5557,8 @@ void Tree::OutputSiteDerivatives(int partNum, vector<double> &likes, vector<doub
 		int col = data->Number(site);
 		if(col == -1)
 			ordered << site+1 << "\tgap\t-\t-\t-\t-";
+		else if(col >= data->NChar())
+			ordered << site+1 << "\tunsampled\t-\t-\t-\t-" << endl;
 		else{
 			ordered << site+1 << "\t" << (likes.size() > 0 ? likes[col] : 0.0) << "\t" << d1s[col] << "\t" << d2s[col] << "\t" << under1[col];
 			if(under2 != NULL)
@@ -6882,6 +7127,51 @@ void Tree::ReadBinaryFormattedTree(FILE *in){
 		}
 	}
 
+//fills the topology and branch lengths of packed, which can then be rebuilt by UnpackTopology on another tree
+//for the same taxa.  Child order isn't kept, which doesn't matter for an unrooted tree.
+void Tree::PackTopology(PackedIndividual &packed) const{
+	assert(root == allNodes[0]);
+	packed.anc.resize(numNodesTotal);
+	packed.lengths.resize(numNodesTotal);
+	for(int i=0;i<numNodesTotal;i++){
+		assert(allNodes[i]->nodeNum == i);
+		packed.anc[i] = (allNodes[i]->anc == NULL ? -1 : allNodes[i]->anc->nodeNum);
+		packed.lengths[i] = allNodes[i]->dlen;
+		}
+	packed.lnL = lnL;
+	}
+
+//relinks the nodes to match packed.  As with ReadBinaryFormattedTree, clas need to be assigned afterwards.
+void Tree::UnpackTopology(const PackedIndividual &packed){
+	if(packed.NumNodes() != numNodesTotal)
+		throw ErrorException("Number of nodes in exchanged tree (%d) doesn't match this tree (%d)!", packed.NumNodes(), numNodesTotal);
+	for(int i=0;i<numNodesTotal;i++){
+		TreeNode *nd = allNodes[i];
+		nd->left = nd->right = nd->next = nd->prev = NULL;
+		nd->anc = (packed.anc[i] < 0 ? NULL : allNodes[packed.anc[i]]);
+		nd->attached = true;
+		nd->dlen = packed.lengths[i];
+		}
+	//descendants are attached in node number order
+	for(int i=1;i<numNodesTotal;i++){
+		TreeNode *nd = allNodes[i];
+		TreeNode *a = nd->anc;
+		assert(a != NULL);
+		if(a->left == NULL)
+			a->left = nd;
+		else{
+			a->right->next = nd;
+			nd->prev = a->right;
+			}
+		a->right = nd;
+		}
+	root = allNodes[0];
+	numTipsAdded = numTipsTotal;
+	numNodesAdded = numNodesTotal;
+	numBranchesAdded = numNodesTotal - 1;
+	lnL = packed.lnL;
+	}
+
 FLOAT_TYPE Tree::OptimizeInsertDeleteRates(FLOAT_TYPE prec, int modnum){
 	FLOAT_TYPE improve = 0.0;
 	FLOAT_TYPE insProp, del;
@@ -7182,7 +7472,7 @@ FLOAT_TYPE Tree::OptimizeRelativeNucRates(FLOAT_TYPE prec, int modnum){
 		ofstream modlog("models.log", ios::app);
 		modlog << lnL << "\t" << modstr.c_str() << "\t";
 
-		char treeString[5000];
+		string treeString;
 		modlog.setf( ios::floatfield, ios::fixed );
 		modlog.setf( ios::showpoint );
 		root->MakeNewick(treeString, false, true);
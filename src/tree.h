@@ -33,6 +33,9 @@ using namespace std;
 #include "model.h"
 #include "sequencedata.h"
 #include "reconnode.h"
+#include "topologycache.h"
+#include "bufferedoutput.h"
+#include "treeexchange.h"
 
 
 #undef BRENT
@@ -47,6 +50,19 @@ extern rng rnd;
 
 #define RESCALE_ARRAY_LENGTH 90
 
+//A single free model parameter as handled by Tree::OptimizeModelParametersJointly.  Everything but pinv is
+//optimized on a log scale, and the bounds are on that scale.  State frequencies and subset rates are sum
+//constrained, so they are set as a group and then renormalized.
+class JointModelParam{
+public:
+	enum{ALPHA, PINV, RELRATE, FREQ, SUBSETRATE};
+	int type;
+	int modnum;
+	int which;
+	FLOAT_TYPE low, high;
+	JointModelParam(int t, int m, int w, FLOAT_TYPE l, FLOAT_TYPE h) : type(t), modnum(m), which(w), low(l), high(h){}
+	};
+
 class Tree{
 	protected:
 		int numTipsTotal;
@@ -78,7 +94,13 @@ class Tree{
 		static const DataPartition *dataPart;
 		static FLOAT_TYPE treeRejectionThreshold;
 		static vector<Constraint> constraints;
+		//when non-zero, topology mutations are confined to the clade below this node (see SetSearchSubtree)
+		static int searchSubtreeRoot;
+		static vector<int> searchSubtreeNodes;
+		static vector<bool> inSearchSubtree;
 		static AttemptedSwapList attemptedSwaps;
+		static TopologyCache topologyCache;
+		static SiteLikelihoodOutput siteLikeOutput;
 		static FLOAT_TYPE uniqueSwapBias;
 		static FLOAT_TYPE distanceSwapBias;
 		static unsigned rescaleEvery;
@@ -88,6 +110,7 @@ class Tree{
 		static list<TreeNode *> nodeOptVector;
 		
 		static bool useOptBoundedForBlen;
+		static bool concurrentBranchOpt;
 		static bool rootWithDummy;
 		static bool dummyRootBranchMidpoint;
 		static bool someOrientedGap;
@@ -103,6 +126,17 @@ class Tree{
 		static Bipartition *outgroup;
 
 		static int siteToScore;
+		static unsigned long numScorings;
+		static unsigned long long numClaUpdates;//calls to UpdateCLAs, one per node and direction recalculated
+		static unsigned long long numRescales;
+
+		//when the data patterns are split across MPI processes (mpitrick.cpp) each one only computes its part of
+		//every likelihood and derivative sum, and the parts must be totalled before they are used
+		static int numPatternSlices;
+		static int patternSlice;
+		static void SumAcrossSlices(double *vals, int num);
+		static void MaxAcrossSlices(double *vals, int num);
+		static bool AnySlice(bool flag);
 
 		int calcs;
 
@@ -157,6 +191,8 @@ class Tree{
 		void SwapAndFreeNodes(TreeNode *cop);
 		void OutputBinaryFormattedTree(OUTPUT_CLASS &) const;
 		void ReadBinaryFormattedTree(FILE *);
+		void PackTopology(PackedIndividual &packed) const;
+		void UnpackTopology(const PackedIndividual &packed);
 
 		//functions for copying trees
 		void MimicTopologyButNotInternNodeNums(TreeNode *copySource,TreeNode *replicate,int &placeInAllNodes);
@@ -167,6 +203,10 @@ class Tree{
 
 		// mutation functions
 		int TopologyMutator(FLOAT_TYPE optPrecision, int range, int subtreeNode);
+		void GetCladeMembers(int node, vector<int> &members) const;
+		void ChooseSearchSubtrees(int num, int minTaxa, vector<int> &roots) const;
+		void SetSearchSubtree(int node) const;
+		static void ClearSearchSubtree();
 		void DeterministicSwapperByDist(Individual *source, double optPrecision, int range, bool furthestFirst);
 		void DeterministicSwapperByCut(Individual *source, double optPrecision, int range, bool furthestFirst);
 		void DeterministicSwapperRandom(Individual *source, double optPrecision, int range);
@@ -176,9 +216,9 @@ class Tree{
 		void FillAllSwapsList(ReconList *cuts, int reconLim);
 		unsigned FillWeightsForAllSwaps(ReconList *cuts, double *);
 		bool AssignWeightsToSwaps(TreeNode *cut);
-		int SPRMutate(int cutnum, ReconNode *broke, FLOAT_TYPE optPrecision, int subtreeNode);
+		int SPRMutate(int cutnum, ReconNode *broke, FLOAT_TYPE optPrecision, int subtreeNode, bool useTopoCache=false);
 		int SPRMutateDummy(int cutnum, ReconNode *broke, FLOAT_TYPE optPrecision, int subtreeNode);
-		void ReorientSubtreeSPRMutate(int oldRoot, ReconNode *newRoot, FLOAT_TYPE optPrecision);
+		void ReorientSubtreeSPRMutate(int oldRoot, ReconNode *newRoot, FLOAT_TYPE optPrecision, bool useTopoCache=false);
 		void ReorientSubtreeSPRMutateDummy(int oldRoot, ReconNode *newRoot, FLOAT_TYPE optPrecision);
 		int BrlenMutate();
 		int BrlenMutateSubset(const vector<int> &subtreeList);
@@ -216,6 +256,10 @@ class Tree{
 		TreeNode *ContainsBipartitionOrComplement(const Bipartition &bip);
 		TreeNode *ContainsMaskedBipartitionOrComplement(const Bipartition &bip, const Bipartition &mask);
 		void AdjustBipartsForSwap(int cut, int broken);
+		TopoHash TopologyHash();
+		TopoHash ModelHash() const;
+		bool ConsultTopologyCache();
+		void AddToTopologyCache(FLOAT_TYPE score);
 
 		// functions for computing likelihood
 		bool ConditionalLikelihood(int direction, TreeNode* nd);	
@@ -231,15 +275,18 @@ class Tree{
 		//functions to optimize blens and params
 		pair<FLOAT_TYPE, FLOAT_TYPE> CalcDerivativesRateHet(TreeNode *nd1, TreeNode *nd2);
 		FLOAT_TYPE NewtonRaphsonOptimizeBranchLength(FLOAT_TYPE precision1, TreeNode *nd, bool goodGuess);
+		pair<FLOAT_TYPE, FLOAT_TYPE> CalcDerivativesFromClas(TreeNode *nd, FLOAT_TYPE len, CondLikeArraySet *setOne, CondLikeArraySet *setTwo, ModelPartition *pmatMods);
+		FLOAT_TYPE ConcurrentNewtonRaphsonBranchLength(FLOAT_TYPE precision, TreeNode *nd, CondLikeArraySet *setOne, CondLikeArraySet *setTwo, ModelPartition *pmatMods);
 #ifdef OPT_DEBUG
 		FLOAT_TYPE NewtonRaphsonSpoof(FLOAT_TYPE precision1, TreeNode *nd, bool goodGuess);
 #endif
-		void GetDerivsPartialTerminal(const CondLikeArray *partialCLA, const FLOAT_TYPE *prmat, const FLOAT_TYPE *d1mat, const FLOAT_TYPE *d2mat, const char *Ldata, FLOAT_TYPE &d1Tot, FLOAT_TYPE &d2Tot, int modIndex, int dataIndex, const unsigned *ambigMap =NULL);
-		void GetDerivsPartialTerminalNState(const CondLikeArray *partialCLA, const FLOAT_TYPE *prmat, const FLOAT_TYPE *d1mat, const FLOAT_TYPE *d2mat, const char *Ldata, FLOAT_TYPE &d1Tot, FLOAT_TYPE &d2Tot, int modIndex, int dataIndex);
-		void GetDerivsPartialTerminalNStateRateHet(const CondLikeArray *partialCLA, const FLOAT_TYPE *prmat, const FLOAT_TYPE *d1mat, const FLOAT_TYPE *d2mat, const char *Ldata, FLOAT_TYPE &d1Tot, FLOAT_TYPE &d2Tot, int modIndex, int dataIndex);
-		void GetDerivsPartialInternal(const CondLikeArray *partialCLA, const CondLikeArray *childCLA, const FLOAT_TYPE *prmat, const FLOAT_TYPE *d1mat, const FLOAT_TYPE *d2mat, FLOAT_TYPE &d1, FLOAT_TYPE &d2, int modIndex, int dataIndex);
-		void GetDerivsPartialInternalNState(const CondLikeArray *partialCLA, const CondLikeArray *childCLA, const FLOAT_TYPE *prmat, const FLOAT_TYPE *d1mat, const FLOAT_TYPE *d2mat, FLOAT_TYPE &d1, FLOAT_TYPE &d2, int modIndex, int dataIndex);
-		void GetDerivsPartialInternalNStateRateHet(const CondLikeArray *partialCLA, const CondLikeArray *childCLA, const FLOAT_TYPE *prmat, const FLOAT_TYPE *d1mat, const FLOAT_TYPE *d2mat, FLOAT_TYPE &d1Tot, FLOAT_TYPE &d2Tot, int modIndex, int dataIndex);
+		//if lnLDest is passed the site likelihoods are summed into it rather than into the tree's lnL
+		void GetDerivsPartialTerminal(const CondLikeArray *partialCLA, const FLOAT_TYPE *prmat, const FLOAT_TYPE *d1mat, const FLOAT_TYPE *d2mat, const char *Ldata, FLOAT_TYPE &d1Tot, FLOAT_TYPE &d2Tot, int modIndex, int dataIndex, const unsigned *ambigMap =NULL, FLOAT_TYPE *lnLDest=NULL);
+		void GetDerivsPartialTerminalNState(const CondLikeArray *partialCLA, const FLOAT_TYPE *prmat, const FLOAT_TYPE *d1mat, const FLOAT_TYPE *d2mat, const char *Ldata, FLOAT_TYPE &d1Tot, FLOAT_TYPE &d2Tot, int modIndex, int dataIndex, FLOAT_TYPE *lnLDest=NULL);
+		void GetDerivsPartialTerminalNStateRateHet(const CondLikeArray *partialCLA, const FLOAT_TYPE *prmat, const FLOAT_TYPE *d1mat, const FLOAT_TYPE *d2mat, const char *Ldata, FLOAT_TYPE &d1Tot, FLOAT_TYPE &d2Tot, int modIndex, int dataIndex, FLOAT_TYPE *lnLDest=NULL);
+		void GetDerivsPartialInternal(const CondLikeArray *partialCLA, const CondLikeArray *childCLA, const FLOAT_TYPE *prmat, const FLOAT_TYPE *d1mat, const FLOAT_TYPE *d2mat, FLOAT_TYPE &d1, FLOAT_TYPE &d2, int modIndex, int dataIndex, FLOAT_TYPE *lnLDest=NULL);
+		void GetDerivsPartialInternalNState(const CondLikeArray *partialCLA, const CondLikeArray *childCLA, const FLOAT_TYPE *prmat, const FLOAT_TYPE *d1mat, const FLOAT_TYPE *d2mat, FLOAT_TYPE &d1, FLOAT_TYPE &d2, int modIndex, int dataIndex, FLOAT_TYPE *lnLDest=NULL);
+		void GetDerivsPartialInternalNStateRateHet(const CondLikeArray *partialCLA, const CondLikeArray *childCLA, const FLOAT_TYPE *prmat, const FLOAT_TYPE *d1mat, const FLOAT_TYPE *d2mat, FLOAT_TYPE &d1Tot, FLOAT_TYPE &d2Tot, int modIndex, int dataIndex, FLOAT_TYPE *lnLDest=NULL);
 		void GetDerivsPartialInternalEQUIV(const CondLikeArray *partialCLA, const CondLikeArray *childCLA, const FLOAT_TYPE *prmat, const FLOAT_TYPE *d1mat, const FLOAT_TYPE *d2mat, FLOAT_TYPE &d1, FLOAT_TYPE &d2, char *equiv, int modIndex, int dataIndex);
 		void CalcFullCLAInternalInternal(CondLikeArray *destCLA, const CondLikeArray *LCLA, const CondLikeArray *RCLA, const FLOAT_TYPE *Lpr, const FLOAT_TYPE *Rpr, int modIndex, int dataIndex);
 		void CalcFullCLATerminalTerminal(CondLikeArray *destCLA, const FLOAT_TYPE *Lpr, const FLOAT_TYPE *Rpr, const char *Ldata, const char *Rdata, int modIndex, int dataIndex);
@@ -272,6 +319,15 @@ class Tree{
 
 		FLOAT_TYPE OptimizeBranchLength(FLOAT_TYPE optPrecision, TreeNode *nd, bool goodGuess);
 		FLOAT_TYPE OptimizeAllBranches(FLOAT_TYPE optPrecision);
+		FLOAT_TYPE OptimizeAllBranchesFullTree(FLOAT_TYPE optPrecision);
+		bool CanOptimizeBranchesConcurrently() const;
+		bool ConcurrentBranchOptimizationPass(FLOAT_TYPE optPrecision, FLOAT_TYPE &improve);
+		void CalcBranchLengthGradient(vector<FLOAT_TYPE> &grad);
+		FLOAT_TYPE GradientOptimizeAllBranches(FLOAT_TYPE optPrecision);
+		static void JointModelParameterCoverage(const ModelSpecification *modSpec, bool &alpha, bool &pinv, bool &freqs, bool &relRates);
+		FLOAT_TYPE ScoreJointModelParameters(const vector<JointModelParam> &params, const vector<FLOAT_TYPE> &x);
+		void JointModelParameterGradient(const vector<JointModelParam> &params, const vector<FLOAT_TYPE> &x, FLOAT_TYPE f, vector<FLOAT_TYPE> &g);
+		FLOAT_TYPE OptimizeModelParametersJointly(FLOAT_TYPE optPrecision, int &numEvals);
 		int PushBranchlengthsToMin();
 		void OptimizeBranchesAroundNode(TreeNode *nd, FLOAT_TYPE optPrecision, int subtreeNode);
 		void OptimizeBranchesWithinRadius(TreeNode *nd, FLOAT_TYPE optPrecision, int subtreeNode, TreeNode *prune);
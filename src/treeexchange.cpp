@@ -0,0 +1,229 @@
+// GARLI version 2.0 source code
+// Copyright 2005-2011 Derrick J. Zwickl
+// email: garli.support@gmail.com
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <string.h>
+#include <cassert>
+#ifdef UNIX
+#include <sys/mman.h>
+#endif
+
+using namespace std;
+
+#include "defs.h"
+#include "treeexchange.h"
+#include "errorexception.h"
+
+//message layout:
+//int32 kind, int32 number of nodes, int32 number of model parameters, float64 lnL, float64 model parameters, then
+//	full: int32 ancestor and float64 branch length of each node
+//	delta: int32 number of changed ancestors, {int32 node, int32 ancestor} for each, 
+//		   int32 number of changed branch lengths, {int32 node, float64 length} for each
+enum{
+	PACKED_FULL = 1,
+	PACKED_DELTA = 2
+	};
+
+static void AppendBytes(vector<char> &buf, const void *val, size_t size){
+	const char *c = (const char *) val;
+	buf.insert(buf.end(), c, c + size);
+	}
+
+static void AppendInt(vector<char> &buf, int val){
+	AppendBytes(buf, &val, sizeof(int));
+	}
+
+static void AppendDouble(vector<char> &buf, double val){
+	AppendBytes(buf, &val, sizeof(double));
+	}
+
+//reads fixed size values from a message, checking that it is long enough
+class PackedReader{
+	const char *pos;
+	const char *end;
+public:
+	PackedReader(const char *buf, int size) : pos(buf), end(buf + size){}
+	void Get(void *val, size_t size){
+		if(pos + size > end)
+			throw ErrorException("Truncated individual received in exchange between populations.");
+		memcpy(val, pos, size);
+		pos += size;
+		}
+	int GetInt(){
+		int val;
+		Get(&val, sizeof(int));
+		return val;
+		}
+	double GetDouble(){
+		double val;
+		Get(&val, sizeof(double));
+		return val;
+		}
+	const char *Pos() const {return pos;}
+	};
+
+static void SerializeHeader(const PackedIndividual &ind, int kind, vector<char> &buf){
+	AppendInt(buf, kind);
+	AppendInt(buf, ind.NumNodes());
+	AppendInt(buf, (int) ind.modelParams.size());
+	AppendDouble(buf, ind.lnL);
+	for(unsigned i = 0;i < ind.modelParams.size();i++)
+		AppendDouble(buf, ind.modelParams[i]);
+	}
+
+void PackedIndividual::Serialize(vector<char> &buf) const{
+	buf.reserve(buf.size() + 3 * sizeof(int) + sizeof(double) * (1 + modelParams.size()) + (sizeof(int) + sizeof(double)) * anc.size());
+	SerializeHeader(*this, PACKED_FULL, buf);
+	if(anc.size() > 0){
+		AppendBytes(buf, &anc[0], sizeof(int) * anc.size());
+		AppendBytes(buf, &lengths[0], sizeof(double) * lengths.size());
+		}
+	}
+
+void PackedIndividual::SerializeDelta(const PackedIndividual &base, vector<char> &buf) const{
+	if(!SameShape(base)){
+		Serialize(buf);
+		return;
+		}
+	SerializeHeader(*this, PACKED_DELTA, buf);
+	vector<int> changed;
+	for(int n = 0;n < NumNodes();n++)
+		if(anc[n] != base.anc[n])
+			changed.push_back(n);
+	AppendInt(buf, (int) changed.size());
+	for(unsigned i = 0;i < changed.size();i++){
+		AppendInt(buf, changed[i]);
+		AppendInt(buf, anc[changed[i]]);
+		}
+	changed.clear();
+	for(int n = 0;n < NumNodes();n++)
+		if(lengths[n] != base.lengths[n])
+			changed.push_back(n);
+	AppendInt(buf, (int) changed.size());
+	for(unsigned i = 0;i < changed.size();i++){
+		AppendInt(buf, changed[i]);
+		AppendDouble(buf, lengths[changed[i]]);
+		}
+	}
+
+int PackedIndividual::Deserialize(const char *buf, int size){
+	PackedReader in(buf, size);
+	int kind = in.GetInt();
+	int numNodes = in.GetInt();
+	int numParams = in.GetInt();
+	if((kind != PACKED_FULL && kind != PACKED_DELTA) || numNodes < 0 || numParams < 0)
+		throw ErrorException("Unrecognized individual received in exchange between populations.");
+	if(kind == PACKED_DELTA && (numNodes != NumNodes() || numParams != (int) modelParams.size()))
+		throw ErrorException("Individual received as a delta against a different tree than expected.");
+
+	lnL = in.GetDouble();
+	modelParams.resize(numParams);
+	for(int i = 0;i < numParams;i++)
+		modelParams[i] = (FLOAT_TYPE) in.GetDouble();
+
+	if(kind == PACKED_FULL){
+		anc.resize(numNodes);
+		lengths.resize(numNodes);
+		if(numNodes > 0){
+			in.Get(&anc[0], sizeof(int) * numNodes);
+			in.Get(&lengths[0], sizeof(double) * numNodes);
+			}
+		}
+	else{
+		int num = in.GetInt();
+		for(int i = 0;i < num;i++){
+			int n = in.GetInt();
+			int a = in.GetInt();
+			if(n < 0 || n >= numNodes || a < -1 || a >= numNodes)
+				throw ErrorException("Bad node number in individual received in exchange between populations.");
+			anc[n] = a;
+			}
+		num = in.GetInt();
+		for(int i = 0;i < num;i++){
+			int n = in.GetInt();
+			if(n < 0 || n >= numNodes)
+				throw ErrorException("Bad node number in individual received in exchange between populations.");
+			lengths[n] = in.GetDouble();
+			}
+		}
+	return (int) (in.Pos() - buf);
+	}
+
+void MigrationBuffer::Allocate(int slots, int maxSize){
+	Release();
+	//keep each slot's header aligned
+	slotBytes = sizeof(SlotHeader) + maxSize;
+	slotBytes += (sizeof(double) - slotBytes % sizeof(double)) % sizeof(double);
+#ifdef UNIX
+	void *shared = mmap(NULL, slotBytes * slots, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANON, -1, 0);
+	if(shared == MAP_FAILED)
+		throw ErrorException("Could not allocate %.2f MB of shared memory for island migration.", (slotBytes * slots) / (1024.0 * 1024.0));
+	//anonymous mappings start zeroed, so every slot starts empty at version 0
+	mem = (char *) shared;
+	capacity = maxSize;
+	numSlots = slots;
+	lastSeen.assign(slots, 0);
+#else
+	throw ErrorException("Sorry, numislands > 1 is only supported by the Unix version of GARLI.");
+#endif
+	}
+
+void MigrationBuffer::Release(){
+#ifdef UNIX
+	if(mem != NULL)
+		munmap(mem, slotBytes * numSlots);
+#endif
+	mem = NULL;
+	numSlots = 0;
+	lastSeen.clear();
+	}
+
+void MigrationBuffer::Publish(int slot, const PackedIndividual &ind, bool finished){
+	assert(mem != NULL && slot < numSlots);
+	vector<char> buf;
+	ind.Serialize(buf);
+	if((int) buf.size() > capacity)
+		throw ErrorException("Individual too large for its island migration slot (%d bytes, %d available).", (int) buf.size(), capacity);
+
+	SlotHeader *head = Header(slot);
+	head->version++;
+	__sync_synchronize();
+	memcpy(Data(slot), &buf[0], buf.size());
+	head->size = (int) buf.size();
+	head->finished = finished;
+	__sync_synchronize();
+	head->version++;
+	}
+
+bool MigrationBuffer::Read(int slot, PackedIndividual &ind, bool onlyNew){
+	assert(mem != NULL && slot < numSlots);
+	SlotHeader *head = Header(slot);
+	unsigned version = head->version;
+	__sync_synchronize();
+	if(version == 0 || (version & 1) || (onlyNew && version == lastSeen[slot]))
+		return false;
+	int size = head->size;
+	if(size <= 0 || size > capacity)
+		return false;
+	vector<char> buf(Data(slot), Data(slot) + size);
+	__sync_synchronize();
+	if(head->version != version)
+		return false;
+	lastSeen[slot] = version;
+	ind.Deserialize(&buf[0], size);
+	return true;
+	}
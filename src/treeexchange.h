@@ -0,0 +1,98 @@
+// GARLI version 2.0 source code
+// Copyright 2005-2011 Derrick J. Zwickl
+// email: garli.support@gmail.com
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef TREEEXCHANGE_H
+#define TREEEXCHANGE_H
+
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+#include "defs.h"
+
+//Compact binary form of an individual (tree and model parameters) for passing between populations or
+//processes, so that trees don't need to be written as Newick strings and reparsed on the other end.  The
+//topology is the ancestor of each node by node number (-1 for the root), with branch lengths and model
+//parameters as float64.  Node numbers stay the same as a tree is mutated, so successive trees from the same
+//source can be sent as a delta against the last one that the receiver has.
+//Values are in native byte order, so this is for exchanges between copies of the same executable.
+class PackedIndividual{
+public:
+	vector<int> anc;
+	vector<double> lengths;
+	vector<FLOAT_TYPE> modelParams;
+	double lnL;
+	
+	PackedIndividual() : lnL(0.0){}
+	int NumNodes() const {return (int) anc.size();}
+	bool SameShape(const PackedIndividual &other) const{
+		return anc.size() == other.anc.size() && modelParams.size() == other.modelParams.size();
+		}
+
+	void Swap(PackedIndividual &other){
+		anc.swap(other.anc);
+		lengths.swap(other.lengths);
+		modelParams.swap(other.modelParams);
+		std::swap(lnL, other.lnL);
+		}
+
+	//appends the full encoding to buf
+	void Serialize(vector<char> &buf) const;
+	//appends only what differs from base, which the receiver must also hold
+	void SerializeDelta(const PackedIndividual &base, vector<char> &buf) const;
+	//reads either encoding, returning the number of bytes used.  For a delta this must already hold the same 
+	//base that the sender used
+	int Deserialize(const char *buf, int size);
+	};
+
+//Memory shared between the processes of an island model search (numislands > 1), with a fixed size slot for
+//each island holding the full encoding of that island's latest best individual.  Each slot has only one writer.
+//Its version count is odd while it is being rewritten, which lets readers skip slots that haven't changed since
+//they last looked and discard copies that were torn by a concurrent write.
+class MigrationBuffer{
+	struct SlotHeader{
+		volatile unsigned version;
+		volatile int finished;
+		int size;
+		};
+	char *mem;
+	size_t slotBytes;
+	int capacity;
+	int numSlots;
+	vector<unsigned> lastSeen;
+
+	SlotHeader *Header(int slot) const {return (SlotHeader *) (mem + slot * slotBytes);}
+	char *Data(int slot) const {return mem + slot * slotBytes + sizeof(SlotHeader);}
+
+public:
+	MigrationBuffer() : mem(NULL), slotBytes(0), capacity(0), numSlots(0){}
+	~MigrationBuffer(){Release();}
+
+	//this must be called before the island processes are forked, so that they all map the same memory
+	void Allocate(int slots, int maxSize);
+	void Release();
+	int NumSlots() const {return numSlots;}
+
+	void Publish(int slot, const PackedIndividual &ind, bool finished);
+	//returns false if the slot is empty, is mid-write or (if onlyNew) hasn't changed since this process last read it
+	bool Read(int slot, PackedIndividual &ind, bool onlyNew);
+	bool Finished(int slot) const {return Header(slot)->finished != 0;}
+	};
+
+#endif
@@ -30,6 +30,7 @@ using namespace std;
 #include "errorexception.h"
 #include "outputman.h"
 #include "sequencedata.h"
+#include "bufferedoutput.h"
 
 extern OutputManager outman;
 
@@ -116,114 +117,60 @@ void TreeNode::MoveDesToAnc(TreeNode *d){
 	d->AddDes(this);
 	}
 
-char *TreeNode::MakeNewick(char *s, bool internalNodes, bool branchLengths, bool highPrec /*=false*/) const{
-
-	if(left){
-		if(internalNodes==true && nodeNum!=0){
-			sprintf(s, "%d", nodeNum);
-			while(*s)s++;
-			}
-		*s++='(';
-		s=left->MakeNewick(s, internalNodes, branchLengths, highPrec);
-		if(anc){
-			if(branchLengths==true){
-				*s++=':';
-				if(highPrec == false)
-					sprintf(s, "%.8lf", dlen);
-				else sprintf(s, "%.10lf", dlen);
-				while(*s)s++;
-				}
-			}
-		else
-			{*s='\0';
-			return s;
-			}
-		}
-	else {
-		sprintf(s, "%d", nodeNum);
-		while(*s)s++;
-		if(branchLengths==true){
-			*s++=':';
-			if(highPrec == false)
-				sprintf(s, "%.8lf", dlen);
-			else sprintf(s, "%.10lf", dlen);
-			while(*s)s++;
-			}
-		}
-		
-	if(next){
-		*s++=',';
-		s=next->MakeNewick(s, internalNodes, branchLengths, highPrec);
-		}
-	else {
-		if(anc){
-			*s++=')';
-			}
-		}
-	return s;
+//replaces the contents of s with the description of the tree below this node, with taxon numbers
+void TreeNode::MakeNewick(string &s, bool internalNodes, bool branchLengths, bool highPrec /*=false*/) const{
+	s.clear();
+	MakeNewick(s, NULL, internalNodes, branchLengths, false, highPrec);
 	}
 
+//Appends the description of the subtree below this node, then those of any later siblings and the closing paren
+//of their ancestor.  Called on the root this is the whole tree, without a terminating semicolon.  This walks
+//the tree with a loop rather than recursion, so that very deep trees can't overflow the stack.
 void TreeNode::MakeNewick(string &outStr, const DataPartition *data, bool internalNodes, bool branchLengths, bool taxonNames /*=false*/, bool highPrec /*=false*/) const{
-	char s[500];
-	if(left){
-		if(internalNodes==true && nodeNum!=0){
-			sprintf(s, "%d", nodeNum);
-			outStr += s;
+	char num[64];
+	int prec = (highPrec ? 10 : 8);
+	const TreeNode *stop = anc;
+	const TreeNode *nd = this;
+	while(true){
+		//open internal nodes down to the leftmost tip
+		while(nd->left){
+			if(internalNodes == true && nd->nodeNum != 0)
+				outStr.append(num, FormatInt(num, nd->nodeNum));
+			outStr += '(';
+			nd = nd->left;
 			}
-		outStr += '(';
-		left->MakeNewick(outStr, data, internalNodes, branchLengths, taxonNames, highPrec);
-		if(anc){
-			if(branchLengths==true){
-				outStr += ':';
-				if(highPrec == false){
-					sprintf(s, "%.8lf", dlen);
-					outStr += s;
-					}
-				else{
-					sprintf(s, "%.10lf", dlen);
-					outStr += s;
-					}
-				}
-			}
-		else
-			return;
-		}
-	else {
-		//sprintf(s, "%d", nodeNum);
-		//outStr += s;
 		if(taxonNames && data)
-			outStr += data->TaxonLabel(nodeNum - 1);
-		else{
-			sprintf(s, "%d", nodeNum);
-			outStr += s;
-			}
-		if(branchLengths==true){
+			outStr += data->TaxonLabel(nd->nodeNum - 1);
+		else
+			outStr.append(num, FormatInt(num, nd->nodeNum));
+		if(branchLengths == true){
 			outStr += ':';
-			if(highPrec == false)
-				sprintf(s, "%.8lf", dlen);
-			else 
-				sprintf(s, "%.10lf", dlen);
-			outStr += s;
+			outStr.append(num, FormatFixed(num, nd->dlen, prec));
 			}
-		}
-		
-	if(next){
-		outStr += ',';
-		next->MakeNewick(outStr, data, internalNodes, branchLengths, taxonNames, highPrec);
-		}
-	else {
-		if(anc){
+		//close completed subtrees until reaching one with a sibling still to do
+		while(nd->next == NULL){
+			if(nd->anc == NULL)
+				return;
 			outStr += ')';
+			nd = nd->anc;
+			if(nd == stop || nd->anc == NULL)
+				return;
+			if(branchLengths == true){
+				outStr += ':';
+				outStr.append(num, FormatFixed(num, nd->dlen, prec));
+				}
 			}
+		outStr += ',';
+		nd = nd->next;
 		}
 	}
 
-void TreeNode::MakeNewickForSubtree(char *s) const{
+//replaces the contents of s
+void TreeNode::MakeNewickForSubtree(string &s) const{
 	assert(left);
-	*s++='(';
-	s=left->MakeNewick(s, false, false);
-	*s++=';';
-	*s++='\0';
+	s = "(";
+	left->MakeNewick(s, NULL, false, false, false);
+	s += ';';
 	}
 
 void TreeNode::MakeNewickForSubtree(string &s, const DataPartition *data, bool internalNodes, bool branchLengths, bool taxonNames, bool highPrec) const{
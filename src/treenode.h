@@ -75,9 +75,9 @@ class TreeNode{
 		void RecursivelyAddOrRemoveSubtreeFromBipartitions(const Bipartition &subtree);
 		void CollapseMinLengthBranches(int &);
 		//misc functions
-		char *MakeNewick(char *s, bool internalNodes, bool branchLengths, bool highPrec=false) const;
+		void MakeNewick(string &s, bool internalNodes, bool branchLengths, bool highPrec=false) const;
 		void MakeNewick(string &outStr, const DataPartition *data, bool internalNodes, bool branchLengths, bool taxonNames = false, bool highPrec = false) const;
-		void MakeNewickForSubtree(char *s) const;
+		void MakeNewickForSubtree(string &s) const;
 		void MakeNewickForSubtree(string &s, const DataPartition *data, bool internalNodes, bool branchLengths, bool taxonNames = false, bool highPrec = false) const;
 		bool IsGood();
 		bool IsTerminal() const{
@@ -0,0 +1,101 @@
+#!/bin/bash
+
+if [ $# -lt 3 ];
+then
+	echo Usage: pass three, or \(optionally\) more arguments:
+	echo        '$0 <path to tests directory with data subdirectory> <path of GARLI binary> <path of garli-bench binary> [optional: GARLI command-line arguments]'
+	exit 1
+fi
+
+TESTS_DIR=$1
+GARLI_BIN=$2
+BENCH_BIN=$3
+
+if [ $# -gt 3 ]
+then
+	shift; shift; shift;
+	GARLI_ARGS=$@
+fi
+
+#generations run on each of the simulated datasets
+SYNTH_GENS=200
+
+#name, then garli-bench options, for each simulated dataset.  All use a fixed seed so that
+#every run does the same work, and only differ from the kernel benchmark in running a full search
+SYNTH_SETS=(
+	"synth.dna.64x20K" "--taxa 64 --sites 20000 --datatype dna --ratecats 4 --seed 1"
+	"synth.dna.128x5K.part4" "--taxa 128 --sites 5000 --datatype dna --ratecats 4 --partitions 4 --seed 2"
+	"synth.aa.32x2K" "--taxa 32 --sites 2000 --datatype aa --ratecats 4 --seed 3"
+	)
+
+RESULTS=bench.results.json
+
+rm -f bench.* synth.*
+
+echo "Linking to data ...."
+if [ -d data ];then
+	echo "data folder already exists"
+else
+	ln -sf $TESTS_DIR/data || exit 1
+fi
+
+echo "**************************"
+echo "Running fixed dataset benchmarks ..."
+echo "**************************"
+
+for i in $TESTS_DIR/bench/*.conf
+do
+	echo "Running benchmark $i"
+	echo "Running benchmark $i" >&2
+	$GARLI_BIN $i $GARLI_ARGS
+	if [ ! $? -eq 0 ];then
+		exit 1
+	fi
+done
+
+echo "**************************"
+echo "Running simulated dataset benchmarks ..."
+echo "**************************"
+
+s=0
+while [ $s -lt ${#SYNTH_SETS[@]} ]
+do
+	name=${SYNTH_SETS[$s]}
+	opts=${SYNTH_SETS[$((s + 1))]}
+	s=$((s + 2))
+	echo "Simulating $name"
+	echo "Simulating $name" >&2
+	$BENCH_BIN --simulateonly --prefix $name $opts
+	if [ ! $? -eq 0 ];then
+		exit 1
+	fi
+
+	#the generated config is set up for timing kernels, so turn it into a fixed length search
+	sed -e "s/^stopgen = .*/stopgen = $SYNTH_GENS/" -e "s/^enforcetermconditions = .*/enforcetermconditions = 0/" \
+		-e "s/^nindivs = .*/nindivs = 4/" -e "s/^ofprefix = .*/ofprefix = bench.$name/" \
+		-e "s/^searchreps = 1/searchreps = 1\nthroughputreport = 1/" $name.conf > bench.$name.conf
+
+	echo "Running benchmark $name"
+	echo "Running benchmark $name" >&2
+	$GARLI_BIN bench.$name.conf $GARLI_ARGS
+	if [ ! $? -eq 0 ];then
+		exit 1
+	fi
+done
+
+#gather the per run reports into a single json array
+echo "[" > $RESULTS
+sep=""
+for i in bench.*.throughput.json
+do
+	if [ -n "$sep" ];then
+		echo "$sep" >> $RESULTS
+	fi
+	cat $i >> $RESULTS
+	sep=","
+done
+echo "]" >> $RESULTS
+
+echo "**************************"
+echo "Benchmark results written to $RESULTS"
+echo "**************************"
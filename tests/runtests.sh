@@ -20,7 +20,35 @@ fi
 #set this to move on to the next test after failing one
 #NO_EXIT_ON_ERR=1
 
-rm  -f *.log00.log *.screen.log *.best*.tre *.best*.tre.phy *.boot.tre *.boot.phy *treelog00.tre *treelog00.log *problog00.log *fate00.log .*lock* *swaplog* *.check out.* qout.* mpi_m* *SiteLikes.log *sitelikes.log *best.all.phy *best.phy *current.phy *internalstates.log
+#checks that a test wrote the report $1 and that it is well formed, with $2 
+#being either json or folded (flame graph stacks, each line ending in a count)
+check_report () {
+	if [ ! -s $1 ];then
+		echo "***Report $1 was not written ***"
+		return 1
+	fi
+	if [ "$2" = "json" ];then
+		if command -v python3 > /dev/null;then
+			python3 -m json.tool $1 > /dev/null
+			if [ ! $? -eq 0 ];then
+				echo "***Report $1 is not valid json ***"
+				return 1
+			fi
+		else
+			echo "python3 not found, not validating json in $1"
+		fi
+	elif [ "$2" = "folded" ];then
+		awk 'NF < 2 || $NF !~ /^[0-9]+$/ {bad=1} END{exit bad}' $1
+		if [ ! $? -eq 0 ];then
+			echo "***Report $1 is not in folded stack format ***"
+			return 1
+		fi
+	fi
+	echo "REPORT $1 PASSES"
+	return 0
+}
+
+rm  -f *.log00.log *.screen.log *.best*.tre *.best*.tre.phy *.boot.tre *.boot.phy *treelog00.tre *treelog00.log *problog00.log *fate00.log .*lock* *swaplog* *.check *.check.alt out.* qout.* mpi_m* *SiteLikes.log *sitelikes.log *best.all.phy *best.phy *current.phy *internalstates.log data/*.garli-pack
 
 echo "Linking to data ...."
 if [ -d data ];then
@@ -188,6 +216,24 @@ if [ -d $TESTS_DIR/output ];then
 			exit 1
 		fi
     	fi
+
+	#tests of the optional run reports also check the reports themselves
+	reports=""
+	case $base in
+		n.profile)
+			reports="out.$base.profile.json:json out.$base.profile.folded:folded";;
+		n.throughput)
+			reports="out.$base.throughput.json:json";;
+		n.telemetry)
+			reports="out.$base.telemetry.json:json";;
+	esac
+	for r in $reports
+	do
+		check_report ${r%:*} ${r#*:}
+		if [[ ! $? -eq 0 && ! -n "$NO_EXIT_ON_ERR" ]];then
+			exit 1
+		fi
+	done
 	done
 else
 	echo "No output tests found ..."